@@ -0,0 +1,464 @@
+/**
+ * @file alerts.cpp
+ * @brief Alert detection and the priority alert uplink lane.
+ *
+ * The sample detectors run as an event bus callback on TOPIC_SAMPLE, so the
+ * sensor task does not need to know about them. The gust detector is called
+ * directly by the wind sensor task because single wind readings are not
+ * published. Every alert type has a cooldown, so a persisting condition is
+ * reported once per ALERT_COOLDOWN_MS.
+ *
+ * Server-defined rules are evaluated in the same callback. The active rule
+ * set is guarded by a mutex that the callback only tries to take: while a new
+ * set is being installed, one sample is skipped instead of blocking the
+ * sensor task. Rules are edge-triggered by the rule engine, so they bypass
+ * the cooldown.
+ *
+ * The alert lane task runs above the routine uplink priority on the same core,
+ * so it preempts the publisher and marks the lane busy before any routine
+ * sender can start a new request. It uses short timeouts: an alert is either
+ * acknowledged or dropped within
+ * ALERT_MAX_ATTEMPTS * 2 * ALERT_TIMEOUT_MS + (ALERT_MAX_ATTEMPTS - 1) * ALERT_RETRY_DELAY_MS
+ * of reaching the front of the lane.
+ */
+#include "alerts.h"
+#include "config.h"
+#include "event_bus.h"
+#include "nvs_handler.h"
+#include "discovery.h"
+#include "rule_engine.h"
+#include "station_policies.h"
+#include "supervisor.h"
+#include <WiFi.h>
+#include <atomic>
+#include <math.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// --- Alert Lane Configuration ---
+const uint8_t ALERT_QUEUE_DEPTH = 4;
+const uint32_t ALERT_TIMEOUT_MS = 2000;     // Connect and response timeout per attempt
+const uint8_t ALERT_MAX_ATTEMPTS = 3;
+const uint32_t ALERT_RETRY_DELAY_MS = 250;
+const uint32_t PRESSURE_SLOT_MS = 30UL * 60 * 1000; // Resolution of the pressure history
+const uint8_t PRESSURE_SLOTS = PRESSURE_DROP_WINDOW_MS / PRESSURE_SLOT_MS + 1;
+
+static const char* const ALERT_TYPE_NAMES[ALERT_TYPE_COUNT] = {
+  "rain_start", "wind_gust", "sensor_failure", "pressure_drop", "rule"
+};
+
+// --- Detector State ---
+static uint32_t lastAlertMs[ALERT_TYPE_COUNT];
+static bool alertRaisedOnce[ALERT_TYPE_COUNT];
+static bool raining = false;
+static bool sensorFailed = false;
+
+/** @brief One entry of the pressure history. */
+struct PressureEntry {
+  uint32_t ms;
+  float pressure;
+};
+static PressureEntry pressureHistory[PRESSURE_SLOTS];
+static uint8_t pressureCount = 0;
+static uint8_t pressureNewest = 0;
+
+// --- Rule State ---
+static RuleSet activeRules = {};
+static RuleSet stagingRules;            // Compile target, so a failed compile keeps the active set
+static String activeRulesSource;        // Source of activeRules
+static SemaphoreHandle_t rulesMutex = NULL;
+
+// --- Lane State ---
+static std::atomic<bool> laneSending(false); // Set by the lane task while it handles an alert
+static AlertLaneStats stats = {};
+static uint32_t latencySumMs = 0;
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Detection ---
+
+/**
+ * @brief Publishes an alert on TOPIC_ALERT unless its type is cooling down.
+ * @param type Kind of alert.
+ * @param value Measured value that triggered it.
+ * @param rule Index of the rule for ALERT_RULE.
+ */
+static void raiseAlert(AlertType type, float value, uint8_t rule = 0) {
+    uint32_t now = millis();
+    if (type != ALERT_RULE && alertRaisedOnce[type] && now - lastAlertMs[type] < ALERT_COOLDOWN_MS) {
+        return;
+    }
+    BusMessage* message = eventBusAcquire(TOPIC_ALERT);
+    if (message == NULL) {
+        return; // Pool exhausted; the condition is detected again on the next reading
+    }
+    lastAlertMs[type] = now;
+    alertRaisedOnce[type] = true;
+
+    time_t epoch = time(NULL);
+    message->data.alert.type = type;
+    message->data.alert.value = value;
+    message->data.alert.rule = rule;
+    message->data.alert.epochS = epoch >= (time_t)MIN_VALID_EPOCH ? (uint32_t)epoch : 0;
+    message->data.alert.detectedAtMs = now;
+
+    portENTER_CRITICAL(&statsLock);
+    stats.raised++;
+    portEXIT_CRITICAL(&statsLock);
+    Serial.printf("Alert: %s %u (%.2f)\n", ALERT_TYPE_NAMES[type], (unsigned)rule, value);
+    eventBusPublish(message);
+}
+
+/**
+ * @brief Records the pressure once per PRESSURE_SLOT_MS and checks the tendency over the window.
+ * @param pressure MSL pressure of the sample [hPa].
+ * @param now millis() of the sample.
+ */
+static void checkPressureDrop(float pressure, uint32_t now) {
+    if (pressureCount > 0 && now - pressureHistory[pressureNewest].ms < PRESSURE_SLOT_MS) {
+        return;
+    }
+    pressureNewest = pressureCount > 0 ? (pressureNewest + 1) % PRESSURE_SLOTS : 0;
+    pressureHistory[pressureNewest].ms = now;
+    pressureHistory[pressureNewest].pressure = pressure;
+    if (pressureCount < PRESSURE_SLOTS) {
+        pressureCount++;
+        return; // Not enough history yet
+    }
+
+    const PressureEntry& oldest = pressureHistory[(pressureNewest + 1) % PRESSURE_SLOTS];
+    float change = pressure - oldest.pressure;
+    if (change <= -PRESSURE_DROP_HPA) {
+        raiseAlert(ALERT_PRESSURE_DROP, change);
+    }
+}
+
+/**
+ * @brief Returns the pressure tendency from the history, scaled to PRESSURE_DROP_WINDOW_MS.
+ * @param pressure Current MSL pressure [hPa].
+ * @param now millis() of the current sample.
+ * @return Tendency [hPa per window], NAN until the history spans one slot.
+ */
+static float pressureTendency(float pressure, uint32_t now) {
+    if (pressureCount == 0 || isnan(pressure)) {
+        return NAN;
+    }
+    const PressureEntry& oldest = pressureHistory[pressureCount < PRESSURE_SLOTS ? 0 : (pressureNewest + 1) % PRESSURE_SLOTS];
+    uint32_t spanMs = now - oldest.ms;
+    if (spanMs < PRESSURE_SLOT_MS) {
+        return NAN;
+    }
+    return (pressure - oldest.pressure) * ((float)PRESSURE_DROP_WINDOW_MS / spanMs);
+}
+
+/** @brief Rules that fired during one evaluation. */
+struct FiredRules {
+  uint8_t count;
+  uint8_t rule[RULE_MAX_RULES];
+  float value[RULE_MAX_RULES];
+};
+
+/**
+ * @brief Rule engine callback collecting a fired rule (context: FiredRules*).
+ */
+static void onRuleFired(uint8_t rule, float value, void* context) {
+    FiredRules* fired = static_cast<FiredRules*>(context);
+    fired->rule[fired->count] = rule;
+    fired->value[fired->count] = value;
+    fired->count++;
+}
+
+/**
+ * @brief Evaluates the server-defined rules against a sample.
+ * Skips the sample if the rule set is being replaced.
+ * @param sample The published sample.
+ */
+static void evaluateRules(const WeatherSample& sample) {
+    if (rulesMutex == NULL || xSemaphoreTake(rulesMutex, 0) != pdTRUE) {
+        return;
+    }
+    if (activeRules.ruleCount == 0) {
+        xSemaphoreGive(rulesMutex);
+        return;
+    }
+    float inputs[RULE_INPUT_COUNT];
+    inputs[RULE_INPUT_TEMPERATURE] = fieldValue(sample.temperature, TEMPERATURE_SCALE);
+    inputs[RULE_INPUT_PRESSURE] = fieldValue(sample.pressure, PRESSURE_SCALE);
+    inputs[RULE_INPUT_HUMIDITY] = fieldValue(sample.humidity, HUMIDITY_SCALE);
+    inputs[RULE_INPUT_SUNSHINE] = fieldValue(sample.sunshine, 1);
+    inputs[RULE_INPUT_WIND_SPEED] = fieldValue(sample.windSpeed, WIND_SCALE);
+    inputs[RULE_INPUT_WIND_GUST] = fieldValue(sample.windGust, WIND_SCALE);
+    inputs[RULE_INPUT_PRECIPITATION] = fieldValue(sample.precipitation, 1);
+    inputs[RULE_INPUT_PRESSURE_TENDENCY] = pressureTendency(inputs[RULE_INPUT_PRESSURE], sample.timestampMs);
+
+    // Alerts are published after the evaluation, so the measurement covers the rules only
+    FiredRules fired = {};
+    uint32_t startCycles = ESP.getCycleCount();
+    ruleSetEvaluate(activeRules, inputs, sample.timestampMs, onRuleFired, &fired);
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    xSemaphoreGive(rulesMutex);
+
+    portENTER_CRITICAL(&statsLock);
+    stats.rulesFired += fired.count;
+    stats.ruleEvalCyclesLast = cycles;
+    if (cycles > stats.ruleEvalCyclesMax) {
+        stats.ruleEvalCyclesMax = cycles;
+    }
+    portEXIT_CRITICAL(&statsLock);
+    for (uint8_t i = 0; i < fired.count; i++) {
+        raiseAlert(ALERT_RULE, fired.value[i], fired.rule[i]);
+    }
+}
+
+/**
+ * @brief Event bus callback checking every published sample for alert conditions.
+ * Runs in the sensor task; only publishes, never blocks.
+ */
+static void onSample(const BusMessage* message, void* context) {
+    const WeatherSample& sample = message->data.sample;
+
+    if (!raining && sample.precipitation >= RAIN_START_THRESHOLD) {
+        raining = true;
+        raiseAlert(ALERT_RAIN_START, (float)sample.precipitation);
+    } else if (raining && sample.precipitation != SAMPLE_MISSING && sample.precipitation < RAIN_STOP_THRESHOLD) {
+        raining = false;
+    }
+
+    if (features::kBme280) {
+        bool failed = sample.temperature == SAMPLE_MISSING;
+        if (failed && !sensorFailed) {
+            raiseAlert(ALERT_SENSOR_FAILURE, 0.0f);
+        }
+        sensorFailed = failed;
+    }
+
+    if (sample.pressure != SAMPLE_MISSING) {
+        checkPressureDrop(fieldValue(sample.pressure, PRESSURE_SCALE), sample.timestampMs);
+    }
+
+    evaluateRules(sample);
+}
+
+/**
+ * @brief Checks a single wind reading for a gust.
+ * @param windSpeedMs Wind speed of the reading [m/s].
+ */
+void checkGustAlert(float windSpeedMs) {
+    if (windSpeedMs >= GUST_THRESHOLD_MS) {
+        raiseAlert(ALERT_WIND_GUST, windSpeedMs);
+    }
+}
+
+// --- Public API ---
+
+/**
+ * @brief Returns the name of an alert type as used in the alert payload.
+ * @param type The alert type.
+ * @return Printable name.
+ */
+const char* alertTypeName(AlertType type) {
+    return type < ALERT_TYPE_COUNT ? ALERT_TYPE_NAMES[type] : "unknown";
+}
+
+/**
+ * @brief Loads the stored rules, registers the sample detectors on the event
+ * bus and starts the alert lane task.
+ * @return true if the detectors and the task were set up, false otherwise.
+ */
+bool startAlertLane() {
+    rulesMutex = xSemaphoreCreateMutex();
+    if (rulesMutex == NULL) {
+        return false;
+    }
+    String storedRules;
+    if (loadAlertRulesFromNVS(storedRules) && storedRules.length() > 0) {
+        applyAlertRules(storedRules.c_str(), false);
+    }
+
+    EventSubscriber* subscriber = eventBusSubscribe(TOPIC_BIT(TOPIC_ALERT), ALERT_QUEUE_DEPTH);
+    if (subscriber == NULL || !eventBusSubscribeCallback(TOPIC_BIT(TOPIC_SAMPLE), onSample, NULL)) {
+        return false;
+    }
+    // Above the routine uplink (1) and the sensor tasks, so an alert is sent as soon as it is raised
+    return xTaskCreatePinnedToCore(
+        alertLaneTask, "AlertLaneTask", 6144 + (features::kHttpsTransport ? HTTPS_HANDSHAKE_STACK : 0), subscriber, 3, NULL, APP_CPU_NUM) == pdPASS;
+}
+
+/**
+ * @brief Compiles a rule source and makes it the active rule set.
+ * On a compile error the active rules are kept; an unchanged source is ignored.
+ * @param source Rules separated by ';' or newlines; empty to remove all rules.
+ * @param persist true to store the source in NVS.
+ * @return true if the source compiled and was applied, false otherwise.
+ */
+bool applyAlertRules(const char* source, bool persist) {
+    if (strlen(source) > ALERT_RULES_MAX_LENGTH) {
+        Serial.println("Alert rules rejected: source too long.");
+        return false;
+    }
+    if (rulesMutex == NULL || xSemaphoreTake(rulesMutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+    if (activeRulesSource == source) {
+        xSemaphoreGive(rulesMutex); // Unchanged; keep the hold timers of the running rules
+        return true;
+    }
+    const char* error = NULL;
+    uint8_t errorRule = 0;
+    bool ok = ruleSetCompile(source, stagingRules, &error, &errorRule);
+    if (ok) {
+        activeRules = stagingRules;
+        activeRulesSource = source;
+    }
+    uint8_t ruleCount = activeRules.ruleCount;
+    xSemaphoreGive(rulesMutex);
+
+    if (!ok) {
+        Serial.printf("Alert rules rejected: rule %u: %s\n", (unsigned)errorRule, error);
+        return false;
+    }
+    portENTER_CRITICAL(&statsLock);
+    stats.rules = ruleCount;
+    portEXIT_CRITICAL(&statsLock);
+    Serial.printf("Alert rules applied: %u rules, %u bytes of code.\n", (unsigned)ruleCount, (unsigned)stagingRules.codeBytes);
+    if (persist) {
+        saveAlertRulesToNVS(String(source));
+    }
+    return true;
+}
+
+/**
+ * @brief Extracts the rule source from a server response.
+ * Handles the \\n escape; any other escaped character is copied as-is.
+ * @param response Body of the server response.
+ * @param source Receives the unescaped source.
+ * @return true if the response contains a rule source, false otherwise.
+ */
+bool parseRulesDirective(const String& response, String& source) {
+    const char* rules = strstr(response.c_str(), "\"rules\"");
+    if (rules == NULL) {
+        return false;
+    }
+    const char* cursor = strchr(rules + 7, ':');
+    if (cursor == NULL) {
+        return false;
+    }
+    cursor++;
+    while (*cursor == ' ') {
+        cursor++;
+    }
+    if (*cursor != '"') {
+        return false;
+    }
+    source = "";
+    for (cursor++; *cursor != '\0' && *cursor != '"'; cursor++) {
+        if (*cursor == '\\' && cursor[1] != '\0') {
+            cursor++;
+            source += *cursor == 'n' ? '\n' : *cursor;
+        } else {
+            source += *cursor;
+        }
+    }
+    return *cursor == '"';
+}
+
+/**
+ * @brief Tells whether an alert is being sent.
+ * @return true while the alert lane is sending.
+ */
+bool alertLaneBusy() {
+    return laneSending.load();
+}
+
+/**
+ * @brief Returns a snapshot of the alert lane counters.
+ * @return Copy of the current statistics.
+ */
+AlertLaneStats alertLaneGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    AlertLaneStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    return snapshot;
+}
+
+// --- FreeRTOS Task: Alert Lane ---
+
+/**
+ * @brief Sends one alert, retrying quickly with short timeouts.
+ * @param alert The alert to send.
+ * @return true if the server acknowledged the alert.
+ */
+static bool sendAlert(const AlertEvent& alert) {
+    char value[16];
+    if (isnan(alert.value)) {
+        strcpy(value, "null"); // A rule can fire on an "or" branch whose first input is unavailable
+    } else {
+        snprintf(value, sizeof(value), "%.2f", alert.value);
+    }
+    char body[128];
+    if (alert.type == ALERT_RULE) {
+        snprintf(body, sizeof(body), "{\"type\":\"%s\",\"rule\":%u,\"value\":%s,\"timestamp\":%lu}",
+                 ALERT_TYPE_NAMES[alert.type], (unsigned)alert.rule, value, (unsigned long)alert.epochS);
+    } else {
+        snprintf(body, sizeof(body), "{\"type\":\"%s\",\"value\":%s,\"timestamp\":%lu}",
+                 ALERT_TYPE_NAMES[alert.type], value, (unsigned long)alert.epochS);
+    }
+
+    String endpoint = "http://" + activeServerAddress() + apiAlertPath;
+    endpoint.replace("<mac_plytki>", WiFi.macAddress());
+
+    for (uint8_t attempt = 1; attempt <= ALERT_MAX_ATTEMPTS; attempt++) {
+        if (getSupervisorState() == STATE_ONLINE) {
+            String response;
+            int code = ActiveStation::Transport::post(endpoint, "application/json", String(body), response, ALERT_TIMEOUT_MS);
+            if (code >= 200 && code < 300) {
+                return true;
+            }
+            Serial.printf("Alert Lane: Attempt %u failed (%d).\n", (unsigned)attempt, code);
+        }
+        if (attempt < ALERT_MAX_ATTEMPTS) {
+            vTaskDelay(pdMS_TO_TICKS(ALERT_RETRY_DELAY_MS));
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief FreeRTOS task sending published alerts, one POST per alert, and
+ * recording the detection-to-acknowledgement latency.
+ * @param pvParameters Event bus subscriber handle (EventSubscriber*).
+ */
+void alertLaneTask(void *pvParameters) {
+    EventSubscriber* subscriber = static_cast<EventSubscriber*>(pvParameters);
+    Serial.println("Alert Lane Task started.");
+
+    for (;;) {
+        const BusMessage* message = eventBusReceive(subscriber, portMAX_DELAY);
+        if (message == NULL) {
+            continue;
+        }
+        laneSending.store(true);
+        AlertEvent alert = message->data.alert;
+        eventBusRelease(message);
+
+        bool ok = sendAlert(alert);
+        uint32_t latencyMs = millis() - alert.detectedAtMs;
+        portENTER_CRITICAL(&statsLock);
+        if (ok) {
+            stats.sent++;
+            latencySumMs += latencyMs;
+            stats.latencyMsAvg = latencySumMs / stats.sent;
+            if (latencyMs > stats.latencyMsMax) {
+                stats.latencyMsMax = latencyMs;
+            }
+        } else {
+            stats.failed++;
+        }
+        portEXIT_CRITICAL(&statsLock);
+        if (!ok) {
+            Serial.printf("Alert Lane: %s dropped after %u attempts.\n", ALERT_TYPE_NAMES[alert.type], (unsigned)ALERT_MAX_ATTEMPTS);
+        }
+        laneSending.store(false);
+    }
+}
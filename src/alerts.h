@@ -0,0 +1,110 @@
+/**
+ * @file alerts.h
+ * @brief Declarations for alert detection and the priority alert uplink lane.
+ *
+ * Alerts are detected from the published samples (rain start, sensor failure,
+ * pressure drop) and from individual wind readings (gusts). They are published
+ * on TOPIC_ALERT and sent by a dedicated, higher-priority task, one POST per
+ * alert, without waiting for the routine report cadence. While an alert is
+ * being sent, the routine lane and the backfill hold back their own requests.
+ *
+ * In addition to the built-in detectors, the server can define threshold
+ * rules (see rule_engine.h). They are compiled when they are received, stored
+ * in NVS and evaluated against every published sample; a firing rule is sent
+ * as an ALERT_RULE alert.
+ */
+#ifndef ALERTS_H
+#define ALERTS_H
+
+#include "config.h"
+
+/** @brief Kinds of alerts. */
+enum AlertType {
+  ALERT_RAIN_START = 0,  ///< Precipitation rose above RAIN_START_THRESHOLD (value = precipitation [%]).
+  ALERT_WIND_GUST,       ///< A wind reading reached GUST_THRESHOLD_MS (value = wind speed [m/s]).
+  ALERT_SENSOR_FAILURE,  ///< The BME280 stopped delivering readings (value unused).
+  ALERT_PRESSURE_DROP,   ///< MSL pressure fell by PRESSURE_DROP_HPA or more within the window (value = change [hPa]).
+  ALERT_RULE,            ///< A server-defined rule fired (value = the rule's first input).
+  ALERT_TYPE_COUNT
+};
+
+/** @brief Payload of TOPIC_ALERT. */
+struct AlertEvent {
+  AlertType type;        ///< Kind of alert.
+  float value;           ///< Measured value that triggered the alert.
+  uint8_t rule;          ///< Index of the rule for ALERT_RULE, 0 otherwise.
+  uint32_t epochS;       ///< Unix time of detection, 0 if the clock is not synchronized.
+  uint32_t detectedAtMs; ///< millis() at detection, used to measure end-to-end latency.
+};
+
+/** @brief Counters of the alert lane. */
+struct AlertLaneStats {
+  uint32_t raised;       ///< Alerts detected and published.
+  uint32_t sent;         ///< Alerts acknowledged by the server.
+  uint32_t failed;       ///< Alerts dropped after all attempts.
+  uint32_t latencyMsAvg; ///< Average detection-to-acknowledgement latency [ms].
+  uint32_t latencyMsMax; ///< Maximum detection-to-acknowledgement latency [ms].
+  uint8_t rules;         ///< Number of active server-defined rules.
+  uint32_t rulesFired;   ///< Rule firings detected.
+  uint32_t ruleEvalCyclesLast; ///< CPU cycles of the last evaluation of all rules.
+  uint32_t ruleEvalCyclesMax;  ///< Maximum CPU cycles of an evaluation of all rules.
+};
+
+/**
+ * @brief Returns the name of an alert type as used in the alert payload.
+ * @param type The alert type.
+ * @return Printable name, e.g. "rain_start".
+ */
+const char* alertTypeName(AlertType type);
+
+/**
+ * @brief Registers the sample detectors on the event bus and starts the alert lane task.
+ * @note Must be called after initEventBus() and before the sensor tasks start.
+ * @return true if the detectors and the task were set up, false otherwise.
+ */
+bool startAlertLane();
+
+/**
+ * @brief Checks a single wind reading for a gust. Called by the wind sensor task.
+ * @param windSpeedMs Wind speed of the reading [m/s].
+ */
+void checkGustAlert(float windSpeedMs);
+
+/**
+ * @brief Compiles a rule source and makes it the active rule set.
+ * On a compile error the active rules are kept; an unchanged source is ignored.
+ * @param source Rules separated by ';' or newlines; empty to remove all rules.
+ * @param persist true to store the source in NVS.
+ * @return true if the source compiled and was applied, false otherwise.
+ */
+bool applyAlertRules(const char* source, bool persist);
+
+/**
+ * @brief Extracts the rule source from a server response.
+ * Looks for a "rules" string member, e.g. {"rules":"wind_gust > 15 for 30 s; pressure_tendency < -3"}.
+ * @param response Body of the server response.
+ * @param source Receives the unescaped source.
+ * @return true if the response contains a rule source, false otherwise.
+ */
+bool parseRulesDirective(const String& response, String& source);
+
+/**
+ * @brief Tells whether an alert is being sent.
+ * Routine uploads and backfill wait while this returns true.
+ * @return true while the alert lane is sending.
+ */
+bool alertLaneBusy();
+
+/**
+ * @brief Returns a snapshot of the alert lane counters.
+ * @return Copy of the current statistics.
+ */
+AlertLaneStats alertLaneGetStats();
+
+/**
+ * @brief FreeRTOS task function sending published alerts to the alert endpoint.
+ * @param pvParameters Event bus subscriber handle (EventSubscriber*).
+ */
+void alertLaneTask(void *pvParameters);
+
+#endif // ALERTS_H
@@ -0,0 +1,579 @@
+/**
+ * @file alloc_trace.cpp
+ * @brief Heap allocation tracer on link-time wrapped malloc/free/realloc/calloc.
+ *
+ * __wrap_malloc() calls the real allocator first and then records the block;
+ * __wrap_free() removes the record first and then frees, so an address is
+ * never reused before its record is gone. Live blocks are kept in an open
+ * addressing table keyed by address (linear probing, backward-shift
+ * deletion). All tables are guarded by one lock, which is never held while
+ * the real allocator, the backtrace or a report writer runs.
+ *
+ * realloc() is recorded as a free of the old block and an allocation of the
+ * new one, which is what it means for fragmentation, but only once the real
+ * realloc() has succeeded: a failed one leaves the old block and its record
+ * alone. Another task may get the old address back before its free is
+ * recorded; the allocation then closes the old record, and the late free
+ * recognises the block by its ring index and leaves the new record alone.
+ * A thread-local flag
+ * keeps allocations made by the tracer's own platform calls (e.g. the first
+ * glibc backtrace()) out of the trace. On the ESP32 the thread-local storage
+ * of a task exists only once the scheduler runs, so allocations made by
+ * global constructors before that are not traced.
+ */
+#include "alloc_trace.h"
+
+#if WS_FEATURE_ALLOC_TRACE
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <esp_debug_helpers.h>
+#else
+#include <atomic>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+#endif
+
+extern "C" {
+void* __real_malloc(size_t size);
+void __real_free(void* pointer);
+void* __real_realloc(void* pointer, size_t size);
+void* __real_calloc(size_t count, size_t size);
+}
+
+/** @brief A block that has not been freed yet. */
+struct LiveBlock {
+  uintptr_t address;    ///< 0 = empty slot
+  uint32_t size;
+  uint32_t timeMs;
+  uint32_t ringIndex;   ///< Position of its record in the ring (total count at allocation)
+  uint8_t site;
+};
+
+static LiveBlock liveBlocks[ALLOC_TRACE_LIVE];
+static uint16_t liveCount = 0;
+static AllocSiteStats sites[ALLOC_TRACE_SITES];
+static uint8_t siteCount = 0;
+static AllocRecord ring[ALLOC_TRACE_RING];
+static uint32_t ringTotal = 0;
+
+/** @brief Free heap and largest free block at the end of a minute. */
+struct HeapSample {
+  uint32_t freeBytes;
+  uint32_t largestFreeBlock;
+};
+static HeapSample heapTrend[ALLOC_TRACE_HEAP_MINUTES];
+static uint32_t heapSamples = 0;
+static uint32_t currentMinute = 0;
+
+static bool started = false;
+static uint32_t startMs = 0;
+static uint32_t totalAllocations = 0;
+static uint32_t totalFrees = 0;
+static uint32_t totalBytes = 0;
+static uint32_t untracked = 0;
+
+static const uint32_t NOT_TRACKED = 0xffffffffu; // Ring index of a block missing from the live table
+
+static __thread const char* currentScope = NULL;
+static __thread bool insideTracer = false;
+
+// --- Platform ---
+
+#if defined(ESP_PLATFORM)
+static portMUX_TYPE traceLock = portMUX_INITIALIZER_UNLOCKED;
+static void lock() { portENTER_CRITICAL_SAFE(&traceLock); }
+static void unlock() { portEXIT_CRITICAL_SAFE(&traceLock); }
+static bool platformReady() { return xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED; }
+
+static uint32_t nowMs() {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static HeapSample sampleHeap() {
+    HeapSample sample;
+    sample.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    sample.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    return sample;
+}
+
+/**
+ * @brief Fills callers with the return addresses above the wrapper, innermost first.
+ * The addresses are converted from windowed return addresses to the address
+ * of the call instruction, as addr2line expects.
+ */
+static void __attribute__((noinline)) captureCallers(uintptr_t* callers) {
+    esp_backtrace_frame_t frame;
+    esp_backtrace_get_start(&frame.pc, &frame.sp, &frame.next_pc);
+    bool valid = frame.next_pc != 0 && esp_backtrace_get_next_frame(&frame); // Skip the wrapper
+    for (uint8_t i = 0; i < ALLOC_TRACE_DEPTH; i++) {
+        valid = valid && frame.next_pc != 0 && esp_backtrace_get_next_frame(&frame);
+        uint32_t pc = frame.pc;
+        if (pc & 0x80000000) {
+            pc = (pc & 0x3fffffff) | 0x40000000;
+        }
+        callers[i] = valid ? pc - 3 : 0;
+    }
+}
+#else
+static std::atomic_flag traceLock = ATOMIC_FLAG_INIT;
+static void lock() { while (traceLock.test_and_set(std::memory_order_acquire)) { } }
+static void unlock() { traceLock.clear(std::memory_order_release); }
+static bool platformReady() { return true; }
+
+static uint32_t nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+static HeapSample sampleHeap() {
+    HeapSample sample = {0, 0}; // No portable way to find the largest free block
+    return sample;
+}
+
+/** @brief Fills callers with the return addresses above the wrapper, innermost first. */
+static void __attribute__((noinline)) captureCallers(uintptr_t* callers) {
+    memset(callers, 0, sizeof(uintptr_t) * ALLOC_TRACE_DEPTH);
+#if defined(__GLIBC__)
+    void* frames[ALLOC_TRACE_DEPTH + 2];
+    int count = backtrace(frames, ALLOC_TRACE_DEPTH + 2);
+    for (int i = 2; i < count; i++) { // Skip captureCallers and the wrapper
+        callers[i - 2] = (uintptr_t)frames[i] - 1;
+    }
+#else
+    callers[0] = (uintptr_t)__builtin_return_address(1);
+#endif
+}
+#endif
+
+// --- Tables (called with the lock held) ---
+
+static uint32_t homeSlot(uintptr_t address) {
+    return (uint32_t)((address >> 3) * 2654435761u) & (ALLOC_TRACE_LIVE - 1);
+}
+
+static int findLive(uintptr_t address) {
+    uint32_t slot = homeSlot(address);
+    for (uint16_t probe = 0; probe < ALLOC_TRACE_LIVE; probe++) {
+        if (liveBlocks[slot].address == address) {
+            return (int)slot;
+        }
+        if (liveBlocks[slot].address == 0) {
+            return -1;
+        }
+        slot = (slot + 1) & (ALLOC_TRACE_LIVE - 1);
+    }
+    return -1;
+}
+
+static void eraseLive(uint32_t hole) {
+    uint32_t next = (hole + 1) & (ALLOC_TRACE_LIVE - 1);
+    while (liveBlocks[next].address != 0) {
+        uint32_t home = homeSlot(liveBlocks[next].address);
+        // Move the entry back if the hole lies between its home slot and its slot
+        if (((next - home) & (ALLOC_TRACE_LIVE - 1)) >= ((next - hole) & (ALLOC_TRACE_LIVE - 1))) {
+            liveBlocks[hole] = liveBlocks[next];
+            hole = next;
+        }
+        next = (next + 1) & (ALLOC_TRACE_LIVE - 1);
+    }
+    liveBlocks[hole].address = 0;
+    liveCount--;
+}
+
+static uint8_t findSite(const char* scope, const uintptr_t* callers) {
+    for (uint8_t i = 0; i < siteCount; i++) {
+        if (sites[i].scope == scope && memcmp(sites[i].callers, callers, sizeof(sites[i].callers)) == 0) {
+            return i;
+        }
+    }
+    if (siteCount < ALLOC_TRACE_SITES) {
+        AllocSiteStats& site = sites[siteCount];
+        memset(&site, 0, sizeof(site));
+        site.scope = scope;
+        memcpy(site.callers, callers, sizeof(site.callers));
+        return siteCount++;
+    }
+    return ALLOC_TRACE_SITES - 1; // Further sites share the last entry
+}
+
+/**
+ * @brief Closes the current minute if time has moved past it.
+ * @return true if a heap sample is due.
+ */
+static bool advanceMinute(uint32_t timeMs) {
+    uint32_t minute = timeMs / 60000;
+    if (minute == currentMinute) {
+        return false;
+    }
+    bool consecutive = minute == currentMinute + 1;
+    for (uint8_t i = 0; i < siteCount; i++) {
+        sites[i].lastMinuteBytes = consecutive ? sites[i].currentMinuteBytes : 0;
+        sites[i].currentMinuteBytes = 0;
+    }
+    currentMinute = minute;
+    return true;
+}
+
+static void storeHeapSample(const HeapSample& sample) {
+    lock();
+    heapTrend[heapSamples % ALLOC_TRACE_HEAP_MINUTES] = sample;
+    heapSamples++;
+    unlock();
+}
+
+/**
+ * @brief Counts a freed live block for its site, completes its ring record and removes it.
+ */
+static void closeLive(uint32_t slot, uint32_t timeMs) {
+    LiveBlock& block = liveBlocks[slot];
+    uint32_t lifetimeMs = timeMs - block.timeMs;
+    AllocSiteStats& site = sites[block.site];
+    site.liveBlocks--;
+    site.liveBytes -= block.size;
+    if (lifetimeMs < ALLOC_TRACE_TRANSIENT_MS) {
+        site.transientFrees++;
+    } else {
+        site.longLivedFrees++;
+    }
+    if (ringTotal - block.ringIndex < ALLOC_TRACE_RING) {
+        ring[block.ringIndex % ALLOC_TRACE_RING].lifetimeMs = lifetimeMs;
+    }
+    eraseLive(slot);
+}
+
+// --- Recording ---
+
+static void recordAllocation(void* pointer, size_t size, const uintptr_t* callers) {
+    uint32_t now = nowMs();
+    lock();
+    if (!started) {
+        startMs = now;
+        started = true;
+    }
+    uint32_t timeMs = now - startMs;
+    bool heapSampleDue = advanceMinute(timeMs);
+    uint8_t index = findSite(currentScope, callers);
+    AllocSiteStats& site = sites[index];
+    site.allocations++;
+    site.bytes += size;
+    site.currentMinuteBytes += size;
+    totalAllocations++;
+    totalBytes += size;
+
+    AllocRecord& record = ring[ringTotal % ALLOC_TRACE_RING];
+    record.address = (uintptr_t)pointer;
+    record.size = (uint32_t)size;
+    record.timeMs = timeMs;
+    record.lifetimeMs = ALLOC_TRACE_STILL_LIVE;
+    record.site = index;
+
+    int stale = findLive((uintptr_t)pointer);
+    if (stale >= 0) { // Released by a realloc() in another task that has not recorded the free yet
+        totalFrees++;
+        closeLive((uint32_t)stale, timeMs);
+    }
+    if (liveCount < ALLOC_TRACE_LIVE / 4 * 3) {
+        uint32_t slot = homeSlot((uintptr_t)pointer);
+        while (liveBlocks[slot].address != 0) {
+            slot = (slot + 1) & (ALLOC_TRACE_LIVE - 1);
+        }
+        LiveBlock& block = liveBlocks[slot];
+        block.address = (uintptr_t)pointer;
+        block.size = (uint32_t)size;
+        block.timeMs = timeMs;
+        block.ringIndex = ringTotal;
+        block.site = index;
+        liveCount++;
+        site.liveBlocks++;
+        site.liveBytes += size;
+    } else {
+        untracked++;
+    }
+    ringTotal++;
+    unlock();
+
+    if (heapSampleDue) {
+        storeHeapSample(sampleHeap());
+    }
+}
+
+static void recordFree(void* pointer) {
+    uint32_t now = nowMs();
+    lock();
+    uint32_t timeMs = now - startMs;
+    totalFrees++;
+    int slot = findLive((uintptr_t)pointer);
+    if (slot < 0) {
+        untracked++;
+    } else {
+        closeLive((uint32_t)slot, timeMs);
+    }
+    unlock();
+}
+
+/**
+ * @brief Returns the ring index of a live block, NOT_TRACKED if the block is not in the live table.
+ */
+static uint32_t liveRecord(void* pointer) {
+    lock();
+    int slot = findLive((uintptr_t)pointer);
+    uint32_t ringIndex = slot >= 0 ? liveBlocks[slot].ringIndex : NOT_TRACKED;
+    unlock();
+    return ringIndex;
+}
+
+/**
+ * @brief Records the free of a block released by a successful realloc().
+ * @param pointer The old block.
+ * @param ringIndex Its liveRecord() before the real realloc() ran.
+ */
+static void recordReallocFree(void* pointer, uint32_t ringIndex) {
+    uint32_t now = nowMs();
+    lock();
+    uint32_t timeMs = now - startMs;
+    int slot = findLive((uintptr_t)pointer);
+    if (ringIndex == NOT_TRACKED) {
+        totalFrees++;
+        untracked++;
+    } else if (slot >= 0 && liveBlocks[slot].ringIndex == ringIndex) {
+        totalFrees++;
+        closeLive((uint32_t)slot, timeMs);
+    }
+    // Otherwise the address was reused meanwhile and recordAllocation() closed the record
+    unlock();
+}
+
+// --- Wrappers ---
+
+/**
+ * @brief Tells whether the calling allocation is to be traced and, if so, marks the task as inside the tracer.
+ */
+static bool enterTracer() {
+    if (!platformReady() || insideTracer) {
+        return false;
+    }
+    insideTracer = true;
+    return true;
+}
+
+extern "C" {
+
+void* __wrap_malloc(size_t size) {
+    void* pointer = __real_malloc(size);
+    if (pointer != NULL && enterTracer()) {
+        uintptr_t callers[ALLOC_TRACE_DEPTH];
+        captureCallers(callers);
+        recordAllocation(pointer, size, callers);
+        insideTracer = false;
+    }
+    return pointer;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    void* pointer = __real_calloc(count, size);
+    if (pointer != NULL && enterTracer()) {
+        uintptr_t callers[ALLOC_TRACE_DEPTH];
+        captureCallers(callers);
+        recordAllocation(pointer, count * size, callers);
+        insideTracer = false;
+    }
+    return pointer;
+}
+
+void __wrap_free(void* pointer) {
+    if (pointer != NULL && enterTracer()) {
+        recordFree(pointer);
+        insideTracer = false;
+    }
+    __real_free(pointer);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    if (!enterTracer()) {
+        return __real_realloc(pointer, size);
+    }
+    uint32_t ringIndex = pointer != NULL ? liveRecord(pointer) : NOT_TRACKED;
+    void* resized = __real_realloc(pointer, size);
+    if (pointer != NULL && (resized != NULL || size == 0)) { // realloc(p, 0) frees p
+        recordReallocFree(pointer, ringIndex);
+    }
+    if (resized != NULL) {
+        uintptr_t callers[ALLOC_TRACE_DEPTH];
+        captureCallers(callers);
+        recordAllocation(resized, size, callers);
+    }
+    insideTracer = false;
+    return resized;
+}
+
+} // extern "C"
+
+// --- Scopes ---
+
+AllocTraceScope::AllocTraceScope(const char* name) : previous(currentScope) {
+    currentScope = name;
+}
+
+AllocTraceScope::~AllocTraceScope() {
+    currentScope = previous;
+}
+
+// --- Reports ---
+
+/**
+ * @brief Formats the call site part of a report line: scope and return addresses.
+ */
+static void formatSite(const AllocSiteStats& site, char* buffer, size_t size) {
+    int length = snprintf(buffer, size, "scope=%s callers=", site.scope != NULL ? site.scope : "-");
+    for (uint8_t i = 0; i < ALLOC_TRACE_DEPTH && site.callers[i] != 0 && length > 0 && (size_t)length < size; i++) {
+        length += snprintf(buffer + length, size - length, "%s0x%08lx", i > 0 ? "," : "", (unsigned long)site.callers[i]);
+    }
+}
+
+/**
+ * @brief Writes the summary: totals, the ALLOC_TRACE_REPORT_SITES sites with
+ * the most bytes per minute, their transient, long-lived and live blocks, and
+ * the per-minute largest-free-block trend.
+ * @param writeLine Receives the report line by line.
+ */
+void allocTraceReport(AllocTraceWriter writeLine) {
+    char line[288];
+    char siteText[112];
+    uint32_t averageBytes[ALLOC_TRACE_SITES];
+    uint8_t order[ALLOC_TRACE_SITES];
+
+    uint32_t now = nowMs();
+    lock();
+    uint32_t elapsedMs = started ? now - startMs : 0;
+    unlock();
+    uint32_t minutesTimes10 = elapsedMs / 6000 > 0 ? elapsedMs / 6000 : 1; // Average per minute with 0.1 min resolution
+    lock();
+    uint8_t count = siteCount;
+    for (uint8_t i = 0; i < count; i++) {
+        averageBytes[i] = (uint32_t)((uint64_t)sites[i].bytes * 10 / minutesTimes10);
+    }
+    snprintf(line, sizeof(line), "Alloc trace: %lu s, allocations=%lu (%lu B), frees=%lu, live=%u, untracked=%lu, sites=%u",
+             (unsigned long)(elapsedMs / 1000), (unsigned long)totalAllocations, (unsigned long)totalBytes,
+             (unsigned long)totalFrees, (unsigned)liveCount, (unsigned long)untracked, (unsigned)count);
+    unlock();
+    writeLine(line);
+
+    for (uint8_t i = 0; i < count; i++) { // Sort by average bytes per minute, highest first
+        uint8_t position = i;
+        while (position > 0 && averageBytes[order[position - 1]] < averageBytes[i]) {
+            order[position] = order[position - 1];
+            position--;
+        }
+        order[position] = i;
+    }
+
+    for (uint8_t i = 0; i < count && i < ALLOC_TRACE_REPORT_SITES; i++) {
+        lock();
+        AllocSiteStats site = sites[order[i]];
+        unlock();
+        formatSite(site, siteText, sizeof(siteText));
+        snprintf(line, sizeof(line), "Alloc site %u: %lu B/min (last min %lu), allocs=%lu, freed transient/long-lived=%lu/%lu, live=%lu (%lu B), %s",
+                 (unsigned)order[i], (unsigned long)averageBytes[order[i]], (unsigned long)site.lastMinuteBytes,
+                 (unsigned long)site.allocations, (unsigned long)site.transientFrees, (unsigned long)site.longLivedFrees,
+                 (unsigned long)site.liveBlocks, (unsigned long)site.liveBytes, siteText);
+        writeLine(line);
+    }
+
+    lock();
+    uint32_t samples = heapSamples;
+    unlock();
+    uint32_t first = samples > ALLOC_TRACE_HEAP_MINUTES ? samples - ALLOC_TRACE_HEAP_MINUTES : 0;
+    int length = snprintf(line, sizeof(line), "Alloc heap trend (free/largest block per minute, oldest first):");
+    for (uint32_t i = first; i < samples; i++) {
+        lock();
+        HeapSample sample = heapTrend[i % ALLOC_TRACE_HEAP_MINUTES];
+        unlock();
+        if ((size_t)length > sizeof(line) - 24) {
+            writeLine(line);
+            length = snprintf(line, sizeof(line), "Alloc heap trend (cont.):");
+        }
+        length += snprintf(line + length, sizeof(line) - length, " %lu/%lu",
+                           (unsigned long)sample.freeBytes, (unsigned long)sample.largestFreeBlock);
+    }
+    writeLine(line);
+}
+
+/**
+ * @brief Writes the records of the ring, oldest first, and the call sites they refer to.
+ * @param writeLine Receives the dump line by line.
+ */
+void allocTraceDump(AllocTraceWriter writeLine) {
+    char line[160];
+    lock();
+    uint32_t total = ringTotal;
+    uint8_t count = siteCount;
+    unlock();
+    for (uint8_t i = 0; i < count; i++) {
+        lock();
+        AllocSiteStats site = sites[i];
+        unlock();
+        char siteText[112];
+        formatSite(site, siteText, sizeof(siteText));
+        snprintf(line, sizeof(line), "Alloc site %u: %s", (unsigned)i, siteText);
+        writeLine(line);
+    }
+    uint32_t first = total > ALLOC_TRACE_RING ? total - ALLOC_TRACE_RING : 0;
+    for (uint32_t i = first; i < total; i++) {
+        lock();
+        AllocRecord record = ring[i % ALLOC_TRACE_RING];
+        unlock();
+        if (record.lifetimeMs == ALLOC_TRACE_STILL_LIVE) {
+            snprintf(line, sizeof(line), "Alloc #%lu: t=%lu ms, 0x%08lx, %lu B, site %u, live",
+                     (unsigned long)i, (unsigned long)record.timeMs, (unsigned long)record.address,
+                     (unsigned long)record.size, (unsigned)record.site);
+        } else {
+            snprintf(line, sizeof(line), "Alloc #%lu: t=%lu ms, 0x%08lx, %lu B, site %u, freed after %lu ms",
+                     (unsigned long)i, (unsigned long)record.timeMs, (unsigned long)record.address,
+                     (unsigned long)record.size, (unsigned)record.site, (unsigned long)record.lifetimeMs);
+        }
+        writeLine(line);
+    }
+}
+
+/**
+ * @brief Returns a consistent copy of the totals.
+ * @return The totals.
+ */
+AllocTraceStats allocTraceGetStats() {
+    AllocTraceStats stats;
+    lock();
+    stats.allocations = totalAllocations;
+    stats.frees = totalFrees;
+    stats.bytes = totalBytes;
+    stats.liveBlocks = liveCount;
+    stats.untracked = untracked;
+    stats.sites = siteCount;
+    unlock();
+    return stats;
+}
+
+/**
+ * @brief Copies the counters of the call sites, in the order they were first seen.
+ * @param stats Receives the counters.
+ * @param maxSites Capacity of stats.
+ * @return Number of sites copied.
+ */
+uint8_t allocTraceGetSites(AllocSiteStats* stats, uint8_t maxSites) {
+    lock();
+    uint8_t count = siteCount < maxSites ? siteCount : maxSites;
+    memcpy(stats, sites, sizeof(AllocSiteStats) * count);
+    unlock();
+    return count;
+}
+
+#endif // WS_FEATURE_ALLOC_TRACE
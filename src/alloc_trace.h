@@ -0,0 +1,137 @@
+/**
+ * @file alloc_trace.h
+ * @brief Declarations for the opt-in heap allocation tracer.
+ *
+ * Built with WS_FEATURE_ALLOC_TRACE=1 and linked with
+ *
+ *     -Wl,--wrap=malloc -Wl,--wrap=free -Wl,--wrap=realloc -Wl,--wrap=calloc
+ *
+ * (see the esp32-s3-alloc-trace environment), every malloc/free/realloc/calloc
+ * of the linked code goes through the tracer. operator new and Arduino
+ * String allocate through malloc/realloc and are included; ESP-IDF components
+ * that call heap_caps_malloc() directly (WiFi driver, lwIP buffers) are not.
+ *
+ * For each allocation the tracer records the size, the call site and, when
+ * the block is freed, its lifetime:
+ *
+ * - The call site is the innermost ALLOC_TRACE_SCOPE() name of the calling
+ *   task plus the ALLOC_TRACE_DEPTH return addresses above the allocator
+ *   (resolve them with addr2line against firmware.elf). Allocations with the
+ *   same call site are summed per site.
+ * - A freed block is transient if it lived less than ALLOC_TRACE_TRANSIENT_MS,
+ *   otherwise long-lived. Blocks still allocated are reported as live.
+ * - Every allocation is also written to a ring of the last ALLOC_TRACE_RING
+ *   records (address, size, site, time, lifetime) for allocTraceDump().
+ * - Once per minute the free heap and the largest free block are sampled,
+ *   so fragmentation shows as a falling largest block at constant free heap.
+ *
+ * The tables are static and the tracer never allocates. Blocks allocated
+ * while the live table is full, and frees of such blocks, are counted as
+ * untracked. Tracing slows every allocation (mainly the backtrace).
+ *
+ * This module has no Arduino dependencies. On a host build, link the same
+ * sources with the same --wrap flags (and -static-libstdc++ so that operator
+ * new is covered); the largest free block is then reported as 0.
+ */
+#ifndef ALLOC_TRACE_H
+#define ALLOC_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if WS_FEATURE_ALLOC_TRACE
+
+// --- Limits ---
+constexpr uint16_t ALLOC_TRACE_RING = 256;          // Recent allocation records
+constexpr uint16_t ALLOC_TRACE_LIVE = 512;          // Tracked live blocks (power of two, filled to 3/4 at most)
+constexpr uint8_t ALLOC_TRACE_SITES = 48;           // Distinct call sites; further ones share the last entry
+constexpr uint8_t ALLOC_TRACE_DEPTH = 5;            // Return addresses per call site
+constexpr uint32_t ALLOC_TRACE_TRANSIENT_MS = 1000; // Freed sooner = transient
+constexpr uint8_t ALLOC_TRACE_HEAP_MINUTES = 60;    // Length of the largest-free-block trend
+constexpr uint8_t ALLOC_TRACE_REPORT_SITES = 12;    // Sites listed by allocTraceReport()
+
+/** @brief Counters of one call site. */
+struct AllocSiteStats {
+  const char* scope;                    ///< Innermost ALLOC_TRACE_SCOPE() name, NULL outside any scope.
+  uintptr_t callers[ALLOC_TRACE_DEPTH]; ///< Return addresses, innermost first, 0 past the end of the chain.
+  uint32_t allocations;
+  uint32_t bytes;                       ///< Bytes allocated since boot.
+  uint32_t lastMinuteBytes;             ///< Bytes allocated in the last complete minute.
+  uint32_t currentMinuteBytes;
+  uint32_t transientFrees;              ///< Blocks freed within ALLOC_TRACE_TRANSIENT_MS.
+  uint32_t longLivedFrees;              ///< Blocks freed later.
+  uint32_t liveBlocks;                  ///< Blocks not freed yet.
+  uint32_t liveBytes;
+};
+
+/** @brief One allocation in the ring. */
+struct AllocRecord {
+  uintptr_t address;
+  uint32_t size;
+  uint32_t timeMs;                      ///< Time of the allocation since the tracer started.
+  uint32_t lifetimeMs;                  ///< ALLOC_TRACE_STILL_LIVE while not freed.
+  uint8_t site;                         ///< Index of the call site.
+};
+
+constexpr uint32_t ALLOC_TRACE_STILL_LIVE = 0xffffffffu;
+
+/** @brief Totals since the tracer started. */
+struct AllocTraceStats {
+  uint32_t allocations;
+  uint32_t frees;
+  uint32_t bytes;
+  uint16_t liveBlocks;                  ///< Blocks in the live table.
+  uint32_t untracked;                   ///< Allocations while the live table was full and frees of such blocks.
+  uint8_t sites;
+};
+
+/** @brief Writes one line of a report (without line terminator). */
+typedef void (*AllocTraceWriter)(const char* line);
+
+/** @brief Names the allocations of the calling task until the end of the enclosing block. */
+class AllocTraceScope {
+ public:
+  explicit AllocTraceScope(const char* name);
+  ~AllocTraceScope();
+
+ private:
+  const char* previous;
+};
+
+#define ALLOC_TRACE_SCOPE(name) AllocTraceScope allocTraceScope_(name)
+
+/**
+ * @brief Writes the summary: totals, the ALLOC_TRACE_REPORT_SITES sites with
+ * the most bytes per minute (last minute and average), their transient,
+ * long-lived and live blocks, and the per-minute largest-free-block trend.
+ * @param writeLine Receives the report line by line.
+ */
+void allocTraceReport(AllocTraceWriter writeLine);
+
+/**
+ * @brief Writes the records of the ring, oldest first, and the call sites they refer to.
+ * @param writeLine Receives the dump line by line.
+ */
+void allocTraceDump(AllocTraceWriter writeLine);
+
+/**
+ * @brief Returns a consistent copy of the totals.
+ * @return The totals.
+ */
+AllocTraceStats allocTraceGetStats();
+
+/**
+ * @brief Copies the counters of the call sites, in the order they were first seen.
+ * @param stats Receives the counters.
+ * @param maxSites Capacity of stats.
+ * @return Number of sites copied.
+ */
+uint8_t allocTraceGetSites(AllocSiteStats* stats, uint8_t maxSites);
+
+#else
+
+#define ALLOC_TRACE_SCOPE(name) do { } while (0)
+
+#endif // WS_FEATURE_ALLOC_TRACE
+
+#endif // ALLOC_TRACE_H
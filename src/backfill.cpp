@@ -0,0 +1,317 @@
+/**
+ * @file backfill.cpp
+ * @brief Server-requested backfill of stored samples, rate-limited by a token bucket.
+ *
+ * The backfill task walks the chunk files of the sample store, selects the
+ * samples inside the requested time range and posts them in batches of
+ * BACKFILL_BATCH_SAMPLES to the backfill endpoint. Before every batch it waits
+ * until the token bucket holds enough bytes and no live upload is running.
+ * Payload body:
+ *
+ *     {"from":F,"to":T,"samples":[{"timestamp":E, <sample fields>}, ...]}
+ */
+#include "backfill.h"
+#include "config.h"
+#include "discovery.h"
+#include "sample_store.h"
+#include "station_policies.h"
+#include "supervisor.h"
+#include "uplink.h"
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+// --- Backfill Configuration ---
+const uint32_t BACKFILL_RATE_BYTES_PER_S = 4096; // Sustained payload rate
+const uint32_t BACKFILL_BURST_BYTES = 8192;      // Token bucket capacity
+const uint8_t BACKFILL_BATCH_SAMPLES = 30;
+const uint8_t BACKFILL_MAX_ATTEMPTS = 3;
+const uint32_t BACKFILL_RETRY_DELAY_MS = 5000;
+const uint32_t BACKFILL_LIVE_POLL_MS = 50;       // Poll period while a live upload is running
+
+/** @brief A requested time range. */
+struct BackfillRange {
+  uint32_t fromEpochS;
+  uint32_t toEpochS;
+};
+
+static QueueHandle_t backfillQueue = NULL; // Holds at most one pending request
+static BackfillStats stats = {};
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Token Bucket ---
+
+/** @brief Token bucket metering backfill payload bytes. */
+struct TokenBucket {
+  float tokens;
+  uint32_t lastRefillMs;
+};
+
+static TokenBucket bucket = { (float)BACKFILL_BURST_BYTES, 0 };
+
+/**
+ * @brief Adds the tokens accumulated since the last refill, up to the burst size.
+ */
+static void refillTokens() {
+    uint32_t now = millis();
+    bucket.tokens += (now - bucket.lastRefillMs) * (BACKFILL_RATE_BYTES_PER_S / 1000.0f);
+    if (bucket.tokens > BACKFILL_BURST_BYTES) {
+        bucket.tokens = BACKFILL_BURST_BYTES;
+    }
+    bucket.lastRefillMs = now;
+}
+
+/**
+ * @brief Blocks until the bucket allows sending the given number of bytes, then takes them.
+ * A payload larger than the burst size is sent once the bucket is full and
+ * leaves the bucket in debt, which delays the following batches accordingly.
+ * @param bytes Size of the payload.
+ * @return Time spent waiting [ms].
+ */
+static uint32_t takeTokens(uint32_t bytes) {
+    float needed = bytes < BACKFILL_BURST_BYTES ? (float)bytes : (float)BACKFILL_BURST_BYTES;
+    uint32_t waitedMs = 0;
+    for (;;) {
+        refillTokens();
+        if (bucket.tokens >= needed) {
+            bucket.tokens -= bytes;
+            return waitedMs;
+        }
+        uint32_t delayMs = (uint32_t)((needed - bucket.tokens) * 1000.0f / BACKFILL_RATE_BYTES_PER_S) + 1;
+        vTaskDelay(pdMS_TO_TICKS(delayMs));
+        waitedMs += delayMs;
+    }
+}
+
+/**
+ * @brief Blocks while a live upload is running so it gets the full link.
+ * @return Time spent waiting [ms].
+ */
+static uint32_t waitForLiveIdle() {
+    uint32_t waitedMs = 0;
+    while (uplinkBusy()) {
+        vTaskDelay(pdMS_TO_TICKS(BACKFILL_LIVE_POLL_MS));
+        waitedMs += BACKFILL_LIVE_POLL_MS;
+    }
+    return waitedMs;
+}
+
+// --- Batching ---
+
+/**
+ * @brief Appends one sample with its timestamp to the batch body.
+ * @param batch Comma-separated sample objects collected so far.
+ * @param sample The sample to append.
+ * @param first true for the first sample of the batch.
+ */
+static void appendToBatch(String& batch, const WeatherSample& sample, bool first) {
+    String encoded;
+    encodeTimestampedSample(sample, encoded);
+    if (!first) {
+        batch += ',';
+    }
+    batch += encoded;
+}
+
+/**
+ * @brief Sends one batch, retrying a failed attempt after BACKFILL_RETRY_DELAY_MS.
+ * @param range The request being served.
+ * @param samplesJson Comma-separated sample objects.
+ * @param count Number of samples in the batch.
+ * @return true if the server acknowledged the batch.
+ */
+static bool sendBatch(const BackfillRange& range, const String& samplesJson, uint8_t count) {
+    String body = "{\"from\":";
+    body += range.fromEpochS;
+    body += ",\"to\":";
+    body += range.toEpochS;
+    body += ",\"samples\":[";
+    body += samplesJson;
+    body += "]}";
+
+    String endpoint = "http://" + activeServerAddress() + apiBackfillPath;
+    endpoint.replace("<mac_plytki>", WiFi.macAddress());
+
+    for (uint8_t attempt = 1; attempt <= BACKFILL_MAX_ATTEMPTS; attempt++) {
+        uint32_t throttledMs = takeTokens(body.length());
+        throttledMs += waitForLiveIdle();
+        portENTER_CRITICAL(&statsLock);
+        stats.throttledMs += throttledMs;
+        portEXIT_CRITICAL(&statsLock);
+
+        int code = -1;
+        if (getSupervisorState() == STATE_ONLINE) {
+            String response;
+            code = ActiveStation::Transport::post(endpoint, ActiveStation::Encoder::contentType(), body, response);
+        }
+        if (code >= 200 && code < 300) {
+            portENTER_CRITICAL(&statsLock);
+            stats.batchesSent++;
+            stats.samplesSent += count;
+            stats.bytesSent += body.length();
+            portEXIT_CRITICAL(&statsLock);
+            DEBUG_PRINTF("Backfill: Batch of %u samples sent (%u bytes).\n", (unsigned)count, (unsigned)body.length());
+            return true;
+        }
+        Serial.printf("Backfill: Batch attempt %u failed (%d).\n", (unsigned)attempt, code);
+        vTaskDelay(pdMS_TO_TICKS(BACKFILL_RETRY_DELAY_MS));
+    }
+    portENTER_CRITICAL(&statsLock);
+    stats.batchesFailed++;
+    portEXIT_CRITICAL(&statsLock);
+    return false;
+}
+
+/**
+ * @brief Streams all stored samples inside the range, oldest first.
+ * Stops early when a batch fails or a newer request is queued.
+ * @param range The request to serve.
+ */
+static void serveRequest(const BackfillRange& range) {
+    static WeatherSample chunkSamples[STORE_CHUNK_SAMPLES];
+    uint32_t firstChunk, nextChunk;
+    sampleStoreChunkRange(firstChunk, nextChunk);
+
+    Serial.printf("Backfill: Serving %lu..%lu from chunks %lu..%lu.\n", (unsigned long)range.fromEpochS,
+                  (unsigned long)range.toEpochS, (unsigned long)firstChunk, (unsigned long)nextChunk);
+    uint32_t start = millis();
+    uint32_t bytesBefore = backfillGetStats().bytesSent;
+
+    String batch;
+    uint8_t batchCount = 0;
+    bool ok = true;
+    for (uint32_t chunk = firstChunk; ok && chunk < nextChunk; chunk++) {
+        if (uxQueueMessagesWaiting(backfillQueue) > 0) {
+            Serial.println("Backfill: Superseded by a new request.");
+            ok = false;
+            break;
+        }
+        StoredChunkInfo info;
+        if (!sampleStoreReadChunk(chunk, chunkSamples, info) ||
+            info.lastEpochS < range.fromEpochS || info.firstEpochS > range.toEpochS) {
+            continue;
+        }
+        for (uint16_t i = 0; ok && i < info.count; i++) {
+            const WeatherSample& sample = chunkSamples[i];
+            if (sample.epochS < range.fromEpochS || sample.epochS > range.toEpochS) {
+                continue;
+            }
+            appendToBatch(batch, sample, batchCount == 0);
+            if (++batchCount >= BACKFILL_BATCH_SAMPLES) {
+                ok = sendBatch(range, batch, batchCount);
+                batch = "";
+                batchCount = 0;
+            }
+        }
+    }
+    if (ok && batchCount > 0) {
+        ok = sendBatch(range, batch, batchCount);
+    }
+
+    uint32_t elapsedMs = millis() - start;
+    uint32_t bytes = backfillGetStats().bytesSent - bytesBefore;
+    portENTER_CRITICAL(&statsLock);
+    stats.lastThroughputBps = elapsedMs > 0 ? (uint32_t)((uint64_t)bytes * 1000 / elapsedMs) : 0;
+    portEXIT_CRITICAL(&statsLock);
+    Serial.printf("Backfill: %s, %lu bytes in %lu ms.\n", ok ? "Finished" : "Aborted",
+                  (unsigned long)bytes, (unsigned long)elapsedMs);
+}
+
+// --- Public API ---
+
+/**
+ * @brief Starts the backfill task.
+ * @return true if the task was created, false otherwise.
+ */
+bool startBackfill() {
+    backfillQueue = xQueueCreate(1, sizeof(BackfillRange));
+    if (backfillQueue == NULL) {
+        return false;
+    }
+    bucket.lastRefillMs = millis();
+    return xTaskCreatePinnedToCore(backfillTask, "BackfillTask", 6144 + (features::kHttpsTransport ? HTTPS_HANDSHAKE_STACK : 0), NULL, 1, NULL, APP_CPU_NUM) == pdPASS;
+}
+
+/**
+ * @brief Extracts a backfill request from a server response.
+ * Looks for "backfill" followed by numeric "from" and "to" members, so it
+ * works with any encoder and does not need a JSON parser.
+ * @param response Body of the server response.
+ * @param fromEpochS Receives the start of the range.
+ * @param toEpochS Receives the end of the range.
+ * @return true if the response contains a valid request, false otherwise.
+ */
+bool parseBackfillRequest(const String& response, uint32_t& fromEpochS, uint32_t& toEpochS) {
+    const char* backfill = strstr(response.c_str(), "\"backfill\"");
+    if (backfill == NULL) {
+        return false;
+    }
+    const char* from = strstr(backfill, "\"from\"");
+    const char* to = strstr(backfill, "\"to\"");
+    if (from == NULL || to == NULL) {
+        return false;
+    }
+    from = strchr(from + 6, ':');
+    to = strchr(to + 4, ':');
+    if (from == NULL || to == NULL) {
+        return false;
+    }
+    fromEpochS = strtoul(from + 1, NULL, 10);
+    toEpochS = strtoul(to + 1, NULL, 10);
+    return fromEpochS >= MIN_VALID_EPOCH && fromEpochS <= toEpochS;
+}
+
+/**
+ * @brief Queues a backfill request, replacing one that has not started yet.
+ * @param fromEpochS Start of the range.
+ * @param toEpochS End of the range.
+ * @return true if the request was queued.
+ */
+bool requestBackfill(uint32_t fromEpochS, uint32_t toEpochS) {
+    if (backfillQueue == NULL) {
+        return false;
+    }
+    BackfillRange range = { fromEpochS, toEpochS };
+    xQueueOverwrite(backfillQueue, &range);
+    portENTER_CRITICAL(&statsLock);
+    stats.requests++;
+    portEXIT_CRITICAL(&statsLock);
+    return true;
+}
+
+/**
+ * @brief Returns a snapshot of the backfill counters.
+ * @return Copy of the current statistics.
+ */
+BackfillStats backfillGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    BackfillStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    return snapshot;
+}
+
+// --- FreeRTOS Task: Backfill ---
+
+/**
+ * @brief FreeRTOS task waiting for backfill requests and serving them one at a time.
+ * @param pvParameters Standard FreeRTOS task parameters (unused).
+ */
+void backfillTask(void *pvParameters) {
+    Serial.println("Backfill Task started.");
+    for (;;) {
+        BackfillRange range;
+        if (xQueueReceive(backfillQueue, &range, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        portENTER_CRITICAL(&statsLock);
+        stats.active = true;
+        portEXIT_CRITICAL(&statsLock);
+
+        serveRequest(range);
+
+        portENTER_CRITICAL(&statsLock);
+        stats.active = false;
+        portEXIT_CRITICAL(&statsLock);
+    }
+}
@@ -0,0 +1,68 @@
+/**
+ * @file backfill.h
+ * @brief Declarations for server-requested backfill of stored samples.
+ *
+ * When the server detects a gap in its data it names a time range in the
+ * response to a regular upload:
+ *
+ *     {"backfill": {"from": 1718000000, "to": 1718003600}}
+ *
+ * The backfill task then reads the matching samples from the on-flash store
+ * (see sample_store.h) and posts them in batches to the backfill endpoint.
+ * A token bucket limits the backfill byte rate, and no batch is sent while a
+ * live upload is in progress, so live samples keep priority.
+ */
+#ifndef BACKFILL_H
+#define BACKFILL_H
+
+#include "config.h"
+
+/** @brief Counters describing backfill progress and throughput. */
+struct BackfillStats {
+  uint32_t requests;          ///< Backfill requests accepted.
+  uint32_t batchesSent;       ///< Batches acknowledged by the server.
+  uint32_t batchesFailed;     ///< Batches that failed after all retries.
+  uint32_t samplesSent;       ///< Samples acknowledged by the server.
+  uint32_t bytesSent;         ///< Payload bytes acknowledged by the server.
+  uint32_t lastThroughputBps; ///< Payload throughput of the last finished request [B/s].
+  uint32_t throttledMs;       ///< Total time spent waiting for tokens or live uploads.
+  bool active;                ///< A request is being served.
+};
+
+/**
+ * @brief Starts the backfill task.
+ * @note Must be called after startSampleStore().
+ * @return true if the task was created, false otherwise.
+ */
+bool startBackfill();
+
+/**
+ * @brief Extracts a backfill request from a server response.
+ * @param response Body of the server response.
+ * @param fromEpochS Receives the start of the range (Unix time, inclusive).
+ * @param toEpochS Receives the end of the range (Unix time, inclusive).
+ * @return true if the response contains a valid request, false otherwise.
+ */
+bool parseBackfillRequest(const String& response, uint32_t& fromEpochS, uint32_t& toEpochS);
+
+/**
+ * @brief Queues a backfill request. A new request replaces one that has not started yet.
+ * @param fromEpochS Start of the range (Unix time, inclusive).
+ * @param toEpochS End of the range (Unix time, inclusive).
+ * @return true if the request was queued.
+ */
+bool requestBackfill(uint32_t fromEpochS, uint32_t toEpochS);
+
+/**
+ * @brief Returns a snapshot of the backfill counters.
+ * @return Copy of the current statistics.
+ */
+BackfillStats backfillGetStats();
+
+/**
+ * @brief FreeRTOS task function serving backfill requests.
+ * @param pvParameters Standard FreeRTOS task parameters (unused).
+ */
+void backfillTask(void *pvParameters);
+
+#endif // BACKFILL_H
@@ -0,0 +1,113 @@
+/**
+ * @file button_gesture.cpp
+ * @brief Debouncing and gesture recognition for the push button.
+ *
+ * Implements the ButtonGestureDetector state machine. All timing is relative
+ * to the millisecond timestamps supplied by the caller and uses unsigned
+ * differences, so it is safe across millis() wrap-around.
+ */
+#include "button_gesture.h"
+
+/**
+ * @brief Creates a detector with the given timing parameters.
+ * @param debounceMs Quiet time after the last edge before a level is accepted.
+ * @param longPressMs Hold time after which a press is reported as a long press.
+ * @param doublePressGapMs Maximum time between release and the next press for a double press.
+ */
+ButtonGestureDetector::ButtonGestureDetector(uint32_t debounceMs, uint32_t longPressMs, uint32_t doublePressGapMs)
+    : debounceMs(debounceMs), longPressMs(longPressMs), doublePressGapMs(doublePressGapMs),
+      stablePressed(false), debouncePending(false), lastEdgeMs(0), pressStartMs(0),
+      longReported(false), singlePending(false), releaseMs(0) {}
+
+/**
+ * @brief Records a raw edge and restarts the debounce window.
+ * Bounces simply keep pushing the window forward until the contact settles.
+ * @param nowMs Current time in milliseconds.
+ */
+void ButtonGestureDetector::onEdge(uint32_t nowMs) {
+    debouncePending = true;
+    lastEdgeMs = nowMs;
+}
+
+/**
+ * @brief Advances the detector: accepts a settled level and evaluates the
+ * long-press and double-press timers.
+ * @param rawPressed Current (raw) pin level, true if the button is pressed.
+ * @param nowMs Current time in milliseconds.
+ * @return The gesture completed at this point, or GESTURE_NONE.
+ */
+ButtonGesture ButtonGestureDetector::poll(bool rawPressed, uint32_t nowMs) {
+    if (debouncePending && nowMs - lastEdgeMs >= debounceMs) {
+        debouncePending = false;
+        if (rawPressed != stablePressed) {
+            stablePressed = rawPressed;
+            ButtonGesture gesture = onStableChange(rawPressed, nowMs);
+            if (gesture != GESTURE_NONE) {
+                return gesture;
+            }
+        }
+    }
+
+    if (stablePressed && !longReported && nowMs - pressStartMs >= longPressMs) {
+        longReported = true;
+        singlePending = false;
+        return GESTURE_LONG_PRESS;
+    }
+
+    if (!stablePressed && singlePending && nowMs - releaseMs >= doublePressGapMs) {
+        singlePending = false;
+        return GESTURE_SHORT_PRESS;
+    }
+    return GESTURE_NONE;
+}
+
+/**
+ * @brief Handles a debounced level change.
+ * @param pressed The new debounced level.
+ * @param nowMs Current time in milliseconds.
+ * @return GESTURE_DOUBLE_PRESS when the second short press is released, GESTURE_NONE otherwise.
+ */
+ButtonGesture ButtonGestureDetector::onStableChange(bool pressed, uint32_t nowMs) {
+    if (pressed) {
+        pressStartMs = nowMs;
+        longReported = false;
+        return GESTURE_NONE;
+    }
+
+    if (longReported) {
+        return GESTURE_NONE; // Release after a long press ends the gesture
+    }
+    if (singlePending) {
+        singlePending = false;
+        return GESTURE_DOUBLE_PRESS;
+    }
+    singlePending = true;
+    releaseMs = nowMs;
+    return GESTURE_NONE;
+}
+
+/**
+ * @brief Returns the time until the detector needs to be polled again.
+ * @param nowMs Current time in milliseconds.
+ * @return Milliseconds until the next deadline, 0 if overdue, or GESTURE_NO_DEADLINE when idle.
+ */
+uint32_t ButtonGestureDetector::msUntilDeadline(uint32_t nowMs) const {
+    uint32_t best = GESTURE_NO_DEADLINE;
+    uint32_t elapsed;
+
+    if (debouncePending) {
+        elapsed = nowMs - lastEdgeMs;
+        best = elapsed >= debounceMs ? 0 : debounceMs - elapsed;
+    }
+    if (stablePressed && !longReported) {
+        elapsed = nowMs - pressStartMs;
+        uint32_t remaining = elapsed >= longPressMs ? 0 : longPressMs - elapsed;
+        if (remaining < best) best = remaining;
+    }
+    if (!stablePressed && singlePending) {
+        elapsed = nowMs - releaseMs;
+        uint32_t remaining = elapsed >= doublePressGapMs ? 0 : doublePressGapMs - elapsed;
+        if (remaining < best) best = remaining;
+    }
+    return best;
+}
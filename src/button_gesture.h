@@ -0,0 +1,84 @@
+/**
+ * @file button_gesture.h
+ * @brief Debouncing and gesture recognition for the push button.
+ *
+ * The detector is fed with raw edge notifications and the sampled pin level
+ * and turns them into debounced gestures (short, double and long press). It
+ * has no hardware dependencies: time is passed in by the caller, so the same
+ * logic is driven by the button task on the device and can be replayed with
+ * synthetic waveforms on a host.
+ */
+#ifndef BUTTON_GESTURE_H
+#define BUTTON_GESTURE_H
+
+#include <stdint.h>
+
+/** @brief Gestures recognised on the push button. */
+enum ButtonGesture {
+  GESTURE_NONE = 0,     ///< No gesture completed.
+  GESTURE_SHORT_PRESS,  ///< Single press released before the long-press threshold.
+  GESTURE_DOUBLE_PRESS, ///< Two short presses within the double-press gap.
+  GESTURE_LONG_PRESS    ///< Press held for at least the long-press threshold (reported while still held).
+};
+
+/** @brief Value returned by msUntilDeadline() when no timer is pending. */
+const uint32_t GESTURE_NO_DEADLINE = 0xFFFFFFFFUL;
+
+/**
+ * @brief Turns raw button edges into debounced gestures.
+ * A level is accepted only after no edge has been seen for the debounce time.
+ */
+class ButtonGestureDetector {
+public:
+  /**
+   * @brief Creates a detector.
+   * @param debounceMs Quiet time after the last edge before a level is accepted.
+   * @param longPressMs Hold time after which a press is reported as a long press.
+   * @param doublePressGapMs Maximum time between release and the next press for a double press.
+   */
+  ButtonGestureDetector(uint32_t debounceMs = 30, uint32_t longPressMs = 3000, uint32_t doublePressGapMs = 400);
+
+  /**
+   * @brief Records a raw edge on the button pin and restarts the debounce window.
+   * @param nowMs Current time in milliseconds.
+   */
+  void onEdge(uint32_t nowMs);
+
+  /**
+   * @brief Advances the detector. Call after every edge wait that timed out.
+   * @param rawPressed Current (raw) pin level, true if the button is pressed.
+   * @param nowMs Current time in milliseconds.
+   * @return The gesture completed at this point, or GESTURE_NONE.
+   */
+  ButtonGesture poll(bool rawPressed, uint32_t nowMs);
+
+  /**
+   * @brief Returns the time until the detector needs to be polled again.
+   * @param nowMs Current time in milliseconds.
+   * @return Milliseconds until the next deadline, 0 if overdue, or GESTURE_NO_DEADLINE when idle.
+   */
+  uint32_t msUntilDeadline(uint32_t nowMs) const;
+
+  /**
+   * @brief Returns the debounced button level.
+   * @return true if the button is considered pressed.
+   */
+  bool isPressed() const { return stablePressed; }
+
+private:
+  ButtonGesture onStableChange(bool pressed, uint32_t nowMs);
+
+  uint32_t debounceMs;
+  uint32_t longPressMs;
+  uint32_t doublePressGapMs;
+
+  bool stablePressed;     // Debounced level
+  bool debouncePending;   // An edge was seen and the level is not yet accepted
+  uint32_t lastEdgeMs;    // Time of the most recent raw edge
+  uint32_t pressStartMs;  // Time the current press was accepted
+  bool longReported;      // Long press already reported for the current press
+  bool singlePending;     // A short press is waiting for a possible second press
+  uint32_t releaseMs;     // Time the pending short press was released
+};
+
+#endif // BUTTON_GESTURE_H
@@ -0,0 +1,521 @@
+/**
+ * @file coap_transport.cpp
+ * @brief CoAP-over-UDP client: message encoding, confirmable exchanges with
+ * exponential backoff and Block1 transfers.
+ *
+ * Message layout (RFC 7252):
+ *
+ *     | Ver T TKL | Code | Message ID | Token | Options (delta encoded) | 0xFF | Payload |
+ *
+ * The message and receive buffers are static and guarded by the exchange
+ * mutex, which also enforces NSTART = 1.
+ */
+#include "coap_transport.h"
+
+#if WS_TRANSPORT_COAP
+#include "dns_cache.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// --- Protocol Constants ---
+const uint8_t COAP_VERSION = 1;
+const uint8_t COAP_TYPE_CON = 0;
+const uint8_t COAP_TYPE_NON = 1;
+const uint8_t COAP_TYPE_ACK = 2;
+const uint8_t COAP_TYPE_RST = 3;
+const uint8_t COAP_CODE_EMPTY = 0;
+const uint8_t COAP_CODE_CONTINUE = (2 << 5) | 31; // 2.31
+const uint16_t COAP_OPTION_URI_PATH = 11;
+const uint16_t COAP_OPTION_CONTENT_FORMAT = 12;
+const uint16_t COAP_OPTION_BLOCK1 = 27;
+const uint16_t COAP_OPTION_SIZE1 = 60;
+const uint16_t COAP_FORMAT_JSON = 50;
+const uint16_t COAP_FORMAT_OCTET_STREAM = 42;
+const uint8_t COAP_PAYLOAD_MARKER = 0xFF;
+const uint8_t COAP_TOKEN_LENGTH = 2;
+
+// --- Client Configuration ---
+const size_t COAP_MAX_MESSAGE = COAP_BLOCK_SIZE + 160; // Header, token, options and one block
+const uint32_t COAP_POLL_MS = 5;                       // Receive poll period while waiting for a response
+
+static_assert(COAP_BLOCK_SIZE >= 16 && COAP_BLOCK_SIZE <= 1024 && (COAP_BLOCK_SIZE & (COAP_BLOCK_SIZE - 1)) == 0,
+              "COAP_BLOCK_SIZE must be a power of two between 16 and 1024");
+
+/** @brief The parts of a received message the client uses. */
+struct CoapMessage {
+  uint8_t type;
+  uint8_t code;
+  uint16_t messageId;
+  uint8_t tokenLength;
+  uint8_t token[8];
+  bool hasBlock1;
+  uint32_t block1;            ///< Raw Block1 value: num << 4 | more << 3 | szx.
+  const uint8_t* payload;
+  size_t payloadLength;
+};
+
+static WiFiUDP udp;
+static SemaphoreHandle_t exchangeMutex = NULL;
+static uint16_t nextMessageId = 0;
+static uint16_t nextToken = 0;
+static uint8_t txBuffer[COAP_MAX_MESSAGE];
+static uint8_t rxBuffer[COAP_MAX_MESSAGE];
+
+static CoapStats stats = {};
+static uint32_t exchangeSumMs = 0;
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Encoding ---
+
+/** @brief Builder for one outgoing message in txBuffer. */
+struct CoapWriter {
+  size_t length;
+  uint16_t lastOption;
+  bool overflow;
+};
+
+static void writeByte(CoapWriter& writer, uint8_t byte) {
+    if (writer.length >= sizeof(txBuffer)) {
+        writer.overflow = true;
+        return;
+    }
+    txBuffer[writer.length++] = byte;
+}
+
+static void writeBytes(CoapWriter& writer, const uint8_t* bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        writeByte(writer, bytes[i]);
+    }
+}
+
+/**
+ * @brief Writes the fixed header and the token.
+ */
+static void writeHeader(CoapWriter& writer, uint8_t type, uint8_t code, uint16_t messageId, uint16_t token) {
+    writer.length = 0;
+    writer.lastOption = 0;
+    writer.overflow = false;
+    writeByte(writer, (COAP_VERSION << 6) | (type << 4) | COAP_TOKEN_LENGTH);
+    writeByte(writer, code);
+    writeByte(writer, messageId >> 8);
+    writeByte(writer, messageId & 0xFF);
+    writeByte(writer, token >> 8);
+    writeByte(writer, token & 0xFF);
+}
+
+/**
+ * @brief Encodes an option delta or length nibble and returns its extension bytes.
+ */
+static uint8_t optionNibble(uint32_t value, uint8_t* extension, uint8_t& extensionLength) {
+    if (value < 13) {
+        extensionLength = 0;
+        return (uint8_t)value;
+    }
+    if (value < 269) {
+        extension[0] = (uint8_t)(value - 13);
+        extensionLength = 1;
+        return 13;
+    }
+    extension[0] = (uint8_t)((value - 269) >> 8);
+    extension[1] = (uint8_t)((value - 269) & 0xFF);
+    extensionLength = 2;
+    return 14;
+}
+
+/**
+ * @brief Appends an option; options must be written in ascending number order.
+ */
+static void writeOption(CoapWriter& writer, uint16_t number, const uint8_t* value, size_t valueLength) {
+    uint8_t deltaExtension[2], lengthExtension[2];
+    uint8_t deltaExtensionLength, lengthExtensionLength;
+    uint8_t delta = optionNibble(number - writer.lastOption, deltaExtension, deltaExtensionLength);
+    uint8_t length = optionNibble(valueLength, lengthExtension, lengthExtensionLength);
+    writeByte(writer, (delta << 4) | length);
+    writeBytes(writer, deltaExtension, deltaExtensionLength);
+    writeBytes(writer, lengthExtension, lengthExtensionLength);
+    writeBytes(writer, value, valueLength);
+    writer.lastOption = number;
+}
+
+/**
+ * @brief Appends an option with an unsigned integer value in the fewest bytes.
+ */
+static void writeUintOption(CoapWriter& writer, uint16_t number, uint32_t value) {
+    uint8_t bytes[4];
+    size_t count = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        if (count > 0 || (value >> shift) != 0) {
+            bytes[count++] = (uint8_t)(value >> shift);
+        }
+    }
+    writeOption(writer, number, bytes, count);
+}
+
+/**
+ * @brief Appends one Uri-Path option per segment of a path.
+ */
+static void writeUriPath(CoapWriter& writer, const String& path) {
+    int start = 0;
+    while (start < (int)path.length()) {
+        int end = path.indexOf('/', start);
+        if (end < 0) {
+            end = path.length();
+        }
+        if (end > start) {
+            writeOption(writer, COAP_OPTION_URI_PATH, (const uint8_t*)path.c_str() + start, end - start);
+        }
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief Maps a MIME type to a CoAP Content-Format number.
+ * @return The number, or -1 if there is no registered one.
+ */
+static int contentFormat(const char* contentType) {
+    if (contentType == NULL) {
+        return -1;
+    }
+    if (strcmp(contentType, "application/json") == 0) {
+        return COAP_FORMAT_JSON;
+    }
+    // Protobuf has no registered Content-Format; it is sent as an opaque body
+    if (strcmp(contentType, "application/octet-stream") == 0 || strcmp(contentType, PROTOBUF_CONTENT_TYPE) == 0) {
+        return COAP_FORMAT_OCTET_STREAM;
+    }
+    return -1;
+}
+
+// --- Decoding ---
+
+/**
+ * @brief Reads an option delta or length with its extension bytes.
+ * @return false if the message ends early or the nibble is reserved.
+ */
+static bool readNibble(uint8_t nibble, const uint8_t*& cursor, const uint8_t* end, uint32_t& value) {
+    if (nibble < 13) {
+        value = nibble;
+    } else if (nibble == 13 && cursor < end) {
+        value = 13 + *cursor++;
+    } else if (nibble == 14 && end - cursor >= 2) {
+        value = 269 + (cursor[0] << 8) + cursor[1];
+        cursor += 2;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a received message.
+ * @return false if the message is malformed.
+ */
+static bool parseMessage(const uint8_t* data, size_t length, CoapMessage& message) {
+    if (length < 4 || (data[0] >> 6) != COAP_VERSION) {
+        return false;
+    }
+    message.type = (data[0] >> 4) & 0x03;
+    message.tokenLength = data[0] & 0x0F;
+    message.code = data[1];
+    message.messageId = (data[2] << 8) | data[3];
+    message.hasBlock1 = false;
+    message.payload = NULL;
+    message.payloadLength = 0;
+    if (message.tokenLength > 8 || length < 4u + message.tokenLength) {
+        return false;
+    }
+    memcpy(message.token, data + 4, message.tokenLength);
+
+    const uint8_t* cursor = data + 4 + message.tokenLength;
+    const uint8_t* end = data + length;
+    uint32_t option = 0;
+    while (cursor < end) {
+        if (*cursor == COAP_PAYLOAD_MARKER) {
+            message.payload = cursor + 1;
+            message.payloadLength = end - cursor - 1;
+            return message.payloadLength > 0;
+        }
+        uint8_t header = *cursor++;
+        uint32_t delta, valueLength;
+        if (!readNibble(header >> 4, cursor, end, delta) || !readNibble(header & 0x0F, cursor, end, valueLength) ||
+            (uint32_t)(end - cursor) < valueLength) {
+            return false;
+        }
+        option += delta;
+        if (option == COAP_OPTION_BLOCK1 && valueLength <= 3) {
+            message.hasBlock1 = true;
+            message.block1 = 0;
+            for (uint32_t i = 0; i < valueLength; i++) {
+                message.block1 = (message.block1 << 8) | cursor[i];
+            }
+        }
+        cursor += valueLength;
+    }
+    return true;
+}
+
+// --- Exchange ---
+
+/**
+ * @brief Sends an empty ACK for a confirmable separate response.
+ */
+static void sendEmptyAck(const IPAddress& server, uint16_t messageId) {
+    uint8_t ack[4] = { (uint8_t)((COAP_VERSION << 6) | (COAP_TYPE_ACK << 4)), COAP_CODE_EMPTY,
+                       (uint8_t)(messageId >> 8), (uint8_t)(messageId & 0xFF) };
+    udp.beginPacket(server, COAP_PORT);
+    udp.write(ack, sizeof(ack));
+    udp.endPacket();
+}
+
+/**
+ * @brief Sends the confirmable message in txBuffer until it is answered.
+ * Retransmits with exponential backoff until COAP_MAX_RETRANSMIT or the budget runs out.
+ * @param server Address of the server.
+ * @param length Length of the message in txBuffer.
+ * @param messageId Its message id.
+ * @param token Its token.
+ * @param budgetMs Maximum time for the exchange.
+ * @param response Receives the response; its payload points into rxBuffer.
+ * @return 0 when a response was received, a negative COAP_ERROR_* code otherwise.
+ */
+static int exchange(const IPAddress& server, size_t length, uint16_t messageId, uint16_t token,
+                    uint32_t budgetMs, CoapMessage& response) {
+    uint32_t start = millis();
+    uint32_t timeoutMs = COAP_ACK_TIMEOUT_MS + esp_random() % (COAP_ACK_TIMEOUT_MS / 2 + 1); // ACK_RANDOM_FACTOR 1.5
+    bool acknowledged = false; // Empty ACK received; the response follows separately
+
+    for (uint8_t transmission = 0; ; transmission++) {
+        if (!acknowledged) {
+            udp.beginPacket(server, COAP_PORT);
+            udp.write(txBuffer, length);
+            udp.endPacket();
+            portENTER_CRITICAL(&statsLock);
+            stats.messagesSent++;
+            stats.bytesSent += length;
+            if (transmission > 0) {
+                stats.retransmissions++;
+            }
+            portEXIT_CRITICAL(&statsLock);
+        }
+
+        uint32_t sentAt = millis();
+        while (millis() - start < budgetMs && (acknowledged || millis() - sentAt < timeoutMs)) {
+            int size = udp.parsePacket();
+            if (size <= 0) {
+                vTaskDelay(pdMS_TO_TICKS(COAP_POLL_MS));
+                continue;
+            }
+            int received = udp.read(rxBuffer, sizeof(rxBuffer));
+            portENTER_CRITICAL(&statsLock);
+            stats.bytesReceived += size;
+            portEXIT_CRITICAL(&statsLock);
+            if (received <= 0 || !(udp.remoteIP() == server) || !parseMessage(rxBuffer, received, response)) {
+                continue;
+            }
+            bool tokenMatches = response.tokenLength == COAP_TOKEN_LENGTH &&
+                                ((response.token[0] << 8) | response.token[1]) == token;
+            if (response.type == COAP_TYPE_RST && response.messageId == messageId) {
+                return COAP_ERROR_RESET;
+            }
+            if (response.type == COAP_TYPE_ACK && response.messageId == messageId) {
+                if (response.code == COAP_CODE_EMPTY) {
+                    acknowledged = true;
+                    continue;
+                }
+                if (tokenMatches) {
+                    return 0; // Piggybacked response
+                }
+            }
+            if ((response.type == COAP_TYPE_CON || response.type == COAP_TYPE_NON) && tokenMatches) {
+                if (response.type == COAP_TYPE_CON) {
+                    sendEmptyAck(server, response.messageId);
+                }
+                return 0; // Separate response
+            }
+        }
+        if (acknowledged || millis() - start >= budgetMs || transmission >= COAP_MAX_RETRANSMIT) {
+            return COAP_ERROR_TIMEOUT;
+        }
+        timeoutMs *= 2;
+    }
+}
+
+/**
+ * @brief Splits a URL into host and path.
+ * @return false if the URL has no host.
+ */
+static bool splitUrl(const String& url, String& host, String& path) {
+    int hostStart = url.indexOf("://");
+    hostStart = hostStart < 0 ? 0 : hostStart + 3;
+    int pathStart = url.indexOf('/', hostStart);
+    if (pathStart < 0) {
+        pathStart = url.length();
+    }
+    int portStart = url.indexOf(':', hostStart);
+    int hostEnd = portStart >= 0 && portStart < pathStart ? portStart : pathStart;
+    host = url.substring(hostStart, hostEnd);
+    path = url.substring(pathStart);
+    return host.length() > 0;
+}
+
+// --- Public API ---
+
+/**
+ * @brief Opens the UDP socket and creates the exchange lock.
+ * @return true on success.
+ */
+bool initCoapTransport() {
+    exchangeMutex = xSemaphoreCreateMutex();
+    nextMessageId = (uint16_t)esp_random();
+    nextToken = (uint16_t)esp_random();
+    return exchangeMutex != NULL && udp.begin(0) == 1; // Any local port
+}
+
+/**
+ * @brief Sends a confirmable request and waits for the final response.
+ * @param method COAP_METHOD_GET or COAP_METHOD_POST.
+ * @param url Request URL; its host and path are used, its scheme and port are ignored.
+ * @param contentType MIME type of the body (mapped to Content-Format), or NULL.
+ * @param body Request payload; sent block-wise if larger than COAP_BLOCK_SIZE.
+ * @param response Receives the payload of the response.
+ * @param timeoutMs Budget per message for transmissions, retransmissions and the response is twice this value.
+ * @return Response code as class * 100 + detail, or a negative COAP_ERROR_* code.
+ */
+int coapRequest(CoapMethod method, const String& url, const char* contentType, const String& body,
+                String& response, uint32_t timeoutMs) {
+    response = "";
+    String host, path;
+    if (!splitUrl(url, host, path)) {
+        return COAP_ERROR_INVALID_URL;
+    }
+    IPAddress server;
+    if (WiFi.status() != WL_CONNECTED || exchangeMutex == NULL || !dnsCacheResolve(host, server)) {
+        return COAP_ERROR_NOT_CONNECTED;
+    }
+    if (xSemaphoreTake(exchangeMutex, portMAX_DELAY) != pdTRUE) {
+        return COAP_ERROR_NOT_CONNECTED;
+    }
+    while (udp.parsePacket() > 0) {
+        udp.read(rxBuffer, sizeof(rxBuffer)); // Discard late answers to earlier exchanges
+    }
+
+    uint32_t start = millis();
+    int format = contentFormat(contentType);
+    size_t total = body.length();
+    uint16_t blockSize = COAP_BLOCK_SIZE;
+    bool blockwise = total > COAP_BLOCK_SIZE;
+    uint16_t token = nextToken++;
+    size_t offset = 0;
+    int result;
+    CoapMessage reply;
+
+    for (;;) {
+        uint8_t szx = 0;
+        while ((16u << szx) < blockSize) {
+            szx++;
+        }
+        size_t chunk = blockwise ? (total - offset < blockSize ? total - offset : blockSize) : total;
+        bool more = blockwise && offset + chunk < total;
+        uint16_t messageId = nextMessageId++;
+
+        CoapWriter writer;
+        writeHeader(writer, COAP_TYPE_CON, method, messageId, token);
+        writeUriPath(writer, path);
+        if (format >= 0) {
+            writeUintOption(writer, COAP_OPTION_CONTENT_FORMAT, format);
+        }
+        if (blockwise) {
+            writeUintOption(writer, COAP_OPTION_BLOCK1, (uint32_t)(offset / blockSize) << 4 | (more ? 0x08 : 0) | szx);
+            if (offset == 0) {
+                writeUintOption(writer, COAP_OPTION_SIZE1, total);
+            }
+        }
+        if (chunk > 0) {
+            writeByte(writer, COAP_PAYLOAD_MARKER);
+            writeBytes(writer, (const uint8_t*)body.c_str() + offset, chunk);
+        }
+        if (writer.overflow) {
+            result = COAP_ERROR_PROTOCOL;
+            break;
+        }
+        if (blockwise) {
+            portENTER_CRITICAL(&statsLock);
+            stats.blocks++;
+            portEXIT_CRITICAL(&statsLock);
+        }
+
+        result = exchange(server, writer.length, messageId, token, timeoutMs * 2, reply);
+        if (result < 0) {
+            break;
+        }
+        result = (reply.code >> 5) * 100 + (reply.code & 0x1F);
+        if (!more) {
+            break;
+        }
+        if (reply.code != COAP_CODE_CONTINUE) {
+            break; // The server ended the transfer early (e.g. 4.13 Request Entity Too Large)
+        }
+        offset += chunk;
+        if (reply.hasBlock1) {
+            uint16_t proposed = 16u << (reply.block1 & 0x07);
+            if (proposed < blockSize && offset % proposed == 0) {
+                blockSize = proposed; // Late negotiation: continue with the server's block size
+            }
+        }
+    }
+
+    if (result >= 0 && reply.payload != NULL) {
+        response.reserve(reply.payloadLength);
+        for (size_t i = 0; i < reply.payloadLength; i++) {
+            response += (char)reply.payload[i];
+        }
+    }
+    xSemaphoreGive(exchangeMutex);
+
+    uint32_t elapsedMs = millis() - start;
+    portENTER_CRITICAL(&statsLock);
+    if (result >= 0) {
+        stats.requests++;
+        exchangeSumMs += elapsedMs;
+        stats.exchangeMsAvg = exchangeSumMs / stats.requests;
+        if (elapsedMs > stats.exchangeMsMax) {
+            stats.exchangeMsMax = elapsedMs;
+        }
+    } else {
+        stats.failed++;
+    }
+    portEXIT_CRITICAL(&statsLock);
+    return result;
+}
+
+/**
+ * @brief Returns a description of a COAP_ERROR_* code.
+ * @param code The code.
+ * @return Printable description.
+ */
+String coapErrorToString(int code) {
+    switch (code) {
+        case COAP_ERROR_NOT_CONNECTED: return "not connected";
+        case COAP_ERROR_INVALID_URL: return "invalid URL";
+        case COAP_ERROR_TIMEOUT: return "no response";
+        case COAP_ERROR_RESET: return "reset by server";
+        case COAP_ERROR_PROTOCOL: return "message too large";
+        default: return String("CoAP error ") + code;
+    }
+}
+
+/**
+ * @brief Returns a snapshot of the CoAP counters.
+ * @return Copy of the current statistics.
+ */
+CoapStats coapGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    CoapStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    return snapshot;
+}
+
+#endif // WS_TRANSPORT_COAP
@@ -0,0 +1,81 @@
+/**
+ * @file coap_transport.h
+ * @brief Declarations for the CoAP-over-UDP uplink used by CoapTransport (WS_TRANSPORT_COAP).
+ *
+ * Requests are sent as confirmable (CON) messages to the host of the request
+ * URL on COAP_PORT, with the URL path as Uri-Path options. Every transmission
+ * that is not acknowledged is repeated after a timeout that starts at
+ * COAP_ACK_TIMEOUT_MS (randomized by up to 1.5x) and doubles each time, as in
+ * RFC 7252. Payloads larger than COAP_BLOCK_SIZE are sent block-wise with the
+ * Block1 option (RFC 7959); a smaller block size proposed by the server is
+ * adopted for the remaining blocks. Piggybacked and separate responses are
+ * both accepted.
+ *
+ * Only one exchange runs at a time (NSTART = 1), so callers on different
+ * tasks queue on a mutex.
+ */
+#ifndef COAP_TRANSPORT_H
+#define COAP_TRANSPORT_H
+
+#include "config.h"
+
+/** @brief CoAP request method codes (RFC 7252, 0.0x). */
+enum CoapMethod {
+  COAP_METHOD_GET = 1,
+  COAP_METHOD_POST = 2
+};
+
+// --- Error Codes (negative, like HTTPClient errors) ---
+constexpr int COAP_ERROR_NOT_CONNECTED = -1;
+constexpr int COAP_ERROR_INVALID_URL = -2;
+constexpr int COAP_ERROR_TIMEOUT = -3;
+constexpr int COAP_ERROR_RESET = -4;
+constexpr int COAP_ERROR_PROTOCOL = -5;
+
+/** @brief Counters of the CoAP uplink. */
+struct CoapStats {
+  uint32_t requests;         ///< Requests that received a response.
+  uint32_t failed;           ///< Requests that failed.
+  uint32_t messagesSent;     ///< CON messages sent, including retransmissions.
+  uint32_t retransmissions;  ///< Retransmitted CON messages.
+  uint32_t blocks;           ///< Block1 blocks sent (first transmissions).
+  uint32_t bytesSent;        ///< UDP payload bytes sent.
+  uint32_t bytesReceived;    ///< UDP payload bytes received.
+  uint32_t exchangeMsAvg;    ///< Average time from the first transmission to the final response [ms].
+  uint32_t exchangeMsMax;    ///< Maximum time from the first transmission to the final response [ms].
+};
+
+/**
+ * @brief Opens the UDP socket and creates the exchange lock.
+ * @note Must be called in setup() before any task sends a request.
+ * @return true on success.
+ */
+bool initCoapTransport();
+
+/**
+ * @brief Sends a confirmable request and waits for the final response.
+ * @param method COAP_METHOD_GET or COAP_METHOD_POST.
+ * @param url Request URL; its host and path are used, its scheme and port are ignored.
+ * @param contentType MIME type of the body (mapped to Content-Format), or NULL.
+ * @param body Request payload; sent block-wise if larger than COAP_BLOCK_SIZE.
+ * @param response Receives the payload of the response.
+ * @param timeoutMs Budget per message for transmissions, retransmissions and the response is twice this value.
+ * @return Response code as class * 100 + detail (e.g. 204 for 2.04 Changed), or a negative COAP_ERROR_* code.
+ */
+int coapRequest(CoapMethod method, const String& url, const char* contentType, const String& body,
+                String& response, uint32_t timeoutMs);
+
+/**
+ * @brief Returns a description of a COAP_ERROR_* code.
+ * @param code The code.
+ * @return Printable description.
+ */
+String coapErrorToString(int code);
+
+/**
+ * @brief Returns a snapshot of the CoAP counters.
+ * @return Copy of the current statistics.
+ */
+CoapStats coapGetStats();
+
+#endif // COAP_TRANSPORT_H
@@ -2,55 +2,116 @@
  * @file config.h
  * @brief Configuration settings and global variables for the ESP32 weather station project.
  *
- * This file defines constants for hardware pin assignments, sensor thresholds,
- * network configuration, API endpoints, NVS keys, device operational modes,
- * and extern declarations for global objects.
+ * This file defines the compile-time feature selection, constexpr constants for
+ * hardware pin assignments, sensor thresholds, network configuration, API endpoints,
+ * NVS keys, device operational modes, and extern declarations for global objects.
+ * All constants are constexpr so none of them needs a static initializer or heap
+ * memory at boot.
  */
 #ifndef CONFIG_H
 #define CONFIG_H
 
 #include <Arduino.h>
 #include <NeoPixelBusLg.h>
-#include <Adafruit_BME280.h>
-#include <WebServer.h>
 #include <Preferences.h>
 #include <NeoPixelBus.h>
+#include <atomic>
+
+// --- Compile-Time Feature Selection ---
+// Override with -D flags in platformio.ini (see the esp32-s3-minimal environment).
+// Disabled features are not compiled; their libraries can be excluded with lib_ignore.
+#ifndef WS_FEATURE_BME280
+#define WS_FEATURE_BME280 1      // BME280 temperature/humidity/pressure sensor
+#endif
+#ifndef WS_FEATURE_ARDUINOJSON
+#define WS_FEATURE_ARDUINOJSON 1 // ArduinoJson encoder (otherwise a snprintf encoder with the same JSON fields)
+#endif
+#ifndef WS_TRANSPORT_HTTP
+#define WS_TRANSPORT_HTTP 1      // HTTP uplink (otherwise payloads are written to the serial console)
+#endif
+#ifndef WS_TRANSPORT_MQTT
+#define WS_TRANSPORT_MQTT 0      // MQTT uplink over one persistent connection (takes precedence over WS_TRANSPORT_HTTP)
+#endif
+#ifndef WS_TRANSPORT_COAP
+#define WS_TRANSPORT_COAP 0      // CoAP over UDP with confirmable messages (takes precedence over WS_TRANSPORT_HTTP)
+#endif
+#ifndef WS_TRANSPORT_WEBSOCKET
+#define WS_TRANSPORT_WEBSOCKET 0 // One persistent WebSocket for uploads and pushed control (takes precedence over WS_TRANSPORT_HTTP)
+#endif
+#ifndef WS_TRANSPORT_HTTPS
+#define WS_TRANSPORT_HTTPS 0     // HTTPS over one kept-alive TLS connection with session resumption (takes precedence over WS_TRANSPORT_HTTP)
+#endif
+#ifndef WS_HTTPS_INSECURE
+#define WS_HTTPS_INSECURE 0      // HTTPS without server authentication when HTTPS_CA_CERT is empty (local test servers only)
+#endif
+#ifndef WS_FEATURE_PROTOBUF
+#define WS_FEATURE_PROTOBUF 0    // Protocol Buffers reports (nanopb) when the server accepts them, otherwise JSON
+#endif
+#ifndef WS_FEATURE_DEBUG_LOG
+#define WS_FEATURE_DEBUG_LOG 1   // Verbose per-cycle logging of readings and uploads
+#endif
+#ifndef WS_FEATURE_ALLOC_TRACE
+#define WS_FEATURE_ALLOC_TRACE 0 // Heap allocation tracer; needs the --wrap linker flags (see alloc_trace.h)
+#endif
+
+#if WS_FEATURE_BME280
+#include <Adafruit_BME280.h>
+#endif
+
+#if WS_FEATURE_PROTOBUF && (WS_TRANSPORT_MQTT || WS_TRANSPORT_WEBSOCKET || !(WS_TRANSPORT_HTTP || WS_TRANSPORT_HTTPS || WS_TRANSPORT_COAP))
+#error "WS_FEATURE_PROTOBUF needs a transport with a Content-Type (HTTP, HTTPS or CoAP)"
+#endif
+
+/** @brief constexpr view of the feature selection, for use in ordinary if statements. */
+namespace features {
+constexpr bool kBme280 = WS_FEATURE_BME280;
+constexpr bool kArduinoJson = WS_FEATURE_ARDUINOJSON;
+constexpr bool kHttpTransport = WS_TRANSPORT_HTTP;
+constexpr bool kMqttTransport = WS_TRANSPORT_MQTT;
+constexpr bool kCoapTransport = WS_TRANSPORT_COAP;
+constexpr bool kWebSocketTransport = WS_TRANSPORT_WEBSOCKET;
+constexpr bool kHttpsTransport = WS_TRANSPORT_HTTPS;
+constexpr bool kProtobuf = WS_FEATURE_PROTOBUF;
+constexpr bool kDebugLog = WS_FEATURE_DEBUG_LOG;
+constexpr bool kAllocTrace = WS_FEATURE_ALLOC_TRACE;
+}
+
+// Verbose logging; the branch and its format strings are removed when kDebugLog is false.
+#define DEBUG_PRINTF(...) do { if (features::kDebugLog) Serial.printf(__VA_ARGS__); } while (0)
+#define DEBUG_PRINTLN(x) do { if (features::kDebugLog) Serial.println(x); } while (0)
 
 // --- NeoPixel Configuration ---
-const uint16_t PixelCount = 1;
-const uint8_t PixelPin = 48;
+constexpr uint16_t PixelCount = 1;
+constexpr uint8_t PixelPin = 48;
 extern NeoPixelBus<NeoGrbFeature, NeoEsp32LcdX8Ws2812xMethod> strip;
-extern RgbColor red;
-extern RgbColor green;
-extern RgbColor black;
-extern RgbColor blue;
-extern RgbColor yellow;
 
 // --- Button Configuration ---
-const int BUTTON_PIN = 6;
+constexpr int BUTTON_PIN = 6;
 
 // --- WiFi Access Point Settings ---
 // Credentials for the ESP32's Access Point mode, used for initial device configuration.
-const char* const AP_SSID = "ESP32_Config_AP";
-const char* const AP_PASS = "12345678";
+constexpr const char* AP_SSID = "ESP32_Config_AP";
+constexpr const char* AP_PASS = "12345678";
 
 // --- Sensor Configuration ---
-#define I2C_SDA 8
-#define I2C_SCL 9
-#define I2C_ADDRESS 0x76 // I2C address for the BME280 sensor
+constexpr int I2C_SDA = 8;
+constexpr int I2C_SCL = 9;
+constexpr uint8_t I2C_ADDRESS = 0x76; // I2C address for the BME280 sensor
 
-#define PHOTORESISTOR_PIN 1
-const int DARK_THRESHOLD = 500;
-const int BRIGHT_THRESHOLD = 3000;
-extern bool bmeSensorOk; // Flag indicating if BME280 sensor initialized successfully.
+constexpr uint8_t PHOTORESISTOR_PIN = 1;
+constexpr int DARK_THRESHOLD = 500;
+constexpr int BRIGHT_THRESHOLD = 3000;
 
 /**
  * @brief Rain sensor analog pin and moisture thresholds.
  * @note These thresholds typically require calibration for optimal performance based on the specific sensor and environment.
  */
-#define RAIN_SENSOR_ANALOG_PIN 2
-const int WET_THRESHOLD = 500;  // Lower analog values indicate more moisture/rain.
-const int DRY_THRESHOLD = 4000; // Higher analog values indicate dry conditions.
+constexpr uint8_t RAIN_SENSOR_ANALOG_PIN = 2;
+constexpr int WET_THRESHOLD = 500;  // Lower analog values indicate more moisture/rain.
+constexpr int DRY_THRESHOLD = 4000; // Higher analog values indicate dry conditions.
+
+// GPIO pin for the wind sensor input. Ensure this is an unused GPIO.
+constexpr uint8_t WIND_SENSOR_PIN = 7;
 
 
 // --- API and Network Configuration ---
@@ -59,21 +120,129 @@ extern String wifiPass;
 extern String userName;
 extern String serverAddress;
 // API endpoint paths. Placeholders like <username> and <mac_address> are replaced dynamically.
-const String apiRegisterPath = "/<username>/add_device/<mac_address>";
-const String apiDataPath = "/<mac_plytki>/data"; // <mac_plytki> is placeholder for device MAC
+constexpr const char* apiRegisterPath = "/<username>/add_device/<mac_address>";
+constexpr const char* apiDataPath = "/<mac_plytki>/data"; // <mac_plytki> is placeholder for device MAC
+constexpr const char* apiAlertPath = "/<mac_plytki>/alert"; // Receives alerts on the priority lane
+constexpr const char* apiBackfillPath = "/<mac_plytki>/backfill"; // Receives stored samples requested by the server
+constexpr const char* apiWebSocketPath = "/<mac_plytki>/ws"; // WebSocket endpoint (WS_TRANSPORT_WEBSOCKET)
+constexpr const char* apiDiagnosticsPath = "/<mac_plytki>/diagnostics"; // Receives CPU profiles while diagnostics mode is on
+
+// --- Protocol Buffers Reports (WS_FEATURE_PROTOBUF) ---
+// Reports are sent as a telemetry.Batch (proto/telemetry.proto). A server that answers
+// 415 Unsupported Media Type gets JSON instead, and protobuf is offered again after PROTOBUF_REPROBE_MS.
+constexpr const char* PROTOBUF_CONTENT_TYPE = "application/x-protobuf";
+constexpr uint32_t PROTOBUF_REPROBE_MS = 60UL * 60 * 1000;
+
+// --- Fan-Out Destinations ---
+// Up to FANOUT_MAX_DESTINATIONS extra servers receive every sample besides serverAddress (see fanout.h).
+constexpr uint8_t FANOUT_MAX_DESTINATIONS = 3;
+constexpr uint8_t FANOUT_RING_SAMPLES = 64;           // Shared sample buffer; bounds the backlog of every destination
+constexpr uint8_t FANOUT_MAX_BATCH = 30;              // Samples per report
+constexpr uint8_t FANOUT_DEFAULT_QUEUE = 48;          // Backlog per destination unless set with queue=
+constexpr uint8_t FANOUT_DEFAULT_RETRIES = 3;         // Retries of a report unless set with retries=
+constexpr uint32_t FANOUT_RETRY_MIN_MS = 2000;        // First retry delay; doubled per failed attempt
+constexpr uint32_t FANOUT_RETRY_MAX_MS = 60000;
+
+// --- Local HTTP Server ---
+// One event-driven server (ESP-IDF esp_http_server) on port 80 serves the AP portal and the local APIs (see http_server.h).
+constexpr uint16_t WEB_MAX_CONNECTIONS = 7;           // Open sockets; the least recently used is closed for a new one
+constexpr uint16_t WEB_MAX_HANDLERS = 12;
+constexpr uint16_t WEB_SOCKET_TIMEOUT_S = 5;          // Receive/send timeout of a request in progress
+constexpr size_t WEB_MAX_FORM_BYTES = 1024;           // Larger request bodies are rejected with 413
+constexpr uint32_t WEB_BODY_TIMEOUT_MS = 2000;        // Slower request bodies (or a receive timeout) are rejected with 408
+constexpr size_t WEB_CHUNK_BYTES = 512;               // Files are sent in chunks of this size
+
+// --- Live Stream ---
+constexpr uint8_t LIVE_MAX_CLIENTS = 4;               // Concurrent /api/live viewers
+constexpr uint32_t LIVE_KEEPALIVE_MS = 15000;         // SSE comment sent when no sample was sent for this long
+
+// --- CPU Profiler ---
+// Per-task and per-core load from FreeRTOS run-time stats (esp_timer clock, 1 us), see cpu_profiler.h.
+constexpr uint32_t CPU_PROFILE_WINDOW_MS = 10000;     // Loads are averaged over windows of this length
+constexpr uint8_t CPU_PROFILE_MAX_TASKS = 32;         // Tasks beyond this are not profiled
+
+// --- Allocation Trace (WS_FEATURE_ALLOC_TRACE) ---
+constexpr uint32_t ALLOC_TRACE_REPORT_MS = 60000;     // Summary period in diagnostics mode
+
+// --- DNS Cache ---
+// Host names in serverAddress are resolved by the station itself, so the TTL of the answer is known.
+constexpr uint8_t DNS_CACHE_ENTRIES = 4;
+constexpr uint32_t DNS_TTL_MIN_S = 30;                 // Shorter TTLs are raised to this
+constexpr uint32_t DNS_TTL_MAX_S = 24UL * 60 * 60;     // Longer TTLs are cut to this
+constexpr uint32_t DNS_QUERY_TIMEOUT_MS = 2000;        // Per DNS server
+constexpr uint32_t DNS_RETRY_S = 30;                   // Refresh retry period while DNS is unreachable
+
+// --- Server Discovery ---
+// An empty serverAddress is replaced by an instance of _weather-ingest._tcp found with DNS-SD (see discovery.h).
+constexpr const char* DISCOVERY_SERVICE = "weather-ingest";  // DNS-SD service name without the leading '_'
+constexpr const char* DISCOVERY_PROTOCOL = "tcp";
+constexpr const char* DISCOVERY_HOSTNAME = "weather-station"; // mDNS host name while querying in STA mode
+constexpr uint8_t DISCOVERY_MAX_INSTANCES = 4;
+constexpr uint32_t DISCOVERY_PROBE_TIMEOUT_MS = 1000;         // TCP connect timeout when measuring an instance
+constexpr uint8_t DISCOVERY_FAILOVER_FAILURES = 2;            // Consecutive transport errors before switching instance
+constexpr uint32_t DISCOVERY_RETRY_MS = 30000;                // Query period while no instance is known
+
+// --- MQTT Configuration (WS_TRANSPORT_MQTT) ---
+// The broker is serverAddress (host or host:port) and userName is the MQTT user name.
+constexpr uint16_t MQTT_DEFAULT_PORT = 1883;
+constexpr const char* MQTT_TOPIC_PREFIX = "stations/"; // Topics are stations/<mac>/<data|alert|backfill|register|control|status>
+constexpr uint16_t MQTT_KEEPALIVE_S = 30;
+constexpr uint8_t MQTT_INFLIGHT_WINDOW = 4;            // QoS 1 publishes awaiting PUBACK at the same time (one per publishing task)
+
+// --- CoAP Configuration (WS_TRANSPORT_COAP) ---
+// Requests go to the host of serverAddress; its HTTP port is replaced by COAP_PORT.
+constexpr uint16_t COAP_PORT = 5683;
+constexpr uint16_t COAP_BLOCK_SIZE = 512;              // Block1 size for large payloads (16..1024, power of two)
+constexpr uint32_t COAP_ACK_TIMEOUT_MS = 2000;         // Initial retransmission timeout (RFC 7252 ACK_TIMEOUT)
+constexpr uint8_t COAP_MAX_RETRANSMIT = 4;
+
+// --- WebSocket Configuration (WS_TRANSPORT_WEBSOCKET) ---
+constexpr uint32_t WEBSOCKET_PING_INTERVAL_MS = 15000; // Ping sent when nothing was received for this long
+constexpr uint32_t WEBSOCKET_PONG_TIMEOUT_MS = 10000;  // Connection considered dead if the ping is not answered in time
+constexpr uint32_t WEBSOCKET_BACKOFF_MIN_MS = 1000;    // First reconnect delay; doubled per failed attempt
+constexpr uint32_t WEBSOCKET_BACKOFF_MAX_MS = 60000;
+
+// --- HTTPS Configuration (WS_TRANSPORT_HTTPS) ---
+// Requests go to the host and port of serverAddress (default port HTTPS_DEFAULT_PORT) over TLS.
+constexpr uint16_t HTTPS_DEFAULT_PORT = 443;
+constexpr size_t HTTPS_MAX_RESPONSE = 8192;              // Longer response bodies are truncated
+constexpr uint32_t HTTPS_HANDSHAKE_STACK = 4096;         // Extra stack of the tasks that may perform a TLS handshake
+// PEM root certificate that signed the server certificate. Required: without
+// it the HTTPS transport refuses every request, unless the build sets
+// WS_HTTPS_INSECURE=1 to connect without authenticating the server.
+constexpr const char* HTTPS_CA_CERT = "";
+
+// --- Alert Thresholds ---
+constexpr int RAIN_START_THRESHOLD = 30;           // Precipitation [%] at which rain is considered to start
+constexpr int RAIN_STOP_THRESHOLD = 10;            // Precipitation [%] below which rain is considered over (hysteresis)
+constexpr float GUST_THRESHOLD_MS = 17.2f;         // Single wind reading [m/s] reported as a gust (Beaufort 8)
+constexpr float PRESSURE_DROP_HPA = 6.0f;          // Fall of MSL pressure within PRESSURE_DROP_WINDOW_MS reported as an alert
+constexpr uint32_t PRESSURE_DROP_WINDOW_MS = 3UL * 60 * 60 * 1000; // 3 h pressure tendency
+constexpr uint32_t ALERT_COOLDOWN_MS = 10UL * 60 * 1000;           // Minimum time between two alerts of the same type
+constexpr size_t ALERT_RULES_MAX_LENGTH = 512;     // Longest server-defined rule source accepted (see rule_engine.h)
+
+// --- Time Synchronization ---
+constexpr const char* NTP_SERVER = "pool.ntp.org";
+constexpr uint32_t MIN_VALID_EPOCH = 1700000000; // Earlier clock values mean SNTP has not synchronized yet
 
 // --- Global Variables ---
-const long DATA_SEND_INTERVAL = 5000; // Interval in milliseconds for sending data.
-extern unsigned long lastDataSendTime;
+constexpr long DATA_SEND_INTERVAL = 5000; // Default interval in milliseconds for sending data (server may change it, see runtime_config.h).
+constexpr uint16_t WIND_SAMPLE_INTERVAL = 100; // Default interval in milliseconds between wind sensor readings.
+extern volatile bool diagnosticsMode; // Verbose runtime diagnostics, toggled with a double button press.
 
 // --- NVS Keys ---
 // Keys used for storing configuration in Non-Volatile Storage (NVS).
-const char* const NVS_NAMESPACE = "config";
-const char* const NVS_KEY_SSID = "wifi_ssid";
-const char* const NVS_KEY_PASS = "wifi_pass";
-const char* const NVS_KEY_USER = "username";
-const char* const NVS_KEY_SERVER = "server_addr";
-const char* const NVS_KEY_MODE = "device_mode";
+constexpr const char* NVS_NAMESPACE = "config";
+constexpr const char* NVS_KEY_SSID = "wifi_ssid";
+constexpr const char* NVS_KEY_PASS = "wifi_pass";
+constexpr const char* NVS_KEY_USER = "username";
+constexpr const char* NVS_KEY_SERVER = "server_addr";
+constexpr const char* NVS_KEY_MODE = "device_mode";
+constexpr const char* NVS_KEY_RUNTIME = "runtime_cfg"; // Server-controlled RuntimeConfig blob
+constexpr const char* NVS_KEY_RULES = "alert_rules";   // Server-defined alert rule source
+constexpr const char* NVS_KEY_DESTINATIONS = "destinations"; // Fan-out destinations (see fanout.h)
+constexpr const char* NVS_KEY_DISCOVERED = "disc_server"; // Last instance chosen by server discovery
+constexpr const char* NVS_KEY_SEQUENCE = "upload_seq"; // Upload sequence numbers below this may have been used
 
 // --- Device States ---
 /** @brief Defines the operational modes of the device. */
@@ -81,15 +250,14 @@ enum DeviceMode {
   MODE_UNCONFIGURED = 0, ///< Device requires initial WiFi and server configuration.
   MODE_CONFIGURED = 1    ///< Device is configured and operating in its normal data-logging mode.
 };
-extern DeviceMode currentDeviceMode;
+/** @brief Current mode; written by the supervisor, the portal and NVS loading, read by the uplink task. */
+extern std::atomic<DeviceMode> currentDeviceMode;
 
 // --- Global Objects (Extern Declarations) ---
+#if WS_FEATURE_BME280
 extern Adafruit_BME280 bme;
-extern WebServer server;
+#endif
 extern Preferences preferences;
 
-// GPIO pin for the wind sensor input. Ensure this is an unused GPIO.
-#define WIND_SENSOR_PIN 7
-
 
-#endif // CONFIG_H
\ No newline at end of file
+#endif // CONFIG_H
@@ -0,0 +1,205 @@
+/**
+ * @file cpu_profiler.cpp
+ * @brief Per-task and per-core CPU load from FreeRTOS run-time stats.
+ *
+ * The run-time counters are 32-bit microsecond counters, so they wrap after
+ * about 71 minutes; loads are computed from unsigned differences, which stay
+ * correct as long as a window is shorter than that. A task is matched to its
+ * previous counter by handle; a task created during the window is counted
+ * from zero.
+ */
+#include "cpu_profiler.h"
+#include "http_server.h"
+#include <esp_timer.h>
+#include <string.h>
+
+const uint32_t CPU_PROFILER_STACK = 3072;
+
+#if configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY
+static TaskStatus_t taskStatus[CPU_PROFILE_MAX_TASKS];            // Profiler task only
+static TaskHandle_t previousHandles[CPU_PROFILE_MAX_TASKS] = {};
+static uint32_t previousCounters[CPU_PROFILE_MAX_TASKS] = {};
+static UBaseType_t previousCount = 0;
+static uint32_t previousTotal = 0;
+static bool havePrevious = false;
+static CpuProfile working;                                        // Profiler task only
+#endif
+
+static CpuProfile latestProfile = {};
+static portMUX_TYPE profileLock = portMUX_INITIALIZER_UNLOCKED;
+
+#if configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY
+/**
+ * @brief Returns the counter a task had at the end of the previous window.
+ * @return The counter, 0 if the task did not exist then.
+ */
+static uint32_t previousCounter(TaskHandle_t handle) {
+    for (UBaseType_t i = 0; i < previousCount; i++) {
+        if (previousHandles[i] == handle) {
+            return previousCounters[i];
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads the counters of all tasks and, from the second call on, builds
+ * the profile of the window since the previous call.
+ * @return true if a new profile was built into working.
+ */
+static bool sampleTasks() {
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(taskStatus, CPU_PROFILE_MAX_TASKS, &total);
+    if (count == 0) { // More tasks than CPU_PROFILE_MAX_TASKS
+        portENTER_CRITICAL(&profileLock);
+        latestProfile.untracked++;
+        portEXIT_CRITICAL(&profileLock);
+        havePrevious = false;
+        return false;
+    }
+
+    uint32_t elapsed = total - previousTotal;
+    bool built = havePrevious && elapsed > 0;
+    if (built) {
+        uint32_t idle[portNUM_PROCESSORS] = {};
+        working.taskCount = 0;
+        for (UBaseType_t i = 0; i < count; i++) {
+            const TaskStatus_t& task = taskStatus[i];
+            uint32_t delta = task.ulRunTimeCounter - previousCounter(task.xHandle);
+            for (UBaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+                if (task.xHandle == xTaskGetIdleTaskHandleForCPU(core)) {
+                    idle[core] = delta;
+                }
+            }
+            // Insert ordered by load, highest first
+            uint16_t load = (uint16_t)((uint64_t)delta * 1000 / elapsed);
+            uint8_t position = working.taskCount;
+            while (position > 0 && working.tasks[position - 1].loadPermille < load) {
+                working.tasks[position] = working.tasks[position - 1];
+                position--;
+            }
+            CpuTaskLoad& entry = working.tasks[position];
+            strncpy(entry.name, task.pcTaskName, sizeof(entry.name) - 1);
+            entry.name[sizeof(entry.name) - 1] = '\0';
+            BaseType_t affinity = xTaskGetAffinity(task.xHandle);
+            entry.core = affinity == tskNO_AFFINITY ? -1 : (int8_t)affinity;
+            entry.loadPermille = load;
+            working.taskCount++;
+        }
+        for (UBaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+            uint32_t idlePermille = (uint32_t)((uint64_t)idle[core] * 1000 / elapsed);
+            working.coreLoadPermille[core] = idlePermille >= 1000 ? 0 : (uint16_t)(1000 - idlePermille);
+        }
+        working.windowMs = elapsed / 1000;
+    }
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        previousHandles[i] = taskStatus[i].xHandle;
+        previousCounters[i] = taskStatus[i].ulRunTimeCounter;
+    }
+    previousCount = count;
+    previousTotal = total;
+    havePrevious = true;
+    return built;
+}
+#endif
+
+// --- FreeRTOS Task: CPU Profiler ---
+
+/**
+ * @brief FreeRTOS task sampling the run-time counters every CPU_PROFILE_WINDOW_MS.
+ * The sampling cost is measured with esp_timer and published with the profile.
+ * @param pvParameters Unused.
+ */
+static void cpuProfilerTask(void* pvParameters) {
+#if configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;) {
+        int64_t startUs = esp_timer_get_time();
+        bool built = sampleTasks();
+        uint32_t sampleUs = (uint32_t)(esp_timer_get_time() - startUs);
+        if (built) {
+            working.available = true;
+            working.sampleUs = sampleUs;
+            working.overheadPpm = working.windowMs > 0 ? (uint32_t)((uint64_t)sampleUs * 1000 / working.windowMs) : 0;
+            portENTER_CRITICAL(&profileLock);
+            working.windows = latestProfile.windows + 1;
+            working.untracked = latestProfile.untracked;
+            latestProfile = working;
+            portEXIT_CRITICAL(&profileLock);
+        }
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(CPU_PROFILE_WINDOW_MS));
+    }
+#else
+    Serial.println("CPU profiler: FreeRTOS run-time stats are disabled in this build (CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS).");
+    vTaskDelete(NULL);
+#endif
+}
+
+// --- Handlers ---
+
+/**
+ * @brief GET /api/cpu: the profile of the last complete window (503 before the first one).
+ */
+static esp_err_t handleCpu(httpd_req_t* request) {
+    CpuProfile snapshot;
+    cpuProfileGet(snapshot);
+    if (!snapshot.available) {
+        httpd_resp_set_status(request, "503 Service Unavailable");
+        return httpd_resp_send(request, "No CPU profile yet.", HTTPD_RESP_USE_STRLEN);
+    }
+    String body;
+    encodeCpuProfile(snapshot, body);
+    httpd_resp_set_type(request, "application/json");
+    return httpd_resp_send(request, body.c_str(), body.length());
+}
+
+// --- Public API ---
+
+/**
+ * @brief Registers GET /api/cpu and starts the profiler task.
+ * @return true on success.
+ */
+bool startCpuProfiler() {
+    if (!httpServerOn("/api/cpu", HTTP_GET, handleCpu)) {
+        return false;
+    }
+    return xTaskCreatePinnedToCore(cpuProfilerTask, "CpuProfiler", CPU_PROFILER_STACK, NULL, 1, NULL, APP_CPU_NUM) == pdPASS;
+}
+
+/**
+ * @brief Returns a copy of the profile of the last complete window.
+ * @param profile Receives the profile.
+ */
+void cpuProfileGet(CpuProfile& profile) {
+    portENTER_CRITICAL(&profileLock);
+    profile = latestProfile;
+    portEXIT_CRITICAL(&profileLock);
+}
+
+/**
+ * @brief Encodes a profile as JSON; loads are percentages with one decimal.
+ * @param profile The profile.
+ * @param json Receives the JSON text.
+ */
+void encodeCpuProfile(const CpuProfile& profile, String& json) {
+    char buffer[64];
+    json = "";
+    json.reserve(96 + profile.taskCount * 48);
+    snprintf(buffer, sizeof(buffer), "{\"window_ms\":%lu,\"cores\":[", (unsigned long)profile.windowMs);
+    json += buffer;
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        snprintf(buffer, sizeof(buffer), "%s%u.%u", core > 0 ? "," : "",
+                 profile.coreLoadPermille[core] / 10, profile.coreLoadPermille[core] % 10);
+        json += buffer;
+    }
+    json += "],\"tasks\":[";
+    for (uint8_t i = 0; i < profile.taskCount; i++) {
+        const CpuTaskLoad& task = profile.tasks[i];
+        snprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"core\":%d,\"load\":%u.%u}", i > 0 ? "," : "",
+                 task.name, task.core, task.loadPermille / 10, task.loadPermille % 10);
+        json += buffer;
+    }
+    snprintf(buffer, sizeof(buffer), "],\"overhead_ppm\":%lu}", (unsigned long)profile.overheadPpm);
+    json += buffer;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file cpu_profiler.h
+ * @brief Declarations for the per-task and per-core CPU profiler.
+ *
+ * Every CPU_PROFILE_WINDOW_MS the profiler task reads the FreeRTOS run-time
+ * counters of all tasks (uxTaskGetSystemState(), clocked by esp_timer at
+ * 1 us) and turns the increase since the previous window into loads: a task's
+ * load is its share of one core, a core's load is 100 % minus the share of
+ * its idle task. The profile of the last complete window is printed in
+ * diagnostics mode, served as JSON at GET /api/cpu and uploaded by the uplink
+ * to the diagnostics endpoint while diagnostics mode is on.
+ *
+ * The counters are kept by the kernel on every context switch whether or not
+ * the profiler runs; the profiler itself costs one system state read per
+ * window, whose duration is reported as overheadPpm.
+ *
+ * Requires CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS; without it the profile
+ * stays unavailable.
+ */
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/** @brief Load of one task in a window. */
+struct CpuTaskLoad {
+  char name[configMAX_TASK_NAME_LEN];
+  int8_t core;              ///< Core the task is pinned to, -1 if it may run on either.
+  uint16_t loadPermille;    ///< Share of one core [0.1 %].
+};
+
+/** @brief Profile of the last complete window. */
+struct CpuProfile {
+  bool available;           ///< false until the first window has completed or without run-time stats.
+  uint32_t windows;         ///< Completed windows; changes with every new profile.
+  uint32_t windowMs;        ///< Measured length of the window.
+  uint16_t coreLoadPermille[portNUM_PROCESSORS]; ///< Busy share of each core [0.1 %].
+  uint8_t taskCount;
+  CpuTaskLoad tasks[CPU_PROFILE_MAX_TASKS];      ///< Ordered by load, highest first.
+  uint32_t sampleUs;        ///< Duration of the last system state read and evaluation.
+  uint32_t overheadPpm;     ///< sampleUs relative to the window [parts per million].
+  uint32_t untracked;       ///< Windows skipped because more than CPU_PROFILE_MAX_TASKS tasks existed.
+};
+
+/**
+ * @brief Registers GET /api/cpu and starts the profiler task.
+ * @note Call from setup(), before the supervisor starts the HTTP server.
+ * @return true on success.
+ */
+bool startCpuProfiler();
+
+/**
+ * @brief Returns a copy of the profile of the last complete window.
+ * @param profile Receives the profile.
+ */
+void cpuProfileGet(CpuProfile& profile);
+
+/**
+ * @brief Encodes a profile as JSON: {"window_ms":..,"cores":[..],"tasks":[{"name":..,"core":..,"load":..}],"overhead_ppm":..}.
+ * Loads are percentages with one decimal.
+ * @param profile The profile.
+ * @param json Receives the JSON text.
+ */
+void encodeCpuProfile(const CpuProfile& profile, String& json);
+
+#endif // CPU_PROFILER_H
@@ -1,26 +1,33 @@
 /**
  * @file data_sender.cpp
- * @brief Handles sensor data acquisition, processing, and transmission to a remote server.
+ * @brief Handles sensor data acquisition and processing.
  *
- * This file includes functions for initializing sensors (BME280),
- * calculating derived meteorological values (e.g., pressure reduced to mean sea level),
- * and FreeRTOS tasks for periodically reading sensor data (temperature, humidity,
- * pressure, light, wind, rain) and sending it as JSON to a configured API endpoint.
- * It also includes a function for device registration by sending its MAC address.
+ * This file includes functions for calculating derived meteorological values
+ * (e.g., pressure reduced to mean sea level) and FreeRTOS tasks for periodically reading sensor data (temperature, humidity,
+ * pressure, light, wind, rain) and publishing it as a sample on the event bus,
+ * from where the uplink and any other consumer pick it up. Environmental sensors
+ * are initialized and read through the sensor set policy (see station_policies.h).
  */
 #include "data_sender.h"
 #include "config.h"         
 #include "utils.h"         
-#include <Adafruit_Sensor.h>
+#include "event_bus.h"
+#include "station_policies.h"
+#include "alloc_trace.h"
+#include "latest_sample.h"
+#include "runtime_config.h"
+#include "alerts.h"
 #include <WiFi.h>
-#include <HTTPClient.h>
-#include <ArduinoJson.h>
+#include <time.h>
 #include <freertos/FreeRTOS.h> 
 #include <freertos/task.h>    
 
 
 // --- Global Objects ---
+#if WS_FEATURE_BME280
 Adafruit_BME280 bme; 
+#endif
+static bool bmeSensorOk = false; // Flag indicating if the environmental sensors initialized successfully.
 
 // --- Physical Constants for Meteorological Calculations ---
 const double G_CONST = 9.80665;              // Standard gravity [m/s^2]
@@ -54,61 +61,17 @@ double reduceToMSL(double station_pressure_hpa, double station_temperature_c, do
     return pressure_msl_hpa;
 }
 
-// --- Sensor Initialization ---
-
-/**
- * @brief Initializes the BME280 sensor object.
- * @note Assumes Wire.begin() has ALREADY been called globally (e.g., in setup()).
- * This function should now only be called once at the start of the sensor task.
- * @return true if initialization was successful, false otherwise.
- */
-bool initBME280() {
-    if (!bme.begin(I2C_ADDRESS)) {
-        Serial.println("!!! BME280 init failed!");
-        return false;
-    } else {
-        Serial.println("BME280 init successful.");
-        return true;
-    }
-}
-
-// --- Data Transmission: Device Registration ---
-
-/**
- * @brief Sends the device's MAC address to the registration API endpoint.
- * This is typically called once after a successful Wi-Fi connection in configured mode
- * to register the device with the backend server.
- */
-void sendMacAddress() {
-    if (WiFi.status() != WL_CONNECTED) { return; }
-    WiFiClient client; HTTPClient http; String macAddress = WiFi.macAddress();
-    String constructedEndpoint = "http://" + serverAddress + apiRegisterPath;
-    constructedEndpoint.replace("<username>", userName); constructedEndpoint.replace("<mac_address>", macAddress);
-    Serial.printf("Sending MAC to registration endpoint: %s\n", constructedEndpoint.c_str());
-    http.begin(client, constructedEndpoint); http.setConnectTimeout(5000); http.setTimeout(5000);
-    int httpResponseCode = http.GET();
-    if (httpResponseCode > 0) {
-        Serial.printf("Registration server response: %d\n", httpResponseCode); String response = http.getString();
-        Serial.println("Response:"); Serial.println(response);
-        if (httpResponseCode == 200 || httpResponseCode == 201) { blinkLedInfo(green, 2, green); } else { blinkLedError(green); }
-    } else {
-        Serial.printf("HTTP error during registration: %s\n", http.errorToString(httpResponseCode).c_str()); blinkLedError(green);
-    }
-    http.end();
-
-    vTaskDelay(pdMS_TO_TICKS(20));
-}
-
 // --- FreeRTOS Task: Wind Sensor Data Acquisition ---
 
 volatile float totalWindSpeedSum = 0.0; // Sum of wind speed readings for averaging
 volatile int windReadingCount = 0;      // Number of wind speed readings taken
+volatile float maxWindSpeedms = 0.0;    // Strongest reading since the last sample (gust)
 SemaphoreHandle_t windDataMutex;        // Mutex to protect shared wind data
 
 /**
  * @brief FreeRTOS task function to periodically read wind speed from an analog sensor.
  * It accumulates readings and counts them for averaging by the main sensor task.
- * Uses a mutex to protect shared data (totalWindSpeedSum, windReadingCount).
+ * Uses a mutex to protect shared data (totalWindSpeedSum, windReadingCount, maxWindSpeedms).
  * @param pvParameters Standard FreeRTOS task parameters (unused).
  */
 void windSensorTaskFunction(void *pvParameters) {
@@ -123,140 +86,168 @@ void windSensorTaskFunction(void *pvParameters) {
         // Map analog reading (0-1023 assumed) to wind speed (0-32.40 m/s)
         // Adjust mapping if ADC resolution or sensor output range differs.
         float currentWindSpeedms = constrain(map((long)windSpeedAnalog, 0, 1023, 0, 3240), 0L, 3240L) / 100.0F;
+        checkGustAlert(currentWindSpeedms);
 
         if (xSemaphoreTake(windDataMutex, portMAX_DELAY) == pdTRUE) {
             totalWindSpeedSum += currentWindSpeedms;
             windReadingCount++;
+            if (currentWindSpeedms > maxWindSpeedms) {
+                maxWindSpeedms = currentWindSpeedms;
+            }
             xSemaphoreGive(windDataMutex);
         } else {
             Serial.println("Wind Sensor Task: Could not take windDataMutex!");
         }
-        vTaskDelay(pdMS_TO_TICKS(100)); 
+        vTaskDelay(pdMS_TO_TICKS(getRuntimeConfig().windPeriodMs)); 
+    }
+}
+
+// --- FreeRTOS Task: Main Sensor Data Acquisition ---
+
+static TaskHandle_t sensorTaskHandle = NULL; // Notified to force an immediate send or a reschedule
+
+/**
+ * @brief Returns the smallest free stack the sensor task has had so far.
+ * @return Free stack in bytes, 0 before the task has started.
+ */
+uint32_t sensorTaskStackFree() {
+    return sensorTaskHandle != NULL ? (uint32_t)uxTaskGetStackHighWaterMark(sensorTaskHandle) : 0;
+}
+
+// Notification bits of the sensor task
+const uint32_t NOTIFY_SEND_NOW = 0x01;   // Start the next cycle immediately
+const uint32_t NOTIFY_RESCHEDULE = 0x02; // Sample period changed, recompute the wait
+
+/**
+ * @brief Wakes the sensor task so it reads and sends data immediately.
+ * Has no effect before the sensor task has started.
+ */
+void requestImmediateSend() {
+    if (sensorTaskHandle != NULL) {
+        xTaskNotify(sensorTaskHandle, NOTIFY_SEND_NOW, eSetBits);
     }
 }
 
-// --- FreeRTOS Task: Main Sensor Data Acquisition and Transmission ---
+/**
+ * @brief Makes the sensor task recompute its current wait with the active sample period.
+ * Has no effect before the sensor task has started.
+ */
+void rescheduleSampling() {
+    if (sensorTaskHandle != NULL) {
+        xTaskNotify(sensorTaskHandle, NOTIFY_RESCHEDULE, eSetBits);
+    }
+}
+
+/**
+ * @brief Waits until the sample period has elapsed since the start of the cycle.
+ * A reschedule notification restarts the wait with the new period measured
+ * from the same cycle start, so a shorter period takes effect at once.
+ * @param cycleStartMs millis() at the start of the current cycle.
+ */
+static void waitForNextCycle(uint32_t cycleStartMs) {
+    for (;;) {
+        uint32_t periodMs = getRuntimeConfig().samplePeriodMs;
+        uint32_t elapsedMs = millis() - cycleStartMs;
+        if (elapsedMs >= periodMs) {
+            return;
+        }
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, NOTIFY_SEND_NOW | NOTIFY_RESCHEDULE, &bits, pdMS_TO_TICKS(periodMs - elapsedMs));
+        if (bits & NOTIFY_SEND_NOW) {
+            return;
+        }
+    }
+}
 
 /**
  * @brief FreeRTOS task function to periodically read sensor data
- * (BME280, photoresistor, rain sensor), retrieve averaged wind speed,
- * create a JSON payload, and send it to the API data endpoint.
+ * (BME280, photoresistor, rain sensor) and the averaged wind speed,
+ * and publish them as a WeatherSample on the event bus (TOPIC_SAMPLE).
+ * Transmission is handled by subscribers (see uplink.cpp).
  * Initializes BME280 once at the start.
- * Uses vTaskDelay for periodic execution based on DATA_SEND_INTERVAL.
+ * Waits the runtime sample period between cycles, or less when woken by requestImmediateSend().
  * @param pvParameters Standard FreeRTOS task parameters (unused).
  */
 void sensorTaskFunction(void *pvParameters) {
-    Serial.println("Sensor Task started. Initializing BME280...");
-    bmeSensorOk = initBME280(); 
+    Serial.println("Sensor Task started. Initializing environmental sensors...");
+    sensorTaskHandle = xTaskGetCurrentTaskHandle();
+    bmeSensorOk = ActiveStation::SensorSet::begin(); 
     if (!bmeSensorOk) {
-        Serial.println("Sensor Task: BME280 initialization failed. Task will run but skip BME readings.");
+        Serial.println("Sensor Task: No environmental sensor available. Task will run but skip temperature/pressure/humidity.");
     } else {
-        Serial.println("Sensor Task: BME280 initialized successfully.");
+        Serial.println("Sensor Task: Environmental sensors initialized successfully.");
     }
 
     Serial.println("Sensor Task entering main loop.");
     for (;;) {
-        if (currentDeviceMode == MODE_CONFIGURED && WiFi.status() == WL_CONNECTED) {
-            WiFiClient client;
-            HTTPClient http;
-            String macAddress = WiFi.macAddress();
+        ALLOC_TRACE_SCOPE("sensorTask");
+        uint32_t cycleStartMs = millis();
+        float temp = NAN, pressure = NAN, humidity = NAN;
+        int analogValue = -1;
+        int brightnessPercentage = -1;
 
-            float temp = NAN, pressure = NAN, humidity = NAN;
-            int analogValue = -1;
-            int brightnessPercentage = -1;
-            
-            int rawRainAnalog = analogRead(RAIN_SENSOR_ANALOG_PIN);
-            int precipitationPercentage = map(rawRainAnalog, WET_THRESHOLD, DRY_THRESHOLD, 100, 0);
-            precipitationPercentage = constrain(precipitationPercentage, 0, 100);
+        int rawRainAnalog = analogRead(RAIN_SENSOR_ANALOG_PIN);
+        int precipitationPercentage = map(rawRainAnalog, WET_THRESHOLD, DRY_THRESHOLD, 100, 0);
+        precipitationPercentage = constrain(precipitationPercentage, 0, 100);
 
-            float averageWindSpeed = 0.0;
+        float averageWindSpeed = 0.0;
+        float windGust = NAN;
 
-            // Safely read and reset wind data using mutex
-            if (xSemaphoreTake(windDataMutex, portMAX_DELAY) == pdTRUE) {
-                if (windReadingCount > 0) {
-                    averageWindSpeed = totalWindSpeedSum / windReadingCount;
-                } else {
-                    averageWindSpeed = 0.0; 
-                }
-                totalWindSpeedSum = 0.0; 
-                windReadingCount = 0;   
-                xSemaphoreGive(windDataMutex);
-                Serial.printf("Sensor Task: Calculated Average Wind Speed: %.2f m/s\n", averageWindSpeed);
+        // Safely read and reset wind data using mutex
+        if (xSemaphoreTake(windDataMutex, portMAX_DELAY) == pdTRUE) {
+            if (windReadingCount > 0) {
+                averageWindSpeed = totalWindSpeedSum / windReadingCount;
+                windGust = maxWindSpeedms;
             } else {
-                Serial.println("Sensor Task: Could not take windDataMutex! Using 0 for wind speed.");
                 averageWindSpeed = 0.0; 
             }
-        
-            // Read BME280 sensor data if initialized
-            if (bmeSensorOk) {
-                temp = bme.readTemperature(); 
-                pressure = bme.readPressure() / 100.0F; 
-                humidity = bme.readHumidity() / 100.0F;
-                Serial.printf("Sensor Task: BME280 Reading: Temp=%.2f*C, Press=%.2f hPa, Hum=%.2f (0-1 scale)\n", temp, pressure, humidity);
-            } else {
-                Serial.println("Sensor Task: Skipping BME280 reading - sensor not initialized.");
-            }
-
-            // Read photoresistor data
-            analogValue = analogRead(PHOTORESISTOR_PIN);
-            brightnessPercentage = constrain(map(analogValue, BRIGHT_THRESHOLD, DARK_THRESHOLD, 100, 0), 0, 100);
-            Serial.printf("Sensor Task: Photoresistor Reading: ADC=%d, Brightness=%d%%\n", analogValue, brightnessPercentage);
-
-            // Prepare JSON payload
-            StaticJsonDocument<512> jsonDocument; 
-            if (!isnan(temp)) jsonDocument["temperature"] = round(temp * 100.0) / 100.0;
-            
-            double normalized_pressure = reduceToMSL(pressure, temp, STATION_ALTITUDE_METERS);            
-            if (!isnan(normalized_pressure)) jsonDocument["pressure"]  = round(normalized_pressure * 100.0) / 100.0;
-            else if (!isnan(pressure)) jsonDocument["pressure"] = round(pressure * 100.0) / 100.0; 
-
-            if (!isnan(humidity)) jsonDocument["humidity"] = round(humidity * 10000.0) / 10000.0; 
-            if (analogValue != -1) jsonDocument["sunshine"] = brightnessPercentage; else jsonDocument["sunshine"] = nullptr;
-            
-            jsonDocument["wind_speed"] = (round(averageWindSpeed * 3.6 * 100.0) / 100.0); 
-            jsonDocument["precipitation"] = (round(precipitationPercentage * 10000.0)) / 10000.0; 
-            
-            String jsonData;
-            serializeJson(jsonDocument, jsonData);
-
-            // Construct API endpoint and send data
-            String constructedEndpoint = "http://" + serverAddress + apiDataPath;
-            String macForPath = macAddress; 
-            constructedEndpoint.replace("<mac_plytki>", macForPath);
-
-            Serial.print("Sensor Task: Sending JSON to data endpoint: ");
-            Serial.print(constructedEndpoint);
-            Serial.print(", Data: ");
-            Serial.println(jsonData);
+            totalWindSpeedSum = 0.0; 
+            windReadingCount = 0;   
+            maxWindSpeedms = 0.0;
+            xSemaphoreGive(windDataMutex);
+            DEBUG_PRINTF("Sensor Task: Calculated Average Wind Speed: %.2f m/s\n", averageWindSpeed);
+        } else {
+            Serial.println("Sensor Task: Could not take windDataMutex! Using 0 for wind speed.");
+            averageWindSpeed = 0.0; 
+        }
 
-            http.begin(client, constructedEndpoint);
-            http.addHeader("Content-Type", "application/json");
-            http.setConnectTimeout(5000);
-            http.setTimeout(5000);
-            int httpResponseCode = http.POST(jsonData);
+        // Read temperature, pressure and humidity if the sensor set provides them
+        if (bmeSensorOk && ActiveStation::SensorSet::read(temp, pressure, humidity)) {
+            DEBUG_PRINTF("Sensor Task: BME280 Reading: Temp=%.2f*C, Press=%.2f hPa, Hum=%.2f (0-1 scale)\n", temp, pressure, humidity);
+        } else {
+            DEBUG_PRINTLN("Sensor Task: Skipping BME280 reading - sensor not initialized.");
+        }
 
-            if (httpResponseCode > 0) {
-                Serial.printf("Sensor Task: Data server response: %d\n", httpResponseCode);
-                String response = http.getString();
-                Serial.println("Sensor Task: Response:");
-                Serial.println(response);
-                if (httpResponseCode >= 200 && httpResponseCode < 300 && WiFi.status() == WL_CONNECTED) {
-                    setLedColor(green); 
-                } else if (WiFi.status() == WL_CONNECTED) {
-                    blinkLedError(green); 
-                }
-            } else {
-                Serial.printf("Sensor Task: HTTP error during data sending: %s\n", http.errorToString(httpResponseCode).c_str());
-                if (WiFi.status() == WL_CONNECTED) {
-                    blinkLedError(green); 
-                } else {
-                    blinkLedError(black); 
-                }
-            }
-            http.end();
+        // Read photoresistor data
+        analogValue = analogRead(PHOTORESISTOR_PIN);
+        brightnessPercentage = constrain(map(analogValue, BRIGHT_THRESHOLD, DARK_THRESHOLD, 100, 0), 0, 100);
+        DEBUG_PRINTF("Sensor Task: Photoresistor Reading: ADC=%d, Brightness=%d%%\n", analogValue, brightnessPercentage);
+
+        // Quantized once here; consumers work on the scaled integers
+        WeatherSample sample;
+        sample.timestampMs = millis();
+        time_t now = time(NULL);
+        sample.epochS = now >= (time_t)MIN_VALID_EPOCH ? (uint32_t)now : 0;
+        sample.temperature = quantizeField(temp, TEMPERATURE_SCALE);
+        double normalizedPressure = reduceToMSL(pressure, temp, STATION_ALTITUDE_METERS);
+        sample.pressure = quantizeField(!isnan(normalizedPressure) ? (float)normalizedPressure : pressure, PRESSURE_SCALE);
+        sample.humidity = quantizeField(humidity, HUMIDITY_SCALE);
+        sample.sunshine = analogValue != -1 ? brightnessPercentage : SAMPLE_MISSING;
+        sample.windSpeed = quantizeField(averageWindSpeed, WIND_SCALE);
+        sample.precipitation = precipitationPercentage;
+        sample.windGust = quantizeField(windGust, WIND_SCALE);
+        sample.seq = 0;
+
+        // Latest-sample snapshot first, so bus subscribers woken below already find this sample there
+        latestSamplePublish(sample);
+        BusMessage* message = eventBusAcquire(TOPIC_SAMPLE);
+        if (message != NULL) {
+            message->data.sample = sample;
+            eventBusPublish(message);
         } else {
-            Serial.println("Sensor Task: Skipping data send (not configured or not connected to WiFi).");
+            Serial.println("Sensor Task: Event bus pool exhausted, sample dropped.");
         }
-        vTaskDelay(pdMS_TO_TICKS(DATA_SEND_INTERVAL)); 
+
+        waitForNextCycle(cycleStartMs);
     }
 }
\ No newline at end of file
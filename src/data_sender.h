@@ -1,24 +1,16 @@
 /**
  * @file data_sender.h
- * @brief Function declarations for sensor initialization, data processing, and network communication tasks.
+ * @brief Function declarations for sensor data processing and acquisition tasks.
  *
- * This header file declares functions related to initializing the BME280 sensor,
- * calculating meteorological values like Mean Sea Level pressure, sending device
- * registration information, and the main FreeRTOS tasks for collecting and
- * transmitting sensor data (environmental and wind).
+ * This header file declares functions for calculating meteorological values
+ * like Mean Sea Level pressure, and the main FreeRTOS tasks for collecting
+ * sensor data (environmental and wind) and publishing it on the event bus.
  */
 #ifndef DATA_SENDER_H
 #define DATA_SENDER_H
 
 #include "config.h"
 
-/**
- * @brief Initializes the BME280 sensor object.
- * @note In this version, it might contain Wire.begin() and be called repeatedly.
- * @return true if initialization was successful, false otherwise.
- */
-bool initBME280();
-
 /**
  * @brief Reduces station pressure to Mean Sea Level (MSL) pressure.
  * @param station_pressure_hpa Measured pressure at the station in hectopascals (hPa).
@@ -28,20 +20,32 @@ bool initBME280();
  */
 double reduceToMSL(double station_pressure_hpa, double station_temperature_c, double station_altitude_m);
 
-/**
- * @brief Sends the device's MAC address to the API registration endpoint.
- * @note Works only in STA mode and when WiFi is connected.
- */
-void sendMacAddress();
-
 /**
  * @brief FreeRTOS task function to periodically read environmental sensor data
- * (BME280, photoresistor, rain), create a JSON payload, and send it to the API data endpoint.
- * Handles HTTP errors and potentially updates LED status.
+ * (BME280, photoresistor, rain) and the averaged wind speed and publish them
+ * as a WeatherSample on the event bus (TOPIC_SAMPLE).
  * @param pvParameters Standard FreeRTOS task parameters (unused).
  */
 void sensorTaskFunction(void *pvParameters); // <<< RENAMED/CHANGED
 
+/**
+ * @brief Returns the smallest free stack the sensor task has had so far.
+ * @return Free stack in bytes, 0 before the task has started.
+ */
+uint32_t sensorTaskStackFree();
+
+/**
+ * @brief Wakes the sensor task so it reads and sends data immediately
+ * instead of waiting for the rest of the sample period.
+ */
+void requestImmediateSend();
+
+/**
+ * @brief Makes the sensor task recompute its current wait after the sample
+ * period of the runtime configuration changed.
+ */
+void rescheduleSampling();
+
 /**
  * @brief FreeRTOS task function to periodically read wind sensor data.
  * This task typically reads the wind sensor at a higher frequency and makes
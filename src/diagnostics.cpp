@@ -0,0 +1,247 @@
+/**
+ * @file diagnostics.cpp
+ * @brief Diagnostics task printing the runtime counters of all components.
+ *
+ * The task is woken by a TOPIC_SAMPLE callback while diagnosticsMode is on
+ * and prints one block of counters per sample. The encoder benchmark and the
+ * allocation trace report run here as well, so their stack use and duration
+ * neither count against the sensor task stack nor shift the sample timing.
+ */
+#include "diagnostics.h"
+#include "data_sender.h"
+#include "event_bus.h"
+#include "sample_store.h"
+#include "backfill.h"
+#include "uplink.h"
+#include "fanout.h"
+#include "live_stream.h"
+#include "http_server.h"
+#include "cpu_profiler.h"
+#include "alloc_trace.h"
+#include "latest_sample.h"
+#include "runtime_config.h"
+#include "alerts.h"
+#include "downsampler.h"
+#include "dns_cache.h"
+#include "discovery.h"
+#if WS_TRANSPORT_MQTT
+#include "mqtt_transport.h"
+#endif
+#if WS_TRANSPORT_COAP
+#include "coap_transport.h"
+#endif
+#if WS_TRANSPORT_WEBSOCKET
+#include "websocket_transport.h"
+#endif
+#if WS_TRANSPORT_HTTPS
+#include "https_transport.h"
+#endif
+#if WS_FEATURE_PROTOBUF
+#include "protobuf_encoder.h"
+#endif
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+const uint32_t DIAGNOSTICS_STACK = 8192; // The sensor task stack this work used to run on
+
+static TaskHandle_t diagnosticsTask = NULL;
+
+#if WS_FEATURE_ALLOC_TRACE
+/**
+ * @brief Writes one line of the allocation trace report to the serial console.
+ */
+static void printTraceLine(const char* line) {
+    Serial.println(line);
+}
+#endif
+
+/**
+ * @brief Prints runtime diagnostics (heap, RSSI, stack headroom, uptime, event bus,
+ * sample store, backfill, alert lane and live upload counters, CPU profile, and
+ * once per ALLOC_TRACE_REPORT_MS the allocation trace summary if it is built in).
+ * Called by the diagnostics task after every sample while diagnosticsMode is enabled.
+ */
+static void printDiagnostics() {
+    EventBusStats bus = eventBusGetStats();
+    Serial.printf("Diagnostics: uptime=%lu s, free heap=%u B, min free heap=%u B, largest block=%u B, RSSI=%d dBm, stack free sensor/diagnostics=%u/%u B\n",
+                  millis() / 1000, (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(),
+                  (unsigned)ESP.getMaxAllocHeap(), (int)WiFi.RSSI(),
+                  (unsigned)sensorTaskStackFree(), (unsigned)uxTaskGetStackHighWaterMark(NULL));
+    Serial.printf("Diagnostics: event bus published=%u, pool in use=%u, pool exhausted=%u, queue overflows=%u, publish cycles last/max=%u/%u, dispatch latency avg/max=%u/%u us\n",
+                  (unsigned)bus.published, (unsigned)bus.poolInUse, (unsigned)bus.poolExhausted, (unsigned)bus.queueOverflows,
+                  (unsigned)bus.publishCyclesLast, (unsigned)bus.publishCyclesMax,
+                  (unsigned)bus.dispatchLatencyUsAvg, (unsigned)bus.dispatchLatencyUsMax);
+    SampleStoreStats store = sampleStoreGetStats();
+    Serial.printf("Diagnostics: store chunks=%lu..%lu, pending=%u, stored=%lu samples/%lu B, dropped chunks=%lu, write errors=%lu\n",
+                  (unsigned long)store.firstChunk, (unsigned long)store.nextChunk, (unsigned)store.pendingSamples,
+                  (unsigned long)store.samplesStored, (unsigned long)store.bytesWritten,
+                  (unsigned long)store.chunksDropped, (unsigned long)store.writeErrors);
+    BackfillStats backfill = backfillGetStats();
+    UplinkStats uplink = uplinkGetStats();
+    Serial.printf("Diagnostics: backfill active=%d, requests=%lu, batches ok/failed=%lu/%lu, samples=%lu, bytes=%lu, last throughput=%lu B/s, throttled=%lu ms\n",
+                  (int)backfill.active, (unsigned long)backfill.requests, (unsigned long)backfill.batchesSent,
+                  (unsigned long)backfill.batchesFailed, (unsigned long)backfill.samplesSent, (unsigned long)backfill.bytesSent,
+                  (unsigned long)backfill.lastThroughputBps, (unsigned long)backfill.throttledMs);
+    AlertLaneStats alerts = alertLaneGetStats();
+    Serial.printf("Diagnostics: alerts raised=%lu, sent=%lu, failed=%lu, latency avg/max=%lu/%lu ms\n",
+                  (unsigned long)alerts.raised, (unsigned long)alerts.sent, (unsigned long)alerts.failed,
+                  (unsigned long)alerts.latencyMsAvg, (unsigned long)alerts.latencyMsMax);
+    Serial.printf("Diagnostics: rules=%u, fired=%lu, eval cycles last/max=%lu/%lu\n",
+                  (unsigned)alerts.rules, (unsigned long)alerts.rulesFired,
+                  (unsigned long)alerts.ruleEvalCyclesLast, (unsigned long)alerts.ruleEvalCyclesMax);
+    DownsamplerStats downsampler = downsamplerGetStats();
+    Serial.printf("Diagnostics: downsampler samples in=%lu, records out=%lu\n",
+                  (unsigned long)downsampler.samplesIn, (unsigned long)downsampler.recordsOut);
+    Serial.printf("Diagnostics: live uploads=%lu, latency avg/max=%lu/%lu ms, during backfill avg/max=%lu/%lu ms\n",
+                  (unsigned long)uplink.uploads, (unsigned long)uplink.latencyMsAvg, (unsigned long)uplink.latencyMsMax,
+                  (unsigned long)uplink.latencyMsAvgDuringBackfill, (unsigned long)uplink.latencyMsMaxDuringBackfill);
+    Serial.printf("Diagnostics: delivery next seq=%lu, ack watermark=%lu, unacked=%lu, resent=%lu, dropped=%lu, no ack=%lu\n",
+                  (unsigned long)uplink.nextSequence, (unsigned long)uplink.ackWatermark, (unsigned long)uplink.unacked,
+                  (unsigned long)uplink.resent, (unsigned long)uplink.dropped, (unsigned long)uplink.noAck);
+    for (uint8_t i = 0; i < FANOUT_MAX_DESTINATIONS; i++) {
+        FanoutStats fanout = fanoutGetStats(i);
+        if (!fanout.configured) {
+            continue;
+        }
+        Serial.printf("Diagnostics: destination %u reports=%lu (%lu samples), failed attempts=%lu, dropped reports=%lu, dropped samples=%lu, backlog=%lu, last code=%d\n",
+                      (unsigned)i, (unsigned long)fanout.reportsSent, (unsigned long)fanout.samplesSent,
+                      (unsigned long)fanout.failedAttempts, (unsigned long)fanout.reportsDropped,
+                      (unsigned long)fanout.samplesDropped, (unsigned long)fanout.backlog, fanout.lastCode);
+    }
+    LatestSampleStats latest = latestSampleGetStats();
+    Serial.printf("Diagnostics: latest sample writes=%lu, reads=%lu, retries=%lu, read avg/max=%lu/%lu cycles\n",
+                  (unsigned long)latest.writes, (unsigned long)latest.reads, (unsigned long)latest.retries,
+                  (unsigned long)latest.readCyclesAvg, (unsigned long)latest.readCyclesMax);
+    LiveStreamStats live = liveStreamGetStats();
+    Serial.printf("Diagnostics: live viewers=%u, connects=%lu, rejected=%lu, dropped=%lu, events=%lu, sensor task cost 0/%u viewers=%lu/%lu cycles, broadcast 1/%u viewers=%lu/%lu us\n",
+                  (unsigned)live.viewers, (unsigned long)live.connects, (unsigned long)live.rejected,
+                  (unsigned long)live.dropped, (unsigned long)live.events,
+                  (unsigned)LIVE_MAX_CLIENTS, (unsigned long)live.sampleCyclesAvg[0], (unsigned long)live.sampleCyclesAvg[LIVE_MAX_CLIENTS],
+                  (unsigned)LIVE_MAX_CLIENTS, (unsigned long)live.broadcastUsAvg[1], (unsigned long)live.broadcastUsAvg[LIVE_MAX_CLIENTS]);
+    static CpuProfile cpu; // Diagnostics task only; kept off the stack
+    cpuProfileGet(cpu);
+    if (cpu.available) {
+        Serial.print("Diagnostics: cpu");
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+            Serial.printf(" core%u=%u.%u%%", (unsigned)core, cpu.coreLoadPermille[core] / 10, cpu.coreLoadPermille[core] % 10);
+        }
+        Serial.printf(", window=%lu ms, profiler=%lu us (%lu ppm)\nDiagnostics: cpu tasks",
+                      (unsigned long)cpu.windowMs, (unsigned long)cpu.sampleUs, (unsigned long)cpu.overheadPpm);
+        for (uint8_t i = 0; i < cpu.taskCount; i++) {
+            Serial.printf(" %s(%d)=%u.%u%%", cpu.tasks[i].name, cpu.tasks[i].core,
+                          cpu.tasks[i].loadPermille / 10, cpu.tasks[i].loadPermille % 10);
+        }
+        Serial.println();
+    }
+    HttpServerStats http = httpServerGetStats();
+    Serial.printf("Diagnostics: http requests=%lu, connections=%lu (open %u), rejected bodies=%lu, timed out bodies=%lu\n",
+                  (unsigned long)http.requests, (unsigned long)http.connections, (unsigned)http.open,
+                  (unsigned long)http.rejectedBodies, (unsigned long)http.timedOutBodies);
+    DiscoveryStats discovery = discoveryGetStats();
+    if (discovery.enabled) {
+        Serial.printf("Diagnostics: discovery server=%s, instances=%u, queries=%lu (empty %lu), failovers=%lu, connect time=%lu ms\n",
+                      activeServerAddress().c_str(), (unsigned)discovery.instances, (unsigned long)discovery.queries,
+                      (unsigned long)discovery.emptyQueries, (unsigned long)discovery.failovers,
+                      (unsigned long)discovery.activeLatencyMs);
+    }
+    DnsCacheStats dns = dnsCacheGetStats();
+    uint32_t dnsServed = dns.hits + dns.staleHits + dns.outageHits;
+    Serial.printf("Diagnostics: dns lookups=%lu, hit rate=%lu%% (fresh %lu, stale %lu, outage %lu), misses=%lu, queries=%lu, failures=%lu, resolve avg/max=%lu/%lu ms\n",
+                  (unsigned long)dns.lookups, (unsigned long)(dns.lookups > 0 ? dnsServed * 100 / dns.lookups : 0),
+                  (unsigned long)dns.hits, (unsigned long)dns.staleHits, (unsigned long)dns.outageHits,
+                  (unsigned long)dns.misses, (unsigned long)dns.queries, (unsigned long)dns.queryFailures,
+                  (unsigned long)dns.resolveMsAvg, (unsigned long)dns.resolveMsMax);
+#if WS_TRANSPORT_MQTT
+    MqttStats mqtt = mqttGetStats();
+    Serial.printf("Diagnostics: mqtt published=%lu, failed=%lu, in flight=%u, bytes on air=%lu (payload %lu), PUBACK avg/max=%lu/%lu ms, connects=%lu\n",
+                  (unsigned long)mqtt.published, (unsigned long)mqtt.failed, (unsigned)mqtt.inFlight,
+                  (unsigned long)mqtt.bytesOnAir, (unsigned long)mqtt.payloadBytes,
+                  (unsigned long)mqtt.ackMsAvg, (unsigned long)mqtt.ackMsMax, (unsigned long)mqtt.connects);
+#endif
+#if WS_TRANSPORT_COAP
+    CoapStats coap = coapGetStats();
+    Serial.printf("Diagnostics: coap requests=%lu, failed=%lu, messages=%lu, retransmissions=%lu, blocks=%lu, bytes out/in=%lu/%lu, exchange avg/max=%lu/%lu ms\n",
+                  (unsigned long)coap.requests, (unsigned long)coap.failed, (unsigned long)coap.messagesSent,
+                  (unsigned long)coap.retransmissions, (unsigned long)coap.blocks, (unsigned long)coap.bytesSent,
+                  (unsigned long)coap.bytesReceived, (unsigned long)coap.exchangeMsAvg, (unsigned long)coap.exchangeMsMax);
+#endif
+#if WS_TRANSPORT_WEBSOCKET
+    WebSocketStats ws = webSocketGetStats();
+    Serial.printf("Diagnostics: websocket %s, frames out/in=%lu/%lu, bytes out/in=%lu/%lu, pings=%lu, pongs=%lu, RTT last/max=%lu/%lu ms, connects=%lu, failures=%lu, liveness drops=%lu\n",
+                  ws.connected ? "connected" : "disconnected", (unsigned long)ws.framesSent, (unsigned long)ws.framesReceived,
+                  (unsigned long)ws.bytesSent, (unsigned long)ws.bytesReceived, (unsigned long)ws.pings, (unsigned long)ws.pongs,
+                  (unsigned long)ws.rttMsLast, (unsigned long)ws.rttMsMax, (unsigned long)ws.connects,
+                  (unsigned long)ws.connectFailures, (unsigned long)ws.livenessDrops);
+#endif
+#if WS_TRANSPORT_HTTPS
+    HttpsStats https = httpsGetStats();
+    Serial.printf("Diagnostics: https requests=%lu (on kept-alive connection %lu), failed=%lu, handshake failures=%lu\n",
+                  (unsigned long)https.requests, (unsigned long)https.reusedRequests, (unsigned long)https.failed,
+                  (unsigned long)https.handshakeFailures);
+    Serial.printf("Diagnostics: tls full handshakes=%lu, last/avg/max=%lu/%lu/%lu ms, heap peak=%lu B; resumed=%lu, last/avg/max=%lu/%lu/%lu ms, heap peak=%lu B; resumption refused=%lu\n",
+                  (unsigned long)https.full.count, (unsigned long)https.full.msLast, (unsigned long)https.full.msAvg,
+                  (unsigned long)https.full.msMax, (unsigned long)https.full.heapPeak, (unsigned long)https.resumed.count,
+                  (unsigned long)https.resumed.msLast, (unsigned long)https.resumed.msAvg, (unsigned long)https.resumed.msMax,
+                  (unsigned long)https.resumed.heapPeak, (unsigned long)https.resumeRefused);
+    if (https.full.count > 0 && https.resumed.count > 0) {
+        Serial.printf("Diagnostics: tls resumed handshake avg is %ld ms shorter than a full one\n",
+                      (long)https.full.msAvg - (long)https.resumed.msAvg);
+    }
+#endif
+#if WS_FEATURE_PROTOBUF
+    static bool encoderBenchmarked = false; // Once per boot; it takes a few milliseconds
+    if (!encoderBenchmarked) {
+        encoderBenchmarked = true;
+        const uint8_t reportSizes[] = { 1, RUNTIME_MAX_BATCH };
+        for (uint8_t size : reportSizes) {
+            EncoderBenchmarkResult bench = protobufRunBenchmark(size);
+            Serial.printf("Diagnostics: encode %u sample(s): json %lu cycles/%lu B, protobuf %lu cycles/%lu B\n",
+                          (unsigned)bench.samples, (unsigned long)bench.jsonCycles, (unsigned long)bench.jsonBytes,
+                          (unsigned long)bench.protobufCycles, (unsigned long)bench.protobufBytes);
+        }
+    }
+#endif
+#if WS_FEATURE_ALLOC_TRACE
+    static uint32_t lastTraceReportMs = 0;
+    if (lastTraceReportMs == 0 || millis() - lastTraceReportMs >= ALLOC_TRACE_REPORT_MS) {
+        lastTraceReportMs = millis();
+        allocTraceReport(printTraceLine);
+    }
+#endif
+}
+
+// --- FreeRTOS Task: Diagnostics ---
+
+/**
+ * @brief Event bus callback waking the diagnostics task after every sample while diagnosticsMode is on.
+ * Runs in the sensor task; never blocks.
+ */
+static void onSample(const BusMessage* message, void* context) {
+    if (diagnosticsMode) {
+        xTaskNotifyGive(diagnosticsTask);
+    }
+}
+
+/**
+ * @brief FreeRTOS task function printing the diagnostics once per notification.
+ * @param pvParameters Unused.
+ */
+static void diagnosticsTaskFunction(void* pvParameters) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        printDiagnostics();
+    }
+}
+
+/**
+ * @brief Starts the diagnostics task and subscribes it to TOPIC_SAMPLE.
+ * @return true on success.
+ */
+bool startDiagnostics() {
+    if (xTaskCreatePinnedToCore(diagnosticsTaskFunction, "Diagnostics", DIAGNOSTICS_STACK, NULL, 1,
+                                &diagnosticsTask, APP_CPU_NUM) != pdPASS) {
+        return false;
+    }
+    return eventBusSubscribeCallback(TOPIC_BIT(TOPIC_SAMPLE), onSample, NULL);
+}
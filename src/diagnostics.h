@@ -0,0 +1,22 @@
+/**
+ * @file diagnostics.h
+ * @brief Declarations for the diagnostics task.
+ *
+ * While diagnosticsMode is on (double button press), the diagnostics task
+ * prints the heap, stack headroom and the counters of every component on the
+ * serial console after each sample, from its own task, so the sensor task
+ * only acquires and publishes samples.
+ */
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "config.h"
+
+/**
+ * @brief Starts the diagnostics task and subscribes it to TOPIC_SAMPLE.
+ * @note Must be called after initEventBus().
+ * @return true on success.
+ */
+bool startDiagnostics();
+
+#endif // DIAGNOSTICS_H
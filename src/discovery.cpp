@@ -0,0 +1,263 @@
+/**
+ * @file discovery.cpp
+ * @brief DNS-SD discovery of the server with latency-ordered failover.
+ *
+ * The instance list is shared between the discovery task (which replaces it
+ * after a query) and an event bus callback running in the uplink task (which
+ * counts failed uploads and switches instances), so it is guarded by a
+ * spinlock and holds addresses as integers only.
+ */
+#include "discovery.h"
+#include "event_bus.h"
+#include "supervisor.h"
+#include "nvs_handler.h"
+#include <ESPmDNS.h>
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+const uint32_t LATENCY_UNKNOWN = UINT32_MAX; // Instance restored from NVS, not measured yet
+
+/** @brief One advertised instance of the service. */
+struct DiscoveredInstance {
+  uint32_t address;        ///< IPv4 address as stored by IPAddress.
+  uint16_t port;
+  uint32_t latencyMs;      ///< TCP connect time when it was found.
+  bool failed;             ///< Given up after failed uploads; skipped until the next query.
+};
+
+static DiscoveredInstance instances[DISCOVERY_MAX_INSTANCES];
+static uint8_t instanceCount = 0;
+static int8_t activeInstance = -1;           // Index into instances, -1 while none is known
+static uint8_t consecutiveFailures = 0;
+static bool queryNeeded = true;
+static TaskHandle_t discoveryTaskHandle = NULL;
+static DiscoveryStats stats = {};
+static portMUX_TYPE discoveryLock = portMUX_INITIALIZER_UNLOCKED; // Guards all of the above
+
+/**
+ * @brief Formats an instance as "ip:port".
+ */
+static String formatAddress(uint32_t address, uint16_t port) {
+    return IPAddress(address).toString() + ":" + String(port);
+}
+
+// --- Failover ---
+
+/**
+ * @brief Event bus callback counting failed uploads and switching to the next fastest instance.
+ * Also wakes the task when the station comes online and forgets the
+ * instances when the configuration is cleared. Runs in the publisher's task; never blocks.
+ */
+static void onBusEvent(const BusMessage* message, void* context) {
+    bool wake = false;
+    if (message->topic == TOPIC_WIFI_STATE) {
+        if (message->data.wifi.state == STATE_ONLINE) {
+            xTaskNotifyGive(discoveryTaskHandle); // Query at once if nothing is known yet
+        }
+        return;
+    }
+    if (message->topic == TOPIC_CONFIG_CHANGED) {
+        if (message->data.config.mode != MODE_UNCONFIGURED) {
+            return;
+        }
+        portENTER_CRITICAL(&discoveryLock);
+        instanceCount = 0; // Found on the old network
+        activeInstance = -1;
+        consecutiveFailures = 0;
+        queryNeeded = true;
+        portEXIT_CRITICAL(&discoveryLock);
+        return;
+    }
+    if (serverAddress.length() > 0) {
+        return; // Configured server; nothing to fail over to
+    }
+
+    bool transportError = message->data.uplink.httpCode <= 0; // An HTTP status means the server is reachable
+    portENTER_CRITICAL(&discoveryLock);
+    if (!transportError) {
+        consecutiveFailures = 0;
+    } else if (activeInstance >= 0 && ++consecutiveFailures >= DISCOVERY_FAILOVER_FAILURES) {
+        consecutiveFailures = 0;
+        instances[activeInstance].failed = true;
+        int8_t next = -1;
+        for (uint8_t i = 0; i < instanceCount; i++) { // Sorted by latency, so the first working one is the fastest
+            if (!instances[i].failed) {
+                next = (int8_t)i;
+                break;
+            }
+        }
+        if (next >= 0) {
+            activeInstance = next;
+            stats.failovers++;
+            stats.activeLatencyMs = instances[next].latencyMs == LATENCY_UNKNOWN ? 0 : instances[next].latencyMs;
+        } else {
+            queryNeeded = true; // Keep the current instance until the query finds another
+        }
+        wake = true;
+    }
+    portEXIT_CRITICAL(&discoveryLock);
+    if (wake) {
+        xTaskNotifyGive(discoveryTaskHandle);
+    }
+}
+
+// --- Query ---
+
+/**
+ * @brief Queries the network for the service and measures the connect time of every instance.
+ * Reachable instances replace the list, fastest first; the list is kept if none is found.
+ */
+static void queryInstances() {
+    if (!MDNS.begin(DISCOVERY_HOSTNAME)) {
+        Serial.println("Discovery: Cannot start mDNS.");
+        return;
+    }
+    int found = MDNS.queryService(DISCOVERY_SERVICE, DISCOVERY_PROTOCOL);
+    DiscoveredInstance candidates[DISCOVERY_MAX_INSTANCES];
+    uint8_t candidateCount = 0;
+    for (int i = 0; i < found && candidateCount < DISCOVERY_MAX_INSTANCES; i++) {
+        candidates[candidateCount].address = (uint32_t)MDNS.IP(i);
+        candidates[candidateCount].port = MDNS.port(i);
+        candidates[candidateCount].failed = false;
+        if (candidates[candidateCount].address != 0 && candidates[candidateCount].port != 0) {
+            candidateCount++;
+        }
+    }
+    MDNS.end();
+
+    DiscoveredInstance reachable[DISCOVERY_MAX_INSTANCES];
+    uint8_t reachableCount = 0;
+    for (uint8_t i = 0; i < candidateCount; i++) {
+        WiFiClient client;
+        uint32_t start = millis();
+        bool connected = client.connect(IPAddress(candidates[i].address), candidates[i].port,
+                                        (int32_t)DISCOVERY_PROBE_TIMEOUT_MS);
+        candidates[i].latencyMs = millis() - start;
+        client.stop();
+        Serial.printf("Discovery: %s %s (%lu ms).\n", formatAddress(candidates[i].address, candidates[i].port).c_str(),
+                      connected ? "reachable" : "unreachable", (unsigned long)candidates[i].latencyMs);
+        if (!connected) {
+            continue;
+        }
+        uint8_t position = reachableCount++;
+        while (position > 0 && reachable[position - 1].latencyMs > candidates[i].latencyMs) { // Insertion sort
+            reachable[position] = reachable[position - 1];
+            position--;
+        }
+        reachable[position] = candidates[i];
+    }
+
+    portENTER_CRITICAL(&discoveryLock);
+    stats.queries++;
+    stats.instances = reachableCount;
+    if (reachableCount > 0) {
+        memcpy(instances, reachable, sizeof(reachable[0]) * reachableCount);
+        instanceCount = reachableCount;
+        activeInstance = 0;
+        consecutiveFailures = 0;
+        queryNeeded = false;
+        stats.activeLatencyMs = instances[0].latencyMs;
+    } else {
+        stats.emptyQueries++;
+    }
+    portEXIT_CRITICAL(&discoveryLock);
+
+    if (reachableCount == 0) {
+        Serial.printf("Discovery: No reachable _%s._%s instance, retrying in %lu s.\n", DISCOVERY_SERVICE,
+                      DISCOVERY_PROTOCOL, (unsigned long)(DISCOVERY_RETRY_MS / 1000));
+    }
+}
+
+// --- FreeRTOS Task: Discovery ---
+
+/**
+ * @brief FreeRTOS task querying the network when no working instance is known
+ * and saving the instance in use to NVS when it changes.
+ * @param pvParameters Unused.
+ */
+static void discoveryTaskFunction(void* pvParameters) {
+    String savedAddress = activeInstance >= 0 ? formatAddress(instances[0].address, instances[0].port) : String(); // Restored from NVS
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DISCOVERY_RETRY_MS));
+        if (serverAddress.length() > 0 || getSupervisorState() != STATE_ONLINE) {
+            continue;
+        }
+        portENTER_CRITICAL(&discoveryLock);
+        bool query = queryNeeded;
+        portEXIT_CRITICAL(&discoveryLock);
+        if (query) {
+            queryInstances();
+        }
+
+        String address = activeServerAddress();
+        if (address.length() > 0 && address != savedAddress) {
+            Serial.printf("Discovery: Using %s.\n", address.c_str());
+            saveDiscoveredServerToNVS(address);
+            savedAddress = address;
+        }
+    }
+}
+
+// --- Public API ---
+
+/**
+ * @brief Loads the last chosen instance from NVS and starts the discovery task.
+ * @return true on success.
+ */
+bool startDiscovery() {
+    String cached;
+    if (loadDiscoveredServerFromNVS(cached)) {
+        int colon = cached.indexOf(':');
+        IPAddress ip;
+        if (colon > 0 && ip.fromString(cached.substring(0, colon))) {
+            instances[0].address = (uint32_t)ip;
+            instances[0].port = (uint16_t)cached.substring(colon + 1).toInt();
+            instances[0].latencyMs = LATENCY_UNKNOWN;
+            instances[0].failed = false;
+            instanceCount = 1;
+            activeInstance = 0;
+            queryNeeded = false; // Start with the cached instance; query only if it fails
+            Serial.printf("Discovery: Restored %s from NVS.\n", cached.c_str());
+        }
+    }
+    if (xTaskCreatePinnedToCore(discoveryTaskFunction, "DiscoveryTask", 4096, NULL, 1,
+                                &discoveryTaskHandle, APP_CPU_NUM) != pdPASS) {
+        return false;
+    }
+    return eventBusSubscribeCallback(TOPIC_BIT(TOPIC_UPLINK_RESULT) | TOPIC_BIT(TOPIC_WIFI_STATE) |
+                                     TOPIC_BIT(TOPIC_CONFIG_CHANGED), onBusEvent, NULL);
+}
+
+/**
+ * @brief Returns the server all uplink paths connect to.
+ * @return serverAddress if configured, otherwise "ip:port" of the discovered
+ *         instance in use, or an empty string while none is known.
+ */
+String activeServerAddress() {
+    if (serverAddress.length() > 0) {
+        return serverAddress;
+    }
+    uint32_t address = 0;
+    uint16_t port = 0;
+    portENTER_CRITICAL(&discoveryLock);
+    if (activeInstance >= 0) {
+        address = instances[activeInstance].address;
+        port = instances[activeInstance].port;
+    }
+    portEXIT_CRITICAL(&discoveryLock);
+    return address != 0 ? formatAddress(address, port) : String();
+}
+
+/**
+ * @brief Returns a snapshot of the discovery counters.
+ * @return Copy of the current statistics.
+ */
+DiscoveryStats discoveryGetStats() {
+    portENTER_CRITICAL(&discoveryLock);
+    DiscoveryStats snapshot = stats;
+    portEXIT_CRITICAL(&discoveryLock);
+    snapshot.enabled = serverAddress.length() == 0;
+    return snapshot;
+}
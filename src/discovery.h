@@ -0,0 +1,48 @@
+/**
+ * @file discovery.h
+ * @brief Declarations for finding the server with mDNS/DNS-SD.
+ *
+ * When serverAddress is left empty in the portal, the station looks for
+ * instances of _weather-ingest._tcp on the local network once it is online,
+ * measures the TCP connect time of each and uses the fastest. The chosen
+ * instance is saved in NVS and used at the next start without waiting for a
+ * query. Uploads failing with a transport error DISCOVERY_FAILOVER_FAILURES
+ * times in a row switch to the next fastest instance; the network is queried
+ * again only when no working instance is left (or none was ever found).
+ */
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include "config.h"
+
+/** @brief Counters of server discovery. */
+struct DiscoveryStats {
+  bool enabled;            ///< serverAddress is empty, so discovery chooses the server.
+  uint8_t instances;       ///< Reachable instances found by the last query.
+  uint32_t queries;        ///< DNS-SD queries sent.
+  uint32_t emptyQueries;   ///< Queries that found no reachable instance.
+  uint32_t failovers;      ///< Switches to another instance after failed uploads.
+  uint32_t activeLatencyMs; ///< Connect time of the instance in use [ms] (0 if taken from NVS).
+};
+
+/**
+ * @brief Loads the last chosen instance from NVS and starts the discovery task.
+ * @note Must be called after initEventBus() and before the supervisor starts.
+ * @return true on success.
+ */
+bool startDiscovery();
+
+/**
+ * @brief Returns the server all uplink paths connect to.
+ * @return serverAddress if configured, otherwise "ip:port" of the discovered
+ *         instance in use, or an empty string while none is known.
+ */
+String activeServerAddress();
+
+/**
+ * @brief Returns a snapshot of the discovery counters.
+ * @return Copy of the current statistics.
+ */
+DiscoveryStats discoveryGetStats();
+
+#endif // DISCOVERY_H
@@ -0,0 +1,433 @@
+/**
+ * @file dns_cache.cpp
+ * @brief Resolver cache with TTL, stale-while-revalidate and last-good fallback.
+ *
+ * Queries are standard recursive A queries over UDP (RFC 1035):
+ *
+ *     | ID | Flags | QDCOUNT | ANCOUNT | NSCOUNT | ARCOUNT | Question | Answers ... |
+ *
+ * The TTL of an answer is the smallest TTL of the A record and the CNAME
+ * records leading to it. If the DNS servers cannot be queried directly, lwIP's
+ * resolver is used and the entry gets DNS_TTL_MIN_S.
+ */
+#include "dns_cache.h"
+#include <WiFiUdp.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+const size_t DNS_MAX_HOST = 64;              // Longer names are resolved without caching
+const size_t DNS_MAX_MESSAGE = 512;          // Maximum DNS message over UDP
+const uint16_t DNS_PORT = 53;
+const uint16_t DNS_TYPE_A = 1;
+const uint16_t DNS_TYPE_CNAME = 5;
+const uint16_t DNS_CLASS_IN = 1;
+const uint32_t DNS_POLL_MS = 5;              // Receive poll period while waiting for an answer
+
+/** @brief One cached name. */
+struct CacheEntry {
+  char host[DNS_MAX_HOST];
+  uint32_t address;        ///< IPv4 address as stored by IPAddress.
+  uint32_t resolvedMs;     ///< millis() of the last successful resolution.
+  uint32_t ttlMs;
+  uint32_t failedMs;       ///< millis() of the last failed refresh.
+  uint32_t lastUsedMs;     ///< For replacing the least recently used entry.
+  bool used;
+  bool refreshing;         ///< Queued for the DNS task.
+  bool refreshFailed;      ///< The last refresh failed; the address is the last good one.
+};
+
+/** @brief Outcome of parsing a received datagram. */
+enum DnsParseResult {
+  DNS_PARSE_OTHER,         ///< Not the answer to the query.
+  DNS_PARSE_FAILED,        ///< Error answer or no A record.
+  DNS_PARSE_OK
+};
+
+static CacheEntry entries[DNS_CACHE_ENTRIES];
+static SemaphoreHandle_t cacheMutex = NULL;
+static SemaphoreHandle_t queryMutex = NULL;  // Guards the socket and the message buffer
+static TaskHandle_t dnsTaskHandle = NULL;
+static WiFiUDP udp;
+static uint8_t message[DNS_MAX_MESSAGE];
+
+static DnsCacheStats stats = {};
+static uint32_t resolveSumMs = 0;
+static uint32_t resolvedCount = 0;
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- DNS Messages ---
+
+/**
+ * @brief Writes an A query for host into message.
+ * @return Message length, 0 if the name is invalid.
+ */
+static size_t buildQuery(const char* host, uint16_t id) {
+    const uint8_t header[12] = {(uint8_t)(id >> 8), (uint8_t)id, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0}; // RD, one question
+    memcpy(message, header, sizeof(header));
+    size_t length = sizeof(header);
+    const char* label = host;
+    while (*label != '\0') {
+        const char* dot = strchr(label, '.');
+        size_t labelLength = dot != NULL ? (size_t)(dot - label) : strlen(label);
+        if (labelLength == 0 || labelLength > 63 || length + labelLength + 6 > sizeof(message)) {
+            return 0;
+        }
+        message[length++] = (uint8_t)labelLength;
+        memcpy(&message[length], label, labelLength);
+        length += labelLength;
+        label += labelLength + (dot != NULL ? 1 : 0);
+    }
+    message[length++] = 0;
+    message[length++] = 0;
+    message[length++] = DNS_TYPE_A;
+    message[length++] = 0;
+    message[length++] = DNS_CLASS_IN;
+    return length;
+}
+
+/**
+ * @brief Skips an encoded name, following no pointers.
+ * @return Position after the name, 0 if it runs past the message.
+ */
+static size_t skipName(const uint8_t* data, size_t length, size_t position) {
+    while (position < length) {
+        uint8_t labelLength = data[position];
+        if (labelLength == 0) {
+            return position + 1;
+        }
+        if ((labelLength & 0xC0) == 0xC0) {
+            return position + 2 <= length ? position + 2 : 0;
+        }
+        position += labelLength + 1;
+    }
+    return 0;
+}
+
+static uint16_t read16(const uint8_t* data) {
+    return (uint16_t)(data[0] << 8) | data[1];
+}
+
+/**
+ * @brief Extracts the first A record and the TTL from an answer.
+ */
+static DnsParseResult parseAnswer(const uint8_t* data, size_t length, uint16_t id, uint32_t& address, uint32_t& ttlS) {
+    if (length < 12 || read16(data) != id || !(data[2] & 0x80)) {
+        return DNS_PARSE_OTHER;
+    }
+    if ((data[3] & 0x0F) != 0) { // RCODE, e.g. NXDOMAIN
+        return DNS_PARSE_FAILED;
+    }
+    uint16_t questions = read16(&data[4]);
+    uint16_t answers = read16(&data[6]);
+    size_t position = 12;
+    for (uint16_t i = 0; i < questions; i++) {
+        position = skipName(data, length, position);
+        if (position == 0) {
+            return DNS_PARSE_FAILED;
+        }
+        position += 4; // QTYPE, QCLASS
+    }
+
+    bool found = false;
+    ttlS = UINT32_MAX;
+    for (uint16_t i = 0; i < answers; i++) {
+        position = skipName(data, length, position);
+        if (position == 0 || position + 10 > length) {
+            return DNS_PARSE_FAILED;
+        }
+        uint16_t type = read16(&data[position]);
+        uint16_t recordClass = read16(&data[position + 2]);
+        uint32_t ttl = ((uint32_t)read16(&data[position + 4]) << 16) | read16(&data[position + 6]);
+        uint16_t dataLength = read16(&data[position + 8]);
+        position += 10;
+        if (position + dataLength > length) {
+            return DNS_PARSE_FAILED;
+        }
+        if (recordClass == DNS_CLASS_IN && (type == DNS_TYPE_CNAME || (type == DNS_TYPE_A && !found))) {
+            if (ttl < ttlS) {
+                ttlS = ttl;
+            }
+            if (type == DNS_TYPE_A && dataLength == 4) {
+                address = (uint32_t)IPAddress(data[position], data[position + 1], data[position + 2], data[position + 3]);
+                found = true;
+            }
+        }
+        position += dataLength;
+    }
+    return found ? DNS_PARSE_OK : DNS_PARSE_FAILED;
+}
+
+// --- Resolution ---
+
+/**
+ * @brief Queries the DNS servers of the WiFi connection for an A record.
+ * @return true if an address was received.
+ */
+static bool queryServers(const char* host, uint32_t& address, uint32_t& ttlS) {
+    bool resolved = false;
+    xSemaphoreTake(queryMutex, portMAX_DELAY);
+    for (uint8_t server = 0; server < 2 && !resolved; server++) {
+        IPAddress dnsServer = WiFi.dnsIP(server);
+        if ((uint32_t)dnsServer == 0) {
+            continue;
+        }
+        while (udp.parsePacket() > 0) {
+            udp.read(message, sizeof(message)); // Discard late answers to earlier queries
+        }
+        uint16_t id = (uint16_t)esp_random();
+        size_t length = buildQuery(host, id);
+        if (length == 0) {
+            break;
+        }
+        if (!udp.beginPacket(dnsServer, DNS_PORT) || udp.write(message, length) != length || !udp.endPacket()) {
+            continue;
+        }
+        uint32_t start = millis();
+        while (millis() - start < DNS_QUERY_TIMEOUT_MS) {
+            if (udp.parsePacket() <= 0) {
+                vTaskDelay(pdMS_TO_TICKS(DNS_POLL_MS));
+                continue;
+            }
+            int received = udp.read(message, sizeof(message));
+            if (received <= 0 || !(udp.remoteIP() == dnsServer)) {
+                continue;
+            }
+            DnsParseResult result = parseAnswer(message, received, id, address, ttlS);
+            if (result != DNS_PARSE_OTHER) {
+                resolved = result == DNS_PARSE_OK;
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(queryMutex);
+    return resolved;
+}
+
+/**
+ * @brief Resolves a name and records the outcome.
+ * @return true if an address was found.
+ */
+static bool resolveHost(const char* host, uint32_t& address, uint32_t& ttlS) {
+    if (WiFi.status() != WL_CONNECTED) {
+        return false;
+    }
+    uint32_t start = millis();
+    bool resolved = queryServers(host, address, ttlS);
+    if (!resolved) {
+        IPAddress ip;
+        resolved = WiFi.hostByName(host, ip) == 1;
+        address = (uint32_t)ip;
+        ttlS = DNS_TTL_MIN_S;
+    }
+    uint32_t durationMs = millis() - start;
+
+    portENTER_CRITICAL(&statsLock);
+    stats.queries++;
+    if (resolved) {
+        resolvedCount++;
+        resolveSumMs += durationMs;
+        stats.resolveMsAvg = resolveSumMs / resolvedCount;
+        if (durationMs > stats.resolveMsMax) {
+            stats.resolveMsMax = durationMs;
+        }
+    } else {
+        stats.queryFailures++;
+    }
+    portEXIT_CRITICAL(&statsLock);
+
+    if (ttlS < DNS_TTL_MIN_S) {
+        ttlS = DNS_TTL_MIN_S;
+    } else if (ttlS > DNS_TTL_MAX_S) {
+        ttlS = DNS_TTL_MAX_S;
+    }
+    if (resolved) {
+        DEBUG_PRINTF("DNS: %s -> %s (TTL %lu s, %lu ms).\n", host, IPAddress(address).toString().c_str(),
+                     (unsigned long)ttlS, (unsigned long)durationMs);
+    }
+    return resolved;
+}
+
+/**
+ * @brief FreeRTOS task refreshing expired entries that were served stale.
+ * @param pvParameters Unused.
+ */
+static void dnsTask(void* pvParameters) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (uint8_t i = 0; i < DNS_CACHE_ENTRIES; i++) {
+            char host[DNS_MAX_HOST];
+            xSemaphoreTake(cacheMutex, portMAX_DELAY);
+            bool queued = entries[i].used && entries[i].refreshing;
+            if (queued) {
+                memcpy(host, entries[i].host, sizeof(host));
+            }
+            xSemaphoreGive(cacheMutex);
+            if (!queued) {
+                continue;
+            }
+
+            uint32_t address, ttlS;
+            bool resolved = resolveHost(host, address, ttlS);
+            xSemaphoreTake(cacheMutex, portMAX_DELAY);
+            CacheEntry& entry = entries[i];
+            if (entry.used && strcmp(entry.host, host) == 0) {
+                if (resolved) {
+                    entry.address = address;
+                    entry.resolvedMs = millis();
+                    entry.ttlMs = ttlS * 1000;
+                    entry.refreshFailed = false;
+                } else {
+                    if (!entry.refreshFailed) {
+                        Serial.printf("DNS: Cannot refresh %s, using the last good address.\n", host);
+                    }
+                    entry.refreshFailed = true;
+                    entry.failedMs = millis();
+                }
+                entry.refreshing = false;
+            }
+            xSemaphoreGive(cacheMutex);
+        }
+    }
+}
+
+// --- Public API ---
+
+/**
+ * @brief Creates the cache lock and starts the DNS refresh task.
+ * @return true on success.
+ */
+bool startDnsCache() {
+    cacheMutex = xSemaphoreCreateMutex();
+    queryMutex = xSemaphoreCreateMutex();
+    if (cacheMutex == NULL || queryMutex == NULL || udp.begin(0) != 1) { // Any local port
+        return false;
+    }
+    return xTaskCreatePinnedToCore(dnsTask, "DnsTask", 3072, NULL, 1, &dnsTaskHandle, APP_CPU_NUM) == pdPASS;
+}
+
+/**
+ * @brief Returns the address of a host, from the cache if possible.
+ * @param host Host name or IP literal.
+ * @param ip Receives the address.
+ * @return true if an address is known.
+ */
+bool dnsCacheResolve(const String& host, IPAddress& ip) {
+    if (ip.fromString(host)) {
+        return true;
+    }
+    uint32_t address, ttlS;
+    if (cacheMutex == NULL || host.length() >= DNS_MAX_HOST) {
+        if (!resolveHost(host.c_str(), address, ttlS)) {
+            return false;
+        }
+        ip = address;
+        return true;
+    }
+
+    portENTER_CRITICAL(&statsLock);
+    stats.lookups++;
+    portEXIT_CRITICAL(&statsLock);
+
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        CacheEntry& entry = entries[i];
+        if (!entry.used || strcmp(entry.host, host.c_str()) != 0) {
+            continue;
+        }
+        entry.lastUsedMs = now;
+        ip = entry.address;
+        bool fresh = now - entry.resolvedMs < entry.ttlMs;
+        bool refresh = !fresh && !entry.refreshing &&
+                       (!entry.refreshFailed || now - entry.failedMs >= DNS_RETRY_S * 1000);
+        if (refresh) {
+            entry.refreshing = true;
+        }
+        bool outage = entry.refreshFailed;
+        xSemaphoreGive(cacheMutex);
+
+        portENTER_CRITICAL(&statsLock);
+        if (fresh) {
+            stats.hits++;
+        } else if (outage) {
+            stats.outageHits++;
+        } else {
+            stats.staleHits++;
+        }
+        portEXIT_CRITICAL(&statsLock);
+        if (refresh) {
+            xTaskNotifyGive(dnsTaskHandle);
+        }
+        return true;
+    }
+    xSemaphoreGive(cacheMutex);
+
+    portENTER_CRITICAL(&statsLock);
+    stats.misses++;
+    portEXIT_CRITICAL(&statsLock);
+    if (!resolveHost(host.c_str(), address, ttlS)) {
+        return false;
+    }
+
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    CacheEntry* slot = &entries[0];
+    for (uint8_t i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (!entries[i].used || strcmp(entries[i].host, host.c_str()) == 0) {
+            slot = &entries[i];
+            break;
+        }
+        if (entries[i].lastUsedMs < slot->lastUsedMs) {
+            slot = &entries[i]; // Least recently used
+        }
+    }
+    memset(slot, 0, sizeof(*slot));
+    strncpy(slot->host, host.c_str(), sizeof(slot->host) - 1);
+    slot->address = address;
+    slot->resolvedMs = slot->lastUsedMs = millis();
+    slot->ttlMs = ttlS * 1000;
+    slot->used = true;
+    xSemaphoreGive(cacheMutex);
+
+    ip = address;
+    return true;
+}
+
+/**
+ * @brief Connects a client to the host and port of a URL through the cache.
+ * @param client The client.
+ * @param url URL; its host and port (defaultPort if none) are used.
+ * @param defaultPort Port of URLs without one.
+ * @param timeoutMs Connect timeout.
+ * @return true if the client is connected.
+ */
+bool dnsCacheConnect(WiFiClient& client, const String& url, uint16_t defaultPort, uint32_t timeoutMs) {
+    int hostStart = url.indexOf("://");
+    hostStart = hostStart < 0 ? 0 : hostStart + 3;
+    int pathStart = url.indexOf('/', hostStart);
+    if (pathStart < 0) {
+        pathStart = url.length();
+    }
+    int portStart = url.indexOf(':', hostStart);
+    bool hasPort = portStart >= 0 && portStart < pathStart;
+    String host = url.substring(hostStart, hasPort ? portStart : pathStart);
+    uint16_t port = hasPort ? (uint16_t)url.substring(portStart + 1, pathStart).toInt() : defaultPort;
+
+    IPAddress ip;
+    if (host.length() == 0 || port == 0 || !dnsCacheResolve(host, ip)) {
+        return false;
+    }
+    return client.connect(ip, port, (int32_t)timeoutMs) == 1;
+}
+
+/**
+ * @brief Returns a snapshot of the resolver cache counters.
+ * @return Copy of the current statistics.
+ */
+DnsCacheStats dnsCacheGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    DnsCacheStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    return snapshot;
+}
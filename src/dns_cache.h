@@ -0,0 +1,64 @@
+/**
+ * @file dns_cache.h
+ * @brief Declarations for the resolver cache used to reach the server by host name.
+ *
+ * Names are resolved with the station's own DNS query (A record) to the DNS
+ * servers of the WiFi connection, so the TTL of the answer is known. A cached
+ * address is used until its TTL (limited to DNS_TTL_MIN_S..DNS_TTL_MAX_S)
+ * expires. After that it is still returned at once while the DNS task
+ * refreshes it in the background. If the refresh fails, the last good address
+ * keeps being used and the refresh is retried every DNS_RETRY_S.
+ * Only a name that is not cached at all is resolved in the calling task.
+ */
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include "config.h"
+#include <WiFi.h>
+
+/** @brief Counters of the resolver cache. */
+struct DnsCacheStats {
+  uint32_t lookups;          ///< Lookups of host names (IP literals are not counted).
+  uint32_t hits;             ///< Answered from an entry within its TTL.
+  uint32_t staleHits;        ///< Answered from an expired entry while it was being refreshed.
+  uint32_t outageHits;       ///< Answered from an expired entry whose refresh had failed.
+  uint32_t misses;           ///< Resolved in the calling task.
+  uint32_t queries;          ///< DNS resolutions (misses and refreshes).
+  uint32_t queryFailures;    ///< Resolutions that failed.
+  uint32_t resolveMsAvg;     ///< Average duration of successful resolutions [ms].
+  uint32_t resolveMsMax;     ///< Maximum duration of successful resolutions [ms].
+};
+
+/**
+ * @brief Creates the cache lock and starts the DNS refresh task.
+ * @note Must be called in setup() before any task connects to the server.
+ * @return true on success.
+ */
+bool startDnsCache();
+
+/**
+ * @brief Returns the address of a host, from the cache if possible.
+ * @param host Host name or IP literal.
+ * @param ip Receives the address.
+ * @return true if an address is known.
+ */
+bool dnsCacheResolve(const String& host, IPAddress& ip);
+
+/**
+ * @brief Connects a client to the host and port of a URL through the cache.
+ * A client connected this way is reused by HTTPClient::begin(client, url).
+ * @param client The client.
+ * @param url URL; its host and port (defaultPort if none) are used.
+ * @param defaultPort Port of URLs without one.
+ * @param timeoutMs Connect timeout.
+ * @return true if the client is connected.
+ */
+bool dnsCacheConnect(WiFiClient& client, const String& url, uint16_t defaultPort, uint32_t timeoutMs);
+
+/**
+ * @brief Returns a snapshot of the resolver cache counters.
+ * @return Copy of the current statistics.
+ */
+DnsCacheStats dnsCacheGetStats();
+
+#endif // DNS_CACHE_H
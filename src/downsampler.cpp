@@ -0,0 +1,215 @@
+/**
+ * @file downsampler.cpp
+ * @brief Per-field windowed aggregation of samples into upload records.
+ *
+ * Each field keeps the running count, sum, minimum, maximum and last value of
+ * its current window, so every aggregation is available in O(1) when the
+ * window closes, whatever the window length. Fields are aggregated in
+ * physical units (see fieldValue()) and quantized again when the record is
+ * written. Unavailable readings are not aggregated; a window without any reading yields an unavailable
+ * field, except for "count", which yields 0.
+ *
+ * Only the uplink task calls downsamplerAdd(), so the accumulators need no lock.
+ */
+#include "downsampler.h"
+#include <math.h>
+
+/** @brief Running aggregate of one field over its current window. */
+struct FieldAccumulator {
+  uint32_t windowStartMs; ///< millis() at the start of the window.
+  uint32_t count;
+  float sum;
+  float min;
+  float max;
+  float last;
+  bool open;             ///< A window has been started.
+};
+
+static FieldAccumulator accumulators[SAMPLE_FIELD_COUNT];
+static FieldDownsampling activeDownsampling[SAMPLE_FIELD_COUNT]; // Configuration the accumulators belong to
+static DownsamplerStats stats = {};
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Units per physical unit of each field, in SampleFieldBit order. */
+static const int16_t FIELD_SCALES[SAMPLE_FIELD_COUNT] = {
+    TEMPERATURE_SCALE, PRESSURE_SCALE, HUMIDITY_SCALE, 1, WIND_SCALE, 1
+};
+
+/**
+ * @brief Reads a field of a sample in physical units.
+ * @return The value, NAN if unavailable.
+ */
+static float readField(const WeatherSample& sample, uint8_t field) {
+    int16_t scaled;
+    switch (field) {
+        case 0: scaled = sample.temperature; break;
+        case 1: scaled = sample.pressure; break;
+        case 2: scaled = sample.humidity; break;
+        case 3: scaled = sample.sunshine; break;
+        case 4: scaled = sample.windSpeed; break;
+        case 5: scaled = sample.precipitation; break;
+        default: return NAN;
+    }
+    return fieldValue(scaled, FIELD_SCALES[field]);
+}
+
+/**
+ * @brief Writes a field of a record from physical units; NAN marks it unavailable.
+ */
+static void writeField(WeatherSample& record, uint8_t field, float value) {
+    int16_t scaled = quantizeField(value, FIELD_SCALES[field]);
+    switch (field) {
+        case 0: record.temperature = scaled; break;
+        case 1: record.pressure = scaled; break;
+        case 2: record.humidity = scaled; break;
+        case 3: record.sunshine = scaled; break;
+        case 4: record.windSpeed = scaled; break;
+        case 5: record.precipitation = scaled; break;
+    }
+}
+
+/**
+ * @brief Returns the aggregate of a closed window.
+ */
+static float aggregate(const FieldAccumulator& accumulator, uint8_t aggregation) {
+    if (aggregation == AGGREGATE_COUNT) {
+        return (float)accumulator.count;
+    }
+    if (accumulator.count == 0) {
+        return NAN;
+    }
+    switch (aggregation) {
+        case AGGREGATE_MEAN: return accumulator.sum / accumulator.count;
+        case AGGREGATE_MIN:  return accumulator.min;
+        case AGGREGATE_MAX:  return accumulator.max;
+        case AGGREGATE_SUM:  return accumulator.sum;
+        default:             return accumulator.last;
+    }
+}
+
+/**
+ * @brief Starts a new, empty window.
+ */
+static void openWindow(FieldAccumulator& accumulator, uint32_t windowStartMs) {
+    accumulator.windowStartMs = windowStartMs;
+    accumulator.count = 0;
+    accumulator.sum = 0.0f;
+    accumulator.min = INFINITY;
+    accumulator.max = -INFINITY;
+    accumulator.last = NAN;
+    accumulator.open = true;
+}
+
+/**
+ * @brief Returns the record of a window, starting a new one if it has none yet.
+ * @param records Records of this call.
+ * @param recordWindowMs Window length of each record (0 for the pass-through record).
+ * @param count Number of records so far; incremented for a new record.
+ * @param sample The sample being added; provides the clock for epochS.
+ * @param startMs millis() at the start of the window.
+ * @param windowMs Window length, 0 for pass-through.
+ * @return The record.
+ */
+static WeatherSample& windowRecord(WeatherSample* records, uint32_t* recordWindowMs, uint8_t& count,
+                                   const WeatherSample& sample, uint32_t startMs, uint32_t windowMs) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (records[i].timestampMs == startMs && recordWindowMs[i] == windowMs) {
+            return records[i];
+        }
+    }
+    WeatherSample& record = records[count];
+    recordWindowMs[count] = windowMs;
+    count++;
+    record = sample;
+    record.timestampMs = startMs;
+    record.epochS = sample.epochS != 0 ? sample.epochS - (sample.timestampMs - startMs) / 1000 : 0;
+    for (uint8_t field = 0; field < SAMPLE_FIELD_COUNT; field++) {
+        writeField(record, field, NAN);
+    }
+    if (windowMs != 0) {
+        record.windGust = SAMPLE_MISSING; // Belongs to the current sample, not to the window
+    }
+    return record;
+}
+
+/**
+ * @brief Aggregates one sample and produces a record per closed window length.
+ * @param sample The sample, already masked with the field mask.
+ * @param config Active runtime configuration.
+ * @param records Receives up to SAMPLE_FIELD_COUNT records, oldest window first.
+ * @return Number of records produced.
+ */
+uint8_t downsamplerAdd(const WeatherSample& sample, const RuntimeConfig& config, WeatherSample* records) {
+    for (uint8_t field = 0; field < SAMPLE_FIELD_COUNT; field++) {
+        if (activeDownsampling[field].aggregation != config.downsampling[field].aggregation ||
+            activeDownsampling[field].windowMs != config.downsampling[field].windowMs) {
+            activeDownsampling[field] = config.downsampling[field];
+            accumulators[field].open = false; // The partial window of the old configuration is dropped
+        }
+    }
+
+    uint32_t recordWindowMs[SAMPLE_FIELD_COUNT];
+    uint8_t count = 0;
+    for (uint8_t field = 0; field < SAMPLE_FIELD_COUNT; field++) {
+        if (!(config.fieldMask & (1 << field))) {
+            continue;
+        }
+        const FieldDownsampling& downsampling = config.downsampling[field];
+        FieldAccumulator& accumulator = accumulators[field];
+        float value = readField(sample, field);
+
+        if (downsampling.windowMs == 0) { // Pass-through
+            WeatherSample& record = windowRecord(records, recordWindowMs, count, sample, sample.timestampMs, 0);
+            writeField(record, field, downsampling.aggregation == AGGREGATE_COUNT ? (isnan(value) ? 0.0f : 1.0f) : value);
+            continue;
+        }
+
+        // Elapsed time since the window opened, so that the millis() wrap does not close it early
+        uint32_t elapsedMs = sample.timestampMs - accumulator.windowStartMs;
+        if (accumulator.open && elapsedMs >= downsampling.windowMs) {
+            WeatherSample& record = windowRecord(records, recordWindowMs, count, sample,
+                                                 accumulator.windowStartMs, downsampling.windowMs);
+            writeField(record, field, aggregate(accumulator, downsampling.aggregation));
+            // The next window starts on the same grid, skipping windows without samples
+            openWindow(accumulator, accumulator.windowStartMs + elapsedMs / downsampling.windowMs * downsampling.windowMs);
+        }
+        if (!accumulator.open) {
+            openWindow(accumulator, sample.timestampMs - sample.timestampMs % downsampling.windowMs);
+        }
+        if (!isnan(value)) {
+            accumulator.count++;
+            accumulator.sum += value;
+            if (value < accumulator.min) accumulator.min = value;
+            if (value > accumulator.max) accumulator.max = value;
+            accumulator.last = value;
+        }
+    }
+
+    // Oldest window first (insertion sort of at most SAMPLE_FIELD_COUNT records)
+    for (uint8_t i = 1; i < count; i++) {
+        WeatherSample record = records[i];
+        uint8_t position = i;
+        while (position > 0 && (int32_t)(records[position - 1].timestampMs - record.timestampMs) > 0) {
+            records[position] = records[position - 1];
+            position--;
+        }
+        records[position] = record;
+    }
+
+    portENTER_CRITICAL(&statsLock);
+    stats.samplesIn++;
+    stats.recordsOut += count;
+    portEXIT_CRITICAL(&statsLock);
+    return count;
+}
+
+/**
+ * @brief Returns a snapshot of the downsampling counters.
+ * @return Copy of the current statistics.
+ */
+DownsamplerStats downsamplerGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    DownsamplerStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    return snapshot;
+}
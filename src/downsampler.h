@@ -0,0 +1,51 @@
+/**
+ * @file downsampler.h
+ * @brief Declarations for the per-field windowed downsampling stage between acquisition and uplink.
+ *
+ * Every field of the sample is aggregated on its own (see FieldDownsampling
+ * in runtime_config.h), e.g. temperature mean per minute, wind speed max per
+ * 10 s and precipitation sum per 5 min. The first window is aligned to a
+ * multiple of its length on the millis() clock and the following windows are
+ * back to back, so windows of related lengths close together. A window closes
+ * by the time elapsed since it opened, which stays correct across the millis()
+ * wrap. A field with a window of 0 passes every sample through.
+ *
+ * Each field keeps a constant-size accumulator that is updated in O(1) per
+ * sample. When the first sample of a new window arrives, every window that has
+ * ended becomes an output record stamped with the start of that window
+ * (timestampMs, and epochS derived from the sample's clock). Fields whose
+ * windows have the same length close together and share a record; a record
+ * never mixes windows of different lengths, so each value in it covers
+ * [timestamp, timestamp + window of its field). Pass-through fields form one
+ * record stamped with the sample itself. Fields not in a record are left
+ * unavailable in it.
+ */
+#ifndef DOWNSAMPLER_H
+#define DOWNSAMPLER_H
+
+#include "runtime_config.h"
+#include "sample.h"
+
+/** @brief Counters of the downsampling stage. */
+struct DownsamplerStats {
+  uint32_t samplesIn;   ///< Samples aggregated.
+  uint32_t recordsOut;  ///< Records produced.
+};
+
+/**
+ * @brief Aggregates one sample and produces a record per closed window length.
+ * The accumulators restart when the downsampling configuration changes.
+ * @param sample The sample, already masked with the field mask.
+ * @param config Active runtime configuration.
+ * @param records Receives up to SAMPLE_FIELD_COUNT records, oldest window first.
+ * @return Number of records produced.
+ */
+uint8_t downsamplerAdd(const WeatherSample& sample, const RuntimeConfig& config, WeatherSample* records);
+
+/**
+ * @brief Returns a snapshot of the downsampling counters.
+ * @return Copy of the current statistics.
+ */
+DownsamplerStats downsamplerGetStats();
+
+#endif // DOWNSAMPLER_H
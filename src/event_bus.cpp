@@ -0,0 +1,248 @@
+/**
+ * @file event_bus.cpp
+ * @brief In-process publish/subscribe event bus with a fixed-size message pool.
+ *
+ * This file implements the message pool (a free list over a static array),
+ * the subscriber tables and zero-copy delivery. A message carries a reference
+ * count equal to the number of queue subscribers holding it; the publisher
+ * holds one extra reference while dispatching so a fast subscriber cannot
+ * return the message to the pool before all deliveries are made. Pool and
+ * counter updates are short critical sections on a spinlock, so the bus may be
+ * used from tasks on both cores.
+ */
+#include "event_bus.h"
+#include "config.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+// --- Bus Configuration ---
+const uint8_t EVENT_POOL_SIZE = 16;
+const uint8_t MAX_QUEUE_SUBSCRIBERS = 6;
+const uint8_t MAX_CALLBACK_SUBSCRIBERS = 6;
+
+/** @brief A queue subscriber: receives pointers to matching messages. */
+struct EventSubscriber {
+  uint32_t topicMask;
+  QueueHandle_t queue;
+};
+
+/** @brief A callback subscriber: invoked in the publisher's context. */
+struct CallbackSubscriber {
+  uint32_t topicMask;
+  EventBusCallback callback;
+  void* context;
+};
+
+// --- State ---
+static BusMessage messagePool[EVENT_POOL_SIZE];
+static BusMessage* freeList[EVENT_POOL_SIZE];
+static uint8_t freeCount = 0;
+
+static EventSubscriber queueSubscribers[MAX_QUEUE_SUBSCRIBERS];
+static uint8_t queueSubscriberCount = 0;
+static CallbackSubscriber callbackSubscribers[MAX_CALLBACK_SUBSCRIBERS];
+static uint8_t callbackSubscriberCount = 0;
+
+static portMUX_TYPE busLock = portMUX_INITIALIZER_UNLOCKED;
+static EventBusStats stats;
+static uint64_t latencySumUs = 0;
+static uint32_t latencySamples = 0;
+
+// --- Pool Management ---
+
+/**
+ * @brief Drops one reference to a message and returns it to the pool when none are left.
+ * @param message The message to release.
+ */
+static void dropReference(BusMessage* message) {
+    portENTER_CRITICAL(&busLock);
+    if (message->refCount > 0 && --message->refCount == 0) {
+        freeList[freeCount++] = message;
+    }
+    portEXIT_CRITICAL(&busLock);
+}
+
+/**
+ * @brief Initializes the message pool and subscriber tables.
+ */
+void initEventBus() {
+    portENTER_CRITICAL(&busLock);
+    for (uint8_t i = 0; i < EVENT_POOL_SIZE; i++) {
+        messagePool[i].refCount = 0;
+        freeList[i] = &messagePool[i];
+    }
+    freeCount = EVENT_POOL_SIZE;
+    memset(&stats, 0, sizeof(stats));
+    portEXIT_CRITICAL(&busLock);
+    Serial.printf("Event bus initialized (%u pooled messages of %u bytes).\n",
+                  (unsigned)EVENT_POOL_SIZE, (unsigned)sizeof(BusMessage));
+}
+
+// --- Subscription ---
+
+/**
+ * @brief Registers a queue subscriber for the topics in the mask.
+ * @param topicMask Bitwise OR of TOPIC_BIT() values.
+ * @param queueDepth Number of messages the subscriber may hold queued.
+ * @return Subscriber handle, or NULL on failure.
+ */
+EventSubscriber* eventBusSubscribe(uint32_t topicMask, uint8_t queueDepth) {
+    QueueHandle_t queue = xQueueCreate(queueDepth, sizeof(BusMessage*));
+    if (queue == NULL) {
+        Serial.println("!!! ERROR: Failed to create event bus subscriber queue!");
+        return NULL;
+    }
+    EventSubscriber* subscriber = NULL;
+    portENTER_CRITICAL(&busLock);
+    if (queueSubscriberCount < MAX_QUEUE_SUBSCRIBERS) {
+        subscriber = &queueSubscribers[queueSubscriberCount];
+        subscriber->topicMask = topicMask;
+        subscriber->queue = queue;
+        queueSubscriberCount++; // Publish the slot only once it is fully initialized
+    }
+    portEXIT_CRITICAL(&busLock);
+    if (subscriber == NULL) {
+        Serial.println("!!! ERROR: Event bus queue subscriber table full!");
+        vQueueDelete(queue);
+    }
+    return subscriber;
+}
+
+/**
+ * @brief Registers a callback subscriber for the topics in the mask.
+ * @param topicMask Bitwise OR of TOPIC_BIT() values.
+ * @param callback Function called synchronously for every matching message.
+ * @param context Opaque pointer passed to the callback.
+ * @return true if registered, false if the table is full.
+ */
+bool eventBusSubscribeCallback(uint32_t topicMask, EventBusCallback callback, void* context) {
+    bool registered = false;
+    portENTER_CRITICAL(&busLock);
+    if (callbackSubscriberCount < MAX_CALLBACK_SUBSCRIBERS) {
+        CallbackSubscriber& entry = callbackSubscribers[callbackSubscriberCount];
+        entry.topicMask = topicMask;
+        entry.callback = callback;
+        entry.context = context;
+        callbackSubscriberCount++;
+        registered = true;
+    }
+    portEXIT_CRITICAL(&busLock);
+    if (!registered) {
+        Serial.println("!!! ERROR: Event bus callback subscriber table full!");
+    }
+    return registered;
+}
+
+// --- Publishing ---
+
+/**
+ * @brief Takes a free message from the pool for the given topic.
+ * @param topic Topic of the message.
+ * @return Pointer to the message, or NULL if the pool is exhausted.
+ */
+BusMessage* eventBusAcquire(EventTopic topic) {
+    BusMessage* message = NULL;
+    portENTER_CRITICAL(&busLock);
+    if (freeCount > 0) {
+        message = freeList[--freeCount];
+        message->refCount = 1; // Held by the publisher until eventBusPublish() completes
+    } else {
+        stats.poolExhausted++;
+    }
+    portEXIT_CRITICAL(&busLock);
+    if (message != NULL) {
+        message->topic = topic;
+    }
+    return message;
+}
+
+/**
+ * @brief Delivers an acquired message to all subscribers of its topic.
+ * Queue subscribers receive the message pointer; callback subscribers are
+ * called directly. Never blocks.
+ * @param message Message obtained from eventBusAcquire().
+ */
+void eventBusPublish(BusMessage* message) {
+    uint32_t startCycles = ESP.getCycleCount();
+    uint32_t topicBit = TOPIC_BIT(message->topic);
+    uint32_t overflows = 0;
+    message->publishedAtUs = esp_timer_get_time();
+
+    uint8_t subscriberCount = queueSubscriberCount;
+    for (uint8_t i = 0; i < subscriberCount; i++) {
+        EventSubscriber& subscriber = queueSubscribers[i];
+        if ((subscriber.topicMask & topicBit) == 0) {
+            continue;
+        }
+        portENTER_CRITICAL(&busLock);
+        message->refCount++;
+        portEXIT_CRITICAL(&busLock);
+        if (xQueueSend(subscriber.queue, &message, 0) != pdTRUE) {
+            overflows++;
+            dropReference(message);
+        }
+    }
+
+    uint8_t callbackCount = callbackSubscriberCount;
+    for (uint8_t i = 0; i < callbackCount; i++) {
+        if (callbackSubscribers[i].topicMask & topicBit) {
+            callbackSubscribers[i].callback(message, callbackSubscribers[i].context);
+        }
+    }
+
+    dropReference(message); // Publisher's reference
+
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    portENTER_CRITICAL(&busLock);
+    stats.published++;
+    stats.queueOverflows += overflows;
+    stats.publishCyclesLast = cycles;
+    if (cycles > stats.publishCyclesMax) stats.publishCyclesMax = cycles;
+    portEXIT_CRITICAL(&busLock);
+}
+
+// --- Receiving ---
+
+/**
+ * @brief Waits for the next message of a queue subscriber and records its dispatch latency.
+ * @param subscriber Subscriber handle.
+ * @param waitTicks Maximum time to block.
+ * @return The message, or NULL on timeout.
+ */
+const BusMessage* eventBusReceive(EventSubscriber* subscriber, TickType_t waitTicks) {
+    BusMessage* message = NULL;
+    if (subscriber == NULL || xQueueReceive(subscriber->queue, &message, waitTicks) != pdTRUE) {
+        return NULL;
+    }
+    uint32_t latencyUs = (uint32_t)(esp_timer_get_time() - message->publishedAtUs);
+    portENTER_CRITICAL(&busLock);
+    latencySumUs += latencyUs;
+    latencySamples++;
+    if (latencyUs > stats.dispatchLatencyUsMax) stats.dispatchLatencyUsMax = latencyUs;
+    portEXIT_CRITICAL(&busLock);
+    return message;
+}
+
+/**
+ * @brief Releases a message received with eventBusReceive().
+ * @param message The message to release.
+ */
+void eventBusRelease(const BusMessage* message) {
+    if (message != NULL) {
+        dropReference(const_cast<BusMessage*>(message));
+    }
+}
+
+/**
+ * @brief Returns a snapshot of the bus counters.
+ * @return Copy of the current statistics.
+ */
+EventBusStats eventBusGetStats() {
+    portENTER_CRITICAL(&busLock);
+    EventBusStats snapshot = stats;
+    snapshot.dispatchLatencyUsAvg = latencySamples > 0 ? (uint32_t)(latencySumUs / latencySamples) : 0;
+    snapshot.poolInUse = EVENT_POOL_SIZE - freeCount;
+    portEXIT_CRITICAL(&busLock);
+    return snapshot;
+}
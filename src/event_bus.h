@@ -0,0 +1,157 @@
+/**
+ * @file event_bus.h
+ * @brief Declarations for the in-process publish/subscribe event bus.
+ *
+ * Components exchange typed messages (samples, WiFi state, button gestures,
+ * configuration changes, uplink results, alerts) instead of shared globals. Messages
+ * are taken from a preallocated fixed-size pool and are delivered by pointer:
+ * every subscriber sees the same message instance, which returns to the pool
+ * once the last subscriber has released it.
+ *
+ * Two kinds of subscribers exist:
+ * - queue subscribers own a FreeRTOS queue of message pointers and process
+ *   messages in their own task (eventBusReceive() / eventBusRelease());
+ * - callback subscribers are invoked synchronously in the publisher's context
+ *   and must return quickly without blocking.
+ */
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include "config.h"
+#include "sample.h"
+#include "supervisor.h"
+#include "button_gesture.h"
+#include "alerts.h"
+
+/** @brief Topics of the event bus. */
+enum EventTopic {
+  TOPIC_SAMPLE = 0,      ///< New weather sample (data.sample).
+  TOPIC_WIFI_STATE,      ///< Supervisor state changed (data.wifi).
+  TOPIC_BUTTON,          ///< Button gesture recognised (data.button).
+  TOPIC_CONFIG_CHANGED,  ///< Stored configuration saved or cleared (data.config).
+  TOPIC_UPLINK_RESULT,   ///< Result of a data upload (data.uplink).
+  TOPIC_ALERT,           ///< Alert condition detected (data.alert).
+  TOPIC_COUNT
+};
+
+/** @brief Builds a subscription mask bit for a topic. */
+#define TOPIC_BIT(topic) (1UL << (topic))
+
+/** @brief Payload of TOPIC_WIFI_STATE. */
+struct WifiStateEvent {
+  SupervisorState state; ///< New supervisor state.
+  int32_t rssi;          ///< RSSI in dBm when connected, 0 otherwise.
+};
+
+/** @brief Payload of TOPIC_BUTTON. */
+struct ButtonEvent {
+  ButtonGesture gesture; ///< Recognised gesture.
+};
+
+/** @brief Payload of TOPIC_CONFIG_CHANGED. */
+struct ConfigChangedEvent {
+  DeviceMode mode; ///< Device mode stored in NVS after the change.
+};
+
+/** @brief Payload of TOPIC_UPLINK_RESULT. */
+struct UplinkResultEvent {
+  int httpCode;            ///< HTTP status code, or negative HTTPClient error.
+  uint32_t durationMs;     ///< Duration of the request.
+  uint32_t payloadBytes;   ///< Size of the request body.
+  uint32_t sampleTimestampMs; ///< Timestamp of the uploaded sample.
+};
+
+/** @brief A pooled bus message. Read-only for subscribers. */
+struct BusMessage {
+  EventTopic topic;       ///< Topic of the message (selects the payload member).
+  int64_t publishedAtUs;  ///< esp_timer timestamp of publishing.
+  uint8_t refCount;       ///< Number of subscribers still holding the message (managed by the bus).
+  union {
+    WeatherSample sample;
+    WifiStateEvent wifi;
+    ButtonEvent button;
+    ConfigChangedEvent config;
+    UplinkResultEvent uplink;
+    AlertEvent alert;
+  } data;
+};
+
+/** @brief Opaque handle of a queue subscriber. */
+struct EventSubscriber;
+
+/** @brief Callback subscriber signature. Runs in the publisher's task; must not block or keep the pointer. */
+typedef void (*EventBusCallback)(const BusMessage* message, void* context);
+
+/** @brief Counters describing bus usage and cost. */
+struct EventBusStats {
+  uint32_t published;          ///< Messages published.
+  uint32_t poolExhausted;      ///< Acquire attempts that found the pool empty.
+  uint32_t queueOverflows;     ///< Deliveries dropped because a subscriber queue was full.
+  uint32_t publishCyclesLast;  ///< CPU cycles spent in the most recent eventBusPublish().
+  uint32_t publishCyclesMax;   ///< Maximum CPU cycles spent in eventBusPublish().
+  uint32_t dispatchLatencyUsMax; ///< Maximum publish-to-receive latency of queue subscribers [us].
+  uint32_t dispatchLatencyUsAvg; ///< Average publish-to-receive latency of queue subscribers [us].
+  uint8_t poolInUse;           ///< Messages currently held by subscribers.
+};
+
+/**
+ * @brief Initializes the message pool and subscriber tables.
+ * @note Must be called in setup() before any subscription or publication.
+ */
+void initEventBus();
+
+/**
+ * @brief Registers a queue subscriber for the topics in the mask.
+ * @param topicMask Bitwise OR of TOPIC_BIT() values.
+ * @param queueDepth Number of messages the subscriber may hold queued.
+ * @return Subscriber handle, or NULL if the table is full or the queue could not be created.
+ */
+EventSubscriber* eventBusSubscribe(uint32_t topicMask, uint8_t queueDepth);
+
+/**
+ * @brief Registers a callback subscriber for the topics in the mask.
+ * @param topicMask Bitwise OR of TOPIC_BIT() values.
+ * @param callback Function called synchronously for every matching message.
+ * @param context Opaque pointer passed to the callback.
+ * @return true if registered, false if the table is full.
+ */
+bool eventBusSubscribeCallback(uint32_t topicMask, EventBusCallback callback, void* context);
+
+/**
+ * @brief Takes a free message from the pool for the given topic.
+ * The caller fills the matching payload member and then calls eventBusPublish().
+ * @param topic Topic of the message.
+ * @return Pointer to the message, or NULL if the pool is exhausted.
+ */
+BusMessage* eventBusAcquire(EventTopic topic);
+
+/**
+ * @brief Delivers an acquired message to all subscribers of its topic.
+ * Never blocks: a subscriber whose queue is full misses the message.
+ * Ownership passes to the bus; the publisher must not touch the message afterwards.
+ * @param message Message obtained from eventBusAcquire().
+ */
+void eventBusPublish(BusMessage* message);
+
+/**
+ * @brief Waits for the next message of a queue subscriber.
+ * @param subscriber Subscriber handle.
+ * @param waitTicks Maximum time to block.
+ * @return The message (must be released with eventBusRelease()), or NULL on timeout.
+ */
+const BusMessage* eventBusReceive(EventSubscriber* subscriber, TickType_t waitTicks);
+
+/**
+ * @brief Releases a message received with eventBusReceive().
+ * The message returns to the pool once all subscribers have released it.
+ * @param message The message to release.
+ */
+void eventBusRelease(const BusMessage* message);
+
+/**
+ * @brief Returns a snapshot of the bus counters.
+ * @return Copy of the current statistics.
+ */
+EventBusStats eventBusGetStats();
+
+#endif // EVENT_BUS_H
@@ -0,0 +1,435 @@
+/**
+ * @file fanout.cpp
+ * @brief Shared sample ring and per-destination sender tasks.
+ *
+ * The ring is written by an event bus callback in the sensor task: the sample
+ * is stored in slot head % FANOUT_RING_SAMPLES, then head is published. Each
+ * destination task keeps its own cursor (the oldest sample it has not sent)
+ * and reads slots cursor .. head - 1 in place. A slot is overwritten when the
+ * writer laps the reader; the reader checks for that after encoding and
+ * discards the report if it happened, so it never sends a torn sample.
+ */
+#include "fanout.h"
+#include "event_bus.h"
+#include "supervisor.h"
+#include "station_policies.h"
+#if WS_FEATURE_PROTOBUF
+#include "protobuf_encoder.h"
+#endif
+#include <WiFi.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// --- Fan-Out Configuration ---
+const uint32_t FANOUT_TASK_STACK = 6144;
+const int FANOUT_ERROR_NO_TRANSPORT = -100; // HTTP transport not compiled in
+
+static_assert(FANOUT_DEFAULT_QUEUE < FANOUT_RING_SAMPLES, "A queue must fit in the ring");
+static_assert(FANOUT_MAX_BATCH <= FANOUT_DEFAULT_QUEUE, "A report must fit in the default queue");
+
+/** @brief Parsed entry of the destinations specification (owned by its task). */
+struct Destination {
+  bool configured;
+  String url;              ///< http:// URL with <mac_plytki> replaced.
+  bool protobuf;
+  uint32_t everyMs;
+  uint8_t retries;
+  uint8_t queueLimit;
+};
+
+// --- Shared Ring ---
+static WeatherSample ring[FANOUT_RING_SAMPLES];
+static std::atomic<uint32_t> ringHead(0); // Samples written so far; the newest is in slot (head - 1) % size
+
+static TaskHandle_t destinationTasks[FANOUT_MAX_DESTINATIONS] = {};
+
+// --- Destinations Specification ---
+static String destinationsSpec;                // Guarded by specMutex
+static SemaphoreHandle_t specMutex = NULL;
+static std::atomic<uint32_t> specVersion(0);   // Incremented on every change
+static FanoutStats stats[FANOUT_MAX_DESTINATIONS] = {};
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Wakes every destination task.
+ */
+static void wakeDestinations() {
+    for (uint8_t i = 0; i < FANOUT_MAX_DESTINATIONS; i++) {
+        if (destinationTasks[i] != NULL) {
+            xTaskNotifyGive(destinationTasks[i]);
+        }
+    }
+}
+
+/**
+ * @brief Event bus callback storing every sample in the ring and waking the destination tasks.
+ * Runs in the sensor task; never blocks.
+ */
+static void onSample(const BusMessage* message, void* context) {
+    uint32_t head = ringHead.load(std::memory_order_relaxed);
+    ring[head % FANOUT_RING_SAMPLES] = message->data.sample;
+    ringHead.store(head + 1, std::memory_order_release);
+    wakeDestinations();
+}
+
+// --- Configuration ---
+
+/**
+ * @brief Finds entry number index of the specification; empty entries are skipped.
+ * @param spec The specification.
+ * @param index Entry number.
+ * @param begin Receives the first character of the entry.
+ * @param end Receives the character after the entry.
+ * @return false if the specification has fewer entries.
+ */
+static bool findEntry(const char* spec, uint8_t index, const char*& begin, const char*& end) {
+    const char* position = spec;
+    while (*position != '\0') {
+        while (*position == ' ' || *position == ';') {
+            position++;
+        }
+        if (*position == '\0') {
+            break;
+        }
+        begin = position;
+        while (*position != '\0' && *position != ';') {
+            position++;
+        }
+        end = position;
+        if (index == 0) {
+            return true;
+        }
+        index--;
+    }
+    return false;
+}
+
+/**
+ * @brief Parses one entry "<url> [key=value ...]" of the specification.
+ * @param begin First character of the entry.
+ * @param end Character after the entry.
+ * @param destination Receives the destination.
+ * @return false (with a message on the console) if the entry is invalid.
+ */
+static bool parseDestination(const char* begin, const char* end, Destination& destination) {
+    destination.protobuf = false;
+    destination.everyMs = 0;
+    destination.retries = FANOUT_DEFAULT_RETRIES;
+    destination.queueLimit = FANOUT_DEFAULT_QUEUE;
+
+    const char* position = begin;
+    bool first = true;
+    while (position < end) {
+        while (position < end && *position == ' ') {
+            position++;
+        }
+        const char* token = position;
+        while (position < end && *position != ' ') {
+            position++;
+        }
+        if (position == token) {
+            break;
+        }
+        String word;
+        word.reserve(position - token);
+        for (const char* c = token; c < position; c++) {
+            word += *c;
+        }
+
+        if (first) { // URL
+            first = false;
+            if (word.startsWith("https://") || word.startsWith("coap://")) {
+                // Their transports are single-connection singletons owned by the main uplink
+                Serial.printf("Fan-out: %s refused, destinations must use http://.\n", word.c_str());
+                return false;
+            }
+            if (!word.startsWith("http://")) {
+                word = "http://" + word;
+            }
+            if (!features::kHttpTransport) {
+                Serial.printf("Fan-out: No HTTP transport for %s in this build.\n", word.c_str());
+                return false;
+            }
+            word.replace("<mac_plytki>", WiFi.macAddress());
+            destination.url = word;
+            continue;
+        }
+
+        int equals = word.indexOf('=');
+        String key = equals > 0 ? word.substring(0, equals) : word;
+        String value = equals > 0 ? word.substring(equals + 1) : String();
+        long number = value.toInt();
+        if (key == "format" && value == "json") {
+            destination.protobuf = false;
+        } else if (key == "format" && value == "protobuf" && features::kProtobuf) {
+            destination.protobuf = true;
+        } else if (key == "every" && number >= 0 && number <= 24L * 60 * 60) {
+            destination.everyMs = (uint32_t)number * 1000;
+        } else if (key == "retries" && number >= 0 && number <= 100) {
+            destination.retries = (uint8_t)number;
+        } else if (key == "queue" && number >= 1 && number < FANOUT_RING_SAMPLES) {
+            destination.queueLimit = (uint8_t)number;
+        } else {
+            Serial.printf("Fan-out: Invalid option \"%s\".\n", word.c_str());
+            return false;
+        }
+    }
+    return !first;
+}
+
+/**
+ * @brief Reads entry number index of the specification into a destination.
+ * @param index Entry number (the destination slot).
+ * @param spec Copy of the specification.
+ * @param destination Receives the destination; configured is false if there is no valid entry.
+ */
+static void configureDestination(uint8_t index, const String& spec, Destination& destination) {
+    const char* begin;
+    const char* end;
+    destination.configured = findEntry(spec.c_str(), index, begin, end) &&
+                             parseDestination(begin, end, destination);
+    if (destination.configured) {
+        Serial.printf("Fan-out: Destination %u is %s (%s, every %lu s, %u retries, queue %u).\n",
+                      (unsigned)index, destination.url.c_str(), destination.protobuf ? "protobuf" : "json",
+                      (unsigned long)(destination.everyMs / 1000), (unsigned)destination.retries,
+                      (unsigned)destination.queueLimit);
+    }
+    portENTER_CRITICAL(&statsLock);
+    stats[index].configured = destination.configured;
+    stats[index].backlog = 0;
+    portEXIT_CRITICAL(&statsLock);
+}
+
+// --- Sending ---
+
+/**
+ * @brief Encodes ring samples first .. first + count - 1 in the destination's format.
+ * @param destination The destination.
+ * @param first Sequence number of the first sample in the ring.
+ * @param count Number of samples.
+ * @param payload Receives the body.
+ * @return Content-Type of the body, or NULL if encoding failed.
+ */
+static const char* encodeFromRing(const Destination& destination, uint32_t first, uint8_t count, String& payload) {
+#if WS_FEATURE_PROTOBUF
+    if (destination.protobuf) {
+        payload = "";
+        payload.reserve(count * PROTOBUF_SAMPLE_MAX_BYTES);
+        for (uint8_t i = 0; i < count; i++) {
+            if (!protobufAppendSample(ring[(first + i) % FANOUT_RING_SAMPLES], payload)) {
+                return NULL;
+            }
+        }
+        return PROTOBUF_CONTENT_TYPE;
+    }
+#endif
+    payload = "[";
+    for (uint8_t i = 0; i < count; i++) {
+        String encoded;
+        encodeTimestampedSample(ring[(first + i) % FANOUT_RING_SAMPLES], encoded);
+        if (i > 0) {
+            payload += ',';
+        }
+        payload += encoded;
+    }
+    payload += ']';
+    return ActiveStation::Encoder::contentType();
+}
+
+/**
+ * @brief Posts a body to the destination on a connection of its own.
+ * @return Status code, or a transport error (FANOUT_ERROR_NO_TRANSPORT if HTTP is not compiled in).
+ */
+static int postToDestination(const Destination& destination, const char* contentType, const String& body) {
+#if WS_TRANSPORT_HTTP
+    String response;
+    return HttpTransport::post(destination.url, contentType, body, response);
+#else
+    return FANOUT_ERROR_NO_TRANSPORT;
+#endif
+}
+
+// --- FreeRTOS Tasks: Destinations ---
+
+/**
+ * @brief FreeRTOS task function sending the ring samples to one destination.
+ * Wakes on every new sample, when the report period has elapsed or when a
+ * retry is due. Reports are sent when every has elapsed since the last one
+ * (at once for every=0) or FANOUT_MAX_BATCH samples are waiting. A failed
+ * report is retried after FANOUT_RETRY_MIN_MS, doubling up to
+ * FANOUT_RETRY_MAX_MS; after its retries its samples are dropped.
+ * @param pvParameters Destination slot (index into the specification).
+ */
+static void fanoutTaskFunction(void* pvParameters) {
+    uint8_t index = (uint8_t)(uintptr_t)pvParameters;
+    Destination destination;
+    destination.configured = false;
+    bool specRead = false;
+    uint32_t activeVersion = 0;
+    uint32_t cursor = ringHead.load(std::memory_order_acquire);
+    uint32_t lastReportMs = millis();
+    uint8_t attempts = 0;
+    uint32_t retryAtMs = 0;
+    TickType_t waitTicks = 0;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, waitTicks);
+        waitTicks = portMAX_DELAY; // Next sample, unless a report or retry is due earlier
+
+        uint32_t version = specVersion.load(std::memory_order_acquire);
+        if (!specRead || version != activeVersion) {
+            activeVersion = version;
+            specRead = true;
+            configureDestination(index, fanoutGetDestinations(), destination);
+            cursor = ringHead.load(std::memory_order_acquire);
+            lastReportMs = millis();
+            attempts = 0;
+        }
+        if (!destination.configured) {
+            continue;
+        }
+
+        uint32_t head = ringHead.load(std::memory_order_acquire);
+        uint32_t backlog = head - cursor;
+        if (backlog > destination.queueLimit) { // Fell behind: drop the oldest
+            uint32_t dropped = backlog - destination.queueLimit;
+            cursor += dropped;
+            backlog = destination.queueLimit;
+            portENTER_CRITICAL(&statsLock);
+            stats[index].samplesDropped += dropped;
+            portEXIT_CRITICAL(&statsLock);
+        }
+        portENTER_CRITICAL(&statsLock);
+        stats[index].backlog = backlog;
+        portEXIT_CRITICAL(&statsLock);
+        if (backlog == 0 || getSupervisorState() != STATE_ONLINE) {
+            continue;
+        }
+
+        uint32_t now = millis();
+        uint32_t dueAtMs = attempts > 0 ? retryAtMs : lastReportMs + destination.everyMs;
+        if (attempts == 0 && backlog >= FANOUT_MAX_BATCH) {
+            dueAtMs = now;
+        }
+        if ((int32_t)(dueAtMs - now) > 0) {
+            waitTicks = pdMS_TO_TICKS(dueAtMs - now);
+            continue;
+        }
+
+        uint8_t count = backlog < FANOUT_MAX_BATCH ? (uint8_t)backlog : FANOUT_MAX_BATCH;
+        String payload;
+        const char* contentType = encodeFromRing(destination, cursor, count, payload);
+        if (ringHead.load(std::memory_order_acquire) - cursor >= FANOUT_RING_SAMPLES) {
+            waitTicks = 0; // Lapped by the writer while encoding; drop the oldest and encode again
+            continue;
+        }
+
+        int code = contentType != NULL ? postToDestination(destination, contentType, payload) : FANOUT_ERROR_NO_TRANSPORT;
+        now = millis();
+        bool ok = code >= 200 && code < 300;
+        bool giveUp = !ok && attempts >= destination.retries;
+        portENTER_CRITICAL(&statsLock);
+        stats[index].lastCode = code;
+        if (ok) {
+            stats[index].reportsSent++;
+            stats[index].samplesSent += count;
+        } else {
+            stats[index].failedAttempts++;
+        }
+        if (giveUp) {
+            stats[index].reportsDropped++;
+            stats[index].samplesDropped += count;
+        }
+        portEXIT_CRITICAL(&statsLock);
+
+        if (ok || giveUp) {
+            if (giveUp) {
+                Serial.printf("Fan-out: Destination %u dropped %u sample(s) after %u attempt(s), last error %d.\n",
+                              (unsigned)index, (unsigned)count, (unsigned)attempts + 1, code);
+            }
+            cursor += count;
+            attempts = 0;
+            lastReportMs = now;
+            waitTicks = backlog - count >= FANOUT_MAX_BATCH ? 0 : portMAX_DELAY;
+        } else {
+            uint32_t delayMs = FANOUT_RETRY_MIN_MS << (attempts < 5 ? attempts : 5);
+            if (delayMs > FANOUT_RETRY_MAX_MS) {
+                delayMs = FANOUT_RETRY_MAX_MS;
+            }
+            attempts++;
+            retryAtMs = now + delayMs;
+            waitTicks = pdMS_TO_TICKS(delayMs);
+            DEBUG_PRINTF("Fan-out: Destination %u failed (%d), retry %u in %lu ms.\n",
+                         (unsigned)index, code, (unsigned)attempts, (unsigned long)delayMs);
+        }
+    }
+}
+
+/**
+ * @brief Creates the shared sample ring, subscribes it to TOPIC_SAMPLE and starts one task per destination slot.
+ * The tasks read their entry of the destinations specification and pick up changes to it.
+ * @return true on success.
+ */
+bool startFanout() {
+    specMutex = xSemaphoreCreateMutex();
+    if (specMutex == NULL) {
+        return false;
+    }
+    for (uint8_t i = 0; i < FANOUT_MAX_DESTINATIONS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "FanoutTask%u", (unsigned)i);
+        if (xTaskCreatePinnedToCore(fanoutTaskFunction, name, FANOUT_TASK_STACK,
+                                    (void*)(uintptr_t)i, 1, &destinationTasks[i], APP_CPU_NUM) != pdPASS) {
+            return false;
+        }
+    }
+    return eventBusSubscribeCallback(TOPIC_BIT(TOPIC_SAMPLE), onSample, NULL);
+}
+
+/**
+ * @brief Replaces the destinations specification and wakes the destination tasks.
+ * @param spec The new specification, empty for none.
+ */
+void fanoutSetDestinations(const String& spec) {
+    if (specMutex == NULL) {
+        return;
+    }
+    xSemaphoreTake(specMutex, portMAX_DELAY);
+    destinationsSpec = spec;
+    xSemaphoreGive(specMutex);
+    specVersion.fetch_add(1, std::memory_order_release);
+    wakeDestinations();
+}
+
+/**
+ * @brief Returns a copy of the destinations specification.
+ * @return The specification, empty for none.
+ */
+String fanoutGetDestinations() {
+    String spec;
+    if (specMutex == NULL) {
+        return spec;
+    }
+    xSemaphoreTake(specMutex, portMAX_DELAY);
+    spec = destinationsSpec;
+    xSemaphoreGive(specMutex);
+    return spec;
+}
+
+/**
+ * @brief Returns a snapshot of the counters of one destination.
+ * @param destination Index of the destination in the specification (0 .. FANOUT_MAX_DESTINATIONS - 1).
+ * @return Copy of the current statistics.
+ */
+FanoutStats fanoutGetStats(uint8_t destination) {
+    FanoutStats snapshot = {};
+    if (destination >= FANOUT_MAX_DESTINATIONS) {
+        return snapshot;
+    }
+    portENTER_CRITICAL(&statsLock);
+    snapshot = stats[destination];
+    portEXIT_CRITICAL(&statsLock);
+    return snapshot;
+}
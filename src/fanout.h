@@ -0,0 +1,79 @@
+/**
+ * @file fanout.h
+ * @brief Declarations for the fan-out of samples to extra destinations.
+ *
+ * Besides serverAddress, which gets the reports of the uplink (see uplink.h),
+ * up to FANOUT_MAX_DESTINATIONS servers can receive every sample, e.g. an
+ * archive. They are configured in the destinations specification (see
+ * fanoutSetDestinations()), one entry per destination separated by ';':
+ *
+ *     <url> [format=json|protobuf] [every=<s>] [retries=<n>] [queue=<n>]
+ *
+ * - url: http:// URL the reports are posted to; a URL without scheme is
+ *   http://. <mac_plytki> is replaced by the MAC address. https:// and
+ *   coap:// are refused: the HTTPS and CoAP transports keep one connection,
+ *   session and request lock for the whole device, which belong to the main
+ *   uplink, and a destination sharing them would make every request switch
+ *   hosts (a full TLS handshake each time) and hold the lock the uplink waits
+ *   on. HTTP posts open their own connection and share nothing.
+ * - format: JSON array of time-stamped samples (default) or a telemetry.Batch
+ *   (WS_FEATURE_PROTOBUF builds only).
+ * - every: seconds between reports, 0 (default) to send every sample at once.
+ * - retries: retries of a failed report before its samples are dropped.
+ * - queue: samples the destination may fall behind before the oldest are dropped.
+ *
+ * Every sample is written once into a shared ring of FANOUT_RING_SAMPLES
+ * samples. Each destination has its own task and its own read position in
+ * the ring, and encodes its reports straight from the ring slots, so samples
+ * are never copied per destination. The writer never waits for a reader: a
+ * destination that falls behind loses its oldest samples, and the others are
+ * not affected.
+ */
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include "config.h"
+
+/** @brief Counters of one destination. */
+struct FanoutStats {
+  bool configured;         ///< The destination has a valid entry in the specification.
+  uint32_t reportsSent;    ///< Reports acknowledged with a 2xx status.
+  uint32_t samplesSent;    ///< Samples in those reports.
+  uint32_t failedAttempts; ///< Posts that failed (each retry counts).
+  uint32_t reportsDropped; ///< Reports given up after their retries.
+  uint32_t samplesDropped; ///< Samples lost to dropped reports or a full queue.
+  uint32_t backlog;        ///< Samples waiting to be sent.
+  int lastCode;            ///< Status code or transport error of the last post.
+};
+
+/**
+ * @brief Creates the shared sample ring, subscribes it to TOPIC_SAMPLE and starts one task per destination slot.
+ * The tasks read their entry of the destinations specification and pick up changes to it.
+ * @note Must be called after initEventBus() and before the configuration is loaded.
+ * @return true on success.
+ */
+bool startFanout();
+
+/**
+ * @brief Replaces the destinations specification (empty for none) and wakes the destination tasks.
+ * The specification is kept by the fan-out under a mutex; the tasks take a
+ * copy only when it has changed. Safe to call from any task.
+ * @param spec The new specification.
+ */
+void fanoutSetDestinations(const String& spec);
+
+/**
+ * @brief Returns a copy of the destinations specification.
+ * Safe to call from any task.
+ * @return The specification, empty for none.
+ */
+String fanoutGetDestinations();
+
+/**
+ * @brief Returns a snapshot of the counters of one destination.
+ * @param destination Index of the destination in the specification (0 .. FANOUT_MAX_DESTINATIONS - 1).
+ * @return Copy of the current statistics.
+ */
+FanoutStats fanoutGetStats(uint8_t destination);
+
+#endif // FANOUT_H
@@ -0,0 +1,292 @@
+/**
+ * @file http_server.cpp
+ * @brief Local HTTP server on esp_http_server with registration before start.
+ *
+ * Every handler is registered through dispatch(), which counts the request
+ * and calls the module's handler stored in user_ctx. The open/close hooks
+ * count sockets; the close hook also tells a streaming module that one of
+ * its clients is gone and then closes the socket (esp_http_server leaves
+ * that to a custom close_fn).
+ */
+#include "http_server.h"
+#include <LittleFS.h>
+#include <lwip/sockets.h>
+#include <freertos/FreeRTOS.h>
+
+const size_t HTTP_SERVER_STACK = 6144;       // Handlers build the portal page and send file chunks on this stack
+
+/** @brief A registered handler. */
+struct HandlerEntry {
+  const char* uri;
+  httpd_method_t method;
+  HttpHandler handler;
+};
+
+static HandlerEntry handlers[WEB_MAX_HANDLERS];
+static uint8_t handlerCount = 0;
+static HttpCloseHook closeHook = NULL;
+static httpd_handle_t serverHandle = NULL;
+
+static HttpServerStats stats = {};
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Common entry point of all requests.
+ */
+static esp_err_t dispatch(httpd_req_t* request) {
+    portENTER_CRITICAL(&statsLock);
+    stats.requests++;
+    portEXIT_CRITICAL(&statsLock);
+    const HandlerEntry* entry = (const HandlerEntry*)request->user_ctx;
+    return entry->handler(request);
+}
+
+/**
+ * @brief Counts an accepted socket.
+ */
+static esp_err_t onSocketOpen(httpd_handle_t server, int socket) {
+    portENTER_CRITICAL(&statsLock);
+    stats.connections++;
+    stats.open++;
+    portEXIT_CRITICAL(&statsLock);
+    return ESP_OK;
+}
+
+/**
+ * @brief Notifies the close hook and closes the socket.
+ */
+static void onSocketClose(httpd_handle_t server, int socket) {
+    if (closeHook != NULL) {
+        closeHook(socket);
+    }
+    close(socket);
+    portENTER_CRITICAL(&statsLock);
+    if (stats.open > 0) {
+        stats.open--;
+    }
+    portEXIT_CRITICAL(&statsLock);
+}
+
+/**
+ * @brief Registers one handler with the running server.
+ */
+static bool registerHandler(HandlerEntry& entry) {
+    httpd_uri_t uri = {};
+    uri.uri = entry.uri;
+    uri.method = entry.method;
+    uri.handler = dispatch;
+    uri.user_ctx = &entry;
+    return httpd_register_uri_handler(serverHandle, &uri) == ESP_OK;
+}
+
+// --- Public API ---
+
+/**
+ * @brief Registers a handler; registrations made before the server starts are applied when it does.
+ * @note Call from setup() only.
+ * @param uri Exact path, e.g. "/api/current".
+ * @param method HTTP_GET or HTTP_POST.
+ * @param handler The handler.
+ * @return false if WEB_MAX_HANDLERS handlers are already registered.
+ */
+bool httpServerOn(const char* uri, httpd_method_t method, HttpHandler handler) {
+    if (handlerCount >= WEB_MAX_HANDLERS) {
+        Serial.printf("!!! ERROR: No handler slot left for %s!\n", uri);
+        return false;
+    }
+    HandlerEntry& entry = handlers[handlerCount++];
+    entry.uri = uri;
+    entry.method = method;
+    entry.handler = handler;
+    return serverHandle == NULL || registerHandler(entry);
+}
+
+/**
+ * @brief Sets the hook called when a socket is closed.
+ * @param hook The hook.
+ */
+void httpServerOnClose(HttpCloseHook hook) {
+    closeHook = hook;
+}
+
+/**
+ * @brief Starts the server on port 80 if it is not running yet.
+ * @note Called by the supervisor task only (entering provisioning or online).
+ * @return true if the server is running.
+ */
+bool startHttpServer() {
+    if (serverHandle != NULL) {
+        return true;
+    }
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = 80;
+    config.core_id = APP_CPU_NUM;
+    config.stack_size = HTTP_SERVER_STACK;
+    config.max_open_sockets = WEB_MAX_CONNECTIONS;
+    config.max_uri_handlers = WEB_MAX_HANDLERS;
+    config.lru_purge_enable = true;
+    config.recv_wait_timeout = WEB_SOCKET_TIMEOUT_S;
+    config.send_wait_timeout = WEB_SOCKET_TIMEOUT_S;
+    config.open_fn = onSocketOpen;
+    config.close_fn = onSocketClose;
+
+    httpd_handle_t handle = NULL;
+    if (httpd_start(&handle, &config) != ESP_OK) {
+        Serial.println("!!! ERROR: Failed to start the HTTP server!");
+        return false;
+    }
+    serverHandle = handle;
+    for (uint8_t i = 0; i < handlerCount; i++) {
+        if (!registerHandler(handlers[i])) {
+            Serial.printf("!!! ERROR: Failed to register %s!\n", handlers[i].uri);
+        }
+    }
+    Serial.printf("HTTP server started (%u handlers, up to %u connections).\n",
+                  (unsigned)handlerCount, (unsigned)WEB_MAX_CONNECTIONS);
+    return true;
+}
+
+/**
+ * @brief Returns the server handle for httpd_queue_work() and httpd_socket_send().
+ * @return The handle, NULL before the server has started.
+ */
+httpd_handle_t httpServerHandle() {
+    return serverHandle;
+}
+
+/**
+ * @brief Answers a request whose body did not arrive in time with 408.
+ * @return false, for httpServerReadBody().
+ */
+static bool rejectSlowBody(httpd_req_t* request) {
+    portENTER_CRITICAL(&statsLock);
+    stats.timedOutBodies++;
+    portEXIT_CRITICAL(&statsLock);
+    httpd_resp_set_status(request, "408 Request Timeout");
+    httpd_resp_set_hdr(request, "Connection", "close");
+    httpd_resp_send(request, "Request body timed out.", HTTPD_RESP_USE_STRLEN);
+    return false;
+}
+
+/**
+ * @brief Reads a request body of at most WEB_MAX_FORM_BYTES; larger bodies are answered with 413,
+ * bodies not complete within WEB_BODY_TIMEOUT_MS with 408.
+ * @param request The request.
+ * @param body Receives the body.
+ * @return false if the body was too large or could not be read; the handler should return ESP_FAIL to close the connection.
+ */
+bool httpServerReadBody(httpd_req_t* request, String& body) {
+    if (request->content_len > WEB_MAX_FORM_BYTES) {
+        portENTER_CRITICAL(&statsLock);
+        stats.rejectedBodies++;
+        portEXIT_CRITICAL(&statsLock);
+        httpd_resp_set_status(request, "413 Payload Too Large");
+        httpd_resp_send(request, "Request body too large.", HTTPD_RESP_USE_STRLEN);
+        return false;
+    }
+    body = "";
+    body.reserve(request->content_len);
+    char buffer[128];
+    size_t remaining = request->content_len;
+    uint32_t startMs = millis();
+    while (remaining > 0) {
+        // The server has a single task: a client that stalls or trickles its
+        // body must not hold it beyond WEB_BODY_TIMEOUT_MS plus one receive wait.
+        if (millis() - startMs > WEB_BODY_TIMEOUT_MS) {
+            return rejectSlowBody(request);
+        }
+        int received = httpd_req_recv(request, buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+        if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+            return rejectSlowBody(request);
+        }
+        if (received <= 0) {
+            return false;
+        }
+        body.concat(buffer, (unsigned)received);
+        remaining -= (size_t)received;
+    }
+    return true;
+}
+
+/**
+ * @brief Decodes %XX escapes and '+' of a form field.
+ */
+static String urlDecode(const char* begin, const char* end) {
+    String decoded;
+    decoded.reserve(end - begin);
+    for (const char* c = begin; c < end; c++) {
+        if (*c == '+') {
+            decoded += ' ';
+        } else if (*c == '%' && end - c > 2 && isxdigit((unsigned char)c[1]) && isxdigit((unsigned char)c[2])) {
+            char hex[3] = {c[1], c[2], '\0'};
+            decoded += (char)strtol(hex, NULL, 16);
+            c += 2;
+        } else {
+            decoded += *c;
+        }
+    }
+    return decoded;
+}
+
+/**
+ * @brief Returns a field of an application/x-www-form-urlencoded body, URL-decoded.
+ * @param body The body.
+ * @param name Field name.
+ * @param value Receives the value.
+ * @return false if the field is not present.
+ */
+bool httpFormValue(const String& body, const char* name, String& value) {
+    const char* position = body.c_str();
+    const char* end = position + body.length();
+    size_t nameLength = strlen(name);
+    while (position < end) {
+        const char* pairEnd = (const char*)memchr(position, '&', end - position);
+        if (pairEnd == NULL) {
+            pairEnd = end;
+        }
+        const char* equals = (const char*)memchr(position, '=', pairEnd - position);
+        const char* nameEnd = equals != NULL ? equals : pairEnd;
+        if ((size_t)(nameEnd - position) == nameLength && strncmp(position, name, nameLength) == 0) {
+            value = equals != NULL ? urlDecode(equals + 1, pairEnd) : String();
+            return true;
+        }
+        position = pairEnd + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief Sends a LittleFS file in WEB_CHUNK_BYTES chunks, or 404 if it does not exist.
+ * @param request The request.
+ * @param path File path.
+ * @param contentType Content-Type of the response.
+ * @return ESP_OK unless sending failed.
+ */
+esp_err_t httpServerSendFile(httpd_req_t* request, const char* path, const char* contentType) {
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return httpd_resp_send_err(request, HTTPD_404_NOT_FOUND, "File not found");
+    }
+    httpd_resp_set_type(request, contentType);
+    char chunk[WEB_CHUNK_BYTES];
+    size_t length;
+    while ((length = file.read((uint8_t*)chunk, sizeof(chunk))) > 0) {
+        if (httpd_resp_send_chunk(request, chunk, length) != ESP_OK) {
+            file.close();
+            return ESP_FAIL;
+        }
+    }
+    file.close();
+    return httpd_resp_send_chunk(request, NULL, 0);
+}
+
+/**
+ * @brief Returns a snapshot of the HTTP server counters.
+ * @return Copy of the current statistics.
+ */
+HttpServerStats httpServerGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    HttpServerStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    return snapshot;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file http_server.h
+ * @brief Declarations for the local HTTP server shared by the portal and the local APIs.
+ *
+ * The server is ESP-IDF's esp_http_server: one task waits on all sockets with
+ * select() and runs a handler only when a complete request header has
+ * arrived, so a slow client never holds up the others. Connections are kept
+ * alive between requests. At most WEB_MAX_CONNECTIONS sockets are open; a
+ * new connection closes the least recently used one.
+ *
+ * Memory per connection is bounded: the request header is parsed into one
+ * scratch buffer shared by all connections (requests are handled one at a
+ * time), request bodies are limited to WEB_MAX_FORM_BYTES and files are sent
+ * in WEB_CHUNK_BYTES chunks from the server task's stack.
+ *
+ * Modules register their handlers with httpServerOn() during setup(); the
+ * server is started on first use in AP or STA mode, when the network stack
+ * is up, and then keeps running across mode changes.
+ */
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include "config.h"
+#include <esp_http_server.h>
+
+/** @brief Request handler; runs in the server task and must not block. */
+typedef esp_err_t (*HttpHandler)(httpd_req_t* request);
+
+/** @brief Hook called in the server task when a socket is closed. */
+typedef void (*HttpCloseHook)(int socket);
+
+/** @brief Counters of the HTTP server. */
+struct HttpServerStats {
+  uint32_t requests;       ///< Requests passed to a handler.
+  uint32_t connections;    ///< Sockets accepted.
+  uint16_t open;           ///< Sockets currently open.
+  uint32_t rejectedBodies; ///< Requests refused because the body exceeded WEB_MAX_FORM_BYTES.
+  uint32_t timedOutBodies; ///< Requests refused because the body did not arrive within WEB_BODY_TIMEOUT_MS.
+};
+
+/**
+ * @brief Registers a handler; registrations made before the server starts are applied when it does.
+ * @param uri Exact path, e.g. "/api/current".
+ * @param method HTTP_GET or HTTP_POST.
+ * @param handler The handler.
+ * @return false if WEB_MAX_HANDLERS handlers are already registered.
+ */
+bool httpServerOn(const char* uri, httpd_method_t method, HttpHandler handler);
+
+/**
+ * @brief Sets the hook called when a socket is closed (e.g. to forget a streaming client).
+ * @param hook The hook.
+ */
+void httpServerOnClose(HttpCloseHook hook);
+
+/**
+ * @brief Starts the server on port 80 if it is not running yet.
+ * @note Call only once the network stack is up (AP or STA mode started).
+ * @return true if the server is running.
+ */
+bool startHttpServer();
+
+/**
+ * @brief Returns the server handle for httpd_queue_work() and httpd_socket_send().
+ * @return The handle, NULL before the server has started.
+ */
+httpd_handle_t httpServerHandle();
+
+/**
+ * @brief Reads a request body of at most WEB_MAX_FORM_BYTES; larger bodies are answered with 413,
+ * bodies not complete within WEB_BODY_TIMEOUT_MS with 408.
+ * @param request The request.
+ * @param body Receives the body.
+ * @return false if the body was too large or could not be read (a response has been sent).
+ */
+bool httpServerReadBody(httpd_req_t* request, String& body);
+
+/**
+ * @brief Returns a field of an application/x-www-form-urlencoded body, URL-decoded.
+ * @param body The body.
+ * @param name Field name.
+ * @param value Receives the value.
+ * @return false if the field is not present.
+ */
+bool httpFormValue(const String& body, const char* name, String& value);
+
+/**
+ * @brief Sends a LittleFS file in WEB_CHUNK_BYTES chunks, or 404 if it does not exist.
+ * @param request The request.
+ * @param path File path.
+ * @param contentType Content-Type of the response.
+ * @return ESP_OK unless sending failed.
+ */
+esp_err_t httpServerSendFile(httpd_req_t* request, const char* path, const char* contentType);
+
+/**
+ * @brief Returns a snapshot of the HTTP server counters.
+ * @return Copy of the current statistics.
+ */
+HttpServerStats httpServerGetStats();
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,542 @@
+/**
+ * @file https_transport.cpp
+ * @brief HTTP/1.1 client over one kept-alive mbedTLS connection with TLS session resumption.
+ *
+ * TCP is provided by WiFiClient, which mbedTLS uses through the tlsSend() and
+ * tlsRecv() callbacks. After every handshake the session (master secret and,
+ * if the server issued one, its session ticket) is saved and offered on the
+ * next connection. A handshake counts as resumed when the server accepted the
+ * offer, which is visible as the unchanged master secret.
+ *
+ * The heap cost of a handshake is the drop of free heap below its level at
+ * the start of the handshake, sampled at every socket read and write the
+ * handshake makes.
+ */
+#include "https_transport.h"
+
+#if WS_TRANSPORT_HTTPS
+#include "dns_cache.h"
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/error.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#if !defined(MBEDTLS_AES_ALT) || !defined(MBEDTLS_SHA256_ALT)
+#warning "mbedTLS is built without hardware AES/SHA; TLS is processed in software"
+#endif
+
+const size_t HTTPS_MAX_LINE = 512;           // Longer status and header lines are truncated
+const char* const HTTPS_DRBG_PERSONALIZATION = "ws-https";
+
+// --- TLS State (guarded by requestMutex) ---
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context drbg;
+static mbedtls_ssl_config tlsConfig;
+static mbedtls_ssl_context tls;
+static mbedtls_x509_crt caChain;
+static mbedtls_ssl_session savedSession;     // Session of the last handshake, offered on the next connection
+static bool haveSession = false;
+
+// --- Connection State (guarded by requestMutex) ---
+static WiFiClient client;
+static SemaphoreHandle_t requestMutex = NULL;
+static bool missingCaCert = false;           // Not started: no CA and not an insecure build
+static bool connectionOpen = false;          // TLS established on client
+static String connectedHost;
+static uint16_t connectedPort = 0;
+static uint8_t rxBuffer[256];                // Decrypted bytes not yet consumed
+static size_t rxLength = 0;
+static size_t rxPosition = 0;
+
+// --- Handshake Heap Sampling ---
+static bool samplingHeap = false;
+static size_t handshakeMinFree = 0;
+
+static HttpsStats stats = {};
+static uint32_t fullSumMs = 0;
+static uint32_t resumedSumMs = 0;
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Socket Callbacks ---
+
+/** @brief Records the free heap while a handshake is running. */
+static void sampleHandshakeHeap() {
+    if (samplingHeap) {
+        size_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        if (freeHeap < handshakeMinFree) {
+            handshakeMinFree = freeHeap;
+        }
+    }
+}
+
+/** @brief mbedTLS send callback writing to the WiFiClient. */
+static int tlsSend(void* context, const unsigned char* buffer, size_t length) {
+    sampleHandshakeHeap();
+    WiFiClient* socket = static_cast<WiFiClient*>(context);
+    size_t written = socket->write(buffer, length);
+    return written > 0 ? (int)written : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+/** @brief mbedTLS receive callback reading from the WiFiClient, with timeout. */
+static int tlsRecv(void* context, unsigned char* buffer, size_t length, uint32_t timeoutMs) {
+    sampleHandshakeHeap();
+    WiFiClient* socket = static_cast<WiFiClient*>(context);
+    uint32_t start = millis();
+    while (socket->available() <= 0) {
+        if (!socket->connected()) {
+            return 0; // End of stream
+        }
+        if (timeoutMs > 0 && millis() - start >= timeoutMs) {
+            return MBEDTLS_ERR_SSL_TIMEOUT;
+        }
+        vTaskDelay(1);
+    }
+    int count = socket->read(buffer, length);
+    return count > 0 ? count : MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+// --- Connection ---
+
+/**
+ * @brief Closes the connection; the saved session is kept for resumption.
+ * @param notify true to send a TLS close_notify first.
+ */
+static void closeConnection(bool notify) {
+    if (connectionOpen && notify) {
+        mbedtls_ssl_close_notify(&tls);
+    }
+    client.stop();
+    connectionOpen = false;
+    rxLength = rxPosition = 0;
+}
+
+/** @brief Forgets the saved session, e.g. because the server changed. */
+static void forgetSession() {
+    mbedtls_ssl_session_free(&savedSession);
+    mbedtls_ssl_session_init(&savedSession);
+    haveSession = false;
+}
+
+/**
+ * @brief Records the cost of a successful handshake.
+ * @param resumed true if the server resumed the session.
+ * @param offered true if a saved session was offered.
+ * @param durationMs Duration of the handshake, without the TCP connect.
+ * @param heapBytes Heap taken by the handshake at its peak.
+ */
+static void recordHandshake(bool resumed, bool offered, uint32_t durationMs, uint32_t heapBytes) {
+    portENTER_CRITICAL(&statsLock);
+    HandshakeCost& cost = resumed ? stats.resumed : stats.full;
+    uint32_t& sumMs = resumed ? resumedSumMs : fullSumMs;
+    cost.count++;
+    sumMs += durationMs;
+    cost.msAvg = sumMs / cost.count;
+    cost.msLast = durationMs;
+    if (offered && !resumed) {
+        stats.resumeRefused++;
+    }
+    if (durationMs > cost.msMax) {
+        cost.msMax = durationMs;
+    }
+    if (heapBytes > cost.heapPeak) {
+        cost.heapPeak = heapBytes;
+    }
+    portEXIT_CRITICAL(&statsLock);
+}
+
+/**
+ * @brief Connects and performs the TLS handshake, offering the saved session.
+ * @return 0 on success, HTTPS_ERROR_CONNECT or HTTPS_ERROR_HANDSHAKE.
+ */
+static int openConnection(const String& host, uint16_t port, uint32_t timeoutMs) {
+    IPAddress ip;
+    if (!dnsCacheResolve(host, ip) || !client.connect(ip, port, (int32_t)timeoutMs)) {
+        return HTTPS_ERROR_CONNECT;
+    }
+    client.setNoDelay(true);
+    mbedtls_ssl_session_reset(&tls);
+    mbedtls_ssl_set_hostname(&tls, host.c_str());
+    mbedtls_ssl_set_bio(&tls, &client, tlsSend, NULL, tlsRecv);
+    bool offered = haveSession && mbedtls_ssl_set_session(&tls, &savedSession) == 0;
+
+    size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    handshakeMinFree = freeBefore;
+    samplingHeap = true;
+    uint32_t start = millis();
+    int result;
+    do {
+        result = mbedtls_ssl_handshake(&tls);
+    } while (result == MBEDTLS_ERR_SSL_WANT_READ || result == MBEDTLS_ERR_SSL_WANT_WRITE);
+    uint32_t durationMs = millis() - start;
+    samplingHeap = false;
+
+    if (result != 0) {
+        char description[80];
+        mbedtls_strerror(result, description, sizeof(description));
+        Serial.printf("HTTPS: Handshake with %s failed: %s (-0x%04X).\n", host.c_str(), description, (unsigned)-result);
+        portENTER_CRITICAL(&statsLock);
+        stats.handshakeFailures++;
+        portEXIT_CRITICAL(&statsLock);
+        if (offered) {
+            forgetSession(); // Do not offer a session the server may have choked on again
+        }
+        client.stop();
+        return HTTPS_ERROR_HANDSHAKE;
+    }
+
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    bool resumed = false;
+    if (mbedtls_ssl_get_session(&tls, &session) == 0) {
+        resumed = offered && memcmp(session.master, savedSession.master, sizeof(session.master)) == 0;
+        mbedtls_ssl_session_free(&savedSession);
+        savedSession = session; // Takes over the ticket and certificate owned by session
+        haveSession = true;
+    } else {
+        mbedtls_ssl_session_free(&session);
+    }
+
+    connectionOpen = true;
+    connectedHost = host;
+    connectedPort = port;
+    rxLength = rxPosition = 0;
+    recordHandshake(resumed, offered, durationMs, freeBefore > handshakeMinFree ? freeBefore - handshakeMinFree : 0);
+    DEBUG_PRINTF("HTTPS: %s handshake with %s in %lu ms, %s.\n", resumed ? "Resumed" : "Full", host.c_str(),
+                 (unsigned long)durationMs, mbedtls_ssl_get_ciphersuite(&tls));
+    return 0;
+}
+
+// --- Plaintext I/O ---
+
+/**
+ * @brief Writes all bytes over TLS.
+ * @return true on success.
+ */
+static bool tlsWriteAll(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        int written = mbedtls_ssl_write(&tls, data, length);
+        if (written == MBEDTLS_ERR_SSL_WANT_READ || written == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads one decrypted byte.
+ * @param byte Receives the byte.
+ * @return false on timeout, error or end of stream.
+ */
+static bool tlsReadByte(uint8_t& byte) {
+    while (rxPosition >= rxLength) {
+        int count = mbedtls_ssl_read(&tls, rxBuffer, sizeof(rxBuffer));
+        if (count == MBEDTLS_ERR_SSL_WANT_READ || count == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        rxLength = count;
+        rxPosition = 0;
+    }
+    byte = rxBuffer[rxPosition++];
+    return true;
+}
+
+/**
+ * @brief Reads a CRLF-terminated line without the terminator.
+ * @return false if the stream ended before the line did.
+ */
+static bool tlsReadLine(String& line) {
+    line = "";
+    uint8_t byte;
+    while (tlsReadByte(byte)) {
+        if (byte == '\n') {
+            return true;
+        }
+        if (byte != '\r' && line.length() < HTTPS_MAX_LINE) {
+            line += (char)byte;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Reads length body bytes, keeping up to HTTPS_MAX_RESPONSE of them.
+ * @return false if the stream ended early.
+ */
+static bool readBody(String& response, size_t length) {
+    uint8_t byte;
+    for (size_t i = 0; i < length; i++) {
+        if (!tlsReadByte(byte)) {
+            return false;
+        }
+        if (response.length() < HTTPS_MAX_RESPONSE) {
+            response += (char)byte;
+        }
+    }
+    return true;
+}
+
+// --- HTTP ---
+
+/**
+ * @brief Splits a URL into host, port and path.
+ * @return false if the URL has no host.
+ */
+static bool splitUrl(const String& url, String& host, uint16_t& port, String& path) {
+    int schemeEnd = url.indexOf("://");
+    int start = schemeEnd < 0 ? 0 : schemeEnd + 3;
+    int slash = url.indexOf('/', start);
+    String authority = slash < 0 ? url.substring(start) : url.substring(start, slash);
+    path = slash < 0 ? String("/") : url.substring(slash);
+    int colon = authority.indexOf(':');
+    host = colon < 0 ? authority : authority.substring(0, colon);
+    port = colon < 0 ? HTTPS_DEFAULT_PORT : (uint16_t)authority.substring(colon + 1).toInt();
+    return host.length() > 0 && port != 0;
+}
+
+/**
+ * @brief Sends one request on the open connection and reads the response.
+ * @param answered Set once the status line has been received.
+ * @return HTTP status code, HTTPS_ERROR_WRITE or HTTPS_ERROR_READ.
+ */
+static int exchange(const char* method, const String& host, const String& path, const char* contentType,
+                    const String& body, String& response, bool& answered) {
+    answered = false;
+    String head = String(method) + " " + path + " HTTP/1.1\r\nHost: " + host + "\r\n";
+    if (contentType != NULL) {
+        head += "Content-Type: ";
+        head += contentType;
+        head += "\r\n";
+    }
+    if (body.length() > 0 || strcmp(method, "POST") == 0) {
+        head += "Content-Length: " + String(body.length()) + "\r\n";
+    }
+    head += "Connection: keep-alive\r\n\r\n";
+    if (!tlsWriteAll((const uint8_t*)head.c_str(), head.length()) ||
+        !tlsWriteAll((const uint8_t*)body.c_str(), body.length())) {
+        return HTTPS_ERROR_WRITE;
+    }
+
+    String line;
+    if (!tlsReadLine(line) || !line.startsWith("HTTP/1.")) {
+        return HTTPS_ERROR_READ;
+    }
+    answered = true;
+    int code = line.substring(9, 12).toInt();
+
+    long contentLength = -1;
+    bool chunked = false;
+    bool closeAfter = false;
+    for (;;) {
+        if (!tlsReadLine(line)) {
+            return HTTPS_ERROR_READ;
+        }
+        if (line.length() == 0) {
+            break;
+        }
+        int separator = line.indexOf(':');
+        if (separator <= 0) {
+            continue;
+        }
+        String name = line.substring(0, separator);
+        String value = line.substring(separator + 1);
+        value.trim();
+        value.toLowerCase();
+        if (name.equalsIgnoreCase("Content-Length")) {
+            contentLength = value.toInt();
+        } else if (name.equalsIgnoreCase("Transfer-Encoding")) {
+            chunked = value.indexOf("chunked") >= 0;
+        } else if (name.equalsIgnoreCase("Connection")) {
+            closeAfter = value.indexOf("close") >= 0;
+        }
+    }
+
+    if (code == 204 || code == 304 || (code >= 100 && code < 200)) {
+        // No body
+    } else if (chunked) {
+        for (;;) {
+            if (!tlsReadLine(line)) {
+                return HTTPS_ERROR_READ;
+            }
+            size_t chunkLength = strtoul(line.c_str(), NULL, 16);
+            if (chunkLength == 0) {
+                while (tlsReadLine(line) && line.length() > 0) {} // Trailer
+                break;
+            }
+            if (!readBody(response, chunkLength) || !tlsReadLine(line)) {
+                return HTTPS_ERROR_READ;
+            }
+        }
+    } else if (contentLength >= 0) {
+        if (!readBody(response, (size_t)contentLength)) {
+            return HTTPS_ERROR_READ;
+        }
+    } else {
+        readBody(response, SIZE_MAX); // Body ends with the connection
+        closeAfter = true;
+    }
+
+    if (closeAfter) {
+        closeConnection(true);
+    }
+    return code;
+}
+
+// --- Public API ---
+
+/**
+ * @brief Seeds the random generator, loads HTTPS_CA_CERT and prepares the TLS context.
+ * @return true on success.
+ */
+bool initHttpsTransport() {
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_ssl_init(&tls);
+    mbedtls_ssl_config_init(&tlsConfig);
+    mbedtls_x509_crt_init(&caChain);
+    mbedtls_ssl_session_init(&savedSession);
+
+    if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                              (const unsigned char*)HTTPS_DRBG_PERSONALIZATION, strlen(HTTPS_DRBG_PERSONALIZATION)) != 0 ||
+        mbedtls_ssl_config_defaults(&tlsConfig, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+        return false;
+    }
+    mbedtls_ssl_conf_rng(&tlsConfig, mbedtls_ctr_drbg_random, &drbg);
+    mbedtls_ssl_conf_session_tickets(&tlsConfig, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    if (strlen(HTTPS_CA_CERT) > 0) {
+        if (mbedtls_x509_crt_parse(&caChain, (const unsigned char*)HTTPS_CA_CERT, strlen(HTTPS_CA_CERT) + 1) != 0) {
+            Serial.println("HTTPS: Invalid HTTPS_CA_CERT.");
+            return false;
+        }
+        mbedtls_ssl_conf_ca_chain(&tlsConfig, &caChain, NULL);
+        mbedtls_ssl_conf_authmode(&tlsConfig, MBEDTLS_SSL_VERIFY_REQUIRED);
+    } else if (WS_HTTPS_INSECURE) {
+        Serial.println("HTTPS: WARNING: WS_HTTPS_INSECURE build, the server is not authenticated.");
+        mbedtls_ssl_conf_authmode(&tlsConfig, MBEDTLS_SSL_VERIFY_NONE);
+    } else {
+        Serial.println("HTTPS: No HTTPS_CA_CERT configured, refusing to send without server authentication.");
+        missingCaCert = true;
+        return false;
+    }
+    if (mbedtls_ssl_setup(&tls, &tlsConfig) != 0) {
+        return false;
+    }
+    requestMutex = xSemaphoreCreateMutex();
+    return requestMutex != NULL;
+}
+
+/**
+ * @brief Sends a request on the kept-alive connection and reads the response.
+ * A request on a connection the server has closed is retried once on a new connection.
+ * @param method "GET" or "POST".
+ * @param url Request URL; its host, port and path are used, its scheme is ignored.
+ * @param contentType MIME type of the body, or NULL for none.
+ * @param body Request body (empty for none).
+ * @param response Receives the response body.
+ * @param timeoutMs Timeout for waiting on the connection, connecting and every read.
+ * @return HTTP status code, or a negative HTTPS_ERROR_* code.
+ */
+int httpsRequest(const char* method, const String& url, const char* contentType, const String& body,
+                 String& response, uint32_t timeoutMs) {
+    response = "";
+    String host, path;
+    uint16_t port;
+    if (!splitUrl(url, host, port, path)) {
+        return HTTPS_ERROR_INVALID_URL;
+    }
+    if (missingCaCert) {
+        return HTTPS_ERROR_NO_CA_CERT;
+    }
+    if (requestMutex == NULL || xSemaphoreTake(requestMutex, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {
+        return HTTPS_ERROR_BUSY;
+    }
+    mbedtls_ssl_conf_read_timeout(&tlsConfig, timeoutMs);
+
+    if (connectedPort != 0 && (host != connectedHost || port != connectedPort)) {
+        Serial.println("HTTPS: Server address changed, reconnecting.");
+        closeConnection(true);
+        forgetSession();
+        connectedPort = 0;
+    }
+
+    int code = HTTPS_ERROR_CONNECT;
+    bool reused = false;
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+        reused = connectionOpen && client.connected();
+        if (!reused) {
+            closeConnection(false);
+            code = openConnection(host, port, timeoutMs);
+            if (code < 0) {
+                break;
+            }
+        }
+        bool answered;
+        response = "";
+        code = exchange(method, host, path, contentType, body, response, answered);
+        if (code < 0) {
+            closeConnection(false);
+        }
+        if (code >= 0 || answered || !reused) {
+            break;
+        }
+        DEBUG_PRINTLN("HTTPS: Kept-alive connection was closed by the server, retrying on a new one.");
+    }
+    xSemaphoreGive(requestMutex);
+
+    portENTER_CRITICAL(&statsLock);
+    if (code >= 0) {
+        stats.requests++;
+        if (reused) {
+            stats.reusedRequests++;
+        }
+    } else {
+        stats.failed++;
+    }
+    portEXIT_CRITICAL(&statsLock);
+    return code;
+}
+
+/**
+ * @brief Returns a description of an HTTPS_ERROR_* code.
+ * @param code The code.
+ * @return Printable description.
+ */
+String httpsErrorToString(int code) {
+    switch (code) {
+        case HTTPS_ERROR_CONNECT: return "connection refused";
+        case HTTPS_ERROR_HANDSHAKE: return "TLS handshake failed";
+        case HTTPS_ERROR_WRITE: return "send failed";
+        case HTTPS_ERROR_READ: return "no or incomplete response";
+        case HTTPS_ERROR_INVALID_URL: return "invalid URL";
+        case HTTPS_ERROR_BUSY: return "connection busy";
+        case HTTPS_ERROR_NO_CA_CERT: return "no HTTPS_CA_CERT configured";
+        default: return String("HTTPS error ") + code;
+    }
+}
+
+/**
+ * @brief Returns a snapshot of the HTTPS counters.
+ * @return Copy of the current statistics.
+ */
+HttpsStats httpsGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    HttpsStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    return snapshot;
+}
+
+#endif // WS_TRANSPORT_HTTPS
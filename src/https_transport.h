@@ -0,0 +1,87 @@
+/**
+ * @file https_transport.h
+ * @brief Declarations for the HTTPS uplink used by HttpsTransport (WS_TRANSPORT_HTTPS).
+ *
+ * Requests are sent as HTTP/1.1 over one TLS connection to the host and port
+ * of the request URL (default HTTPS_DEFAULT_PORT), which is kept alive between
+ * requests. When the server closes it, the next request reconnects and offers
+ * the session of the previous connection (session ticket or session id), so
+ * the server can resume it with an abbreviated handshake instead of a full
+ * one with certificate exchange and key agreement. Record encryption and
+ * hashing use the mbedTLS hardware AES/SHA acceleration of the ESP32-S3.
+ *
+ * Only one request runs at a time; callers on different tasks queue on a mutex.
+ * The handshake runs on the calling task, whose stack must include
+ * HTTPS_HANDSHAKE_STACK.
+ */
+#ifndef HTTPS_TRANSPORT_H
+#define HTTPS_TRANSPORT_H
+
+#include "config.h"
+
+// --- Error Codes (negative, like HTTPClient errors) ---
+constexpr int HTTPS_ERROR_CONNECT = -1;
+constexpr int HTTPS_ERROR_HANDSHAKE = -2;
+constexpr int HTTPS_ERROR_WRITE = -3;
+constexpr int HTTPS_ERROR_READ = -4;
+constexpr int HTTPS_ERROR_INVALID_URL = -5;
+constexpr int HTTPS_ERROR_BUSY = -6;
+constexpr int HTTPS_ERROR_NO_CA_CERT = -7;
+
+/** @brief Cost of one kind of TLS handshake. */
+struct HandshakeCost {
+  uint32_t count;        ///< Handshakes of this kind.
+  uint32_t msAvg;        ///< Average duration [ms].
+  uint32_t msMax;        ///< Maximum duration [ms].
+  uint32_t msLast;       ///< Duration of the last one [ms].
+  uint32_t heapPeak;     ///< Largest mbedTLS heap in use during one handshake [bytes].
+};
+
+/** @brief Counters of the HTTPS uplink. */
+struct HttpsStats {
+  uint32_t requests;         ///< Requests that received a response.
+  uint32_t failed;           ///< Requests that failed.
+  uint32_t reusedRequests;   ///< Requests sent on an already open connection.
+  uint32_t handshakeFailures;
+  uint32_t resumeRefused;    ///< Full handshakes although a saved session was offered.
+  HandshakeCost full;        ///< Full handshakes.
+  HandshakeCost resumed;     ///< Abbreviated handshakes resuming a previous session.
+};
+
+/**
+ * @brief Seeds the random generator, loads HTTPS_CA_CERT and prepares the TLS context.
+ * Fails closed: without HTTPS_CA_CERT the transport is not started (every
+ * request returns HTTPS_ERROR_NO_CA_CERT), unless WS_HTTPS_INSECURE is set.
+ * @note Must be called in setup() before any task sends a request.
+ * @return true on success.
+ */
+bool initHttpsTransport();
+
+/**
+ * @brief Sends a request on the kept-alive connection and reads the response.
+ * A request on a connection the server has closed is retried once on a new connection.
+ * @param method "GET" or "POST".
+ * @param url Request URL; its host, port and path are used, its scheme is ignored.
+ * @param contentType MIME type of the body, or NULL for none.
+ * @param body Request body (empty for none).
+ * @param response Receives the response body.
+ * @param timeoutMs Timeout for waiting on the connection, connecting and every read.
+ * @return HTTP status code, or a negative HTTPS_ERROR_* code.
+ */
+int httpsRequest(const char* method, const String& url, const char* contentType, const String& body,
+                 String& response, uint32_t timeoutMs);
+
+/**
+ * @brief Returns a description of an HTTPS_ERROR_* code.
+ * @param code The code.
+ * @return Printable description.
+ */
+String httpsErrorToString(int code);
+
+/**
+ * @brief Returns a snapshot of the HTTPS counters.
+ * @return Copy of the current statistics.
+ */
+HttpsStats httpsGetStats();
+
+#endif // HTTPS_TRANSPORT_H
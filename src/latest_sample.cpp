@@ -0,0 +1,121 @@
+/**
+ * @file latest_sample.cpp
+ * @brief Seqlock-protected latest-sample snapshot.
+ *
+ * The sample is stored as an array of atomic words accessed with relaxed
+ * loads and stores, so an overlapping read is a retry rather than a data
+ * race; the acquire/release ordering of the sequence orders them:
+ *
+ *     writer: sequence = odd (relaxed), release fence, words (relaxed), sequence = even (release)
+ *     reader: v1 = sequence (acquire), words (relaxed), acquire fence, v2 = sequence (relaxed)
+ *             retry while v1 is odd or v1 != v2
+ *
+ * The reader counters are relaxed atomics as well, so a read takes no lock.
+ * The read cost is a moving average updated without a compare-and-swap;
+ * concurrent readers may overwrite each other's update, which is fine for
+ * a diagnostic figure.
+ */
+#include "latest_sample.h"
+#include <atomic>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+
+const size_t SNAPSHOT_WORDS = (sizeof(WeatherSample) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+static std::atomic<uint32_t> sequence(0);      // Odd while a write is in progress; 0 until the first sample
+static std::atomic<uint32_t> words[SNAPSHOT_WORDS];
+static portMUX_TYPE writerLock = portMUX_INITIALIZER_UNLOCKED; // Only keeps the writer from being preempted
+
+const uint8_t READ_CYCLES_AVG_SHIFT = 4; // Moving average weight of a new read: 1/16
+
+// --- Reader Counters (relaxed atomics) ---
+static std::atomic<uint32_t> writes(0);
+static std::atomic<uint32_t> reads(0);
+static std::atomic<uint32_t> retries(0);
+static std::atomic<uint32_t> readCyclesAvg(0);
+static std::atomic<uint32_t> readCyclesMax(0);
+
+/**
+ * @brief Publishes a sample as the latest one.
+ * @param sample The sample.
+ */
+void latestSamplePublish(const WeatherSample& sample) {
+    uint32_t buffer[SNAPSHOT_WORDS] = {};
+    memcpy(buffer, &sample, sizeof(sample));
+
+    portENTER_CRITICAL(&writerLock);
+    uint32_t current = sequence.load(std::memory_order_relaxed);
+    sequence.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < SNAPSHOT_WORDS; i++) {
+        words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+    sequence.store(current + 2, std::memory_order_release);
+    portEXIT_CRITICAL(&writerLock);
+
+    writes.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Copies the latest sample.
+ * @param sample Receives the sample.
+ * @param version Receives the version of the snapshot (optional).
+ * @return false if no sample has been published yet.
+ */
+bool latestSampleRead(WeatherSample& sample, uint32_t* version) {
+    uint32_t startCycles = ESP.getCycleCount();
+    uint32_t buffer[SNAPSHOT_WORDS];
+    uint32_t before, after;
+    uint32_t attempts = 0;
+    for (;;) {
+        before = sequence.load(std::memory_order_acquire);
+        if (before == 0) {
+            return false;
+        }
+        if ((before & 1) == 0) {
+            for (size_t i = 0; i < SNAPSHOT_WORDS; i++) {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+            if (after == before) {
+                break;
+            }
+        }
+        attempts++;
+    }
+    memcpy(&sample, buffer, sizeof(sample));
+    if (version != NULL) {
+        *version = before;
+    }
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+
+    if (reads.fetch_add(1, std::memory_order_relaxed) == 0) {
+        readCyclesAvg.store(cycles, std::memory_order_relaxed);
+    } else {
+        int32_t average = (int32_t)readCyclesAvg.load(std::memory_order_relaxed);
+        readCyclesAvg.store((uint32_t)(average + (((int32_t)cycles - average) >> READ_CYCLES_AVG_SHIFT)),
+                            std::memory_order_relaxed);
+    }
+    if (attempts > 0) {
+        retries.fetch_add(attempts, std::memory_order_relaxed);
+    }
+    uint32_t maximum = readCyclesMax.load(std::memory_order_relaxed);
+    while (cycles > maximum && !readCyclesMax.compare_exchange_weak(maximum, cycles, std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+/**
+ * @brief Returns a snapshot of the reader counters.
+ * @return Copy of the current statistics.
+ */
+LatestSampleStats latestSampleGetStats() {
+    LatestSampleStats snapshot;
+    snapshot.writes = writes.load(std::memory_order_relaxed);
+    snapshot.reads = reads.load(std::memory_order_relaxed);
+    snapshot.retries = retries.load(std::memory_order_relaxed);
+    snapshot.readCyclesAvg = readCyclesAvg.load(std::memory_order_relaxed);
+    snapshot.readCyclesMax = readCyclesMax.load(std::memory_order_relaxed);
+    return snapshot;
+}
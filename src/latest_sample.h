@@ -0,0 +1,52 @@
+/**
+ * @file latest_sample.h
+ * @brief Declarations for the latest-sample snapshot shared across tasks.
+ *
+ * The sensor task publishes every sample here as well as on the event bus.
+ * Any task can then read the most recent sample at any time, without
+ * touching the sensors or subscribing to the bus.
+ *
+ * The snapshot is a seqlock with a single writer (the sensor task). The
+ * version is odd while a write is in progress; a reader copies the sample
+ * between two reads of the version and retries if they differ or are odd.
+ * The writer copies inside a critical section, so it is never preempted
+ * mid-write and readers on either core retry for at most the duration of
+ * one copy. Readers never block the writer or each other.
+ */
+#ifndef LATEST_SAMPLE_H
+#define LATEST_SAMPLE_H
+
+#include "config.h"
+#include "sample.h"
+
+/** @brief Counters of the snapshot readers. */
+struct LatestSampleStats {
+  uint32_t writes;          ///< Samples published.
+  uint32_t reads;           ///< Successful reads.
+  uint32_t retries;         ///< Read attempts repeated because a write overlapped.
+  uint32_t readCyclesAvg;   ///< Moving average of the CPU cycles of a read (weight 1/16), retries included.
+  uint32_t readCyclesMax;   ///< Maximum CPU cycles of a read.
+};
+
+/**
+ * @brief Publishes a sample as the latest one.
+ * @note Must only be called by the sensor task (single writer).
+ * @param sample The sample.
+ */
+void latestSamplePublish(const WeatherSample& sample);
+
+/**
+ * @brief Copies the latest sample.
+ * @param sample Receives the sample.
+ * @param version Receives the version of the snapshot, which changes with every published sample (optional).
+ * @return false if no sample has been published yet.
+ */
+bool latestSampleRead(WeatherSample& sample, uint32_t* version = NULL);
+
+/**
+ * @brief Returns a snapshot of the reader counters.
+ * @return Copy of the current statistics.
+ */
+LatestSampleStats latestSampleGetStats();
+
+#endif // LATEST_SAMPLE_H
@@ -0,0 +1,177 @@
+/**
+ * @file led_service.cpp
+ * @brief Non-blocking NeoPixel LED animation service.
+ *
+ * This file owns the NeoPixel strip and implements the LED service task. The
+ * task renders a base layer and an optional priority overlay from a table of
+ * declarative patterns (solid, blink, pulse, breathe), and only pushes a new
+ * color to the strip when the rendered color changes. While nothing animates
+ * the task blocks on its command queue indefinitely.
+ */
+#include "led_service.h"
+#include "config.h"
+#include <NeoPixelBus.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+// --- Global Objects ---
+// Definition of the LED strip object
+NeoPixelBus<NeoGrbFeature, NeoEsp32LcdX8Ws2812xMethod> strip(PixelCount, PixelPin);
+
+// --- Service Configuration ---
+const uint32_t LED_QUEUE_LENGTH = 8;
+const uint32_t LED_FRAME_MS = 20; // Render period while an animation is running
+
+// --- Pattern Table ---
+
+/** @brief Animation primitives a pattern can use. */
+enum LedAnimation {
+  ANIM_SOLID,   ///< Constant color.
+  ANIM_BLINK,   ///< On for the first half of each period, off for the second.
+  ANIM_PULSE,   ///< Short flash (first quarter of each period).
+  ANIM_BREATHE  ///< Smooth fade in and out over each period.
+};
+
+/** @brief Declarative description of one LED pattern. */
+struct LedPattern {
+  LedAnimation animation; ///< Animation primitive.
+  RgbColor color;         ///< Color at full brightness.
+  uint16_t periodMs;      ///< Period of one animation cycle (unused for ANIM_SOLID).
+  uint8_t repeats;        ///< 0 = base layer (plays forever), >0 = overlay played this many cycles.
+  uint8_t priority;       ///< Overlay priority; an overlay only preempts one of lower or equal priority.
+};
+
+// Indexed by LedPatternId.
+static const LedPattern LED_PATTERNS[LED_PATTERN_COUNT] = {
+  /* LED_PATTERN_OFF          */ { ANIM_SOLID,   RgbColor(0, 0, 0),     0,    0, 0 },
+  /* LED_PATTERN_PROVISIONING */ { ANIM_SOLID,   RgbColor(255, 165, 0), 0,    0, 0 },
+  /* LED_PATTERN_CONNECTING   */ { ANIM_BLINK,   RgbColor(0, 0, 255),   500,  0, 0 },
+  /* LED_PATTERN_ONLINE       */ { ANIM_SOLID,   RgbColor(0, 255, 0),   0,    0, 0 },
+  /* LED_PATTERN_SLEEPING     */ { ANIM_BREATHE, RgbColor(0, 0, 64),    4000, 0, 0 },
+  /* LED_PATTERN_FATAL        */ { ANIM_BLINK,   RgbColor(255, 0, 0),   300,  0, 0 },
+  /* LED_OVERLAY_ERROR        */ { ANIM_BLINK,   RgbColor(255, 0, 0),   300,  3, 3 },
+  /* LED_OVERLAY_SUCCESS      */ { ANIM_BLINK,   RgbColor(0, 255, 0),   400,  2, 1 },
+  /* LED_OVERLAY_ACK          */ { ANIM_PULSE,   RgbColor(255, 165, 0), 400,  1, 1 },
+  /* LED_OVERLAY_DIAG_ON      */ { ANIM_BLINK,   RgbColor(0, 0, 255),   400,  2, 2 },
+  /* LED_OVERLAY_DIAG_OFF     */ { ANIM_BLINK,   RgbColor(0, 0, 255),   400,  1, 2 },
+};
+
+static QueueHandle_t ledQueue = NULL;
+
+// --- LED Control ---
+
+/**
+ * @brief Sets the color of the single NeoPixel LED.
+ * Only called from the LED service task.
+ * @param color The RgbColor to set.
+ */
+static void setLedColor(RgbColor color) {
+    strip.SetPixelColor(0, color);
+    strip.Show();
+}
+
+/**
+ * @brief Computes the color of a pattern at a given time since it started.
+ * @param pattern The pattern to render.
+ * @param elapsedMs Milliseconds since the pattern started.
+ * @return The color to show.
+ */
+static RgbColor renderPattern(const LedPattern& pattern, uint32_t elapsedMs) {
+    if (pattern.animation == ANIM_SOLID || pattern.periodMs == 0) {
+        return pattern.color;
+    }
+    uint32_t phase = elapsedMs % pattern.periodMs;
+
+    switch (pattern.animation) {
+        case ANIM_BLINK:
+            return phase < pattern.periodMs / 2 ? pattern.color : RgbColor(0, 0, 0);
+        case ANIM_PULSE:
+            return phase < pattern.periodMs / 4 ? pattern.color : RgbColor(0, 0, 0);
+        case ANIM_BREATHE: {
+            uint32_t half = pattern.periodMs / 2;
+            float level = phase < half ? (float)phase / half : (float)(pattern.periodMs - phase) / half;
+            return RgbColor::LinearBlend(RgbColor(0, 0, 0), pattern.color, level * level); // Squared for a perceptually smoother fade
+        }
+        default:
+            return pattern.color;
+    }
+}
+
+// --- Public API ---
+
+/**
+ * @brief Initializes the NeoPixel LED strip and starts the LED service task.
+ * Turns the LED off initially by setting it to black.
+ */
+void setupLed() {
+    strip.Begin();
+    strip.Show(); // Initialize strip to black (off)
+
+    ledQueue = xQueueCreate(LED_QUEUE_LENGTH, sizeof(uint8_t));
+    if (ledQueue == NULL) {
+        Serial.println("!!! ERROR: Failed to create LED command queue!");
+        return;
+    }
+    xTaskCreatePinnedToCore(ledServiceTask, "LedTask", 2048, NULL, 1, NULL, APP_CPU_NUM);
+}
+
+/**
+ * @brief Posts a pattern to the LED service without waiting.
+ * @param pattern The pattern to play.
+ * @return true if the command was queued, false otherwise.
+ */
+bool ledPlay(LedPatternId pattern) {
+    if (ledQueue == NULL || pattern >= LED_PATTERN_COUNT) {
+        return false;
+    }
+    uint8_t id = (uint8_t)pattern;
+    return xQueueSend(ledQueue, &id, 0) == pdTRUE;
+}
+
+// --- FreeRTOS Task: LED Service ---
+
+/**
+ * @brief FreeRTOS task rendering the base layer and the active overlay.
+ * Renders every LED_FRAME_MS while something animates and blocks on the
+ * command queue indefinitely while the output is static.
+ * @param pvParameters Standard FreeRTOS task parameters (unused).
+ */
+void ledServiceTask(void *pvParameters) {
+    const LedPattern* base = &LED_PATTERNS[LED_PATTERN_OFF];
+    const LedPattern* overlay = NULL;
+    uint32_t baseStartMs = millis();
+    uint32_t overlayStartMs = 0;
+    RgbColor shown(0, 0, 0);
+
+    for (;;) {
+        uint32_t now = millis();
+        if (overlay != NULL && now - overlayStartMs >= (uint32_t)overlay->periodMs * overlay->repeats) {
+            overlay = NULL; // Overlay finished, fall back to the base layer
+        }
+
+        RgbColor color = overlay != NULL ? renderPattern(*overlay, now - overlayStartMs)
+                                         : renderPattern(*base, now - baseStartMs);
+        if (color != shown) {
+            setLedColor(color);
+            shown = color;
+        }
+
+        bool animating = overlay != NULL || base->animation != ANIM_SOLID;
+        uint8_t id;
+        if (xQueueReceive(ledQueue, &id, animating ? pdMS_TO_TICKS(LED_FRAME_MS) : portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        const LedPattern* pattern = &LED_PATTERNS[id];
+        if (pattern->repeats == 0) {
+            if (pattern != base) { // Re-posting the current base must not restart its phase
+                base = pattern;
+                baseStartMs = millis();
+            }
+        } else if (overlay == NULL || pattern->priority >= overlay->priority) {
+            overlay = pattern;
+            overlayStartMs = millis();
+        }
+    }
+}
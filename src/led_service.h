@@ -0,0 +1,55 @@
+/**
+ * @file led_service.h
+ * @brief Declarations for the non-blocking NeoPixel LED animation service.
+ *
+ * The status LED is driven exclusively by a dedicated FreeRTOS task that plays
+ * declarative animation patterns. Callers only post a pattern ID to the task's
+ * command queue; posting is O(1) and never waits. Patterns are either a base
+ * layer (the persistent status, e.g. online or provisioning) or a finite
+ * overlay (e.g. an error blink) that temporarily covers the base layer and may
+ * be preempted by an overlay of higher priority.
+ */
+#ifndef LED_SERVICE_H
+#define LED_SERVICE_H
+
+#include "config.h"
+
+/** @brief Identifiers of the predefined LED patterns (see the pattern table in led_service.cpp). */
+enum LedPatternId {
+  // --- Base layer (persistent status) ---
+  LED_PATTERN_OFF = 0,       ///< LED off.
+  LED_PATTERN_PROVISIONING,  ///< Solid yellow: AP mode, awaiting configuration.
+  LED_PATTERN_CONNECTING,    ///< Blinking blue: (re)connecting to WiFi.
+  LED_PATTERN_ONLINE,        ///< Solid green: connected and sending data.
+  LED_PATTERN_SLEEPING,      ///< Slowly breathing blue: radio switched off.
+  LED_PATTERN_FATAL,         ///< Fast red blinking: unrecoverable error.
+  // --- Overlays (finite, drawn over the base layer) ---
+  LED_OVERLAY_ERROR,         ///< Three red blinks: transmission or connection error.
+  LED_OVERLAY_SUCCESS,       ///< Two green blinks: registration succeeded.
+  LED_OVERLAY_ACK,           ///< One yellow pulse: button acknowledged without action.
+  LED_OVERLAY_DIAG_ON,       ///< Two blue blinks: diagnostics mode enabled.
+  LED_OVERLAY_DIAG_OFF,      ///< One blue blink: diagnostics mode disabled.
+  LED_PATTERN_COUNT
+};
+
+/**
+ * @brief Initializes the NeoPixel LED strip and starts the LED service task.
+ * @note Must be called before any pattern is posted.
+ */
+void setupLed();
+
+/**
+ * @brief Posts a pattern to the LED service without waiting.
+ * Base patterns replace the current base layer; overlays are played once over it.
+ * @param pattern The pattern to play.
+ * @return true if the command was queued, false if the queue is full or the service is not running.
+ */
+bool ledPlay(LedPatternId pattern);
+
+/**
+ * @brief FreeRTOS task function rendering LED animations.
+ * @param pvParameters Standard FreeRTOS task parameters (unused).
+ */
+void ledServiceTask(void *pvParameters);
+
+#endif // LED_SERVICE_H
@@ -0,0 +1,255 @@
+/**
+ * @file live_stream.cpp
+ * @brief Live dashboard streaming samples as Server-Sent Events.
+ *
+ * Handlers on the shared HTTP server (see http_server.h):
+ *
+ *     GET /live        -> live.html from LittleFS (style.css is served by the portal handler)
+ *     GET /api/live    -> text/event-stream, kept open; one "data:" event per sample
+ *     GET /api/current -> the latest sample as JSON (503 before the first one)
+ *
+ * The viewer table is touched only in the server task: by the /api/live
+ * handler, by the close hook and by the broadcast work item the live task
+ * queues with httpd_queue_work(). The event of a sample is built once into a
+ * single String and the same buffer is written to each viewer.
+ */
+#include "live_stream.h"
+#include "http_server.h"
+#include "event_bus.h"
+#include "station_policies.h"
+#include "latest_sample.h"
+#include <lwip/sockets.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// --- Live Stream Configuration ---
+const uint32_t LIVE_POLL_MS = 1000;          // Keep-alive check period of the live task
+const uint32_t LIVE_TASK_STACK = 2048;       // Only queues work; encoding runs in the server task
+
+static const char SSE_HEADERS[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "\r\n"
+    "retry: 5000\n\n";                       // Browser reconnect delay
+static const char KEEPALIVE_EVENT[] = ": keepalive\n\n";
+
+static int viewerSockets[LIVE_MAX_CLIENTS];  // -1 = free; owned by the server task
+static std::atomic<uint8_t> viewerCount(0);  // Read by the sensor and live tasks to skip work when nobody watches
+static std::atomic<bool> broadcastQueued(false);
+static TaskHandle_t liveTaskHandle = NULL;
+static uint32_t sentGeneration = 0;          // Server task only
+static uint32_t lastWriteMs = 0;             // Server task only
+
+static LiveStreamStats stats = {};
+static uint32_t sampleCyclesSum[LIVE_MAX_CLIENTS + 1] = {};
+static uint32_t sampleCount[LIVE_MAX_CLIENTS + 1] = {};
+static uint32_t broadcastUsSum[LIVE_MAX_CLIENTS + 1] = {};
+static uint32_t broadcastCount[LIVE_MAX_CLIENTS + 1] = {};
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Event bus callback waking the live task when someone is watching.
+ * The broadcast reads the sample from the latest-sample snapshot (published
+ * before the bus message). Runs in the sensor task; never blocks. Its cost is
+ * recorded by number of viewers.
+ */
+static void onSample(const BusMessage* message, void* context) {
+    uint32_t startCycles = ESP.getCycleCount();
+    uint8_t watching = viewerCount.load(std::memory_order_relaxed);
+    if (watching > 0) {
+        xTaskNotifyGive(liveTaskHandle);
+    }
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+
+    portENTER_CRITICAL(&statsLock);
+    sampleCyclesSum[watching] += cycles;
+    sampleCount[watching]++;
+    stats.sampleCyclesAvg[watching] = sampleCyclesSum[watching] / sampleCount[watching];
+    portEXIT_CRITICAL(&statsLock);
+}
+
+// --- Viewers (server task) ---
+
+/**
+ * @brief Writes a buffer to every viewer without blocking; viewers that do not take all of it are closed.
+ * @param data The buffer, shared by all viewers.
+ * @param length Its length.
+ */
+static void writeToViewers(const char* data, size_t length) {
+    httpd_handle_t server = httpServerHandle();
+    for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+        if (viewerSockets[i] < 0) {
+            continue;
+        }
+        int sent = httpd_socket_send(server, viewerSockets[i], data, length, MSG_DONTWAIT);
+        if (sent != (int)length) {
+            httpd_sess_trigger_close(server, viewerSockets[i]);
+            viewerSockets[i] = -1;
+            viewerCount.fetch_sub(1);
+            portENTER_CRITICAL(&statsLock);
+            stats.dropped++;
+            portEXIT_CRITICAL(&statsLock);
+        }
+    }
+    lastWriteMs = millis();
+}
+
+/**
+ * @brief Close hook: forgets a viewer whose socket the server closed.
+ * @param socket The closed socket.
+ */
+static void onSocketClosed(int socket) {
+    for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+        if (viewerSockets[i] == socket) {
+            viewerSockets[i] = -1;
+            viewerCount.fetch_sub(1);
+        }
+    }
+}
+
+/**
+ * @brief Work item queued by the live task: broadcasts the snapshot if it is
+ * new, otherwise keeps idle streams alive.
+ * @param arg Unused.
+ */
+static void broadcastWork(void* arg) {
+    broadcastQueued.store(false);
+    uint8_t watching = viewerCount.load();
+    if (watching == 0) {
+        return;
+    }
+    WeatherSample sample;
+    uint32_t generation = 0;
+    if (latestSampleRead(sample, &generation) && generation != sentGeneration) {
+        sentGeneration = generation;
+        uint32_t startUs = micros();
+        String encoded;
+        encodeTimestampedSample(sample, encoded);
+        String event;
+        event.reserve(encoded.length() + 8);
+        event = "data: ";
+        event += encoded;
+        event += "\n\n";
+        writeToViewers(event.c_str(), event.length());
+        uint32_t durationUs = micros() - startUs;
+
+        portENTER_CRITICAL(&statsLock);
+        stats.events++;
+        broadcastUsSum[watching] += durationUs;
+        broadcastCount[watching]++;
+        stats.broadcastUsAvg[watching] = broadcastUsSum[watching] / broadcastCount[watching];
+        portEXIT_CRITICAL(&statsLock);
+    } else if (millis() - lastWriteMs >= LIVE_KEEPALIVE_MS) {
+        writeToViewers(KEEPALIVE_EVENT, sizeof(KEEPALIVE_EVENT) - 1); // Also detects closed browsers
+    }
+}
+
+// --- Handlers ---
+
+/**
+ * @brief GET /live: the dashboard page.
+ */
+static esp_err_t handleLivePage(httpd_req_t* request) {
+    return httpServerSendFile(request, "/live.html", "text/html");
+}
+
+/**
+ * @brief GET /api/live: sends the stream headers and keeps the socket as a viewer.
+ * The handler returns at once; the socket stays open and events are written
+ * to it by broadcastWork(). Answers 503 when all LIVE_MAX_CLIENTS slots are taken.
+ */
+static esp_err_t handleLiveEvents(httpd_req_t* request) {
+    for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+        if (viewerSockets[i] >= 0) {
+            continue;
+        }
+        if (httpd_send(request, SSE_HEADERS, sizeof(SSE_HEADERS) - 1) != (int)(sizeof(SSE_HEADERS) - 1)) {
+            return ESP_FAIL;
+        }
+        viewerSockets[i] = httpd_req_to_sockfd(request);
+        viewerCount.fetch_add(1);
+        portENTER_CRITICAL(&statsLock);
+        stats.connects++;
+        portEXIT_CRITICAL(&statsLock);
+        xTaskNotifyGive(liveTaskHandle); // Send the current sample right away
+        return ESP_OK;
+    }
+    portENTER_CRITICAL(&statsLock);
+    stats.rejected++;
+    portEXIT_CRITICAL(&statsLock);
+    httpd_resp_set_status(request, "503 Service Unavailable");
+    return httpd_resp_send(request, "Too many viewers.", HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * @brief GET /api/current: the latest sample from the snapshot; the sensors are not read.
+ */
+static esp_err_t handleCurrent(httpd_req_t* request) {
+    WeatherSample sample;
+    if (!latestSampleRead(sample)) {
+        httpd_resp_set_status(request, "503 Service Unavailable");
+        return httpd_resp_send(request, "No sample yet.", HTTPD_RESP_USE_STRLEN);
+    }
+    String body;
+    encodeTimestampedSample(sample, body);
+    httpd_resp_set_type(request, "application/json");
+    return httpd_resp_send(request, body.c_str(), body.length());
+}
+
+// --- FreeRTOS Task: Live Stream ---
+
+/**
+ * @brief FreeRTOS task scheduling broadcasts on the server task.
+ * Wakes on every new sample or every LIVE_POLL_MS and, while someone is
+ * watching, queues one broadcast work item (never more than one at a time).
+ * @param pvParameters Unused.
+ */
+static void liveTaskFunction(void* pvParameters) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LIVE_POLL_MS));
+        httpd_handle_t server = httpServerHandle();
+        if (server == NULL || viewerCount.load() == 0 || broadcastQueued.exchange(true)) {
+            continue;
+        }
+        if (httpd_queue_work(server, broadcastWork, NULL) != ESP_OK) {
+            broadcastQueued.store(false);
+        }
+    }
+}
+
+/**
+ * @brief Registers the live handlers, subscribes to TOPIC_SAMPLE and starts the live task.
+ * @return true on success.
+ */
+bool startLiveStream() {
+    for (uint8_t i = 0; i < LIVE_MAX_CLIENTS; i++) {
+        viewerSockets[i] = -1;
+    }
+    if (!httpServerOn("/live", HTTP_GET, handleLivePage) ||
+        !httpServerOn("/api/live", HTTP_GET, handleLiveEvents) ||
+        !httpServerOn("/api/current", HTTP_GET, handleCurrent)) {
+        return false;
+    }
+    httpServerOnClose(onSocketClosed);
+    if (xTaskCreatePinnedToCore(liveTaskFunction, "LiveTask", LIVE_TASK_STACK, NULL, 1,
+                                &liveTaskHandle, APP_CPU_NUM) != pdPASS) {
+        return false;
+    }
+    return eventBusSubscribeCallback(TOPIC_BIT(TOPIC_SAMPLE), onSample, NULL);
+}
+
+/**
+ * @brief Returns a snapshot of the live stream counters.
+ * @return Copy of the current statistics.
+ */
+LiveStreamStats liveStreamGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    LiveStreamStats copy = stats;
+    portEXIT_CRITICAL(&statsLock);
+    copy.viewers = viewerCount.load();
+    return copy;
+}
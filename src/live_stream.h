@@ -0,0 +1,49 @@
+/**
+ * @file live_stream.h
+ * @brief Declarations for the live dashboard server (Server-Sent Events).
+ *
+ * http://<station>/live serves a small dashboard and /api/live streams every
+ * new sample as a Server-Sent Event ("data: <sample JSON>") to up to
+ * LIVE_MAX_CLIENTS browsers. Both are handlers on the shared HTTP server
+ * (see http_server.h), so a viewer holds one of its WEB_MAX_CONNECTIONS sockets.
+ *
+ * /api/current returns the latest sample as JSON from the latest-sample
+ * snapshot (see latest_sample.h), without reading the sensors.
+ *
+ * In the sensor task, an event bus callback only wakes the live task, and
+ * only when someone is watching. The live task queues a broadcast on the
+ * server task, which reads the snapshot, encodes it once and writes the same
+ * buffer to every viewer without blocking, so acquisition timing does not
+ * depend on the number or speed of the viewers; a viewer whose connection
+ * does not take a whole event is closed.
+ */
+#ifndef LIVE_STREAM_H
+#define LIVE_STREAM_H
+
+#include "config.h"
+
+/** @brief Counters of the live stream. */
+struct LiveStreamStats {
+  uint8_t viewers;         ///< Connected /api/live clients.
+  uint32_t connects;       ///< Viewers accepted.
+  uint32_t rejected;       ///< Viewers refused because all slots were taken.
+  uint32_t dropped;        ///< Viewers closed after a failed write.
+  uint32_t events;         ///< Samples broadcast.
+  uint32_t sampleCyclesAvg[LIVE_MAX_CLIENTS + 1];  ///< Average cost per sample in the sensor task [CPU cycles], by number of viewers.
+  uint32_t broadcastUsAvg[LIVE_MAX_CLIENTS + 1];   ///< Average encode and write time per sample in the server task [us], by number of viewers.
+};
+
+/**
+ * @brief Registers the live handlers, subscribes to TOPIC_SAMPLE and starts the live task.
+ * @note Call from setup(), before the supervisor starts the HTTP server.
+ * @return true on success.
+ */
+bool startLiveStream();
+
+/**
+ * @brief Returns a snapshot of the live stream counters.
+ * @return Copy of the current statistics.
+ */
+LiveStreamStats liveStreamGetStats();
+
+#endif // LIVE_STREAM_H
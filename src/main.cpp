@@ -3,19 +3,45 @@
  * @brief Main application file for the ESP32S3 Weather Station.
  *
  * Initializes hardware (LED, button, I2C), file systems (LittleFS, NVS),
- * Wi-Fi connectivity, and web server for configuration. It then starts
- * FreeRTOS tasks for button handling, wind sensing, and main sensor data
- * acquisition and transmission. The main loop handles web server requests
- * in unconfigured mode or checks Wi-Fi status in configured mode.
+ * and the supervisor task which owns Wi-Fi connectivity and the configuration
+ * web server. It then starts FreeRTOS tasks for button handling, wind sensing,
+ * and main sensor data acquisition and transmission. The Arduino loop task is
+ * not needed and deletes itself.
  */
 #include "Arduino.h"
 
 #include "config.h"
 #include "utils.h"
+#include "led_service.h"
 #include "nvs_handler.h"
 #include "wifi_manager.h"
 #include "web_interface.h"
 #include "data_sender.h" 
+#include "supervisor.h"
+#include "event_bus.h"
+#include "uplink.h"
+#include "fanout.h"
+#include "live_stream.h"
+#include "cpu_profiler.h"
+#include "diagnostics.h"
+#include "sample_store.h"
+#include "backfill.h"
+#include "runtime_config.h"
+#include "alerts.h"
+#include "dns_cache.h"
+#include "discovery.h"
+#if WS_TRANSPORT_MQTT
+#include "mqtt_transport.h"
+#endif
+#if WS_TRANSPORT_COAP
+#include "coap_transport.h"
+#endif
+#if WS_TRANSPORT_WEBSOCKET
+#include "websocket_transport.h"
+#endif
+#if WS_TRANSPORT_HTTPS
+#include "https_transport.h"
+#endif
 
 #include <WiFi.h>        
 #include <Wire.h>         
@@ -27,15 +53,14 @@ String wifiSSID = "";
 String wifiPass = "";
 String userName = "defaultUser";       // Default username
 String serverAddress = "192.168.50.200:5000"; // Default server address
-DeviceMode currentDeviceMode = MODE_UNCONFIGURED; 
-unsigned long lastDataSendTime = 0;
-bool bmeSensorOk = false; 
+std::atomic<DeviceMode> currentDeviceMode(MODE_UNCONFIGURED);
+volatile bool diagnosticsMode = false;
 
 /**
  * @brief Setup function, runs once on ESP32S3 startup.
  * Initializes serial communication, hardware components (LED, button),
- * file systems, I2C bus, loads configuration from NVS, attempts Wi-Fi connection
- * or starts AP mode, and creates FreeRTOS tasks for core functionalities.
+ * file systems, I2C bus, starts the supervisor task, hands it the configuration
+ * loaded from NVS, and creates FreeRTOS tasks for core functionalities.
  */
 void setup() {
     Serial.begin(115200);
@@ -49,7 +74,7 @@ void setup() {
         while(1) { delay(1000); }
     }
     if (!initNVS()) {
-        blinkLedError(red); 
+        ledPlay(LED_PATTERN_FATAL);
         while(1) { delay(1000); }
     }
 
@@ -58,30 +83,73 @@ void setup() {
     Wire.begin(I2C_SDA, I2C_SCL); 
     // Wire.setClock(100000); // Optionally set I2C clock speed if needed
 
+    // Restore the server-controlled cadence before any task reads it
+    initRuntimeConfig();
+
+    // The event bus must exist before any component subscribes or publishes
+    initEventBus();
+    if (!startDnsCache()) {
+        Serial.println("!!! ERROR: Failed to start DNS cache!");
+    }
+    if (!startDiscovery()) {
+        Serial.println("!!! ERROR: Failed to start server discovery!");
+    }
+#if WS_TRANSPORT_MQTT
+    if (!initMqttTransport()) {
+        Serial.println("!!! ERROR: Failed to initialize MQTT transport!");
+    }
+#endif
+#if WS_TRANSPORT_COAP
+    if (!initCoapTransport()) {
+        Serial.println("!!! ERROR: Failed to initialize CoAP transport!");
+    }
+#endif
+#if WS_TRANSPORT_WEBSOCKET
+    if (!startWebSocketTransport()) {
+        Serial.println("!!! ERROR: Failed to start WebSocket transport!");
+    }
+#endif
+#if WS_TRANSPORT_HTTPS
+    if (!initHttpsTransport()) {
+        Serial.println("!!! ERROR: Failed to initialize HTTPS transport!");
+    }
+#endif
+    if (!startUplink()) {
+        Serial.println("!!! ERROR: Failed to start uplink task!");
+    }
+    if (!startFanout()) {
+        Serial.println("!!! ERROR: Failed to start fan-out tasks!");
+    }
+    setupWebServer(); // Handlers only; the supervisor starts the server once the network is up
+    if (!startDiagnostics()) {
+        Serial.println("!!! ERROR: Failed to start diagnostics task!");
+    }
+    if (!startCpuProfiler()) {
+        Serial.println("!!! ERROR: Failed to start CPU profiler!");
+    }
+    if (!startLiveStream()) {
+        Serial.println("!!! ERROR: Failed to start live stream!");
+    }
+    if (!startAlertLane()) {
+        Serial.println("!!! ERROR: Failed to start alert lane!");
+    }
+    if (!startSampleStore() || !startBackfill()) {
+        Serial.println("!!! ERROR: Failed to start sample history/backfill!");
+    }
+
+    // Start the supervisor before anything may post events to it
+    if (!startSupervisor()) {
+        ledPlay(LED_PATTERN_FATAL);
+        while(1) { delay(1000); }
+    }
+
     // Start the button handling task
     xTaskCreatePinnedToCore(
         buttonTask, "ButtonTask", 2048, NULL, 1, NULL, 1);
     Serial.println("Button handling task started.");
 
-    // --- Startup Logic: Load NVS Configuration or Start AP Mode ---
-    if (loadConfigurationFromNVS()) {
-         Serial.println("Configuration found in NVS. Attempting to connect to WiFi...");
-         WiFi.disconnect(true); 
-         delay(100);
-         if (connectToWiFi()) {
-             sendMacAddress(); 
-         } else {
-             Serial.println("Automatic WiFi connection failed. Switching to AP mode for configuration.");
-             clearConfigurationInNVS(); 
-             switchToAPMode();
-             setupWebServer();
-         }
-    } else {
-         Serial.println("No valid configuration in NVS or device set to unconfigured. Starting in AP mode.");
-         clearConfigurationInNVS();
-         switchToAPMode();
-         setupWebServer(); 
-    }
+    // --- Startup Logic: Hand the stored configuration over to the supervisor ---
+    postSupervisorEvent(loadConfigurationFromNVS() ? EVENT_CONFIG_LOADED : EVENT_CONFIG_MISSING);
 
     // --- Create FreeRTOS Tasks for Sensor Data Handling ---
     Serial.println("Creating Wind Sensor Task...");
@@ -111,16 +179,12 @@ void setup() {
 }
 
 /**
- * @brief Main loop function, runs repeatedly after setup.
- * If the device is in MODE_UNCONFIGURED, it handles web server client requests.
- * If in MODE_CONFIGURED, it checks and maintains the Wi-Fi connection.
- * Sensor data reading and transmission are handled by dedicated FreeRTOS tasks.
+ * @brief Main loop function.
+ * All periodic work is event driven: mode transitions, Wi-Fi supervision and
+ * the configuration web server are owned by the supervisor task, and sensor
+ * handling runs in dedicated FreeRTOS tasks. The loop task deletes itself
+ * to free its stack.
  */
 void loop() {
-    if (currentDeviceMode == MODE_UNCONFIGURED) {
-        handleWebServerClient(); 
-    } else if (currentDeviceMode == MODE_CONFIGURED) {
-        checkAndReconnectWiFi(); 
-    }
-    vTaskDelay(pdMS_TO_TICKS(20)); 
+    vTaskDelete(NULL);
 }
\ No newline at end of file
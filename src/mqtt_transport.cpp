@@ -0,0 +1,344 @@
+/**
+ * @file mqtt_transport.cpp
+ * @brief MQTT uplink over one persistent esp-mqtt connection with QoS 1 publishes.
+ *
+ * Every publish occupies one slot of MQTT_INFLIGHT_WINDOW until its PUBACK
+ * arrives or it times out, and the publishing task waits for that PUBACK.
+ * The slots let several tasks publish at once; they do not pipeline the
+ * publishes of one task. The PUBACK is reported by the esp-mqtt task
+ * (MQTT_EVENT_PUBLISHED), which can run before the publishing task has
+ * recorded the message id of its slot; such early acknowledgements are kept
+ * in a small list and matched when the slot is registered.
+ *
+ * A publish that timed out stays in the esp-mqtt outbox and may still be
+ * delivered, so delivery is at-least-once, as usual for QoS 1.
+ */
+#include "mqtt_transport.h"
+
+#if WS_TRANSPORT_MQTT
+#include "discovery.h"
+#include <WiFi.h>
+#include <mqtt_client.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+const uint32_t MQTT_NETWORK_TIMEOUT_MS = 5000;
+const uint32_t MQTT_CONNECT_POLL_MS = 20;    // Poll period while a publish waits for the connection
+
+/** @brief One publish awaiting its PUBACK. */
+struct InFlightSlot {
+  bool used;
+  int msgId;                   ///< Message id, -1 until the publish returned it.
+  SemaphoreHandle_t ackSignal; ///< Given by the esp-mqtt task when the PUBACK arrives.
+};
+
+// --- Connection State ---
+static esp_mqtt_client_handle_t client = NULL;
+static SemaphoreHandle_t clientMutex = NULL; // Serializes creating and replacing the client
+static std::atomic<bool> connected(false);
+static String brokerAddress;                 // Server address the client was created for
+static String brokerUri, clientId, stationTopic, statusTopic, controlTopic;
+
+// --- In-Flight Window ---
+static InFlightSlot slots[MQTT_INFLIGHT_WINDOW];
+static SemaphoreHandle_t windowSemaphore = NULL; // Counts free slots
+static int earlyAcks[MQTT_INFLIGHT_WINDOW];      // PUBACKs that arrived before their slot knew its id
+static uint8_t earlyAckNext = 0;
+static portMUX_TYPE slotLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Control Messages ---
+static String pendingControl;                // Latest message on the control topic
+static SemaphoreHandle_t controlMutex = NULL;
+
+static MqttStats stats = {};
+static uint32_t ackSumMs = 0;
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Event Handling ---
+
+/**
+ * @brief Wakes the publisher waiting for a message id, or records the PUBACK for later.
+ * @param msgId Message id of the acknowledged publish.
+ */
+static void signalAck(int msgId) {
+    portENTER_CRITICAL(&slotLock);
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        if (slots[i].used && slots[i].msgId == msgId) {
+            portEXIT_CRITICAL(&slotLock);
+            xSemaphoreGive(slots[i].ackSignal);
+            return;
+        }
+    }
+    earlyAcks[earlyAckNext] = msgId;
+    earlyAckNext = (earlyAckNext + 1) % MQTT_INFLIGHT_WINDOW;
+    portEXIT_CRITICAL(&slotLock);
+}
+
+/**
+ * @brief esp-mqtt event handler; runs in the esp-mqtt task.
+ */
+static void onMqttEvent(void* handlerArgs, esp_event_base_t base, int32_t eventId, void* eventData) {
+    esp_mqtt_event_handle_t event = static_cast<esp_mqtt_event_handle_t>(eventData);
+    switch ((esp_mqtt_event_id_t)eventId) {
+        case MQTT_EVENT_CONNECTED:
+            connected.store(true);
+            portENTER_CRITICAL(&statsLock);
+            stats.connects++;
+            portEXIT_CRITICAL(&statsLock);
+            Serial.printf("MQTT: Connected to %s.\n", brokerUri.c_str());
+            esp_mqtt_client_publish(event->client, statusTopic.c_str(), "online", 0, 1, 1);
+            esp_mqtt_client_subscribe(event->client, controlTopic.c_str(), 1); // Kept by the broker; renewed in case the session was lost
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+            if (connected.exchange(false)) {
+                Serial.println("MQTT: Disconnected, esp-mqtt reconnects.");
+            }
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            signalAck(event->msg_id);
+            break;
+        case MQTT_EVENT_DATA:
+            // Control messages are small; fragments of larger messages are ignored
+            if (event->current_data_offset == 0 && event->data_len == event->total_data_len &&
+                controlTopic.length() == (unsigned)event->topic_len &&
+                strncmp(event->topic, controlTopic.c_str(), event->topic_len) == 0 &&
+                xSemaphoreTake(controlMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+                pendingControl = "";
+                pendingControl.reserve(event->data_len);
+                for (int i = 0; i < event->data_len; i++) {
+                    pendingControl += event->data[i];
+                }
+                xSemaphoreGive(controlMutex);
+                DEBUG_PRINTF("MQTT: Control message (%d bytes) received.\n", event->data_len);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// --- Connection ---
+
+/**
+ * @brief Creates the in-flight window and the locks of the transport.
+ * @return true on success.
+ */
+bool initMqttTransport() {
+    clientMutex = xSemaphoreCreateMutex();
+    controlMutex = xSemaphoreCreateMutex();
+    windowSemaphore = xSemaphoreCreateCounting(MQTT_INFLIGHT_WINDOW, MQTT_INFLIGHT_WINDOW);
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        slots[i].used = false;
+        slots[i].msgId = -1;
+        slots[i].ackSignal = xSemaphoreCreateBinary();
+        earlyAcks[i] = -1;
+        if (slots[i].ackSignal == NULL) {
+            return false;
+        }
+    }
+    return clientMutex != NULL && controlMutex != NULL && windowSemaphore != NULL;
+}
+
+/**
+ * @brief Starts the client for the current server address, or reconfigures it after the address changed.
+ * The client is never destroyed, so other tasks can keep using its handle.
+ * @return true if a client is running.
+ */
+static bool ensureClient() {
+    if (xSemaphoreTake(clientMutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+    String address = activeServerAddress();
+    if (address.length() > 0 && (client == NULL || brokerAddress != address)) {
+        if (client != NULL) {
+            Serial.println("MQTT: Server address changed, reconnecting.");
+            esp_mqtt_client_stop(client);
+            connected.store(false);
+        }
+        String mac = WiFi.macAddress();
+        stationTopic = String(MQTT_TOPIC_PREFIX) + mac + "/";
+        statusTopic = stationTopic + "status";
+        controlTopic = stationTopic + "control";
+        mac.replace(":", "");
+        clientId = "ws-" + mac; // Fixed, so the broker resumes the persistent session
+        brokerUri = "mqtt://" + address;
+        if (address.indexOf(':') < 0) {
+            brokerUri += ":" + String(MQTT_DEFAULT_PORT);
+        }
+
+        esp_mqtt_client_config_t mqttConfig = {};
+        mqttConfig.uri = brokerUri.c_str();
+        mqttConfig.client_id = clientId.c_str();
+        mqttConfig.username = userName.length() > 0 ? userName.c_str() : NULL;
+        mqttConfig.keepalive = MQTT_KEEPALIVE_S;
+        mqttConfig.disable_clean_session = true;
+        mqttConfig.lwt_topic = statusTopic.c_str();
+        mqttConfig.lwt_msg = "offline";
+        mqttConfig.lwt_qos = 1;
+        mqttConfig.lwt_retain = 1;
+        mqttConfig.network_timeout_ms = MQTT_NETWORK_TIMEOUT_MS;
+
+        if (client == NULL) {
+            client = esp_mqtt_client_init(&mqttConfig);
+            if (client != NULL) {
+                esp_mqtt_client_register_event(client, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, onMqttEvent, NULL);
+            }
+        } else {
+            esp_mqtt_set_config(client, &mqttConfig);
+        }
+        if (client != NULL && esp_mqtt_client_start(client) == ESP_OK) {
+            brokerAddress = address;
+        }
+    }
+    bool running = client != NULL && brokerAddress == address;
+    xSemaphoreGive(clientMutex);
+    return running;
+}
+
+/**
+ * @brief Size of a QoS 1 PUBLISH packet on the wire.
+ * @param topicLength Length of the topic.
+ * @param payloadLength Length of the payload.
+ * @return Bytes of fixed header, topic, packet id and payload.
+ */
+static uint32_t publishPacketBytes(size_t topicLength, size_t payloadLength) {
+    uint32_t remaining = 2 + topicLength + 2 + payloadLength;
+    uint32_t lengthBytes = 1;
+    for (uint32_t rest = remaining >> 7; rest > 0; rest >>= 7) {
+        lengthBytes++;
+    }
+    return 1 + lengthBytes + remaining;
+}
+
+// --- Public API ---
+
+/**
+ * @brief Publishes a payload with QoS 1 and waits for the PUBACK.
+ * Waits up to timeoutMs for the connection if it is not up yet.
+ * @param channel Last topic level, e.g. "data".
+ * @param payload The payload.
+ * @param response Receives the pending control message for the "data" channel, otherwise cleared.
+ * @param timeoutMs Maximum time to wait for a window slot and for the PUBACK.
+ * @return 200 when acknowledged, a negative MQTT_ERROR_* code otherwise.
+ */
+int mqttPublish(const char* channel, const String& payload, String& response, uint32_t timeoutMs) {
+    response = "";
+    if (windowSemaphore == NULL || !ensureClient()) {
+        return MQTT_ERROR_NOT_CONNECTED;
+    }
+    uint32_t start = millis();
+    while (!connected.load()) {
+        if (millis() - start >= timeoutMs) {
+            return MQTT_ERROR_NOT_CONNECTED;
+        }
+        vTaskDelay(pdMS_TO_TICKS(MQTT_CONNECT_POLL_MS));
+    }
+    uint32_t waitedMs = millis() - start;
+    if (waitedMs >= timeoutMs || xSemaphoreTake(windowSemaphore, pdMS_TO_TICKS(timeoutMs - waitedMs)) != pdTRUE) {
+        return MQTT_ERROR_WINDOW_FULL;
+    }
+
+    // Claim a slot; the window semaphore guarantees a free one
+    InFlightSlot* slot = NULL;
+    portENTER_CRITICAL(&slotLock);
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW && slot == NULL; i++) {
+        if (!slots[i].used) {
+            slot = &slots[i];
+            slot->used = true;
+            slot->msgId = -1;
+        }
+    }
+    portEXIT_CRITICAL(&slotLock);
+    xSemaphoreTake(slot->ackSignal, 0); // Drop a late signal of a previous, timed-out publish
+
+    String topic = stationTopic + channel;
+    int msgId = esp_mqtt_client_publish(client, topic.c_str(), payload.c_str(), payload.length(), 1, 0);
+    bool acked = false;
+    if (msgId >= 0) {
+        portENTER_CRITICAL(&slotLock);
+        slot->msgId = msgId;
+        for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+            if (earlyAcks[i] == msgId) {
+                earlyAcks[i] = -1;
+                acked = true;
+            }
+        }
+        portEXIT_CRITICAL(&slotLock);
+        uint32_t elapsedMs = millis() - start;
+        if (!acked && elapsedMs < timeoutMs) {
+            acked = xSemaphoreTake(slot->ackSignal, pdMS_TO_TICKS(timeoutMs - elapsedMs)) == pdTRUE;
+        }
+    }
+
+    portENTER_CRITICAL(&slotLock);
+    slot->used = false;
+    slot->msgId = -1;
+    portEXIT_CRITICAL(&slotLock);
+    xSemaphoreGive(windowSemaphore);
+
+    uint32_t ackMs = millis() - start;
+    portENTER_CRITICAL(&statsLock);
+    if (msgId >= 0) {
+        stats.bytesOnAir += publishPacketBytes(topic.length(), payload.length());
+        stats.payloadBytes += payload.length();
+    }
+    if (acked) {
+        stats.published++;
+        ackSumMs += ackMs;
+        stats.ackMsAvg = ackSumMs / stats.published;
+        if (ackMs > stats.ackMsMax) {
+            stats.ackMsMax = ackMs;
+        }
+    } else {
+        stats.failed++;
+    }
+    portEXIT_CRITICAL(&statsLock);
+
+    if (!acked) {
+        return msgId < 0 ? MQTT_ERROR_PUBLISH : MQTT_ERROR_ACK_TIMEOUT;
+    }
+    if (strcmp(channel, "data") == 0 && xSemaphoreTake(controlMutex, 0) == pdTRUE) {
+        response = pendingControl;
+        pendingControl = "";
+        xSemaphoreGive(controlMutex);
+    }
+    return 200;
+}
+
+/**
+ * @brief Returns a description of an MQTT_ERROR_* code.
+ * @param code The code.
+ * @return Printable description.
+ */
+String mqttErrorToString(int code) {
+    switch (code) {
+        case MQTT_ERROR_NOT_CONNECTED: return "not connected to broker";
+        case MQTT_ERROR_WINDOW_FULL: return "in-flight window full";
+        case MQTT_ERROR_PUBLISH: return "publish failed";
+        case MQTT_ERROR_ACK_TIMEOUT: return "no PUBACK";
+        default: return String("MQTT error ") + code;
+    }
+}
+
+/**
+ * @brief Returns a snapshot of the MQTT counters.
+ * @return Copy of the current statistics.
+ */
+MqttStats mqttGetStats() {
+    uint8_t inFlight = 0;
+    portENTER_CRITICAL(&slotLock);
+    for (uint8_t i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        if (slots[i].used) {
+            inFlight++;
+        }
+    }
+    portEXIT_CRITICAL(&slotLock);
+    portENTER_CRITICAL(&statsLock);
+    MqttStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    snapshot.inFlight = inFlight;
+    return snapshot;
+}
+
+#endif // WS_TRANSPORT_MQTT
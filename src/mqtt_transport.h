@@ -0,0 +1,75 @@
+/**
+ * @file mqtt_transport.h
+ * @brief Declarations for the MQTT uplink used by MqttTransport (WS_TRANSPORT_MQTT).
+ *
+ * One long-lived connection to the broker at serverAddress is opened on first
+ * use and kept open by esp-mqtt, which reconnects on its own. The session is
+ * persistent (clean session off, fixed client id "ws-<mac>"), so the broker
+ * keeps the subscription and queued control messages while the station is
+ * offline. A retained last will of "offline" on stations/<mac>/status replaces
+ * the "online" published after every connect.
+ *
+ * Payloads are published with QoS 1 to stations/<mac>/<channel>. A publish
+ * waits for its PUBACK; up to MQTT_INFLIGHT_WINDOW publishes from different
+ * tasks can be in flight at the same time. This is not pipelining: each call
+ * blocks until its own PUBACK, so one task has at most one publish in flight
+ * and every report of that task costs a full broker round trip. The window
+ * only lets the uplink, the alert lane and backfill publish concurrently. Messages on stations/<mac>/control
+ * are handed to the next data publish as its "response", so the uplink handles
+ * them exactly like the body of an HTTP response.
+ */
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include "config.h"
+
+// --- Error Codes (negative, like HTTPClient errors) ---
+constexpr int MQTT_ERROR_NOT_CONNECTED = -1;
+constexpr int MQTT_ERROR_WINDOW_FULL = -2;
+constexpr int MQTT_ERROR_PUBLISH = -3;
+constexpr int MQTT_ERROR_ACK_TIMEOUT = -4;
+
+/** @brief Counters of the MQTT uplink. */
+struct MqttStats {
+  uint32_t published;      ///< Publishes acknowledged by the broker.
+  uint32_t failed;         ///< Publishes that failed or timed out.
+  uint32_t bytesOnAir;     ///< MQTT bytes of all PUBLISH packets sent (header, topic, packet id, payload).
+  uint32_t payloadBytes;   ///< Payload bytes of all PUBLISH packets sent.
+  uint32_t ackMsAvg;       ///< Average publish-to-PUBACK time [ms].
+  uint32_t ackMsMax;       ///< Maximum publish-to-PUBACK time [ms].
+  uint32_t connects;       ///< Successful connections to the broker.
+  uint8_t inFlight;        ///< Publishes currently awaiting PUBACK.
+};
+
+/**
+ * @brief Creates the in-flight window and the locks of the transport.
+ * @note Must be called in setup() before any task publishes.
+ * @return true on success.
+ */
+bool initMqttTransport();
+
+/**
+ * @brief Publishes a payload with QoS 1 and waits for the PUBACK.
+ * Connects to the broker on first use and waits up to timeoutMs for the connection.
+ * @param channel Last topic level, e.g. "data".
+ * @param payload The payload.
+ * @param response Receives the pending control message for the "data" channel, otherwise cleared.
+ * @param timeoutMs Maximum time to wait for a window slot and for the PUBACK.
+ * @return 200 when acknowledged, a negative MQTT_ERROR_* code otherwise.
+ */
+int mqttPublish(const char* channel, const String& payload, String& response, uint32_t timeoutMs);
+
+/**
+ * @brief Returns a description of an MQTT_ERROR_* code.
+ * @param code The code.
+ * @return Printable description.
+ */
+String mqttErrorToString(int code);
+
+/**
+ * @brief Returns a snapshot of the MQTT counters.
+ * @return Copy of the current statistics.
+ */
+MqttStats mqttGetStats();
+
+#endif // MQTT_TRANSPORT_H
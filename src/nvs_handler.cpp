@@ -6,9 +6,14 @@
  * (like Wi-Fi credentials, server address, username, and device mode) from NVS
  * into global variables, save the current configuration to NVS, and clear
  * the stored configuration, effectively resetting the device to an unconfigured state.
+ * It also persists the server-controlled runtime configuration (see runtime_config.h)
+ * and the server-defined alert rules (see alerts.h).
  */
 #include "nvs_handler.h"
 #include "config.h"      
+#include "alerts.h"
+#include "event_bus.h"
+#include "fanout.h"
 #include <Preferences.h> 
 
 // --- Global Objects ---
@@ -38,6 +43,18 @@ bool initNVS() {
 
 // --- NVS Configuration Management ---
 
+/**
+ * @brief Publishes the stored device mode on TOPIC_CONFIG_CHANGED.
+ * @param mode The device mode now stored in NVS.
+ */
+static void publishConfigChanged(DeviceMode mode) {
+    BusMessage* message = eventBusAcquire(TOPIC_CONFIG_CHANGED);
+    if (message != NULL) {
+        message->data.config.mode = mode;
+        eventBusPublish(message);
+    }
+}
+
 /**
  * @brief Loads the configuration from NVS into global variables.
  * @return true if configuration was loaded successfully and the device mode
@@ -57,6 +74,8 @@ bool loadConfigurationFromNVS() {
         wifiPass = preferences.getString(NVS_KEY_PASS, "");
         userName = preferences.getString(NVS_KEY_USER, "defaultUser");
         serverAddress = preferences.getString(NVS_KEY_SERVER, "192.168.50.23:5000"); // Use default if missing
+        String destinations = preferences.getString(NVS_KEY_DESTINATIONS, "");
+        fanoutSetDestinations(destinations);
 
         preferences.end();
 
@@ -66,6 +85,9 @@ bool loadConfigurationFromNVS() {
             // Avoid printing password for security: Serial.printf("  Pass: %s\n", wifiPass.c_str());
             Serial.printf("  User: %s\n", userName.c_str());
             Serial.printf("  Server: %s\n", serverAddress.c_str());
+            if (destinations.length() > 0) {
+                Serial.printf("  Destinations: %s\n", destinations.c_str());
+            }
             return true; 
         } else {
              Serial.println("Configured mode, but SSID is missing in NVS. Forcing AP mode.");
@@ -81,7 +103,7 @@ bool loadConfigurationFromNVS() {
 /**
  * @brief Saves the current configuration (from global variables wifiSSID, wifiPass, etc.) to NVS.
  * Sets the device mode to MODE_CONFIGURED in NVS.
- * Updates the currentDeviceMode global variable.
+ * Updates the currentDeviceMode global variable and publishes TOPIC_CONFIG_CHANGED.
  */
 void saveConfigurationToNVS() {
     if (!preferences.begin(NVS_NAMESPACE, false)) { 
@@ -92,17 +114,20 @@ void saveConfigurationToNVS() {
     preferences.putString(NVS_KEY_PASS, wifiPass);
     preferences.putString(NVS_KEY_USER, userName);
     preferences.putString(NVS_KEY_SERVER, serverAddress);
+    preferences.putString(NVS_KEY_DESTINATIONS, fanoutGetDestinations());
     preferences.putUInt(NVS_KEY_MODE, MODE_CONFIGURED); 
     preferences.end(); 
     Serial.println("Configuration saved to NVS.");
     currentDeviceMode = MODE_CONFIGURED; 
+    publishConfigChanged(MODE_CONFIGURED);
 }
 
 
 /**
  * @brief Clears the configuration in NVS by setting the mode to UNCONFIGURED.
  * Optionally removes other keys for completeness.
- * Updates the currentDeviceMode global variable and clears sensitive RAM variables.
+ * Updates the currentDeviceMode global variable, clears sensitive RAM variables
+ * and publishes TOPIC_CONFIG_CHANGED.
  */
 void clearConfigurationInNVS() {
     if (!preferences.begin(NVS_NAMESPACE, false)) { 
@@ -114,9 +139,148 @@ void clearConfigurationInNVS() {
     preferences.remove(NVS_KEY_PASS);
     preferences.remove(NVS_KEY_USER);
     preferences.remove(NVS_KEY_SERVER);
+    preferences.remove(NVS_KEY_DESTINATIONS);
+    preferences.remove(NVS_KEY_DISCOVERED); // Discovered on the old network
+    preferences.remove(NVS_KEY_RUNTIME); // The next server sets its own cadence
+    preferences.remove(NVS_KEY_RULES);   // ... and its own alert rules
     preferences.end();
     Serial.println("NVS configuration cleared (mode set to unconfigured).");
     currentDeviceMode = MODE_UNCONFIGURED; 
     wifiSSID = "";
     wifiPass = "";
-}
\ No newline at end of file
+    fanoutSetDestinations("");
+    applyRuntimeConfig(defaultRuntimeConfig(), false);
+    applyAlertRules("", false);
+    publishConfigChanged(MODE_UNCONFIGURED);
+}
+
+// --- NVS Runtime Configuration ---
+// These run in the uplink task, so they use their own Preferences handle
+// instead of the global one used by the supervisor.
+
+/**
+ * @brief Loads the server-controlled runtime configuration from NVS.
+ * @param config Receives the stored configuration (not validated).
+ * @return true if a configuration of the expected size was stored, false otherwise.
+ */
+bool loadRuntimeConfigFromNVS(RuntimeConfig& config) {
+    Preferences runtimePreferences;
+    if (!runtimePreferences.begin(NVS_NAMESPACE, true)) {
+        return false;
+    }
+    bool found = runtimePreferences.getBytesLength(NVS_KEY_RUNTIME) == sizeof(RuntimeConfig) &&
+                 runtimePreferences.getBytes(NVS_KEY_RUNTIME, &config, sizeof(RuntimeConfig)) == sizeof(RuntimeConfig);
+    runtimePreferences.end();
+    return found;
+}
+
+/**
+ * @brief Saves the server-controlled runtime configuration to NVS.
+ * @param config The configuration to store.
+ */
+void saveRuntimeConfigToNVS(const RuntimeConfig& config) {
+    Preferences runtimePreferences;
+    if (!runtimePreferences.begin(NVS_NAMESPACE, false)) {
+        Serial.println("!!! ERROR: Failed to open NVS in write mode while saving runtime config!");
+        return;
+    }
+    runtimePreferences.putBytes(NVS_KEY_RUNTIME, &config, sizeof(RuntimeConfig));
+    runtimePreferences.end();
+}
+
+/**
+ * @brief Loads the server-defined alert rule source from NVS.
+ * @param source Receives the stored source.
+ * @return true if a source was stored, false otherwise.
+ */
+bool loadAlertRulesFromNVS(String& source) {
+    Preferences rulesPreferences;
+    if (!rulesPreferences.begin(NVS_NAMESPACE, true)) {
+        return false;
+    }
+    bool found = rulesPreferences.isKey(NVS_KEY_RULES);
+    if (found) {
+        source = rulesPreferences.getString(NVS_KEY_RULES, "");
+    }
+    rulesPreferences.end();
+    return found;
+}
+
+/**
+ * @brief Saves the server-defined alert rule source to NVS.
+ * @param source The source to store.
+ */
+void saveAlertRulesToNVS(const String& source) {
+    Preferences rulesPreferences;
+    if (!rulesPreferences.begin(NVS_NAMESPACE, false)) {
+        Serial.println("!!! ERROR: Failed to open NVS in write mode while saving alert rules!");
+        return;
+    }
+    rulesPreferences.putString(NVS_KEY_RULES, source);
+    rulesPreferences.end();
+}
+
+// --- NVS Server Discovery ---
+
+/**
+ * @brief Loads the server instance chosen by the last discovery.
+ * @param address Receives "ip:port"; unchanged if none is stored.
+ * @return true if an address was found.
+ */
+bool loadDiscoveredServerFromNVS(String& address) {
+    Preferences discoveryPreferences;
+    if (!discoveryPreferences.begin(NVS_NAMESPACE, true)) {
+        return false;
+    }
+    bool found = discoveryPreferences.isKey(NVS_KEY_DISCOVERED);
+    if (found) {
+        address = discoveryPreferences.getString(NVS_KEY_DISCOVERED, "");
+    }
+    discoveryPreferences.end();
+    return found && address.length() > 0;
+}
+
+/**
+ * @brief Saves the server instance chosen by discovery.
+ * @param address "ip:port" of the instance.
+ */
+void saveDiscoveredServerToNVS(const String& address) {
+    Preferences discoveryPreferences;
+    if (!discoveryPreferences.begin(NVS_NAMESPACE, false)) {
+        Serial.println("!!! ERROR: Failed to open NVS in write mode while saving the discovered server!");
+        return;
+    }
+    discoveryPreferences.putString(NVS_KEY_DISCOVERED, address);
+    discoveryPreferences.end();
+}
+
+// --- NVS Upload Sequence ---
+// Not cleared with the configuration: sequence numbers must never repeat.
+
+/**
+ * @brief Loads the limit of the upload sequence numbers reserved before the last reboot.
+ * @return The limit, 0 if none was stored.
+ */
+uint32_t loadSequenceLimitFromNVS() {
+    Preferences sequencePreferences;
+    if (!sequencePreferences.begin(NVS_NAMESPACE, true)) {
+        return 0;
+    }
+    uint32_t limit = sequencePreferences.getUInt(NVS_KEY_SEQUENCE, 0);
+    sequencePreferences.end();
+    return limit;
+}
+
+/**
+ * @brief Saves the limit of the reserved upload sequence numbers.
+ * @param limit Sequence numbers below this may be used without another write.
+ */
+void saveSequenceLimitToNVS(uint32_t limit) {
+    Preferences sequencePreferences;
+    if (!sequencePreferences.begin(NVS_NAMESPACE, false)) {
+        Serial.println("!!! ERROR: Failed to open NVS in write mode while saving the sequence limit!");
+        return;
+    }
+    sequencePreferences.putUInt(NVS_KEY_SEQUENCE, limit);
+    sequencePreferences.end();
+}
@@ -11,6 +11,7 @@
 #define NVS_HANDLER_H
 
 #include "config.h" 
+#include "runtime_config.h"
 
 /**
  * @brief Initializes the NVS (Non-Volatile Storage).
@@ -38,4 +39,55 @@ void saveConfigurationToNVS();
  */
 void clearConfigurationInNVS();
 
+/**
+ * @brief Loads the server-controlled runtime configuration from NVS.
+ * @param config Receives the stored configuration (not validated).
+ * @return true if a configuration of the expected size was stored, false otherwise.
+ */
+bool loadRuntimeConfigFromNVS(RuntimeConfig& config);
+
+/**
+ * @brief Saves the server-controlled runtime configuration to NVS.
+ * @param config The configuration to store.
+ */
+void saveRuntimeConfigToNVS(const RuntimeConfig& config);
+
+/**
+ * @brief Loads the server-defined alert rule source from NVS.
+ * @param source Receives the stored source.
+ * @return true if a source was stored, false otherwise.
+ */
+bool loadAlertRulesFromNVS(String& source);
+
+/**
+ * @brief Saves the server-defined alert rule source to NVS.
+ * @param source The source to store.
+ */
+void saveAlertRulesToNVS(const String& source);
+
+/**
+ * @brief Loads the server instance chosen by the last discovery.
+ * @param address Receives "ip:port"; unchanged if none is stored.
+ * @return true if an address was found.
+ */
+bool loadDiscoveredServerFromNVS(String& address);
+
+/**
+ * @brief Saves the server instance chosen by discovery.
+ * @param address "ip:port" of the instance.
+ */
+void saveDiscoveredServerToNVS(const String& address);
+
+/**
+ * @brief Loads the limit of the upload sequence numbers reserved before the last reboot.
+ * @return The limit, 0 if none was stored.
+ */
+uint32_t loadSequenceLimitFromNVS();
+
+/**
+ * @brief Saves the limit of the reserved upload sequence numbers.
+ * @param limit Sequence numbers below this may be used without another write.
+ */
+void saveSequenceLimitToNVS(uint32_t limit);
+
 #endif // NVS_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,153 @@
+/**
+ * @file protobuf_encoder.cpp
+ * @brief Protocol Buffers encoding of reports with nanopb, and the JSON comparison benchmark.
+ *
+ * Wire layout of a report (telemetry.Batch):
+ *
+ *     | tag 1, length-delimited | length | Sample | tag 1, length-delimited | length | Sample | ...
+ *
+ * which is what pb_encode() of a Batch with repeated samples produces. The
+ * samples are written one by one with pb_encode_submessage(), so only one
+ * telemetry_Sample exists at a time. Fields that are not reported
+ * (SAMPLE_MISSING) have their has_ flag cleared and take no bytes.
+ */
+#include "protobuf_encoder.h"
+
+#if WS_FEATURE_PROTOBUF
+#include "station_policies.h"
+#include "runtime_config.h"
+#include <pb_encode.h>
+#include "telemetry.pb.h"
+
+static_assert(PROTOBUF_SAMPLE_MAX_BYTES >= telemetry_Sample_size + 2, "Tag and length byte per sample");
+
+// --- Benchmark Configuration ---
+const uint8_t BENCHMARK_RUNS = 8; // Runs per encoding; the fastest counts
+
+// --- Encoding ---
+
+/**
+ * @brief nanopb output callback appending to the String in stream->state.
+ * @return false if the String could not grow.
+ */
+static bool appendToString(pb_ostream_t* stream, const pb_byte_t* buffer, size_t count) {
+    String* out = static_cast<String*>(stream->state);
+    return out->concat(reinterpret_cast<const char*>(buffer), count);
+}
+
+/**
+ * @brief Fills a telemetry.Sample with the scaled fields of a sample.
+ * @param sample The sample.
+ * @param message Receives the fields; unreported ones are absent.
+ */
+static void toMessage(const WeatherSample& sample, telemetry_Sample& message) {
+    message = telemetry_Sample_init_zero;
+    message.has_seq = sample.seq != 0;
+    message.seq = sample.seq;
+    message.has_timestamp = sample.epochS != 0;
+    message.timestamp = sample.epochS;
+    static_assert(TEMPERATURE_SCALE == 10 && PRESSURE_SCALE == 10 && HUMIDITY_SCALE == 100 && WIND_SCALE == 10,
+                  "Sample resolution differs from proto/telemetry.proto");
+    message.has_temperature = sample.temperature != SAMPLE_MISSING;
+    message.temperature = sample.temperature;
+    message.has_pressure = sample.pressure != SAMPLE_MISSING && sample.pressure >= 0;
+    message.pressure = (uint32_t)sample.pressure;
+    message.has_humidity = sample.humidity != SAMPLE_MISSING && sample.humidity >= 0;
+    message.humidity = (uint32_t)sample.humidity;
+    message.has_sunshine = sample.sunshine != SAMPLE_MISSING;
+    message.sunshine = sample.sunshine;
+    message.has_wind_speed = sample.windSpeed != SAMPLE_MISSING && sample.windSpeed >= 0;
+    message.wind_speed = (uint32_t)sample.windSpeed;
+    message.has_precipitation = sample.precipitation != SAMPLE_MISSING;
+    message.precipitation = sample.precipitation;
+}
+
+/**
+ * @brief Encodes a report as a telemetry.Batch.
+ * @param samples Samples of the report, oldest first.
+ * @param count Number of samples.
+ * @param out Receives the encoded message (binary).
+ * @return true on success, false if the payload could not be allocated.
+ */
+bool protobufEncodeReport(const WeatherSample* samples, uint8_t count, String& out) {
+    out = "";
+    out.reserve(count * PROTOBUF_SAMPLE_MAX_BYTES);
+    for (uint8_t i = 0; i < count; i++) {
+        if (!protobufAppendSample(samples[i], out)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Appends one sample to a telemetry.Batch being built.
+ * @param sample The sample.
+ * @param out Encoded Batch so far; receives the sample as one more "samples" entry.
+ * @return true on success, false if the payload could not grow.
+ */
+bool protobufAppendSample(const WeatherSample& sample, String& out) {
+    pb_ostream_t stream = { &appendToString, &out, SIZE_MAX, 0 };
+    telemetry_Sample message;
+    toMessage(sample, message);
+    if (!pb_encode_tag(&stream, PB_WT_STRING, telemetry_Batch_samples_tag) ||
+        !pb_encode_submessage(&stream, telemetry_Sample_fields, &message)) {
+        Serial.printf("Protobuf: Encoding failed: %s\n", PB_GET_ERROR(&stream));
+        return false;
+    }
+    return true;
+}
+
+// --- Benchmark ---
+
+/**
+ * @brief Encodes a reference report with the JSON path of the uplink and as protobuf.
+ * Each encoding is repeated several times; the fastest run is reported, so
+ * preemption by other tasks does not distort the result.
+ * @param samples Samples in the report (1..RUNTIME_MAX_BATCH).
+ * @return Cycles and bytes of both encodings.
+ */
+EncoderBenchmarkResult protobufRunBenchmark(uint8_t samples) {
+    static WeatherSample report[RUNTIME_MAX_BATCH];
+    if (samples < 1) samples = 1;
+    if (samples > RUNTIME_MAX_BATCH) samples = RUNTIME_MAX_BATCH;
+    for (uint8_t i = 0; i < samples; i++) { // Every field reported, typical values
+        WeatherSample& sample = report[i];
+        sample.timestampMs = millis();
+        sample.epochS = 1700000000UL + i * 60;
+        sample.temperature = 214 + i; // 21.4 °C
+        sample.pressure = 10132;      // 1013.2 hPa
+        sample.humidity = 48;         // 0.48
+        sample.sunshine = 63;
+        sample.windSpeed = 34;        // 3.4 m/s
+        sample.precipitation = 12;
+        sample.windGust = SAMPLE_MISSING;
+        sample.seq = 100000UL + i;
+    }
+
+    EncoderBenchmarkResult result;
+    result.samples = samples;
+    result.jsonCycles = UINT32_MAX;
+    result.protobufCycles = UINT32_MAX;
+    String payload;
+    for (uint8_t run = 0; run < BENCHMARK_RUNS; run++) {
+        uint32_t startCycles = ESP.getCycleCount();
+        encodeJsonReport(report, samples, samples > 1, payload);
+        uint32_t cycles = ESP.getCycleCount() - startCycles;
+        if (cycles < result.jsonCycles) {
+            result.jsonCycles = cycles;
+        }
+        result.jsonBytes = payload.length();
+
+        startCycles = ESP.getCycleCount();
+        protobufEncodeReport(report, samples, payload);
+        cycles = ESP.getCycleCount() - startCycles;
+        if (cycles < result.protobufCycles) {
+            result.protobufCycles = cycles;
+        }
+        result.protobufBytes = payload.length();
+    }
+    return result;
+}
+
+#endif // WS_FEATURE_PROTOBUF
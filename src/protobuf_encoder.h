@@ -0,0 +1,55 @@
+/**
+ * @file protobuf_encoder.h
+ * @brief Declarations for the Protocol Buffers report encoder (WS_FEATURE_PROTOBUF).
+ *
+ * Reports are encoded as a telemetry.Batch (see proto/telemetry.proto) with the
+ * nanopb runtime and the code generated from that file at build time. Each
+ * sample is encoded from a stack message straight into the payload String, so
+ * no batch structure or intermediate buffer is allocated.
+ */
+#ifndef PROTOBUF_ENCODER_H
+#define PROTOBUF_ENCODER_H
+
+#include "config.h"
+#include "sample.h"
+
+/** @brief Largest encoding of one sample inside a telemetry.Batch, tag and length included [bytes]. */
+constexpr size_t PROTOBUF_SAMPLE_MAX_BYTES = 64;
+
+/** @brief Encode cost of one report, JSON against protobuf. */
+struct EncoderBenchmarkResult {
+  uint8_t samples;          ///< Samples in the report.
+  uint32_t jsonCycles;      ///< CPU cycles to build the JSON report (best run).
+  uint32_t jsonBytes;       ///< Size of the JSON report [bytes].
+  uint32_t protobufCycles;  ///< CPU cycles to build the protobuf report (best run).
+  uint32_t protobufBytes;   ///< Size of the protobuf report [bytes].
+};
+
+/**
+ * @brief Encodes a report as a telemetry.Batch.
+ * @param samples Samples of the report, oldest first.
+ * @param count Number of samples.
+ * @param out Receives the encoded message (binary).
+ * @return true on success, false if the payload could not be allocated.
+ */
+bool protobufEncodeReport(const WeatherSample* samples, uint8_t count, String& out);
+
+/**
+ * @brief Appends one sample to a telemetry.Batch being built.
+ * Samples appended one by one to an empty String form the same message as protobufEncodeReport().
+ * @param sample The sample.
+ * @param out Encoded Batch so far; receives the sample as one more "samples" entry.
+ * @return true on success, false if the payload could not grow.
+ */
+bool protobufAppendSample(const WeatherSample& sample, String& out);
+
+/**
+ * @brief Encodes a reference report with the JSON path of the uplink and as protobuf.
+ * Each encoding is repeated several times; the fastest run is reported, so
+ * preemption by other tasks does not distort the result.
+ * @param samples Samples in the report (1..RUNTIME_MAX_BATCH).
+ * @return Cycles and bytes of both encodings.
+ */
+EncoderBenchmarkResult protobufRunBenchmark(uint8_t samples);
+
+#endif // PROTOBUF_ENCODER_H
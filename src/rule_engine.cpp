@@ -0,0 +1,361 @@
+/**
+ * @file rule_engine.cpp
+ * @brief Threshold rule compiler (recursive descent) and postfix bytecode interpreter.
+ *
+ * Bytecode of one rule, e.g. "wind_gust > 15 and temperature < 2":
+ *
+ *     LOAD wind_gust, CONST 15, GT, LOAD temperature, CONST 2, LT, AND, END
+ *
+ * LOAD takes a one-byte input index, CONST a four-byte float (copied with
+ * memcpy, the code array is not aligned). Every other opcode is one byte.
+ */
+#include "rule_engine.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Opcodes of the rule bytecode. */
+enum RuleOpcode {
+  OP_END = 0,
+  OP_LOAD,
+  OP_CONST,
+  OP_GT,
+  OP_LT,
+  OP_GE,
+  OP_LE,
+  OP_EQ,
+  OP_NE,
+  OP_AND,
+  OP_OR
+};
+
+static const char* const INPUT_NAMES[RULE_INPUT_COUNT] = {
+  "temperature", "pressure", "humidity", "sunshine",
+  "wind_speed", "wind_gust", "precipitation", "pressure_tendency"
+};
+
+// --- Compiler ---
+
+/** @brief State of the compiler while it works through one source. */
+struct RuleCompiler {
+  const char* cursor;
+  const char* end;        // End of the current rule
+  RuleSet* set;
+  const char* error;
+  uint8_t depth;          // Stack depth of the code emitted so far
+  int firstInput;         // First input referenced by the current rule, -1 if none yet
+};
+
+static bool isRuleSeparator(char c) {
+  return c == ';' || c == '\n';
+}
+
+static void skipSpaces(RuleCompiler& compiler) {
+    while (compiler.cursor < compiler.end && (*compiler.cursor == ' ' || *compiler.cursor == '\t' || *compiler.cursor == '\r')) {
+        compiler.cursor++;
+    }
+}
+
+static bool fail(RuleCompiler& compiler, const char* message) {
+    if (compiler.error == NULL) {
+        compiler.error = message;
+    }
+    return false;
+}
+
+static bool emitByte(RuleCompiler& compiler, uint8_t byte) {
+    if (compiler.set->codeBytes >= RULE_MAX_CODE_BYTES) {
+        return fail(compiler, "rule code too large");
+    }
+    compiler.set->code[compiler.set->codeBytes++] = byte;
+    return true;
+}
+
+/**
+ * @brief Updates the stack depth for an emitted opcode and checks the limit.
+ * @param delta Change of the depth caused by the opcode.
+ */
+static bool adjustDepth(RuleCompiler& compiler, int delta) {
+    int depth = compiler.depth + delta;
+    if (depth > RULE_STACK_DEPTH) {
+        return fail(compiler, "expression too deep");
+    }
+    compiler.depth = (uint8_t)depth;
+    return true;
+}
+
+/**
+ * @brief Reads an identifier ([a-z_]+) at the cursor.
+ * @param length Receives its length; 0 if there is none.
+ * @return Start of the identifier.
+ */
+static const char* readWord(RuleCompiler& compiler, size_t& length) {
+    skipSpaces(compiler);
+    const char* start = compiler.cursor;
+    while (compiler.cursor < compiler.end && ((*compiler.cursor >= 'a' && *compiler.cursor <= 'z') || *compiler.cursor == '_')) {
+        compiler.cursor++;
+    }
+    length = compiler.cursor - start;
+    return start;
+}
+
+/**
+ * @brief Consumes a keyword if it is next in the source.
+ * @return true if the keyword was consumed.
+ */
+static bool acceptKeyword(RuleCompiler& compiler, const char* keyword) {
+    const char* saved = compiler.cursor;
+    size_t length;
+    const char* word = readWord(compiler, length);
+    if (length == strlen(keyword) && strncmp(word, keyword, length) == 0) {
+        return true;
+    }
+    compiler.cursor = saved;
+    return false;
+}
+
+static bool readNumber(RuleCompiler& compiler, float& value) {
+    skipSpaces(compiler);
+    char* parsedEnd;
+    value = strtof(compiler.cursor, &parsedEnd);
+    if (parsedEnd == compiler.cursor || parsedEnd > compiler.end) {
+        return fail(compiler, "number expected");
+    }
+    compiler.cursor = parsedEnd;
+    return true;
+}
+
+/**
+ * @brief Compiles "field op number".
+ */
+static bool compileComparison(RuleCompiler& compiler) {
+    size_t length;
+    const char* word = readWord(compiler, length);
+    int input = -1;
+    for (uint8_t i = 0; i < RULE_INPUT_COUNT; i++) {
+        if (length == strlen(INPUT_NAMES[i]) && strncmp(word, INPUT_NAMES[i], length) == 0) {
+            input = i;
+            break;
+        }
+    }
+    if (input < 0) {
+        return fail(compiler, "unknown field");
+    }
+    if (compiler.firstInput < 0) {
+        compiler.firstInput = input;
+    }
+
+    skipSpaces(compiler);
+    uint8_t opcode;
+    const char* op = compiler.cursor;
+    bool twoChars = compiler.end - op >= 2 && op[1] == '=';
+    switch (op < compiler.end ? *op : '\0') {
+        case '>': opcode = twoChars ? OP_GE : OP_GT; break;
+        case '<': opcode = twoChars ? OP_LE : OP_LT; break;
+        case '=': if (!twoChars) return fail(compiler, "comparison expected"); opcode = OP_EQ; break;
+        case '!': if (!twoChars) return fail(compiler, "comparison expected"); opcode = OP_NE; break;
+        default: return fail(compiler, "comparison expected");
+    }
+    compiler.cursor += twoChars ? 2 : 1;
+
+    float threshold;
+    if (!readNumber(compiler, threshold)) {
+        return false;
+    }
+
+    uint8_t constant[sizeof(float)];
+    memcpy(constant, &threshold, sizeof(float));
+    return emitByte(compiler, OP_LOAD) && emitByte(compiler, (uint8_t)input) && adjustDepth(compiler, 1) &&
+           emitByte(compiler, OP_CONST) && emitByte(compiler, constant[0]) && emitByte(compiler, constant[1]) &&
+           emitByte(compiler, constant[2]) && emitByte(compiler, constant[3]) && adjustDepth(compiler, 1) &&
+           emitByte(compiler, opcode) && adjustDepth(compiler, -1);
+}
+
+/**
+ * @brief Compiles "comparison { and comparison }".
+ */
+static bool compileTerm(RuleCompiler& compiler) {
+    if (!compileComparison(compiler)) {
+        return false;
+    }
+    while (acceptKeyword(compiler, "and")) {
+        if (!compileComparison(compiler) || !emitByte(compiler, OP_AND) || !adjustDepth(compiler, -1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Compiles "term { or term }".
+ */
+static bool compileExpression(RuleCompiler& compiler) {
+    if (!compileTerm(compiler)) {
+        return false;
+    }
+    while (acceptKeyword(compiler, "or")) {
+        if (!compileTerm(compiler) || !emitByte(compiler, OP_OR) || !adjustDepth(compiler, -1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Compiles one rule between compiler.cursor and compiler.end.
+ */
+static bool compileRule(RuleCompiler& compiler, CompiledRule& rule) {
+    rule.codeOffset = compiler.set->codeBytes;
+    rule.holdMs = 0;
+    compiler.depth = 0;
+    compiler.firstInput = -1;
+
+    if (!compileExpression(compiler) || !emitByte(compiler, OP_END)) {
+        return false;
+    }
+    if (acceptKeyword(compiler, "for")) {
+        float hold;
+        if (!readNumber(compiler, hold) || hold < 0) {
+            return fail(compiler, "invalid hold time");
+        }
+        float unitMs = 1000.0f; // Seconds by default
+        if (acceptKeyword(compiler, "ms")) unitMs = 1.0f;
+        else if (acceptKeyword(compiler, "min")) unitMs = 60000.0f;
+        else acceptKeyword(compiler, "s");
+        rule.holdMs = (uint32_t)(hold * unitMs);
+    }
+    skipSpaces(compiler);
+    if (compiler.cursor != compiler.end) {
+        return fail(compiler, "unexpected text");
+    }
+    rule.firstInput = (uint8_t)compiler.firstInput;
+    rule.conditionTrue = false;
+    rule.fired = false;
+    rule.trueSinceMs = 0;
+    return true;
+}
+
+/**
+ * @brief Compiles a rule source into a rule set.
+ * @param source Rules separated by ';' or newlines.
+ * @param set Receives the compiled set.
+ * @param error Receives a description of the first error (may be NULL).
+ * @param errorRule Receives the index of the rule containing the error (may be NULL).
+ * @return true if every rule compiled, false otherwise.
+ */
+bool ruleSetCompile(const char* source, RuleSet& set, const char** error, uint8_t* errorRule) {
+    RuleCompiler compiler = { source, source, &set, NULL, 0, -1 };
+    set.ruleCount = 0;
+    set.codeBytes = 0;
+
+    const char* cursor = source;
+    while (*cursor != '\0') {
+        const char* ruleEnd = cursor;
+        while (*ruleEnd != '\0' && !isRuleSeparator(*ruleEnd)) {
+            ruleEnd++;
+        }
+        compiler.cursor = cursor;
+        compiler.end = ruleEnd;
+        skipSpaces(compiler);
+        if (compiler.cursor != ruleEnd) { // Skip empty rules
+            if (set.ruleCount >= RULE_MAX_RULES) {
+                fail(compiler, "too many rules");
+            } else if (compileRule(compiler, set.rules[set.ruleCount])) {
+                set.ruleCount++;
+            }
+            if (compiler.error != NULL) {
+                if (error != NULL) *error = compiler.error;
+                if (errorRule != NULL) *errorRule = set.ruleCount;
+                return false;
+            }
+        }
+        cursor = *ruleEnd != '\0' ? ruleEnd + 1 : ruleEnd;
+    }
+    if (error != NULL) *error = NULL;
+    return true;
+}
+
+// --- Interpreter ---
+
+/**
+ * @brief Runs the bytecode of one rule.
+ * @return true if the condition holds.
+ */
+static bool runRule(const uint8_t* code, const float* inputs) {
+    float stack[RULE_STACK_DEPTH];
+    uint8_t top = 0; // Number of values on the stack; the compiler guarantees the bounds
+
+    for (;;) {
+        uint8_t opcode = *code++;
+        if (opcode == OP_END) {
+            return top > 0 && stack[top - 1] != 0.0f;
+        }
+        if (opcode == OP_LOAD) {
+            stack[top++] = inputs[*code++];
+            continue;
+        }
+        if (opcode == OP_CONST) {
+            memcpy(&stack[top++], code, sizeof(float));
+            code += sizeof(float);
+            continue;
+        }
+
+        float b = stack[--top];
+        float a = stack[top - 1];
+        bool result;
+        switch (opcode) {
+            case OP_GT:  result = a > b; break;
+            case OP_LT:  result = a < b; break;
+            case OP_GE:  result = a >= b; break;
+            case OP_LE:  result = a <= b; break;
+            case OP_EQ:  result = a == b; break;
+            case OP_NE:  result = !isnan(a) && !isnan(b) && a != b; break;
+            case OP_AND: result = a != 0.0f && b != 0.0f; break;
+            case OP_OR:  result = a != 0.0f || b != 0.0f; break;
+            default:     return false;
+        }
+        stack[top - 1] = result ? 1.0f : 0.0f;
+    }
+}
+
+/**
+ * @brief Evaluates every rule of a set against one set of inputs.
+ * @param set The compiled set; its runtime state is updated.
+ * @param inputs Array of RULE_INPUT_COUNT values, NAN where unavailable.
+ * @param nowMs Current time in milliseconds.
+ * @param onFired Called for every rule that fires (may be NULL).
+ * @param context Passed to onFired.
+ * @return Number of rules that fired.
+ */
+uint8_t ruleSetEvaluate(RuleSet& set, const float* inputs, uint32_t nowMs, RuleFiredCallback onFired, void* context) {
+    uint8_t firedCount = 0;
+    for (uint8_t i = 0; i < set.ruleCount; i++) {
+        CompiledRule& rule = set.rules[i];
+        if (!runRule(set.code + rule.codeOffset, inputs)) {
+            rule.conditionTrue = false;
+            rule.fired = false;
+            continue;
+        }
+        if (!rule.conditionTrue) {
+            rule.conditionTrue = true;
+            rule.trueSinceMs = nowMs;
+        }
+        if (!rule.fired && nowMs - rule.trueSinceMs >= rule.holdMs) {
+            rule.fired = true;
+            firedCount++;
+            if (onFired != NULL) {
+                onFired(i, inputs[rule.firstInput], context);
+            }
+        }
+    }
+    return firedCount;
+}
+
+/**
+ * @brief Returns the name of an input as used in rule sources.
+ * @param input The input.
+ * @return The name.
+ */
+const char* ruleInputName(RuleInput input) {
+    return input < RULE_INPUT_COUNT ? INPUT_NAMES[input] : "unknown";
+}
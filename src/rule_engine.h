@@ -0,0 +1,105 @@
+/**
+ * @file rule_engine.h
+ * @brief Declarations for the threshold rule compiler and its bytecode interpreter.
+ *
+ * Rules are short text conditions over sample fields, for example
+ *
+ *     wind_gust > 15 for 30 s
+ *     pressure_tendency < -3
+ *     precipitation >= 40 and temperature < 2
+ *
+ * Grammar:
+ *
+ *     rule       := expression [ "for" number [ "ms" | "s" | "min" ] ]
+ *     expression := term { "or" term }
+ *     term       := comparison { "and" comparison }
+ *     comparison := field ( ">" | "<" | ">=" | "<=" | "==" | "!=" ) number
+ *
+ * A rule set is compiled once, when it is loaded, into one flat byte array of
+ * postfix stack-machine code. Evaluation then only walks that array: it does
+ * no parsing, allocation or string handling. A rule fires once when its
+ * condition has held continuously for the hold time, and it can fire again
+ * only after the condition has become false. Comparisons with an unavailable
+ * input (NAN) are false.
+ *
+ * This module has no Arduino dependencies.
+ */
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief Inputs a rule can refer to; indices into the input array passed to ruleSetEvaluate(). */
+enum RuleInput {
+  RULE_INPUT_TEMPERATURE = 0,  ///< "temperature" [°C]
+  RULE_INPUT_PRESSURE,         ///< "pressure" MSL [hPa]
+  RULE_INPUT_HUMIDITY,         ///< "humidity" [0-1]
+  RULE_INPUT_SUNSHINE,         ///< "sunshine" [%]
+  RULE_INPUT_WIND_SPEED,       ///< "wind_speed" average since the previous sample [m/s]
+  RULE_INPUT_WIND_GUST,        ///< "wind_gust" strongest reading since the previous sample [m/s]
+  RULE_INPUT_PRECIPITATION,    ///< "precipitation" [%]
+  RULE_INPUT_PRESSURE_TENDENCY,///< "pressure_tendency" [hPa/3h]
+  RULE_INPUT_COUNT
+};
+
+// --- Limits ---
+constexpr uint8_t RULE_MAX_RULES = 8;
+constexpr uint16_t RULE_MAX_CODE_BYTES = 256; // Bytecode of all rules of a set
+constexpr uint8_t RULE_STACK_DEPTH = 8;
+
+/** @brief Compiled form and runtime state of one rule. */
+struct CompiledRule {
+  uint16_t codeOffset;    ///< Start of the rule's bytecode in RuleSet::code.
+  uint8_t firstInput;     ///< Input reported as the rule's value when it fires.
+  uint32_t holdMs;        ///< Time the condition must hold before the rule fires.
+  uint32_t trueSinceMs;   ///< Time the condition became true (valid while conditionTrue).
+  bool conditionTrue;     ///< Condition was true at the previous evaluation.
+  bool fired;             ///< Rule has fired since the condition became true.
+};
+
+/** @brief A compiled rule set. */
+struct RuleSet {
+  uint8_t ruleCount;
+  uint16_t codeBytes;
+  CompiledRule rules[RULE_MAX_RULES];
+  uint8_t code[RULE_MAX_CODE_BYTES];
+};
+
+/**
+ * @brief Called by ruleSetEvaluate() for every rule that fires.
+ * @param rule Index of the rule in the set (order of the source).
+ * @param value Current value of the rule's first input.
+ * @param context Opaque pointer passed to ruleSetEvaluate().
+ */
+typedef void (*RuleFiredCallback)(uint8_t rule, float value, void* context);
+
+/**
+ * @brief Compiles a rule source into a rule set.
+ * @param source Rules separated by ';' or newlines. An empty source gives an empty set.
+ * @param set Receives the compiled set; left in an unspecified state on failure.
+ * @param error Receives a description of the first error (may be NULL).
+ * @param errorRule Receives the index of the rule containing the error (may be NULL).
+ * @return true if every rule compiled, false otherwise.
+ */
+bool ruleSetCompile(const char* source, RuleSet& set, const char** error, uint8_t* errorRule);
+
+/**
+ * @brief Evaluates every rule of a set against one set of inputs.
+ * @param set The compiled set; its runtime state is updated.
+ * @param inputs Array of RULE_INPUT_COUNT values, NAN where unavailable.
+ * @param nowMs Current time in milliseconds (wrap-around safe).
+ * @param onFired Called for every rule that fires (may be NULL).
+ * @param context Passed to onFired.
+ * @return Number of rules that fired.
+ */
+uint8_t ruleSetEvaluate(RuleSet& set, const float* inputs, uint32_t nowMs, RuleFiredCallback onFired, void* context);
+
+/**
+ * @brief Returns the name of an input as used in rule sources.
+ * @param input The input.
+ * @return The name, e.g. "wind_gust".
+ */
+const char* ruleInputName(RuleInput input);
+
+#endif // RULE_ENGINE_H
@@ -0,0 +1,308 @@
+/**
+ * @file runtime_config.cpp
+ * @brief Server-controlled runtime configuration of sampling and reporting.
+ *
+ * The active configuration is a single struct guarded by a spinlock. Readers
+ * copy it as a whole, so they never see a mix of old and new members.
+ * Applying a configuration wakes the sensor task, which recomputes its wait
+ * with the new period instead of finishing the old one.
+ */
+#include "runtime_config.h"
+#include "config.h"
+#include "data_sender.h"
+#include "nvs_handler.h"
+#include <math.h>
+
+static RuntimeConfig activeConfig = {
+    (uint32_t)DATA_SEND_INTERVAL, (uint32_t)DATA_SEND_INTERVAL, WIND_SAMPLE_INTERVAL, 1, FIELD_ALL, {} };
+static portMUX_TYPE configLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const SAMPLE_FIELD_NAMES[SAMPLE_FIELD_COUNT] = {
+  "temperature", "pressure", "humidity", "sunshine", "wind_speed", "precipitation"
+};
+
+static const char* const AGGREGATION_NAMES[AGGREGATE_TYPE_COUNT] = {
+  "last", "mean", "min", "max", "sum", "count"
+};
+
+/** @brief Units per physical unit of each field, in SampleFieldBit order. */
+static const int16_t FIELD_SCALES[SAMPLE_FIELD_COUNT] = {
+  TEMPERATURE_SCALE, PRESSURE_SCALE, HUMIDITY_SCALE, 1, WIND_SCALE, 1
+};
+
+/** @brief Largest magnitude of each scaled field, in SampleFieldBit order. */
+static const int16_t FIELD_MAX_SCALED[SAMPLE_FIELD_COUNT] = {
+  TEMPERATURE_MAX_SCALED, PRESSURE_MAX_SCALED, HUMIDITY_MAX_SCALED, PERCENT_MAX_SCALED, WIND_MAX_SCALED,
+  PERCENT_MAX_SCALED
+};
+
+/**
+ * @brief Checks that the sum or count of a window fits the int16_t record field.
+ * A window of windowMs holds at most windowMs / samplePeriodMs + 1 samples.
+ * @param downsampling Downsampling of the field.
+ * @param field Index of the field in SampleFieldBit order.
+ * @param samplePeriodMs Period of the sensor acquisition cycle.
+ * @return true if the aggregate cannot saturate.
+ */
+static bool aggregateFits(const FieldDownsampling& downsampling, uint8_t field, uint32_t samplePeriodMs) {
+    if (downsampling.windowMs == 0 ||
+        (downsampling.aggregation != AGGREGATE_SUM && downsampling.aggregation != AGGREGATE_COUNT)) {
+        return true;
+    }
+    uint32_t samples = downsampling.windowMs / samplePeriodMs + 1;
+    uint32_t perSample = downsampling.aggregation == AGGREGATE_COUNT ? FIELD_SCALES[field] : FIELD_MAX_SCALED[field];
+    return samples <= (uint32_t)INT16_MAX / perSample;
+}
+
+/**
+ * @brief Returns the built-in configuration.
+ * @return The default configuration.
+ */
+RuntimeConfig defaultRuntimeConfig() {
+    RuntimeConfig config;
+    config.samplePeriodMs = DATA_SEND_INTERVAL;
+    config.reportPeriodMs = DATA_SEND_INTERVAL;
+    config.windPeriodMs = WIND_SAMPLE_INTERVAL;
+    config.batchSize = 1;
+    config.fieldMask = FIELD_ALL;
+    for (uint8_t i = 0; i < SAMPLE_FIELD_COUNT; i++) {
+        config.downsampling[i].aggregation = AGGREGATE_LAST;
+        config.downsampling[i].windowMs = 0;
+    }
+    return config;
+}
+
+/**
+ * @brief Checks every member of a configuration against its limits.
+ * @param config The configuration to check.
+ * @param reason Receives a description of the first violated limit (may be NULL).
+ * @return true if the configuration is valid.
+ */
+bool validateRuntimeConfig(const RuntimeConfig& config, const char** reason) {
+    const char* problem = NULL;
+    if (config.samplePeriodMs < RUNTIME_SAMPLE_MS_MIN || config.samplePeriodMs > RUNTIME_SAMPLE_MS_MAX) {
+        problem = "sample_ms out of range";
+    } else if (config.reportPeriodMs < RUNTIME_REPORT_MS_MIN || config.reportPeriodMs > RUNTIME_REPORT_MS_MAX) {
+        problem = "report_ms out of range";
+    } else if (config.windPeriodMs < RUNTIME_WIND_MS_MIN || config.windPeriodMs > RUNTIME_WIND_MS_MAX) {
+        problem = "wind_ms out of range";
+    } else if (config.batchSize < 1 || config.batchSize > RUNTIME_MAX_BATCH) {
+        problem = "batch out of range";
+    } else if (config.fieldMask == 0 || (config.fieldMask & ~FIELD_ALL) != 0) {
+        problem = "invalid fields mask";
+    }
+    for (uint8_t i = 0; problem == NULL && i < SAMPLE_FIELD_COUNT; i++) {
+        if (config.downsampling[i].aggregation >= AGGREGATE_TYPE_COUNT) {
+            problem = "invalid aggregation";
+        } else if (config.downsampling[i].windowMs > RUNTIME_WINDOW_MS_MAX) {
+            problem = "downsample window out of range";
+        } else if (!aggregateFits(config.downsampling[i], i, config.samplePeriodMs)) {
+            problem = "downsample sum or count too large";
+        }
+    }
+    if (reason != NULL) {
+        *reason = problem;
+    }
+    return problem == NULL;
+}
+
+/**
+ * @brief Finds an unsigned numeric member between begin and end.
+ * @param begin Start of the object text.
+ * @param end End of the object text.
+ * @param key Member name including quotes.
+ * @param value Receives the value.
+ * @return true if the member was found with a numeric value.
+ */
+static bool findUnsignedMember(const char* begin, const char* end, const char* key, uint32_t& value) {
+    const char* member = strstr(begin, key);
+    if (member == NULL || member >= end) {
+        return false;
+    }
+    const char* colon = strchr(member + strlen(key), ':');
+    if (colon == NULL || colon >= end) {
+        return false;
+    }
+    char* parsedEnd;
+    unsigned long parsed = strtoul(colon + 1, &parsedEnd, 10);
+    if (parsedEnd == colon + 1) {
+        return false;
+    }
+    value = (uint32_t)parsed;
+    return true;
+}
+
+/**
+ * @brief Returns the index of a name in a table.
+ * @param name Start of the name.
+ * @param length Length of the name.
+ * @param table Table of names.
+ * @param count Number of entries.
+ * @return Index, or -1 if the name is not in the table.
+ */
+static int findName(const char* name, size_t length, const char* const* table, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (strlen(table[i]) == length && strncmp(name, table[i], length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Applies a "downsample" member ("field:aggregation:window_s,...") to a configuration.
+ * An entry with an unknown field or aggregation marks the configuration
+ * invalid, so the whole control block is rejected by validateRuntimeConfig().
+ * @param begin Start of the control block text.
+ * @param end End of the control block text.
+ * @param config Configuration to update.
+ */
+static void parseDownsampleMember(const char* begin, const char* end, RuntimeConfig& config) {
+    const char* member = strstr(begin, "\"downsample\"");
+    if (member == NULL || member >= end) {
+        return;
+    }
+    const char* cursor = strchr(member + 12, '"');
+    const char* close = cursor != NULL ? strchr(cursor + 1, '"') : NULL;
+    if (close == NULL || close >= end) {
+        return;
+    }
+    for (cursor++; cursor < close; ) {
+        const char* entryEnd = cursor;
+        while (entryEnd < close && *entryEnd != ',') {
+            entryEnd++;
+        }
+        const char* colon1 = (const char*)memchr(cursor, ':', entryEnd - cursor);
+        const char* colon2 = colon1 != NULL ? (const char*)memchr(colon1 + 1, ':', entryEnd - colon1 - 1) : NULL;
+        int field = colon1 != NULL ? findName(cursor, colon1 - cursor, SAMPLE_FIELD_NAMES, SAMPLE_FIELD_COUNT) : -1;
+        int aggregation = colon2 != NULL ? findName(colon1 + 1, colon2 - colon1 - 1, AGGREGATION_NAMES, AGGREGATE_TYPE_COUNT) : -1;
+        if (field < 0 || aggregation < 0) {
+            config.downsampling[0].aggregation = AGGREGATE_TYPE_COUNT; // Invalid entry, reject the block
+            return;
+        }
+        unsigned long windowS = strtoul(colon2 + 1, NULL, 10);
+        config.downsampling[field].aggregation = (uint8_t)aggregation;
+        config.downsampling[field].windowMs = windowS > RUNTIME_WINDOW_MS_MAX / 1000 ? RUNTIME_WINDOW_MS_MAX + 1 : windowS * 1000;
+        cursor = entryEnd + 1;
+    }
+}
+
+/**
+ * @brief Applies the control block of a server response on top of a configuration.
+ * The block is a flat JSON object, so it is located by its braces without a JSON parser.
+ * @param response Body of the server response.
+ * @param config Configuration to update.
+ * @return true if the response contains a control block, false otherwise.
+ */
+bool parseControlBlock(const String& response, RuntimeConfig& config) {
+    const char* control = strstr(response.c_str(), "\"control\"");
+    if (control == NULL) {
+        return false;
+    }
+    const char* begin = strchr(control, '{');
+    const char* end = begin != NULL ? strchr(begin, '}') : NULL;
+    if (end == NULL) {
+        return false;
+    }
+
+    uint32_t value;
+    if (findUnsignedMember(begin, end, "\"sample_ms\"", value)) config.samplePeriodMs = value;
+    if (findUnsignedMember(begin, end, "\"report_ms\"", value)) config.reportPeriodMs = value;
+    if (findUnsignedMember(begin, end, "\"wind_ms\"", value)) config.windPeriodMs = value > 0xFFFF ? 0xFFFF : (uint16_t)value;
+    if (findUnsignedMember(begin, end, "\"batch\"", value)) config.batchSize = value > 0xFF ? 0xFF : (uint8_t)value;
+    if (findUnsignedMember(begin, end, "\"fields\"", value)) config.fieldMask = value > 0xFF ? 0xFF : (uint8_t)value;
+    parseDownsampleMember(begin, end, config);
+    return true;
+}
+
+/**
+ * @brief Loads the configuration stored in NVS, or the defaults if none is stored or it is invalid.
+ */
+void initRuntimeConfig() {
+    RuntimeConfig stored;
+    const char* reason = NULL;
+    if (loadRuntimeConfigFromNVS(stored) && validateRuntimeConfig(stored, &reason)) {
+        portENTER_CRITICAL(&configLock);
+        activeConfig = stored;
+        portEXIT_CRITICAL(&configLock);
+        Serial.printf("Runtime config restored: sample=%lu ms, report=%lu ms, wind=%u ms, batch=%u, fields=0x%02X\n",
+                      (unsigned long)stored.samplePeriodMs, (unsigned long)stored.reportPeriodMs,
+                      (unsigned)stored.windPeriodMs, (unsigned)stored.batchSize, (unsigned)stored.fieldMask);
+    } else if (reason != NULL) {
+        Serial.printf("Stored runtime config rejected (%s), using defaults.\n", reason);
+    }
+}
+
+/**
+ * @brief Returns a consistent copy of the active configuration.
+ * @return The active configuration.
+ */
+RuntimeConfig getRuntimeConfig() {
+    portENTER_CRITICAL(&configLock);
+    RuntimeConfig config = activeConfig;
+    portEXIT_CRITICAL(&configLock);
+    return config;
+}
+
+/**
+ * @brief Validates and activates a configuration, then reschedules the sensor task.
+ * @param config The new configuration.
+ * @param persist true to store the configuration in NVS.
+ * @return true if the configuration was valid and applied.
+ */
+bool applyRuntimeConfig(const RuntimeConfig& config, bool persist) {
+    const char* reason;
+    if (!validateRuntimeConfig(config, &reason)) {
+        Serial.printf("Runtime config rejected: %s\n", reason);
+        return false;
+    }
+
+    portENTER_CRITICAL(&configLock);
+    bool changed = activeConfig != config;
+    activeConfig = config;
+    portEXIT_CRITICAL(&configLock);
+    if (!changed) {
+        return true;
+    }
+
+    Serial.printf("Runtime config applied: sample=%lu ms, report=%lu ms, wind=%u ms, batch=%u, fields=0x%02X\n",
+                  (unsigned long)config.samplePeriodMs, (unsigned long)config.reportPeriodMs,
+                  (unsigned)config.windPeriodMs, (unsigned)config.batchSize, (unsigned)config.fieldMask);
+    if (persist) {
+        saveRuntimeConfigToNVS(config);
+    }
+    rescheduleSampling();
+    return true;
+}
+
+/**
+ * @brief Marks the fields excluded by a field mask as unavailable.
+ * @param sample The sample to modify.
+ * @param fieldMask SampleFieldBit values of the fields to keep.
+ */
+void maskSampleFields(WeatherSample& sample, uint8_t fieldMask) {
+    if (!(fieldMask & FIELD_TEMPERATURE)) sample.temperature = SAMPLE_MISSING;
+    if (!(fieldMask & FIELD_PRESSURE)) sample.pressure = SAMPLE_MISSING;
+    if (!(fieldMask & FIELD_HUMIDITY)) sample.humidity = SAMPLE_MISSING;
+    if (!(fieldMask & FIELD_SUNSHINE)) sample.sunshine = SAMPLE_MISSING;
+    if (!(fieldMask & FIELD_WIND_SPEED)) { sample.windSpeed = SAMPLE_MISSING; sample.windGust = SAMPLE_MISSING; }
+    if (!(fieldMask & FIELD_PRECIPITATION)) sample.precipitation = SAMPLE_MISSING;
+}
+
+/**
+ * @brief Returns the name of a sample field as used in payloads and the control block.
+ * @param field Field index (0 .. SAMPLE_FIELD_COUNT - 1).
+ * @return The name.
+ */
+const char* sampleFieldName(uint8_t field) {
+    return field < SAMPLE_FIELD_COUNT ? SAMPLE_FIELD_NAMES[field] : "unknown";
+}
+
+/**
+ * @brief Returns the name of an aggregation as used in the control block.
+ * @param type The aggregation.
+ * @return The name.
+ */
+const char* aggregationTypeName(AggregationType type) {
+    return type < AGGREGATE_TYPE_COUNT ? AGGREGATION_NAMES[type] : "unknown";
+}
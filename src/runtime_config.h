@@ -0,0 +1,165 @@
+/**
+ * @file runtime_config.h
+ * @brief Declarations for the server-controlled runtime configuration (sampling and reporting cadence).
+ *
+ * The server can change the cadence by adding a control block to the response
+ * of any upload:
+ *
+ *     {"control": {"sample_ms": 2000, "report_ms": 10000, "batch": 5, "fields": 63, "wind_ms": 100,
+ *                  "downsample": "temperature:mean:60,wind_speed:max:10,precipitation:sum:300"}}
+ *
+ * "downsample" lists field:aggregation:window_s entries (see downsampler.h);
+ * fields that are not listed keep their aggregation.
+ *
+ * Members that are omitted keep their current value. The resulting
+ * configuration is range-checked as a whole. It is either applied completely
+ * or rejected, and readers always see one consistent version. Accepted
+ * configurations are persisted in NVS and restored at boot.
+ */
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include "config.h"
+#include "sample.h"
+
+/** @brief Bits of the field mask selecting which sample fields are reported. */
+enum SampleFieldBit {
+  FIELD_TEMPERATURE   = 0x01,
+  FIELD_PRESSURE      = 0x02,
+  FIELD_HUMIDITY      = 0x04,
+  FIELD_SUNSHINE      = 0x08,
+  FIELD_WIND_SPEED    = 0x10,
+  FIELD_PRECIPITATION = 0x20,
+  FIELD_ALL           = 0x3F
+};
+
+/** @brief Number of reported sample fields; field i corresponds to SampleFieldBit (1 << i). */
+constexpr uint8_t SAMPLE_FIELD_COUNT = 6;
+
+/** @brief Aggregations a field can be downsampled with. */
+enum AggregationType {
+  AGGREGATE_LAST = 0,  ///< Last available value of the window.
+  AGGREGATE_MEAN,      ///< Mean of the available values.
+  AGGREGATE_MIN,       ///< Smallest available value.
+  AGGREGATE_MAX,       ///< Largest available value.
+  AGGREGATE_SUM,       ///< Sum of the available values.
+  AGGREGATE_COUNT,     ///< Number of available values.
+  AGGREGATE_TYPE_COUNT
+};
+
+/** @brief Downsampling of one field. */
+struct FieldDownsampling {
+  uint8_t aggregation;   ///< AggregationType.
+  uint32_t windowMs;     ///< Output window; 0 passes every sample through.
+};
+
+/** @brief Compares two field downsamplings member by member. */
+inline bool operator==(const FieldDownsampling& a, const FieldDownsampling& b) {
+  return a.aggregation == b.aggregation && a.windowMs == b.windowMs;
+}
+
+inline bool operator!=(const FieldDownsampling& a, const FieldDownsampling& b) { return !(a == b); }
+
+// --- Limits ---
+constexpr uint32_t RUNTIME_SAMPLE_MS_MIN = 1000;
+constexpr uint32_t RUNTIME_SAMPLE_MS_MAX = 3600000;   // 1 h
+constexpr uint32_t RUNTIME_REPORT_MS_MIN = 1000;
+constexpr uint32_t RUNTIME_REPORT_MS_MAX = 86400000;  // 24 h
+constexpr uint16_t RUNTIME_WIND_MS_MIN = 20;
+constexpr uint16_t RUNTIME_WIND_MS_MAX = 5000;
+constexpr uint8_t RUNTIME_MAX_BATCH = 12;             // Samples per report
+constexpr uint32_t RUNTIME_WINDOW_MS_MAX = 86400000;  // 24 h downsampling window
+
+/** @brief Cadence and content of acquisition and reporting. */
+struct RuntimeConfig {
+  uint32_t samplePeriodMs; ///< Period of the sensor acquisition cycle.
+  uint32_t reportPeriodMs; ///< Maximum time a sample waits in the uplink batch.
+  uint16_t windPeriodMs;   ///< Period of wind sensor readings.
+  uint8_t batchSize;       ///< Samples per report; 1 keeps the single-object payload.
+  uint8_t fieldMask;       ///< SampleFieldBit values of the fields to report.
+  FieldDownsampling downsampling[SAMPLE_FIELD_COUNT]; ///< Per-field aggregation, indexed like SampleFieldBit.
+};
+
+/**
+ * @brief Compares two configurations member by member.
+ * The structs contain padding, whose content is unspecified, so they are not compared with memcmp().
+ */
+inline bool operator==(const RuntimeConfig& a, const RuntimeConfig& b) {
+  if (a.samplePeriodMs != b.samplePeriodMs || a.reportPeriodMs != b.reportPeriodMs ||
+      a.windPeriodMs != b.windPeriodMs || a.batchSize != b.batchSize || a.fieldMask != b.fieldMask) {
+    return false;
+  }
+  for (uint8_t i = 0; i < SAMPLE_FIELD_COUNT; i++) {
+    if (a.downsampling[i] != b.downsampling[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool operator!=(const RuntimeConfig& a, const RuntimeConfig& b) { return !(a == b); }
+
+/**
+ * @brief Returns the built-in configuration (DATA_SEND_INTERVAL, one sample per report, all fields, no downsampling).
+ * @return The default configuration.
+ */
+RuntimeConfig defaultRuntimeConfig();
+
+/**
+ * @brief Checks every member of a configuration against its limits.
+ * @param config The configuration to check.
+ * @param reason Receives a description of the first violated limit (may be NULL).
+ * @return true if the configuration is valid.
+ */
+bool validateRuntimeConfig(const RuntimeConfig& config, const char** reason);
+
+/**
+ * @brief Applies the control block of a server response on top of a configuration.
+ * @param response Body of the server response.
+ * @param config Configuration to update; members absent from the block are left unchanged.
+ * @return true if the response contains a control block, false otherwise.
+ */
+bool parseControlBlock(const String& response, RuntimeConfig& config);
+
+/**
+ * @brief Loads the configuration stored in NVS, or the defaults if none is stored or it is invalid.
+ * @note Must be called in setup() before the sensor tasks start.
+ */
+void initRuntimeConfig();
+
+/**
+ * @brief Returns a consistent copy of the active configuration.
+ * @return The active configuration.
+ */
+RuntimeConfig getRuntimeConfig();
+
+/**
+ * @brief Validates and activates a configuration, then reschedules the sensor task.
+ * @param config The new configuration.
+ * @param persist true to store the configuration in NVS.
+ * @return true if the configuration was valid and applied.
+ */
+bool applyRuntimeConfig(const RuntimeConfig& config, bool persist);
+
+/**
+ * @brief Marks the fields excluded by a field mask as unavailable (SAMPLE_MISSING).
+ * @param sample The sample to modify.
+ * @param fieldMask SampleFieldBit values of the fields to keep.
+ */
+void maskSampleFields(WeatherSample& sample, uint8_t fieldMask);
+
+/**
+ * @brief Returns the name of a sample field as used in payloads and the control block.
+ * @param field Field index (0 .. SAMPLE_FIELD_COUNT - 1).
+ * @return The name, e.g. "wind_speed".
+ */
+const char* sampleFieldName(uint8_t field);
+
+/**
+ * @brief Returns the name of an aggregation as used in the control block.
+ * @param type The aggregation.
+ * @return The name, e.g. "mean".
+ */
+const char* aggregationTypeName(AggregationType type);
+
+#endif // RUNTIME_CONFIG_H
@@ -0,0 +1,75 @@
+/**
+ * @file sample.h
+ * @brief Definition of a single weather sample shared between acquisition and its consumers.
+ *
+ * A sample is produced once per acquisition cycle by the sensor task and is
+ * passed by reference (never copied per consumer) to uplink, storage and any
+ * other subscriber of the event bus.
+ *
+ * Readings are quantized once, at acquisition, to the resolution the sensor
+ * can actually deliver and kept as scaled integers. Consumers format or
+ * compress the integers without floating-point math; code that needs
+ * physical units converts with fieldValue().
+ */
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+#include <math.h>
+
+// --- Field Resolution ---
+// Units per physical unit of each scaled field; sunshine and precipitation are whole percent.
+constexpr int16_t SAMPLE_MISSING = INT16_MIN;   // Marks an unavailable reading
+constexpr int16_t TEMPERATURE_SCALE = 10;       // 0.1 °C (BME280: ±1 °C absolute)
+constexpr int16_t PRESSURE_SCALE = 10;          // 0.1 hPa (BME280: ±0.12 hPa relative)
+constexpr int16_t HUMIDITY_SCALE = 100;         // 0.01 of the 0-1 scale, i.e. 1 % (BME280: ±3 %)
+constexpr int16_t WIND_SCALE = 10;              // 0.1 m/s
+
+// Largest magnitude of each scaled field over the sensor ranges; bounds the sums of downsampling windows
+constexpr int16_t TEMPERATURE_MAX_SCALED = 85 * TEMPERATURE_SCALE; // BME280: -40 to 85 °C
+constexpr int16_t PRESSURE_MAX_SCALED = 1100 * PRESSURE_SCALE;     // BME280: 300 to 1100 hPa
+constexpr int16_t HUMIDITY_MAX_SCALED = HUMIDITY_SCALE;            // 0-1 scale
+constexpr int16_t WIND_MAX_SCALED = 324;                           // 32.4 m/s at full ADC scale
+constexpr int16_t PERCENT_MAX_SCALED = 100;                        // Sunshine and precipitation
+
+/**
+ * @brief Quantizes a reading to a scaled integer, saturating at the int16_t range.
+ * @param value Reading in physical units, NAN if unavailable.
+ * @param scale Units per physical unit.
+ * @return The scaled value, SAMPLE_MISSING for NAN.
+ */
+inline int16_t quantizeField(float value, int16_t scale) {
+  if (isnan(value)) {
+    return SAMPLE_MISSING;
+  }
+  long scaled = lroundf(value * scale);
+  if (scaled > INT16_MAX) return INT16_MAX;
+  if (scaled < -INT16_MAX) return -INT16_MAX;
+  return (int16_t)scaled;
+}
+
+/**
+ * @brief Converts a scaled field back to physical units.
+ * @param scaled The scaled value.
+ * @param scale Units per physical unit.
+ * @return The value, NAN for SAMPLE_MISSING.
+ */
+inline float fieldValue(int16_t scaled, int16_t scale) {
+  return scaled == SAMPLE_MISSING ? NAN : (float)scaled / scale;
+}
+
+/** @brief One acquisition cycle worth of sensor readings. */
+struct WeatherSample {
+  uint32_t timestampMs;  ///< millis() at acquisition.
+  uint32_t epochS;       ///< Unix time at acquisition [s], 0 if the clock has not been synchronized yet.
+  int16_t temperature;   ///< Air temperature [1/TEMPERATURE_SCALE °C], SAMPLE_MISSING if the BME280 is unavailable.
+  int16_t pressure;      ///< Pressure reduced to MSL [1/PRESSURE_SCALE hPa] (station pressure if reduction failed), SAMPLE_MISSING if unavailable.
+  int16_t humidity;      ///< Relative humidity [1/HUMIDITY_SCALE of the 0-1 scale], SAMPLE_MISSING if unavailable.
+  int16_t sunshine;      ///< Brightness [%], SAMPLE_MISSING if unavailable.
+  int16_t windSpeed;     ///< Average wind speed since the previous sample [1/WIND_SCALE m/s], SAMPLE_MISSING if not reported.
+  int16_t precipitation; ///< Rain sensor wetness [%], SAMPLE_MISSING if not reported.
+  int16_t windGust;      ///< Strongest wind reading since the previous sample [1/WIND_SCALE m/s], SAMPLE_MISSING if none. Used on the device only; not uploaded or stored.
+  uint32_t seq;          ///< Upload sequence number assigned by the uplink to each record, 0 if none (acquired or stored samples).
+};
+
+#endif // SAMPLE_H
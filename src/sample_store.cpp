@@ -0,0 +1,407 @@
+/**
+ * @file sample_store.cpp
+ * @brief On-flash history of weather samples in compressed chunk files.
+ *
+ * Chunks are files named /samples/<sequence>.bin. Each file starts with a
+ * ChunkHeader followed by the compressed samples. The store keeps at most
+ * STORE_MAX_CHUNKS files and removes the oldest one when the limit is reached
+ * or the file system is full. A mutex serializes flash access between the
+ * store task (writer) and readers such as the backfill task.
+ */
+#include "sample_store.h"
+#include "config.h"
+#include "event_bus.h"
+#include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// --- Store Configuration ---
+const char* const STORE_DIR = "/samples";
+const uint32_t STORE_MAX_CHUNKS = 256;       // 256 chunks of 60 samples at 5 s = ~21 h of history
+const uint8_t STORE_QUEUE_DEPTH = 4;
+const uint32_t CHUNK_MAGIC = 0x32435357;     // "WSC2": fields at the sample resolution (see sample.h)
+const uint8_t RECORD_FIELDS = 7;             // epoch, temperature, pressure, humidity, sunshine, wind, precipitation
+const size_t RECORD_MAX_BYTES = 1 + RECORD_FIELDS * 5; // Presence byte + worst-case varints
+const size_t CHUNK_MAX_BYTES = STORE_CHUNK_SAMPLES * RECORD_MAX_BYTES;
+
+// Presence bits of optional fields
+const uint8_t HAS_TEMPERATURE = 0x01;
+const uint8_t HAS_PRESSURE = 0x02;
+const uint8_t HAS_HUMIDITY = 0x04;
+const uint8_t HAS_SUNSHINE = 0x08;
+
+/** @brief Header at the start of every chunk file. */
+struct ChunkHeader {
+  uint32_t magic;
+  uint16_t count;
+  uint16_t bytes;
+  uint32_t firstEpochS;
+  uint32_t lastEpochS;
+};
+
+// --- Store State ---
+static SemaphoreHandle_t storeMutex = NULL; // Guards flash access, chunk range and stats
+static uint32_t firstChunk = 0;
+static uint32_t nextChunk = 0;
+static SampleStoreStats stats = {};
+
+// Current chunk being filled (store task only)
+static uint8_t chunkBuffer[CHUNK_MAX_BYTES];
+static size_t chunkBytes = 0;
+static uint16_t chunkCount = 0;
+static uint32_t chunkFirstEpochS = 0;
+static uint32_t chunkLastEpochS = 0;
+static int32_t encodePrevious[RECORD_FIELDS];
+
+// --- Compression ---
+
+static inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static size_t writeVarint(uint8_t* out, uint32_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+static bool readVarint(const uint8_t* in, size_t size, size_t& position, uint32_t& value) {
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (position >= size) {
+            return false;
+        }
+        uint8_t byte = in[position++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Converts a sample to the integer fields stored on flash.
+ * The scaled fields of the sample are stored as they are, so the deltas
+ * between samples only carry changes the sensors can resolve.
+ * @param sample The sample to convert.
+ * @param fields Output array of RECORD_FIELDS values.
+ * @return Presence bits of the optional fields.
+ */
+static uint8_t sampleToFields(const WeatherSample& sample, int32_t* fields) {
+    uint8_t presence = 0;
+    fields[0] = (int32_t)sample.epochS;
+    if (sample.temperature != SAMPLE_MISSING) { presence |= HAS_TEMPERATURE; fields[1] = sample.temperature; }
+    if (sample.pressure != SAMPLE_MISSING) { presence |= HAS_PRESSURE; fields[2] = sample.pressure; }
+    if (sample.humidity != SAMPLE_MISSING) { presence |= HAS_HUMIDITY; fields[3] = sample.humidity; }
+    if (sample.sunshine != SAMPLE_MISSING) { presence |= HAS_SUNSHINE; fields[4] = sample.sunshine; }
+    fields[5] = sample.windSpeed;
+    fields[6] = sample.precipitation;
+    return presence;
+}
+
+/**
+ * @brief Tells whether a field is present in a record with the given presence bits.
+ */
+static bool fieldPresent(uint8_t presence, uint8_t field) {
+    return field == 0 || field >= 5 || (presence & (1 << (field - 1))) != 0;
+}
+
+/**
+ * @brief Appends one sample to the current chunk (delta + zigzag varint per field).
+ * @param sample The sample to append.
+ */
+static void appendToChunk(const WeatherSample& sample) {
+    if (chunkCount == 0) {
+        memset(encodePrevious, 0, sizeof(encodePrevious));
+        chunkFirstEpochS = sample.epochS;
+    }
+    int32_t fields[RECORD_FIELDS];
+    uint8_t presence = sampleToFields(sample, fields);
+    chunkBuffer[chunkBytes++] = presence;
+    for (uint8_t i = 0; i < RECORD_FIELDS; i++) {
+        if (!fieldPresent(presence, i)) {
+            continue;
+        }
+        chunkBytes += writeVarint(chunkBuffer + chunkBytes, zigzag(fields[i] - encodePrevious[i]));
+        encodePrevious[i] = fields[i];
+    }
+    chunkLastEpochS = sample.epochS;
+    chunkCount++;
+}
+
+/**
+ * @brief Decompresses the samples of a chunk.
+ * @param in Compressed bytes.
+ * @param size Number of compressed bytes.
+ * @param count Number of samples in the chunk.
+ * @param samples Output array of at least count entries.
+ * @return true if the data was consistent, false otherwise.
+ */
+static bool decodeChunk(const uint8_t* in, size_t size, uint16_t count, WeatherSample* samples) {
+    int32_t previous[RECORD_FIELDS] = {};
+    size_t position = 0;
+    for (uint16_t n = 0; n < count; n++) {
+        if (position >= size) {
+            return false;
+        }
+        uint8_t presence = in[position++];
+        for (uint8_t i = 0; i < RECORD_FIELDS; i++) {
+            if (!fieldPresent(presence, i)) {
+                continue;
+            }
+            uint32_t raw;
+            if (!readVarint(in, size, position, raw)) {
+                return false;
+            }
+            previous[i] += unzigzag(raw);
+        }
+        WeatherSample& sample = samples[n];
+        sample.timestampMs = 0;
+        sample.epochS = (uint32_t)previous[0];
+        sample.temperature = (presence & HAS_TEMPERATURE) ? (int16_t)previous[1] : SAMPLE_MISSING;
+        sample.pressure = (presence & HAS_PRESSURE) ? (int16_t)previous[2] : SAMPLE_MISSING;
+        sample.humidity = (presence & HAS_HUMIDITY) ? (int16_t)previous[3] : SAMPLE_MISSING;
+        sample.sunshine = (presence & HAS_SUNSHINE) ? (int16_t)previous[4] : SAMPLE_MISSING;
+        sample.windSpeed = (int16_t)previous[5];
+        sample.precipitation = (int16_t)previous[6];
+        sample.windGust = SAMPLE_MISSING; // Not stored
+        sample.seq = 0;
+    }
+    return true;
+}
+
+// --- Flash Access ---
+
+static String chunkPath(uint32_t chunk) {
+    char path[32];
+    snprintf(path, sizeof(path), "%s/%08lu.bin", STORE_DIR, (unsigned long)chunk);
+    return String(path);
+}
+
+/**
+ * @brief Removes the oldest chunk. Caller holds storeMutex.
+ */
+static void dropOldestChunk() {
+    LittleFS.remove(chunkPath(firstChunk));
+    firstChunk++;
+    stats.chunksDropped++;
+}
+
+/**
+ * @brief Writes a chunk file. Caller holds storeMutex.
+ * @return true if the whole chunk was written.
+ */
+static bool writeChunkFile(uint32_t chunk, const ChunkHeader& header) {
+    File file = LittleFS.open(chunkPath(chunk), "w");
+    if (!file) {
+        return false;
+    }
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              file.write(chunkBuffer, header.bytes) == header.bytes;
+    file.close();
+    if (!ok) {
+        LittleFS.remove(chunkPath(chunk));
+    }
+    return ok;
+}
+
+/**
+ * @brief Writes the current chunk to flash and starts a new one.
+ */
+static void flushChunk() {
+    if (chunkCount == 0) {
+        return;
+    }
+    ChunkHeader header = { CHUNK_MAGIC, chunkCount, (uint16_t)chunkBytes, chunkFirstEpochS, chunkLastEpochS };
+
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    if (nextChunk - firstChunk >= STORE_MAX_CHUNKS) {
+        dropOldestChunk();
+    }
+    bool ok = writeChunkFile(nextChunk, header);
+    if (!ok && firstChunk < nextChunk) {
+        dropOldestChunk(); // File system full: make room and retry once
+        ok = writeChunkFile(nextChunk, header);
+    }
+    if (ok) {
+        nextChunk++;
+        stats.samplesStored += chunkCount;
+        stats.bytesWritten += sizeof(header) + chunkBytes;
+    } else {
+        stats.writeErrors++;
+    }
+    stats.pendingSamples = 0;
+    xSemaphoreGive(storeMutex);
+
+    if (ok) {
+        Serial.printf("Sample Store: Chunk %lu written (%u samples, %u bytes).\n",
+                      (unsigned long)(nextChunk - 1), (unsigned)chunkCount, (unsigned)chunkBytes);
+    } else {
+        Serial.println("Sample Store: Failed to write chunk, samples lost.");
+    }
+    chunkCount = 0;
+    chunkBytes = 0;
+}
+
+/**
+ * @brief Finds the oldest and newest chunk files left from previous runs.
+ */
+static void scanChunks() {
+    if (!LittleFS.exists(STORE_DIR)) {
+        LittleFS.mkdir(STORE_DIR);
+    }
+    File dir = LittleFS.open(STORE_DIR);
+    bool found = false;
+    uint32_t lowest = 0, highest = 0;
+    for (File entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+        const char* name = entry.name();
+        const char* slash = strrchr(name, '/');
+        uint32_t chunk = strtoul(slash != NULL ? slash + 1 : name, NULL, 10);
+        if (!found || chunk < lowest) lowest = chunk;
+        if (!found || chunk > highest) highest = chunk;
+        found = true;
+        entry.close();
+    }
+    dir.close();
+    firstChunk = found ? lowest : 0;
+    nextChunk = found ? highest + 1 : 0;
+}
+
+// --- Public API ---
+
+/**
+ * @brief Scans the chunk directory, subscribes to TOPIC_SAMPLE and starts the store task.
+ * @return true if the store is running, false otherwise.
+ */
+bool startSampleStore() {
+    storeMutex = xSemaphoreCreateMutex();
+    if (storeMutex == NULL) {
+        return false;
+    }
+    scanChunks();
+    Serial.printf("Sample Store: %lu chunks on flash (%lu..%lu).\n",
+                  (unsigned long)(nextChunk - firstChunk), (unsigned long)firstChunk, (unsigned long)nextChunk);
+
+    EventSubscriber* subscriber = eventBusSubscribe(TOPIC_BIT(TOPIC_SAMPLE), STORE_QUEUE_DEPTH);
+    if (subscriber == NULL) {
+        return false;
+    }
+    return xTaskCreatePinnedToCore(
+        sampleStoreTask, "StoreTask", 4096, subscriber, 1, NULL, APP_CPU_NUM) == pdPASS;
+}
+
+/**
+ * @brief Returns the range of chunk sequence numbers currently on flash.
+ * @param first Receives the oldest sequence number.
+ * @param next Receives one past the newest sequence number.
+ */
+void sampleStoreChunkRange(uint32_t& first, uint32_t& next) {
+    if (storeMutex == NULL) {
+        first = next = 0;
+        return;
+    }
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    first = firstChunk;
+    next = nextChunk;
+    xSemaphoreGive(storeMutex);
+}
+
+/**
+ * @brief Reads and decompresses one chunk.
+ * @param chunk Sequence number of the chunk.
+ * @param samples Output array of at least STORE_CHUNK_SAMPLES entries.
+ * @param info Receives the chunk summary.
+ * @return true if the chunk exists and was decoded, false otherwise.
+ */
+bool sampleStoreReadChunk(uint32_t chunk, WeatherSample* samples, StoredChunkInfo& info) {
+    static uint8_t readBuffer[CHUNK_MAX_BYTES]; // Only used under storeMutex
+    if (storeMutex == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    bool ok = false;
+    ChunkHeader header;
+    if (chunk >= firstChunk && chunk < nextChunk) {
+        File file = LittleFS.open(chunkPath(chunk), "r");
+        if (file) {
+            ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 header.magic == CHUNK_MAGIC && header.count <= STORE_CHUNK_SAMPLES &&
+                 header.bytes <= CHUNK_MAX_BYTES &&
+                 file.read(readBuffer, header.bytes) == header.bytes;
+            file.close();
+        }
+        ok = ok && decodeChunk(readBuffer, header.bytes, header.count, samples);
+    }
+    xSemaphoreGive(storeMutex);
+
+    if (ok) {
+        info.count = header.count;
+        info.bytes = header.bytes;
+        info.firstEpochS = header.firstEpochS;
+        info.lastEpochS = header.lastEpochS;
+    }
+    return ok;
+}
+
+/**
+ * @brief Returns a snapshot of the store counters.
+ * @return Copy of the current statistics.
+ */
+SampleStoreStats sampleStoreGetStats() {
+    SampleStoreStats snapshot = {};
+    if (storeMutex == NULL) {
+        return snapshot;
+    }
+    xSemaphoreTake(storeMutex, portMAX_DELAY);
+    snapshot = stats;
+    snapshot.firstChunk = firstChunk;
+    snapshot.nextChunk = nextChunk;
+    xSemaphoreGive(storeMutex);
+    return snapshot;
+}
+
+// --- FreeRTOS Task: Sample Store ---
+
+/**
+ * @brief FreeRTOS task appending received samples to the current chunk and
+ * flushing it to flash when full. A clock jump backwards also flushes the
+ * chunk, so the time range in every chunk header stays ordered.
+ * @param pvParameters Event bus subscriber handle (EventSubscriber*).
+ */
+void sampleStoreTask(void *pvParameters) {
+    EventSubscriber* subscriber = static_cast<EventSubscriber*>(pvParameters);
+    Serial.println("Sample Store Task started.");
+
+    for (;;) {
+        const BusMessage* message = eventBusReceive(subscriber, portMAX_DELAY);
+        if (message == NULL) {
+            continue;
+        }
+        const WeatherSample& sample = message->data.sample;
+        if (sample.epochS != 0) { // Samples without wall-clock time cannot be looked up later
+            if (chunkCount > 0 && sample.epochS < chunkLastEpochS) {
+                flushChunk();
+            }
+            appendToChunk(sample);
+        }
+        eventBusRelease(message);
+
+        if (chunkCount >= STORE_CHUNK_SAMPLES) {
+            flushChunk();
+        }
+        xSemaphoreTake(storeMutex, portMAX_DELAY);
+        stats.pendingSamples = chunkCount;
+        xSemaphoreGive(storeMutex);
+    }
+}
@@ -0,0 +1,76 @@
+/**
+ * @file sample_store.h
+ * @brief Declarations for the on-flash history of weather samples.
+ *
+ * The store subscribes to TOPIC_SAMPLE and keeps a ring of compressed chunk
+ * files on LittleFS. Samples are collected in RAM until a chunk is full, then
+ * the chunk is written to flash in a single operation. Inside a chunk every
+ * field is delta-encoded against the previous sample and written as a zigzag
+ * varint, which typically takes 8-12 bytes per sample instead of 32.
+ * Only samples with a synchronized clock (epochS != 0) are stored, because
+ * stored samples are looked up by Unix time.
+ */
+#ifndef SAMPLE_STORE_H
+#define SAMPLE_STORE_H
+
+#include "config.h"
+#include "sample.h"
+
+/** @brief Maximum number of samples in one chunk. */
+constexpr uint16_t STORE_CHUNK_SAMPLES = 60;
+
+/** @brief Summary of a stored chunk. */
+struct StoredChunkInfo {
+  uint16_t count;       ///< Number of samples in the chunk.
+  uint16_t bytes;       ///< Compressed size of the samples [B].
+  uint32_t firstEpochS; ///< Unix time of the first sample.
+  uint32_t lastEpochS;  ///< Unix time of the last sample.
+};
+
+/** @brief Counters describing the store. */
+struct SampleStoreStats {
+  uint32_t firstChunk;      ///< Sequence number of the oldest chunk on flash.
+  uint32_t nextChunk;       ///< Sequence number the next flushed chunk will get.
+  uint32_t samplesStored;   ///< Samples written to flash since boot.
+  uint32_t bytesWritten;    ///< Compressed bytes written to flash since boot.
+  uint32_t chunksDropped;   ///< Oldest chunks removed to make room.
+  uint32_t writeErrors;     ///< Failed chunk writes.
+  uint16_t pendingSamples;  ///< Samples waiting in RAM for the current chunk to fill.
+};
+
+/**
+ * @brief Scans the chunk directory, subscribes to TOPIC_SAMPLE and starts the store task.
+ * @note Must be called after initLittleFS() and initEventBus().
+ * @return true if the store is running, false otherwise.
+ */
+bool startSampleStore();
+
+/**
+ * @brief Returns the range of chunk sequence numbers currently on flash.
+ * @param firstChunk Receives the oldest sequence number.
+ * @param nextChunk Receives one past the newest sequence number.
+ */
+void sampleStoreChunkRange(uint32_t& firstChunk, uint32_t& nextChunk);
+
+/**
+ * @brief Reads and decompresses one chunk.
+ * @param chunk Sequence number of the chunk.
+ * @param samples Output array of at least STORE_CHUNK_SAMPLES entries. timestampMs is 0 for stored samples.
+ * @param info Receives the chunk summary.
+ * @return true if the chunk exists and was decoded, false otherwise.
+ */
+bool sampleStoreReadChunk(uint32_t chunk, WeatherSample* samples, StoredChunkInfo& info);
+
+/**
+ * @brief Returns a snapshot of the store counters.
+ * @return Copy of the current statistics.
+ */
+SampleStoreStats sampleStoreGetStats();
+
+/**
+ * @brief FreeRTOS task function appending received samples to the current chunk.
+ * @param pvParameters Event bus subscriber handle (EventSubscriber*).
+ */
+void sampleStoreTask(void *pvParameters);
+
+#endif // SAMPLE_STORE_H
@@ -0,0 +1,418 @@
+/**
+ * @file station_policies.h
+ * @brief Compile-time policies selecting the sensor set, payload encoder and uplink transport.
+ *
+ * Each policy is a small class with static member functions. The station is
+ * assembled from one policy of each kind by StationPolicy, and ActiveStation is
+ * selected from the feature macros in config.h. Only the selected policies are
+ * instantiated, so the code and libraries of the others are not linked in.
+ * The policies are header-only for that reason.
+ */
+#ifndef STATION_POLICIES_H
+#define STATION_POLICIES_H
+
+#include "config.h"
+#include "sample.h"
+#include <math.h>
+
+#if WS_FEATURE_ARDUINOJSON
+#include <ArduinoJson.h>
+#endif
+#if WS_TRANSPORT_HTTP
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include "dns_cache.h"
+#endif
+#if WS_TRANSPORT_MQTT
+#include "mqtt_transport.h"
+#endif
+#if WS_TRANSPORT_COAP
+#include "coap_transport.h"
+#endif
+#if WS_TRANSPORT_WEBSOCKET
+#include "websocket_transport.h"
+#endif
+#if WS_TRANSPORT_HTTPS
+#include "https_transport.h"
+#endif
+
+// --- Sensor Set Policies ---
+// Interface: static bool begin(); static bool read(float& temperature, float& pressureHpa, float& humidity);
+// read() returns false and leaves the outputs untouched when no reading is available.
+
+#if WS_FEATURE_BME280
+/** @brief BME280 on I2C providing temperature, station pressure and humidity. */
+struct Bme280SensorSet {
+  static bool begin() {
+    if (!bme.begin(I2C_ADDRESS)) {
+      Serial.println("!!! BME280 init failed!");
+      return false;
+    }
+    Serial.println("BME280 init successful.");
+    return true;
+  }
+
+  static bool read(float& temperature, float& pressureHpa, float& humidity) {
+    temperature = bme.readTemperature();
+    pressureHpa = bme.readPressure() / 100.0F;
+    humidity = bme.readHumidity() / 100.0F;
+    return true;
+  }
+};
+#endif
+
+/** @brief Analog sensors only (light, rain, wind); no temperature, pressure or humidity. */
+struct AnalogSensorSet {
+  static bool begin() { return false; }
+  static bool read(float&, float&, float&) { return false; }
+};
+
+// --- Encoder Policies ---
+// Interface: static const char* contentType(); static void encode(const WeatherSample& sample, String& out);
+// Fields are encoded from the scaled integers of the sample; the JSON units are
+// °C, hPa, 0-1 humidity, % and km/h, with the decimals of the sample resolution.
+
+/**
+ * @brief Converts a scaled wind speed to 0.01 km/h with integer math (0.1 m/s = 36 * 0.01 km/h).
+ * @param windSpeed Wind speed [1/WIND_SCALE m/s].
+ * @return Wind speed [0.01 km/h].
+ */
+inline long windSpeedKmh100(int16_t windSpeed) {
+  static_assert(WIND_SCALE == 10, "Conversion assumes 0.1 m/s units");
+  return (long)windSpeed * 36;
+}
+
+#if WS_FEATURE_ARDUINOJSON
+/** @brief JSON payload built with ArduinoJson. */
+struct ArduinoJsonEncoder {
+  static const char* contentType() { return "application/json"; }
+
+  static void encode(const WeatherSample& sample, String& out) {
+    StaticJsonDocument<512> jsonDocument;
+    // One exact division per field; ArduinoJson prints the quotient with the field's decimals
+    if (sample.temperature != SAMPLE_MISSING) jsonDocument["temperature"] = sample.temperature / (double)TEMPERATURE_SCALE;
+    if (sample.pressure != SAMPLE_MISSING) jsonDocument["pressure"] = sample.pressure / (double)PRESSURE_SCALE;
+    if (sample.humidity != SAMPLE_MISSING) jsonDocument["humidity"] = sample.humidity / (double)HUMIDITY_SCALE;
+    if (sample.sunshine != SAMPLE_MISSING) jsonDocument["sunshine"] = sample.sunshine; else jsonDocument["sunshine"] = nullptr;
+
+    if (sample.windSpeed != SAMPLE_MISSING) jsonDocument["wind_speed"] = windSpeedKmh100(sample.windSpeed) / 100.0;
+    if (sample.precipitation != SAMPLE_MISSING) jsonDocument["precipitation"] = sample.precipitation;
+
+    serializeJson(jsonDocument, out);
+  }
+};
+#endif
+
+/** @brief The same JSON fields as ArduinoJsonEncoder, written with snprintf into a stack buffer using integer math only. */
+struct PrintfJsonEncoder {
+  static const char* contentType() { return "application/json"; }
+
+  static void encode(const WeatherSample& sample, String& out) {
+    char buffer[192];
+    size_t length = 0;
+    append(buffer, sizeof(buffer), length, "{");
+    if (sample.temperature != SAMPLE_MISSING) appendScaled(buffer, sizeof(buffer), length, "temperature", sample.temperature, 1);
+    if (sample.pressure != SAMPLE_MISSING) appendScaled(buffer, sizeof(buffer), length, "pressure", sample.pressure, 1);
+    if (sample.humidity != SAMPLE_MISSING) appendScaled(buffer, sizeof(buffer), length, "humidity", sample.humidity, 2);
+    if (sample.sunshine != SAMPLE_MISSING) append(buffer, sizeof(buffer), length, "\"sunshine\":%d,", sample.sunshine);
+    else append(buffer, sizeof(buffer), length, "\"sunshine\":null,");
+    if (sample.windSpeed != SAMPLE_MISSING) appendScaled(buffer, sizeof(buffer), length, "wind_speed", windSpeedKmh100(sample.windSpeed), 2);
+    if (sample.precipitation != SAMPLE_MISSING) append(buffer, sizeof(buffer), length, "\"precipitation\":%d,", sample.precipitation);
+    if (length > 1 && length < sizeof(buffer)) {
+      buffer[length - 1] = '}'; // Replace the trailing comma
+    } else {
+      append(buffer, sizeof(buffer), length, "}");
+    }
+    out = buffer;
+  }
+
+ private:
+  template <typename... Args>
+  static void append(char* buffer, size_t size, size_t& length, const char* format, Args... args) {
+    if (length >= size) {
+      return;
+    }
+    int written = snprintf(buffer + length, size - length, format, args...);
+    if (written > 0) {
+      length += (size_t)written;
+    }
+  }
+
+  /** @brief Appends "name":value, for a value scaled by 10^decimals (decimals 1 or 2). */
+  static void appendScaled(char* buffer, size_t size, size_t& length, const char* name, long value, uint8_t decimals) {
+    long divisor = decimals == 1 ? 10 : 100;
+    unsigned long magnitude = value < 0 ? (unsigned long)-value : (unsigned long)value;
+    append(buffer, size, length, "\"%s\":%s%lu.%0*lu,", name, value < 0 ? "-" : "",
+           magnitude / divisor, (int)decimals, magnitude % divisor);
+  }
+};
+
+// --- Transport Policies ---
+// Interface: static int post(const String& url, const char* contentType, const String& body, String& response,
+//                            uint32_t timeoutMs = TRANSPORT_TIMEOUT_MS);
+//            static int get(const String& url, String& response);
+//            static String errorToString(int code);
+//            static constexpr bool kStatusConfirmsDelivery;
+// A positive return value is a server status code; zero or negative values are transport errors.
+// kStatusConfirmsDelivery is true if a 2xx status comes from the server that processed the body;
+// push transports return 2xx once a broker or the TCP stack took the message, and the server's
+// acknowledgement arrives later as a pushed control message.
+
+/** @brief Default connect and response timeout of a transport request [ms]. */
+constexpr uint32_t TRANSPORT_TIMEOUT_MS = 5000;
+
+#if WS_TRANSPORT_HTTP
+/**
+ * @brief Plain HTTP via HTTPClient; the timeout applies to connecting and to the response separately.
+ * The server host is resolved through the DNS cache; if that fails, HTTPClient resolves and connects itself.
+ */
+struct HttpTransport {
+  static constexpr bool kStatusConfirmsDelivery = true;
+
+  static int post(const String& url, const char* contentType, const String& body, String& response,
+                  uint32_t timeoutMs = TRANSPORT_TIMEOUT_MS) {
+    WiFiClient client;
+    dnsCacheConnect(client, url, 80, timeoutMs); // Connected through the DNS cache; HTTPClient reuses the connection
+    HTTPClient http;
+    http.begin(client, url);
+    http.addHeader("Content-Type", contentType);
+    http.setConnectTimeout((int32_t)timeoutMs);
+    http.setTimeout((uint16_t)timeoutMs);
+    int code = http.POST(body);
+    if (code > 0) {
+      response = http.getString();
+    }
+    http.end();
+    return code;
+  }
+
+  static int get(const String& url, String& response) {
+    WiFiClient client;
+    dnsCacheConnect(client, url, 80, TRANSPORT_TIMEOUT_MS);
+    HTTPClient http;
+    http.begin(client, url);
+    http.setConnectTimeout(TRANSPORT_TIMEOUT_MS);
+    http.setTimeout(TRANSPORT_TIMEOUT_MS);
+    int code = http.GET();
+    if (code > 0) {
+      response = http.getString();
+    }
+    http.end();
+    return code;
+  }
+
+  static String errorToString(int code) { return HTTPClient::errorToString(code); }
+};
+#endif
+
+#if WS_TRANSPORT_HTTPS
+/**
+ * @brief HTTP/1.1 over one kept-alive TLS connection with session resumption (see https_transport.h).
+ * The scheme of the URL is ignored; a URL without port uses HTTPS_DEFAULT_PORT.
+ */
+struct HttpsTransport {
+  static constexpr bool kStatusConfirmsDelivery = true;
+
+  static int post(const String& url, const char* contentType, const String& body, String& response,
+                  uint32_t timeoutMs = TRANSPORT_TIMEOUT_MS) {
+    return httpsRequest("POST", url, contentType, body, response, timeoutMs);
+  }
+
+  static int get(const String& url, String& response) {
+    return httpsRequest("GET", url, NULL, String(), response, TRANSPORT_TIMEOUT_MS);
+  }
+
+  static String errorToString(int code) { return httpsErrorToString(code); }
+};
+#endif
+
+#if WS_TRANSPORT_MQTT
+/**
+ * @brief QoS 1 publishes over one persistent MQTT connection (see mqtt_transport.h).
+ * The last path segment of the URL selects the topic (stations/<mac>/data, /alert, /backfill);
+ * get() is only used for registration and publishes the user name to stations/<mac>/register.
+ */
+struct MqttTransport {
+  static constexpr bool kStatusConfirmsDelivery = false; // PUBACK comes from the broker
+
+  static int post(const String& url, const char*, const String& body, String& response,
+                  uint32_t timeoutMs = TRANSPORT_TIMEOUT_MS) {
+    String channel = url.substring(url.lastIndexOf('/') + 1);
+    return mqttPublish(channel.c_str(), body, response, timeoutMs);
+  }
+
+  static int get(const String&, String& response) {
+    String body = "{\"user\":\"" + userName + "\"}";
+    return mqttPublish("register", body, response, TRANSPORT_TIMEOUT_MS);
+  }
+
+  static String errorToString(int code) { return mqttErrorToString(code); }
+};
+#endif
+
+#if WS_TRANSPORT_COAP
+/**
+ * @brief Confirmable CoAP requests over UDP (see coap_transport.h).
+ * Uses the host and path of the URL; the payload is the same as for HTTP.
+ */
+struct CoapTransport {
+  static constexpr bool kStatusConfirmsDelivery = true;
+
+  static int post(const String& url, const char* contentType, const String& body, String& response,
+                  uint32_t timeoutMs = TRANSPORT_TIMEOUT_MS) {
+    return coapRequest(COAP_METHOD_POST, url, contentType, body, response, timeoutMs);
+  }
+
+  static int get(const String& url, String& response) {
+    return coapRequest(COAP_METHOD_GET, url, NULL, String(), response, TRANSPORT_TIMEOUT_MS);
+  }
+
+  static String errorToString(int code) { return coapErrorToString(code); }
+};
+#endif
+
+#if WS_TRANSPORT_WEBSOCKET
+/**
+ * @brief Text frames on the persistent WebSocket (see websocket_transport.h).
+ * The last segment of the URL becomes the channel. Responses are always empty:
+ * the server pushes control messages, which the WebSocket task applies itself.
+ */
+struct WebSocketTransport {
+  static constexpr bool kStatusConfirmsDelivery = false; // 200 once the frame is in the TCP send buffer
+
+  static int post(const String& url, const char*, const String& body, String& response,
+                  uint32_t timeoutMs = TRANSPORT_TIMEOUT_MS) {
+    response = "";
+    String channel = url.substring(url.lastIndexOf('/') + 1);
+    return webSocketSend(channel.c_str(), body, timeoutMs);
+  }
+
+  static int get(const String&, String& response) {
+    response = "";
+    String body = "{\"user\":\"" + userName + "\"}";
+    return webSocketSend("register", body, TRANSPORT_TIMEOUT_MS);
+  }
+
+  static String errorToString(int code) { return webSocketErrorToString(code); }
+};
+#endif
+
+/** @brief Writes payloads to the serial console instead of a network; always reports 200. */
+struct SerialTransport {
+  static constexpr bool kStatusConfirmsDelivery = true;
+
+  static int post(const String& url, const char*, const String& body, String& response,
+                  uint32_t = TRANSPORT_TIMEOUT_MS) {
+    Serial.printf("SerialTransport: POST %s %s\n", url.c_str(), body.c_str());
+    response = "";
+    return 200;
+  }
+
+  static int get(const String& url, String& response) {
+    Serial.printf("SerialTransport: GET %s\n", url.c_str());
+    response = "";
+    return 200;
+  }
+
+  static String errorToString(int code) { return String("transport error ") + code; }
+};
+
+// --- Station Assembly ---
+
+/** @brief Bundles one policy of each kind into a station configuration. */
+template <class SensorSetT, class EncoderT, class TransportT>
+struct StationPolicy {
+  typedef SensorSetT SensorSet;
+  typedef EncoderT Encoder;
+  typedef TransportT Transport;
+};
+
+#if WS_FEATURE_BME280
+typedef Bme280SensorSet ActiveSensorSet;
+#else
+typedef AnalogSensorSet ActiveSensorSet;
+#endif
+
+#if WS_FEATURE_ARDUINOJSON
+typedef ArduinoJsonEncoder ActiveEncoder;
+#else
+typedef PrintfJsonEncoder ActiveEncoder;
+#endif
+
+#if WS_TRANSPORT_MQTT
+typedef MqttTransport ActiveTransport;
+#elif WS_TRANSPORT_COAP
+typedef CoapTransport ActiveTransport;
+#elif WS_TRANSPORT_WEBSOCKET
+typedef WebSocketTransport ActiveTransport;
+#elif WS_TRANSPORT_HTTPS
+typedef HttpsTransport ActiveTransport;
+#elif WS_TRANSPORT_HTTP
+typedef HttpTransport ActiveTransport;
+#else
+typedef SerialTransport ActiveTransport;
+#endif
+
+/** @brief The station configuration selected by the feature macros in config.h. */
+typedef StationPolicy<ActiveSensorSet, ActiveEncoder, ActiveTransport> ActiveStation;
+
+/**
+ * @brief Encodes a sample with the active encoder and prepends its sequence
+ * number (if any) and Unix time, for payloads that carry several samples (batches, backfill).
+ * @param sample The sample to encode.
+ * @param out Receives {"seq":N, "timestamp":E, <encoder fields>}; "seq" only if sample.seq != 0.
+ */
+inline void encodeTimestampedSample(const WeatherSample& sample, String& out) {
+  String encoded;
+  ActiveStation::Encoder::encode(sample, encoded);
+  out = "{";
+  if (sample.seq != 0) {
+    out += "\"seq\":";
+    out += sample.seq;
+    out += ',';
+  }
+  out += "\"timestamp\":";
+  out += sample.epochS;
+  if (encoded.length() > 2) { // Merge the encoder's fields into this object
+    out += ',';
+    out += encoded.substring(1);
+  } else {
+    out += '}';
+  }
+}
+
+/**
+ * @brief Builds the JSON body of a report to the data endpoint.
+ * @param samples Samples of the report, oldest first.
+ * @param count Number of samples (at least 1).
+ * @param asArray true to send an array even for a single sample.
+ * @param out Receives a single object {"seq":N, <encoder fields>} for one
+ * sample without asArray, otherwise an array of encodeTimestampedSample() objects.
+ */
+inline void encodeJsonReport(const WeatherSample* samples, uint8_t count, bool asArray, String& out) {
+  if (!asArray && count == 1) {
+    String encoded;
+    ActiveStation::Encoder::encode(samples[0], encoded);
+    out = "{\"seq\":";
+    out += samples[0].seq;
+    if (encoded.length() > 2) { // Merge the encoder's fields into this object
+      out += ',';
+      out += encoded.substring(1);
+    } else {
+      out += '}';
+    }
+    return;
+  }
+  out = "[";
+  for (uint8_t i = 0; i < count; i++) {
+    String encoded;
+    encodeTimestampedSample(samples[i], encoded);
+    if (i > 0) {
+      out += ',';
+    }
+    out += encoded;
+  }
+  out += ']';
+}
+
+#endif // STATION_POLICIES_H
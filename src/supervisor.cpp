@@ -0,0 +1,449 @@
+/**
+ * @file supervisor.cpp
+ * @brief Central device state machine running in a dedicated FreeRTOS task.
+ *
+ * This file implements the supervisor task which consumes events from a queue
+ * (button presses, WiFi driver events, portal submissions, sleep requests) and
+ * performs every device mode transition from a single task context. It also
+ * starts the local HTTP server once the network is up, drives the connection
+ * timeouts and logs the latency of each transition.
+ */
+#include "supervisor.h"
+#include "config.h"
+#include "utils.h"
+#include "led_service.h"
+#include "nvs_handler.h"
+#include "wifi_manager.h"
+#include "web_interface.h"
+#include "http_server.h"
+#include "data_sender.h"
+#include "uplink.h"
+#include "event_bus.h"
+#include "fanout.h"
+#include <WiFi.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+// --- Timing Configuration ---
+const uint32_t SUPERVISOR_QUEUE_LENGTH = 16;
+const uint32_t CONNECT_TIMEOUT_MS = 15000;   // Initial STA connection timeout
+const uint32_t RECONNECT_TIMEOUT_MS = 10000; // Reconnection timeout after a lost connection
+
+// --- State ---
+static QueueHandle_t supervisorQueue = NULL;
+static std::atomic<SupervisorState> supervisorState(STATE_BOOT);
+static unsigned long stateDeadline = 0;    // millis() deadline of the current state (0 = none)
+static bool saveConfigOnConnect = false;   // Set when the connection attempt comes from the portal
+
+// --- Public API ---
+
+/**
+ * @brief Creates the supervisor event queue and starts the supervisor task.
+ * @return true if the queue and the task were created, false otherwise.
+ */
+bool startSupervisor() {
+    supervisorQueue = xQueueCreate(SUPERVISOR_QUEUE_LENGTH, sizeof(SupervisorEvent));
+    if (supervisorQueue == NULL) {
+        Serial.println("!!! ERROR: Failed to create supervisor queue!");
+        return false;
+    }
+    BaseType_t created = xTaskCreatePinnedToCore(
+        supervisorTask, "SupervisorTask", 8192 + (features::kHttpsTransport ? HTTPS_HANDSHAKE_STACK : 0), NULL, 2, NULL, APP_CPU_NUM);
+    if (created != pdPASS) {
+        Serial.println("!!! ERROR: Failed to create supervisor task!");
+        return false;
+    }
+    Serial.println("Supervisor task started.");
+    return true;
+}
+
+/**
+ * @brief Posts an event to the supervisor queue without blocking.
+ * @param type The event type.
+ * @param arg Optional event argument.
+ * @return true if the event was queued, false otherwise.
+ */
+bool postSupervisorEvent(SupervisorEventType type, uint32_t arg) {
+    if (supervisorQueue == NULL) {
+        return false;
+    }
+    SupervisorEvent event = { type, arg, esp_timer_get_time(), NULL };
+    if (xQueueSend(supervisorQueue, &event, 0) != pdTRUE) {
+        Serial.printf("Supervisor: event queue full, dropping event %d\n", (int)type);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Posts EVENT_CONFIG_SUBMITTED with the submitted configuration without blocking.
+ * @param config Heap-allocated configuration; owned by the supervisor from now on.
+ * @return true if the event was queued.
+ */
+bool postConfigSubmitted(PortalConfig* config) {
+    SupervisorEvent event = { EVENT_CONFIG_SUBMITTED, 0, esp_timer_get_time(), config };
+    if (supervisorQueue == NULL || xQueueSend(supervisorQueue, &event, 0) != pdTRUE) {
+        Serial.println("Supervisor: event queue full, dropping submitted configuration");
+        delete config;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the current supervisor state.
+ * @return The current SupervisorState.
+ */
+SupervisorState getSupervisorState() {
+    return supervisorState.load();
+}
+
+/**
+ * @brief Returns a printable name of a supervisor state.
+ * @param state The state to name.
+ * @return Constant string with the state name.
+ */
+const char* supervisorStateName(SupervisorState state) {
+    switch (state) {
+        case STATE_BOOT: return "BOOT";
+        case STATE_PROVISIONING: return "PROVISIONING";
+        case STATE_CONNECTING: return "CONNECTING";
+        case STATE_ONLINE: return "ONLINE";
+        case STATE_DEGRADED: return "DEGRADED";
+        case STATE_SLEEPING: return "SLEEPING";
+        default: return "UNKNOWN";
+    }
+}
+
+/**
+ * @brief Returns a printable name of a supervisor event type.
+ * @param type The event type to name.
+ * @return Constant string with the event name.
+ */
+static const char* supervisorEventName(SupervisorEventType type) {
+    switch (type) {
+        case EVENT_CONFIG_LOADED: return "CONFIG_LOADED";
+        case EVENT_CONFIG_MISSING: return "CONFIG_MISSING";
+        case EVENT_CONFIG_SUBMITTED: return "CONFIG_SUBMITTED";
+        case EVENT_BUTTON_GESTURE: return "BUTTON_GESTURE";
+        case EVENT_WIFI_CONNECTED: return "WIFI_CONNECTED";
+        case EVENT_WIFI_DISCONNECTED: return "WIFI_DISCONNECTED";
+        case EVENT_SLEEP_REQUEST: return "SLEEP_REQUEST";
+        case EVENT_WAKE_REQUEST: return "WAKE_REQUEST";
+        default: return "UNKNOWN";
+    }
+}
+
+// --- State Entry Actions ---
+
+/**
+ * @brief Clears the stored configuration and starts the AP configuration portal.
+ */
+static void enterProvisioning() {
+    clearConfigurationInNVS();
+    switchToAPMode();
+    startHttpServer();
+    stateDeadline = 0;
+}
+
+/**
+ * @brief Starts a non-blocking STA connection attempt with the configured credentials.
+ * @param fromPortal true if the credentials come from the portal and must be saved on success.
+ */
+static void enterConnecting(bool fromPortal) {
+    if (fromPortal) {
+        stopPortalMDNS();
+    }
+    saveConfigOnConnect = fromPortal;
+    beginWiFiConnection();
+    stateDeadline = millis() + CONNECT_TIMEOUT_MS;
+}
+
+/**
+ * @brief Finalises a successful connection: persists the configuration if it came
+ * from the portal and requests registration of the device with the backend.
+ */
+static void enterOnline() {
+    Serial.println(">>> SUCCESS: Connected to WiFi!");
+    Serial.print("Device IP address: ");
+    Serial.println(WiFi.localIP());
+    ledPlay(LED_PATTERN_ONLINE);
+    configTime(0, 0, NTP_SERVER); // Samples carry Unix time once SNTP has synchronized (needed for backfill)
+    currentDeviceMode = MODE_CONFIGURED;
+    stateDeadline = 0;
+    if (saveConfigOnConnect) {
+        saveConfigurationToNVS();
+        saveConfigOnConnect = false;
+    }
+    requestRegistration(); // Sent by the uplink task; the request may block for seconds
+    startHttpServer();
+}
+
+/**
+ * @brief Starts reconnecting after the STA connection was lost.
+ */
+static void enterDegraded() {
+    Serial.println("Lost WiFi connection in STA mode. Attempting to reconnect...");
+    beginWiFiReconnect();
+    stateDeadline = millis() + RECONNECT_TIMEOUT_MS;
+}
+
+/**
+ * @brief Switches the radio off for the requested duration.
+ * @param durationMs Sleep duration in milliseconds (0 = until a wake event arrives).
+ */
+static void enterSleeping(uint32_t durationMs) {
+    Serial.printf("Supervisor: radio off for %lu ms (0 = until woken).\n", (unsigned long)durationMs);
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    ledPlay(LED_PATTERN_SLEEPING);
+    stateDeadline = durationMs > 0 ? millis() + durationMs : 0;
+}
+
+// --- Transition Handling ---
+
+/**
+ * @brief Records a state change, logs its cause and latency and publishes it on TOPIC_WIFI_STATE.
+ * The latency covers the time from posting the causing event until the
+ * entry actions of the new state have completed.
+ * @param previous The state the transition started from.
+ * @param next The new state.
+ * @param cause Name of the event or timeout that caused the transition.
+ * @param postedAtUs esp_timer timestamp when the cause was observed.
+ */
+static void completeTransition(SupervisorState previous, SupervisorState next, const char* cause, int64_t postedAtUs) {
+    supervisorState.store(next);
+    int64_t latencyUs = esp_timer_get_time() - postedAtUs;
+    Serial.printf("Supervisor: %s -> %s on %s (latency %lld us)\n",
+                  supervisorStateName(previous), supervisorStateName(next), cause, (long long)latencyUs);
+
+    BusMessage* message = eventBusAcquire(TOPIC_WIFI_STATE);
+    if (message != NULL) {
+        message->data.wifi.state = next;
+        message->data.wifi.rssi = WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0;
+        eventBusPublish(message);
+    }
+}
+
+/**
+ * @brief Maps a button gesture to its action in the current state.
+ * In AP mode every gesture only gives visual feedback. Otherwise a long press
+ * resets the configuration, a short press forces an immediate upload and a
+ * double press toggles the diagnostics mode.
+ * @param state The current state.
+ * @param gesture The recognised gesture.
+ * @param postedAtUs esp_timer timestamp when the gesture was posted.
+ */
+static void handleButtonGesture(SupervisorState state, ButtonGesture gesture, int64_t postedAtUs) {
+    if (state == STATE_BOOT) {
+        return;
+    }
+    if (state == STATE_PROVISIONING) {
+        Serial.println("Button pressed in AP mode (unconfigured) - no major action taken");
+        ledPlay(LED_OVERLAY_ACK); // Visual feedback
+        return;
+    }
+
+    switch (gesture) {
+        case GESTURE_LONG_PRESS:
+            Serial.println("Long press in configured mode -> Forcing AP mode and clearing NVS");
+            supervisorState.store(STATE_PROVISIONING);
+            enterProvisioning();
+            completeTransition(state, STATE_PROVISIONING, "BUTTON_LONG_PRESS", postedAtUs);
+            break;
+
+        case GESTURE_SHORT_PRESS:
+            if (state == STATE_ONLINE) {
+                Serial.println("Short press -> Forcing immediate data upload");
+                requestImmediateSend();
+            }
+            break;
+
+        case GESTURE_DOUBLE_PRESS:
+            diagnosticsMode = !diagnosticsMode;
+            Serial.printf("Double press -> Diagnostics mode %s\n", diagnosticsMode ? "ON" : "OFF");
+            ledPlay(diagnosticsMode ? LED_OVERLAY_DIAG_ON : LED_OVERLAY_DIAG_OFF);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Copies a configuration submitted through the portal into the configuration globals.
+ * @param config The submitted configuration.
+ */
+static void applyPortalConfig(const PortalConfig& config) {
+    wifiSSID = config.ssid;
+    wifiPass = config.pass;
+    userName = config.userName;
+    serverAddress = config.serverAddress;
+    fanoutSetDestinations(config.destinations);
+    Serial.printf("Received data:\n SSID: %s\n Password: [HIDDEN]\n User: %s\n Server Address: %s\n",
+                  wifiSSID.c_str(), userName.c_str(), serverAddress.c_str());
+}
+
+/**
+ * @brief Applies a single event to the state machine.
+ * Events that are not meaningful in the current state are ignored.
+ * @param event The event to handle.
+ */
+static void handleEvent(const SupervisorEvent& event) {
+    SupervisorState state = supervisorState.load();
+    const char* cause = supervisorEventName(event.type);
+
+    switch (event.type) {
+        case EVENT_CONFIG_LOADED:
+            if (state == STATE_BOOT) {
+                Serial.println("Configuration found in NVS. Attempting to connect to WiFi...");
+                supervisorState.store(STATE_CONNECTING); // Publish before WiFi events can arrive
+                enterConnecting(false);
+                completeTransition(state, STATE_CONNECTING, cause, event.postedAtUs);
+            }
+            break;
+
+        case EVENT_CONFIG_MISSING:
+            if (state == STATE_BOOT) {
+                Serial.println("No valid configuration in NVS or device set to unconfigured. Starting in AP mode.");
+                enterProvisioning();
+                completeTransition(state, STATE_PROVISIONING, cause, event.postedAtUs);
+            }
+            break;
+
+        case EVENT_CONFIG_SUBMITTED:
+            if (state == STATE_PROVISIONING && event.payload != NULL) {
+                applyPortalConfig(*static_cast<const PortalConfig*>(event.payload));
+                Serial.println("Disconnecting AP and attempting connection in STA mode...");
+                supervisorState.store(STATE_CONNECTING);
+                enterConnecting(true);
+                completeTransition(state, STATE_CONNECTING, cause, event.postedAtUs);
+            }
+            break;
+
+        case EVENT_BUTTON_GESTURE:
+            handleButtonGesture(state, (ButtonGesture)event.arg, event.postedAtUs);
+            break;
+
+        case EVENT_WIFI_CONNECTED:
+            if (state == STATE_CONNECTING) {
+                supervisorState.store(STATE_ONLINE);
+                enterOnline();
+                completeTransition(state, STATE_ONLINE, cause, event.postedAtUs);
+            } else if (state == STATE_DEGRADED) {
+                Serial.println("Reconnection successful.");
+                ledPlay(LED_PATTERN_ONLINE);
+                stateDeadline = 0;
+                completeTransition(state, STATE_ONLINE, cause, event.postedAtUs);
+            }
+            break;
+
+        case EVENT_WIFI_DISCONNECTED:
+            if (state == STATE_ONLINE) {
+                supervisorState.store(STATE_DEGRADED);
+                enterDegraded();
+                completeTransition(state, STATE_DEGRADED, cause, event.postedAtUs);
+            }
+            break;
+
+        case EVENT_SLEEP_REQUEST:
+            if (state == STATE_ONLINE || state == STATE_DEGRADED) {
+                supervisorState.store(STATE_SLEEPING);
+                enterSleeping(event.arg);
+                completeTransition(state, STATE_SLEEPING, cause, event.postedAtUs);
+            }
+            break;
+
+        case EVENT_WAKE_REQUEST:
+            if (state == STATE_SLEEPING) {
+                supervisorState.store(STATE_CONNECTING);
+                enterConnecting(false);
+                completeTransition(state, STATE_CONNECTING, cause, event.postedAtUs);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Performs the periodic work of the current state when no event arrived:
+ * enforces timeouts while (re)connecting and ends a timed sleep. The HTTP
+ * server runs in its own task and needs no pumping.
+ */
+static void handleTick() {
+    SupervisorState state = supervisorState.load();
+    bool deadlinePassed = stateDeadline != 0 && (long)(millis() - stateDeadline) >= 0;
+
+    switch (state) {
+        case STATE_CONNECTING:
+        case STATE_DEGRADED:
+            if (!deadlinePassed) {
+                break;
+            }
+            Serial.println(state == STATE_CONNECTING
+                ? "!!! ERROR: Failed to connect to WiFi within the timeout. Returning to AP mode."
+                : "Reconnection failed. Reverting to AP mode.");
+            ledPlay(LED_OVERLAY_ERROR);
+            supervisorState.store(STATE_PROVISIONING);
+            enterProvisioning();
+            completeTransition(state, STATE_PROVISIONING, "TIMEOUT", esp_timer_get_time());
+            break;
+
+        case STATE_SLEEPING:
+            if (deadlinePassed) {
+                supervisorState.store(STATE_CONNECTING);
+                enterConnecting(false);
+                completeTransition(state, STATE_CONNECTING, "SLEEP_TIMEOUT", esp_timer_get_time());
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Returns how long the supervisor may block on its queue in the current state.
+ * @return Block time in ticks.
+ */
+static TickType_t currentWaitTicks() {
+    switch (supervisorState.load()) {
+        case STATE_CONNECTING:
+        case STATE_DEGRADED:
+        case STATE_SLEEPING:
+            if (stateDeadline != 0) {
+                long remaining = (long)(stateDeadline - millis());
+                return remaining > 0 ? pdMS_TO_TICKS(remaining) : 0;
+            }
+            return portMAX_DELAY;
+        default:
+            return portMAX_DELAY;
+    }
+}
+
+// --- FreeRTOS Task: Supervisor ---
+
+/**
+ * @brief FreeRTOS task running the device state machine.
+ * Blocks on the event queue (indefinitely while online) and applies each event,
+ * falling back to periodic state work when the state needs it.
+ * @param pvParameters Standard FreeRTOS task parameters (unused).
+ */
+void supervisorTask(void *pvParameters) {
+    Serial.println("Supervisor Task started.");
+    registerWiFiEventHandlers();
+
+    for (;;) {
+        SupervisorEvent event;
+        if (xQueueReceive(supervisorQueue, &event, currentWaitTicks()) == pdTRUE) {
+            handleEvent(event);
+            if (event.type == EVENT_CONFIG_SUBMITTED) {
+                delete static_cast<PortalConfig*>(event.payload);
+            }
+        } else {
+            handleTick();
+        }
+    }
+}
@@ -0,0 +1,103 @@
+/**
+ * @file supervisor.h
+ * @brief Declarations for the central device state machine (supervisor task).
+ *
+ * The supervisor task is the single owner of all device mode transitions
+ * (provisioning portal, WiFi connection, reconnection, sleep). Other tasks,
+ * WiFi driver callbacks and web handlers never switch modes themselves; they
+ * post events to the supervisor queue and the supervisor performs the
+ * transition from its own task context.
+ */
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include "config.h"
+
+/** @brief States of the device state machine owned by the supervisor task. */
+enum SupervisorState {
+  STATE_BOOT = 0,     ///< Hardware initialised, stored configuration not yet evaluated.
+  STATE_PROVISIONING, ///< AP mode with the configuration web portal running.
+  STATE_CONNECTING,   ///< STA connection attempt in progress.
+  STATE_ONLINE,       ///< Connected to WiFi, sensor data is being sent.
+  STATE_DEGRADED,     ///< STA connection lost, reconnection in progress.
+  STATE_SLEEPING      ///< Radio switched off until the sleep period ends or a wake event arrives.
+};
+
+/** @brief Events consumed by the supervisor state machine. */
+enum SupervisorEventType {
+  EVENT_CONFIG_LOADED = 0,  ///< Valid configuration found in NVS at boot.
+  EVENT_CONFIG_MISSING,     ///< No valid configuration found in NVS at boot.
+  EVENT_CONFIG_SUBMITTED,   ///< New configuration submitted through the web portal; payload = PortalConfig.
+  EVENT_BUTTON_GESTURE,     ///< Recognised button gesture; arg = ButtonGesture.
+  EVENT_WIFI_CONNECTED,     ///< STA interface obtained an IP address.
+  EVENT_WIFI_DISCONNECTED,  ///< STA interface lost its connection.
+  EVENT_SLEEP_REQUEST,      ///< Switch the radio off; arg = sleep duration in ms (0 = until woken).
+  EVENT_WAKE_REQUEST        ///< Leave the sleeping state and reconnect.
+};
+
+/**
+ * @brief Configuration submitted through the portal.
+ * The web handler only parses the form; the supervisor copies the values into
+ * the configuration globals, so they are written by the supervisor task only.
+ */
+struct PortalConfig {
+  String ssid;
+  String pass;
+  String userName;
+  String serverAddress;
+  String destinations;      ///< Extra destinations (see fanout.h), empty for none.
+};
+
+/** @brief A single entry of the supervisor event queue. */
+struct SupervisorEvent {
+  SupervisorEventType type; ///< Event type.
+  uint32_t arg;             ///< Optional event argument (meaning depends on type).
+  int64_t postedAtUs;       ///< esp_timer timestamp of posting, used for transition latency logging.
+  void* payload;            ///< Optional heap object (meaning depends on type), deleted by the supervisor.
+};
+
+/**
+ * @brief Creates the supervisor event queue and starts the supervisor task.
+ * @note Must be called in setup() before any other task may post events.
+ * @return true if the queue and the task were created, false otherwise.
+ */
+bool startSupervisor();
+
+/**
+ * @brief Posts an event to the supervisor queue without blocking.
+ * Safe to call from any task (including WiFi driver callbacks and web handlers).
+ * @param type The event type.
+ * @param arg Optional event argument (defaults to 0).
+ * @return true if the event was queued, false if the queue is full or not created yet.
+ */
+bool postSupervisorEvent(SupervisorEventType type, uint32_t arg = 0);
+
+/**
+ * @brief Posts EVENT_CONFIG_SUBMITTED with the submitted configuration without blocking.
+ * @param config Heap-allocated configuration; the supervisor takes ownership,
+ * also when the event cannot be queued.
+ * @return true if the event was queued.
+ */
+bool postConfigSubmitted(PortalConfig* config);
+
+/**
+ * @brief Returns the current supervisor state.
+ * Safe to call from any task or core.
+ * @return The current SupervisorState.
+ */
+SupervisorState getSupervisorState();
+
+/**
+ * @brief Returns a printable name of a supervisor state.
+ * @param state The state to name.
+ * @return Constant string with the state name.
+ */
+const char* supervisorStateName(SupervisorState state);
+
+/**
+ * @brief FreeRTOS task function running the device state machine.
+ * @param pvParameters Standard FreeRTOS task parameters (unused).
+ */
+void supervisorTask(void *pvParameters);
+
+#endif // SUPERVISOR_H
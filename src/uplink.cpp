@@ -0,0 +1,597 @@
+/**
+ * @file uplink.cpp
+ * @brief Transmission of sensor data and device registration to the remote server.
+ *
+ * This file implements device registration (sending the MAC address) and the
+ * uplink task. The task consumes samples from the event bus, downsamples them
+ * (see downsampler.h), collects the records into reports as set by the runtime
+ * configuration, builds the payload with the
+ * encoder policy, sends it through the transport policy (see station_policies.h)
+ * to the configured API endpoint, signals errors on the LED and publishes the
+ * result of every upload. Control blocks and backfill requests in the server
+ * response are forwarded to their owners. While diagnostics mode is on, the
+ * CPU profile is posted to the diagnostics endpoint after each new window.
+ *
+ * Every record gets the next upload sequence number and stays buffered until
+ * the server acknowledges it. The server answers with the cumulative ack
+ * watermark {"ack": N} (all records up to N received); each report resends
+ * all records above the watermark, so the server can drop duplicates by
+ * sequence number. Over request/response transports a 2xx response without
+ * "ack" acknowledges the whole report, for servers that do not track sequence
+ * numbers. Over push transports (MQTT, WebSocket) the status only means the
+ * broker or the TCP stack took the report, so records are kept until the
+ * server pushes an ack (uplinkHandleDirectives()). Sequence numbers are
+ * reserved in blocks of UPLINK_SEQUENCE_BLOCK, so NVS is written once per block
+ * and numbers never repeat across reboots (unused numbers of a block are skipped).
+ */
+#include "uplink.h"
+#include "config.h"
+#include "event_bus.h"
+#include "led_service.h"
+#include "supervisor.h"
+#include "station_policies.h"
+#include "backfill.h"
+#include "runtime_config.h"
+#include "alerts.h"
+#include "downsampler.h"
+#include "nvs_handler.h"
+#include "discovery.h"
+#include "cpu_profiler.h"
+#include "alloc_trace.h"
+#if WS_FEATURE_PROTOBUF
+#include "protobuf_encoder.h"
+#endif
+#include <WiFi.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// --- Uplink Configuration ---
+const uint8_t UPLINK_QUEUE_DEPTH = 4; // Samples the uplink may fall behind before dropping
+const uint32_t ALERT_YIELD_POLL_MS = 10; // Poll period while the alert lane is sending
+const uint8_t UPLINK_UNACKED_CAPACITY = 120; // Records kept until acknowledged; the oldest are dropped beyond this
+const uint8_t UPLINK_MAX_REPORT = 30;        // Records per report when resending
+const uint32_t UPLINK_SEQUENCE_BLOCK = 1000; // Sequence numbers reserved per NVS write
+
+static_assert(UPLINK_MAX_REPORT >= RUNTIME_MAX_BATCH, "A report must hold a full batch");
+
+static std::atomic<bool> liveUploadInProgress(false);
+static std::atomic<bool> registrationPending(false); // Set by the supervisor, cleared by the uplink task
+
+// --- Unacknowledged Records (uplink task only, except the atomics) ---
+static WeatherSample unacked[UPLINK_UNACKED_CAPACITY]; // Ring, ordered by sequence number
+static uint8_t unackedFirst = 0;
+static uint8_t unackedCount = 0;
+static uint32_t nextSequence = 0;
+static uint32_t reservedSequence = 0;                  // Numbers below this are reserved in NVS
+static std::atomic<uint32_t> ackWatermark(0);          // All records up to this were received by the server
+static std::atomic<uint32_t> highestSentSequence(0);
+static uint32_t resentRecords = 0;
+static uint32_t droppedRecords = 0;
+static uint32_t noAckReports = 0;                      // Reports after which the watermark had not moved
+
+// Latency accumulators, index 0 = no backfill running, 1 = backfill running
+static uint32_t latencySumMs[2] = {};
+static uint32_t latencyCount[2] = {};
+static uint32_t latencyMaxMs[2] = {};
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Data Transmission: Device Registration ---
+
+/**
+ * @brief Sends the device's MAC address to the registration API endpoint.
+ * This is typically called once after a successful Wi-Fi connection in configured mode
+ * to register the device with the backend server. Runs on the uplink task (see
+ * requestRegistration()), so the blocking request does not stall the supervisor.
+ */
+static void sendMacAddress() {
+    if (WiFi.status() != WL_CONNECTED) { return; }
+    ALLOC_TRACE_SCOPE("sendMacAddress");
+    String macAddress = WiFi.macAddress();
+    String constructedEndpoint = "http://" + activeServerAddress() + apiRegisterPath;
+    constructedEndpoint.replace("<username>", userName); constructedEndpoint.replace("<mac_address>", macAddress);
+    Serial.printf("Sending MAC to registration endpoint: %s\n", constructedEndpoint.c_str());
+    String response;
+    int httpResponseCode = ActiveStation::Transport::get(constructedEndpoint, response);
+    if (httpResponseCode > 0) {
+        Serial.printf("Registration server response: %d\n", httpResponseCode);
+        Serial.println("Response:"); Serial.println(response);
+        if (httpResponseCode == 200 || httpResponseCode == 201) { ledPlay(LED_OVERLAY_SUCCESS); } else { ledPlay(LED_OVERLAY_ERROR); }
+    } else {
+        Serial.printf("HTTP error during registration: %s\n", ActiveStation::Transport::errorToString(httpResponseCode).c_str()); ledPlay(LED_OVERLAY_ERROR);
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(20));
+}
+
+/**
+ * @brief Asks the uplink task to send the device's MAC address to the API registration endpoint.
+ * Does not block: the task registers when the supervisor's next TOPIC_WIFI_STATE message
+ * wakes it and the supervisor is online.
+ */
+void requestRegistration() {
+    registrationPending.store(true);
+}
+
+// --- Data Transmission: Samples ---
+
+/**
+ * @brief Publishes the result of an upload on TOPIC_UPLINK_RESULT.
+ * @param httpCode HTTP status code or negative HTTPClient error.
+ * @param durationMs Duration of the request.
+ * @param payloadBytes Size of the request body.
+ * @param sampleTimestampMs Timestamp of the uploaded sample.
+ */
+static void publishUplinkResult(int httpCode, uint32_t durationMs, uint32_t payloadBytes, uint32_t sampleTimestampMs) {
+    BusMessage* message = eventBusAcquire(TOPIC_UPLINK_RESULT);
+    if (message == NULL) {
+        return;
+    }
+    message->data.uplink.httpCode = httpCode;
+    message->data.uplink.durationMs = durationMs;
+    message->data.uplink.payloadBytes = payloadBytes;
+    message->data.uplink.sampleTimestampMs = sampleTimestampMs;
+    eventBusPublish(message);
+}
+
+/**
+ * @brief Adds one live upload to the latency statistics.
+ * @param latencyMs Time from acquisition of the sample to the server response.
+ * @param duringBackfill true if a backfill was running when the upload started.
+ */
+static void recordLatency(uint32_t latencyMs, bool duringBackfill) {
+    uint8_t slot = duringBackfill ? 1 : 0;
+    portENTER_CRITICAL(&statsLock);
+    latencySumMs[slot] += latencyMs;
+    latencyCount[slot]++;
+    if (latencyMs > latencyMaxMs[slot]) {
+        latencyMaxMs[slot] = latencyMs;
+    }
+    portEXIT_CRITICAL(&statsLock);
+}
+
+// --- Sequence Numbers and Acknowledgements ---
+
+/**
+ * @brief Reads the cumulative ack watermark {"ack": N} from a server message.
+ * @param response Body of a server response or a pushed message.
+ * @param ack Receives N.
+ * @return true if the message carries an ack.
+ */
+static bool parseAckWatermark(const String& response, uint32_t& ack) {
+    const char* member = strstr(response.c_str(), "\"ack\"");
+    if (member == NULL) {
+        return false;
+    }
+    const char* value = strchr(member + 5, ':');
+    if (value == NULL) {
+        return false;
+    }
+    ack = strtoul(value + 1, NULL, 10);
+    return true;
+}
+
+/**
+ * @brief Advances the ack watermark; it never moves back and never passes the last record sent.
+ * @param ack Cumulative acknowledgement from the server.
+ */
+static void raiseAckWatermark(uint32_t ack) {
+    uint32_t highest = highestSentSequence.load();
+    if (ack > highest) {
+        ack = highest; // A server cannot acknowledge records it has not been sent
+    }
+    uint32_t current = ackWatermark.load();
+    while (ack > current && !ackWatermark.compare_exchange_weak(current, ack)) {
+    }
+}
+
+/**
+ * @brief Returns the next upload sequence number, reserving a new block in NVS when needed.
+ * @return A number greater than any returned before, also across reboots.
+ */
+static uint32_t allocateSequence() {
+    if (nextSequence >= reservedSequence) {
+        reservedSequence = nextSequence + UPLINK_SEQUENCE_BLOCK;
+        saveSequenceLimitToNVS(reservedSequence);
+    }
+    return nextSequence++;
+}
+
+/**
+ * @brief Numbers a record and appends it to the unacknowledged records.
+ * When the buffer is full, the oldest record is dropped; it is still in the
+ * sample history for backfill.
+ * @param record The record.
+ */
+static void bufferRecord(WeatherSample& record) {
+    record.seq = allocateSequence();
+    if (unackedCount == UPLINK_UNACKED_CAPACITY) {
+        unackedFirst = (unackedFirst + 1) % UPLINK_UNACKED_CAPACITY;
+        unackedCount--;
+        portENTER_CRITICAL(&statsLock);
+        droppedRecords++;
+        portEXIT_CRITICAL(&statsLock);
+    }
+    unacked[(unackedFirst + unackedCount) % UPLINK_UNACKED_CAPACITY] = record;
+    unackedCount++;
+}
+
+/**
+ * @brief Copies the records of the next report: the records not sent yet,
+ * preceded by as many of the oldest sent but unacknowledged records as fit.
+ * New records therefore always go out, also when a server never acknowledges
+ * and the same oldest records would otherwise fill every report.
+ * @param report Receives up to UPLINK_MAX_REPORT records, ordered by sequence number.
+ * @param resent Receives the number of records sent before.
+ * @return Number of records in the report.
+ */
+static uint8_t composeReport(WeatherSample* report, uint8_t& resent) {
+    uint32_t sentBefore = highestSentSequence.load();
+    uint8_t unsent = 0;
+    while (unsent < unackedCount &&
+           unacked[(unackedFirst + unackedCount - 1 - unsent) % UPLINK_UNACKED_CAPACITY].seq > sentBefore) {
+        unsent++;
+    }
+    uint8_t fresh = unsent < UPLINK_MAX_REPORT ? unsent : UPLINK_MAX_REPORT;
+    resent = unackedCount - unsent < UPLINK_MAX_REPORT - fresh ? unackedCount - unsent : UPLINK_MAX_REPORT - fresh;
+    for (uint8_t i = 0; i < resent; i++) {
+        report[i] = unacked[(unackedFirst + i) % UPLINK_UNACKED_CAPACITY];
+    }
+    uint8_t firstUnsent = unackedCount - unsent;
+    for (uint8_t i = 0; i < fresh; i++) {
+        report[resent + i] = unacked[(unackedFirst + firstUnsent + i) % UPLINK_UNACKED_CAPACITY];
+    }
+    return resent + fresh;
+}
+
+/**
+ * @brief Counts a report due while the previous report is still not acknowledged.
+ * Logs the first of a series, since a server that never acknowledges (MQTT,
+ * WebSocket) would otherwise only show as a growing resend count.
+ */
+static void checkAckReceived() {
+    static uint32_t watermarkAtLastReport = 0;
+    static bool missing = false;
+    uint32_t watermark = ackWatermark.load();
+    uint32_t sentUpTo = highestSentSequence.load();
+    if (sentUpTo > watermark && watermark == watermarkAtLastReport) {
+        if (!missing) {
+            Serial.printf("Uplink: No ack received since the last report (watermark %lu, sent up to %lu).\n",
+                          (unsigned long)watermark, (unsigned long)sentUpTo);
+        }
+        missing = true;
+        portENTER_CRITICAL(&statsLock);
+        noAckReports++;
+        portEXIT_CRITICAL(&statsLock);
+    } else {
+        missing = false;
+    }
+    watermarkAtLastReport = watermark;
+}
+
+/** @brief Frees the buffered records at or below the ack watermark. */
+static void releaseAcknowledged() {
+    uint32_t watermark = ackWatermark.load();
+    while (unackedCount > 0 && unacked[unackedFirst].seq <= watermark) {
+        unackedFirst = (unackedFirst + 1) % UPLINK_UNACKED_CAPACITY;
+        unackedCount--;
+    }
+}
+
+/**
+ * @brief Applies the server's control block, backfill request and alert rules, if the message carries them.
+ * @param response Body of a server response or a control message pushed by the server.
+ */
+void uplinkHandleDirectives(const String& response) {
+    uint32_t ack;
+    if (parseAckWatermark(response, ack)) {
+        raiseAckWatermark(ack);
+    }
+    RuntimeConfig config = getRuntimeConfig();
+    if (parseControlBlock(response, config)) {
+        applyRuntimeConfig(config, true);
+    }
+    uint32_t fromEpochS, toEpochS;
+    if (parseBackfillRequest(response, fromEpochS, toEpochS)) {
+        Serial.printf("Uplink: Server requested backfill %lu..%lu.\n", (unsigned long)fromEpochS, (unsigned long)toEpochS);
+        requestBackfill(fromEpochS, toEpochS);
+    }
+    String rules;
+    if (parseRulesDirective(response, rules)) {
+        applyAlertRules(rules.c_str(), true);
+    }
+}
+
+// --- Report Format ---
+
+#if WS_FEATURE_PROTOBUF
+static bool protobufRejected = false; // The server answered 415 to a protobuf report
+static uint32_t protobufRejectedMs = 0;
+#endif
+
+/**
+ * @brief Encodes a report as protobuf when the server accepts it, otherwise as JSON.
+ * @param samples Samples of the report, oldest first.
+ * @param count Number of samples.
+ * @param asArray true to send a JSON array even for a single sample.
+ * @param payload Receives the body.
+ * @return Content-Type of the body.
+ */
+static const char* encodeReport(const WeatherSample* samples, uint8_t count, bool asArray, String& payload) {
+#if WS_FEATURE_PROTOBUF
+    if ((!protobufRejected || millis() - protobufRejectedMs >= PROTOBUF_REPROBE_MS) &&
+        protobufEncodeReport(samples, count, payload)) {
+        return PROTOBUF_CONTENT_TYPE;
+    }
+#endif
+    encodeJsonReport(samples, count, asArray, payload);
+    return ActiveStation::Encoder::contentType();
+}
+
+/**
+ * @brief Tracks whether the server accepts protobuf reports.
+ * @param contentType Content-Type of the report that was sent.
+ * @param httpResponseCode Response to it.
+ * @return true if the server rejected protobuf and the report must be resent as JSON.
+ */
+static bool reportFormatRejected(const char* contentType, int httpResponseCode) {
+#if WS_FEATURE_PROTOBUF
+    if (strcmp(contentType, PROTOBUF_CONTENT_TYPE) != 0) {
+        return false;
+    }
+    if (httpResponseCode == 415) { // Unsupported Media Type (CoAP 4.15)
+        if (!protobufRejected) {
+            Serial.println("Uplink: Server does not accept protobuf, sending JSON.");
+        }
+        protobufRejected = true;
+        protobufRejectedMs = millis();
+        return true;
+    }
+    if (httpResponseCode >= 200 && httpResponseCode < 300 && protobufRejected) {
+        Serial.println("Uplink: Server accepts protobuf again.");
+        protobufRejected = false;
+    }
+#endif
+    return false;
+}
+
+/**
+ * @brief Tells whether any reported field is aggregated over a window.
+ * Such records are stamped with the start of their window, so they are sent
+ * as time-stamped array elements even with a batch size of 1.
+ * @param config The runtime configuration.
+ * @return true if a field in the field mask has a window.
+ */
+static bool isDownsampling(const RuntimeConfig& config) {
+    for (uint8_t field = 0; field < SAMPLE_FIELD_COUNT; field++) {
+        if ((config.fieldMask & (1 << field)) && config.downsampling[field].windowMs > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Encodes a report and posts it to the API data endpoint.
+ * As JSON, a batch size of 1 keeps the original single-object payload with an
+ * added "seq" member; larger batches and resends are sent as a JSON array of
+ * time-stamped samples. With WS_FEATURE_PROTOBUF the report is a
+ * telemetry.Batch, or JSON if the server rejects protobuf. The ack watermark
+ * is raised from the response.
+ * @param samples Samples of the report, oldest first.
+ * @param count Number of samples.
+ * @param asArray true to send an array even for a single sample.
+ */
+static void sendReport(const WeatherSample* samples, uint8_t count, bool asArray) {
+    String payload;
+    const char* contentType = encodeReport(samples, count, asArray, payload);
+
+    // Construct API endpoint and send data
+    String constructedEndpoint = "http://" + activeServerAddress() + apiDataPath;
+    constructedEndpoint.replace("<mac_plytki>", WiFi.macAddress());
+
+    if (strcmp(contentType, PROTOBUF_CONTENT_TYPE) == 0) {
+        DEBUG_PRINTF("Uplink: Sending %u sample(s) to data endpoint: %s, %u bytes of protobuf\n", (unsigned)count, constructedEndpoint.c_str(), payload.length());
+    } else {
+        DEBUG_PRINTF("Uplink: Sending %u sample(s) to data endpoint: %s, Data: %s\n", (unsigned)count, constructedEndpoint.c_str(), payload.c_str());
+    }
+
+    while (alertLaneBusy()) { // Alerts preempt routine reports
+        vTaskDelay(pdMS_TO_TICKS(ALERT_YIELD_POLL_MS));
+    }
+
+    unsigned long start = millis();
+    bool duringBackfill = backfillGetStats().active;
+    if (samples[count - 1].seq > highestSentSequence.load()) {
+        highestSentSequence.store(samples[count - 1].seq);
+    }
+    String response;
+    liveUploadInProgress.store(true);
+    int httpResponseCode = ActiveStation::Transport::post(constructedEndpoint, contentType, payload, response);
+    if (reportFormatRejected(contentType, httpResponseCode)) {
+        encodeJsonReport(samples, count, asArray, payload); // Resend at once in the format every server accepts
+        httpResponseCode = ActiveStation::Transport::post(constructedEndpoint, ActiveStation::Encoder::contentType(), payload, response);
+    }
+    liveUploadInProgress.store(false);
+    recordLatency(millis() - samples[0].timestampMs, duringBackfill); // Oldest sample waited longest
+
+    if (httpResponseCode > 0) {
+        DEBUG_PRINTF("Uplink: Data server response: %d\n", httpResponseCode);
+        DEBUG_PRINTLN("Uplink: Response:");
+        DEBUG_PRINTLN(response);
+        if (httpResponseCode < 200 || httpResponseCode >= 300) {
+            ledPlay(LED_OVERLAY_ERROR);
+        } else {
+            uplinkHandleDirectives(response);
+            uint32_t ack;
+            if (ActiveStation::Transport::kStatusConfirmsDelivery && !parseAckWatermark(response, ack)) {
+                raiseAckWatermark(samples[count - 1].seq); // Server without sequence tracking: the report is acknowledged
+            }
+        }
+    } else {
+        Serial.printf("Uplink: HTTP error during data sending: %s\n", ActiveStation::Transport::errorToString(httpResponseCode).c_str());
+        ledPlay(LED_OVERLAY_ERROR);
+    }
+
+    publishUplinkResult(httpResponseCode, millis() - start, payload.length(), samples[count - 1].timestampMs);
+}
+
+/**
+ * @brief Posts the CPU profile (see cpu_profiler.h) to the diagnostics endpoint
+ * once per profiler window while diagnostics mode is on.
+ */
+static void sendCpuProfile() {
+    static CpuProfile profile; // Uplink task only; kept off the stack
+    static uint32_t sentWindows = 0;
+    cpuProfileGet(profile);
+    if (!profile.available || profile.windows == sentWindows) {
+        return;
+    }
+    sentWindows = profile.windows;
+    String payload;
+    encodeCpuProfile(profile, payload);
+    String constructedEndpoint = "http://" + activeServerAddress() + apiDiagnosticsPath;
+    constructedEndpoint.replace("<mac_plytki>", WiFi.macAddress());
+    while (alertLaneBusy()) {
+        vTaskDelay(pdMS_TO_TICKS(ALERT_YIELD_POLL_MS));
+    }
+    String response;
+    int httpResponseCode = ActiveStation::Transport::post(constructedEndpoint, "application/json", payload, response);
+    if (httpResponseCode <= 0) {
+        Serial.printf("Uplink: Error sending CPU profile: %s\n", ActiveStation::Transport::errorToString(httpResponseCode).c_str());
+    }
+}
+
+/**
+ * @brief Tells whether a live upload or an alert is in progress.
+ * @return true while a report or an alert is being sent.
+ */
+bool uplinkBusy() {
+    return liveUploadInProgress.load() || alertLaneBusy();
+}
+
+/**
+ * @brief Returns a snapshot of the live upload latency and delivery counters.
+ * @return Copy of the current statistics.
+ */
+UplinkStats uplinkGetStats() {
+    UplinkStats snapshot;
+    portENTER_CRITICAL(&statsLock);
+    snapshot.uploads = latencyCount[0] + latencyCount[1];
+    snapshot.latencyMsAvg = latencyCount[0] > 0 ? latencySumMs[0] / latencyCount[0] : 0;
+    snapshot.latencyMsMax = latencyMaxMs[0];
+    snapshot.latencyMsAvgDuringBackfill = latencyCount[1] > 0 ? latencySumMs[1] / latencyCount[1] : 0;
+    snapshot.latencyMsMaxDuringBackfill = latencyMaxMs[1];
+    snapshot.unacked = unackedCount;
+    snapshot.resent = resentRecords;
+    snapshot.dropped = droppedRecords;
+    snapshot.noAck = noAckReports;
+    snapshot.nextSequence = nextSequence;
+    portEXIT_CRITICAL(&statsLock);
+    snapshot.ackWatermark = ackWatermark.load();
+    return snapshot;
+}
+
+// --- FreeRTOS Task: Uplink ---
+
+/**
+ * @brief Subscribes the uplink to TOPIC_SAMPLE and TOPIC_WIFI_STATE and starts the uplink task.
+ * @return true if the subscription and the task were created, false otherwise.
+ */
+bool startUplink() {
+    EventSubscriber* subscriber = eventBusSubscribe(TOPIC_BIT(TOPIC_SAMPLE) | TOPIC_BIT(TOPIC_WIFI_STATE),
+                                                    UPLINK_QUEUE_DEPTH);
+    if (subscriber == NULL) {
+        return false;
+    }
+    return xTaskCreatePinnedToCore(
+        uplinkTaskFunction, "UplinkTask", 8192 + (features::kHttpsTransport ? HTTPS_HANDSHAKE_STACK : 0), subscriber, 1, NULL, APP_CPU_NUM) == pdPASS;
+}
+
+/**
+ * @brief FreeRTOS task function downsampling received samples into records,
+ * numbering them and sending them to the API data endpoint. A report is due
+ * when batchSize new records have arrived or reportPeriodMs has passed since
+ * the last report, whichever comes first. Both limits are re-read from the
+ * runtime configuration on every wake-up, so a new configuration applies to
+ * the batch already being collected. Each report carries the new records and,
+ * in the remaining room up to UPLINK_MAX_REPORT, the oldest unacknowledged
+ * ones, so records not acknowledged are resent with the next report. While the device is
+ * configured but not online, records are buffered and sent once it is.
+ * State changes on TOPIC_WIFI_STATE wake the task to send a pending
+ * registration (see requestRegistration()).
+ * @param pvParameters Event bus subscriber handle (EventSubscriber*).
+ */
+void uplinkTaskFunction(void *pvParameters) {
+    EventSubscriber* subscriber = static_cast<EventSubscriber*>(pvParameters);
+    static WeatherSample records[SAMPLE_FIELD_COUNT];
+    static WeatherSample report[UPLINK_MAX_REPORT];
+    uint8_t newRecords = 0;
+    uint32_t dueSinceMs = millis();
+    nextSequence = loadSequenceLimitFromNVS();
+    if (nextSequence == 0) {
+        nextSequence = 1; // 0 means "no sequence number"
+    }
+    reservedSequence = nextSequence;
+    Serial.printf("Uplink Task started (next sequence number %lu).\n", (unsigned long)nextSequence);
+
+    for (;;) {
+        RuntimeConfig config = getRuntimeConfig();
+        TickType_t waitTicks = portMAX_DELAY;
+        if (unackedCount > 0) {
+            uint32_t waitedMs = millis() - dueSinceMs;
+            waitTicks = waitedMs >= config.reportPeriodMs ? 0 : pdMS_TO_TICKS(config.reportPeriodMs - waitedMs);
+        }
+
+        const BusMessage* message = eventBusReceive(subscriber, waitTicks);
+        if (message != NULL && message->topic == TOPIC_WIFI_STATE) {
+            eventBusRelease(message);
+            message = NULL;
+        }
+        if (message != NULL) {
+            if (currentDeviceMode != MODE_UNCONFIGURED) {
+                WeatherSample sample = message->data.sample;
+                maskSampleFields(sample, config.fieldMask);
+                uint8_t produced = downsamplerAdd(sample, config, records);
+                if (produced > 0 && unackedCount == 0) {
+                    dueSinceMs = millis();
+                }
+                for (uint8_t i = 0; i < produced; i++) {
+                    bufferRecord(records[i]);
+                }
+                newRecords += produced;
+            } else {
+                DEBUG_PRINTLN("Uplink: Skipping sample (device not configured).");
+            }
+            eventBusRelease(message);
+        }
+
+        if (registrationPending.load() && getSupervisorState() == STATE_ONLINE) {
+            registrationPending.store(false);
+            sendMacAddress();
+        }
+
+        config = getRuntimeConfig();
+        if (unackedCount > 0 &&
+            (newRecords >= config.batchSize || millis() - dueSinceMs >= config.reportPeriodMs)) {
+            if (getSupervisorState() == STATE_ONLINE) {
+                checkAckReceived();
+                uint8_t resent;
+                uint8_t count = composeReport(report, resent);
+                portENTER_CRITICAL(&statsLock);
+                resentRecords += resent;
+                portEXIT_CRITICAL(&statsLock);
+                sendReport(report, count, config.batchSize > 1 || count > 1 || isDownsampling(config));
+                releaseAcknowledged();
+            } else {
+                DEBUG_PRINTF("Uplink: Holding %u record(s) (not connected to WiFi).\n", (unsigned)unackedCount);
+            }
+            newRecords = 0;
+            dueSinceMs = millis();
+        }
+
+        if (diagnosticsMode && getSupervisorState() == STATE_ONLINE) {
+            sendCpuProfile();
+        }
+    }
+}
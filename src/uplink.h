@@ -0,0 +1,73 @@
+/**
+ * @file uplink.h
+ * @brief Declarations for device registration and the data uplink task.
+ *
+ * The uplink task is an event bus subscriber: it receives every published
+ * WeatherSample, collects samples into reports as set by the runtime
+ * configuration (see runtime_config.h), encodes them as JSON and sends them to
+ * the API data endpoint, then publishes the outcome on TOPIC_UPLINK_RESULT. Backfill requests found
+ * in the server response are handed to the backfill task (see backfill.h).
+ * Records carry an upload sequence number and are resent until the server's
+ * ack watermark covers them.
+ */
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include "config.h"
+
+/** @brief Live upload latency (sample acquisition to server response), split by backfill activity, and delivery counters. */
+struct UplinkStats {
+  uint32_t uploads;                    ///< Live uploads attempted.
+  uint32_t latencyMsAvg;               ///< Average latency while no backfill was running [ms].
+  uint32_t latencyMsMax;               ///< Maximum latency while no backfill was running [ms].
+  uint32_t latencyMsAvgDuringBackfill; ///< Average latency while a backfill was running [ms].
+  uint32_t latencyMsMaxDuringBackfill; ///< Maximum latency while a backfill was running [ms].
+  uint32_t unacked;                    ///< Records sent or waiting but not yet acknowledged.
+  uint32_t ackWatermark;               ///< Highest sequence number acknowledged by the server.
+  uint32_t nextSequence;               ///< Sequence number of the next record.
+  uint32_t resent;                     ///< Records sent again because no ack covered them.
+  uint32_t dropped;                    ///< Unacknowledged records dropped because the buffer was full.
+  uint32_t noAck;                      ///< Reports due while the watermark had not moved since the previous report.
+};
+
+/**
+ * @brief Asks the uplink task to send the device's MAC address to the API registration endpoint.
+ * Does not block: the task registers when the supervisor's next TOPIC_WIFI_STATE message
+ * wakes it and the supervisor is online.
+ */
+void requestRegistration();
+
+/**
+ * @brief Subscribes the uplink to TOPIC_SAMPLE and TOPIC_WIFI_STATE and starts the uplink task.
+ * @note Must be called after initEventBus() and before the sensor task starts publishing.
+ * @return true if the subscription and the task were created, false otherwise.
+ */
+bool startUplink();
+
+/**
+ * @brief Applies the server's control block, backfill request and alert rules, if the message carries them.
+ * Called for every upload response, and by push transports for every control message.
+ * @param response Body of a server response or a control message pushed by the server.
+ */
+void uplinkHandleDirectives(const String& response);
+
+/**
+ * @brief Tells whether a live upload or an alert is in progress.
+ * Lower-priority senders (backfill) wait while this returns true.
+ * @return true while a report or an alert is being sent.
+ */
+bool uplinkBusy();
+
+/**
+ * @brief Returns a snapshot of the live upload latency and delivery counters.
+ * @return Copy of the current statistics.
+ */
+UplinkStats uplinkGetStats();
+
+/**
+ * @brief FreeRTOS task function sending received samples to the API data endpoint.
+ * @param pvParameters Event bus subscriber handle (EventSubscriber*).
+ */
+void uplinkTaskFunction(void *pvParameters);
+
+#endif // UPLINK_H
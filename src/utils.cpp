@@ -1,91 +1,33 @@
 /**
  * @file utils.cpp
- * @brief Utility functions for LED control, file system operations, and button handling.
+ * @brief Utility functions for file system operations and button handling.
  *
- * This file implements functions for initializing and controlling the NeoPixel LED,
- * initializing the LittleFS file system and loading files from it, and a FreeRTOS
- * task for handling button presses to switch device modes or trigger actions.
+ * This file implements functions for initializing the LittleFS file system and
+ * loading files from it, and an interrupt-driven FreeRTOS task recognising button
+ * gestures. LED control lives in led_service.cpp.
  */
 #include "utils.h"
 #include "config.h"      
+#include "led_service.h"
+#include "supervisor.h"
+#include "button_gesture.h"
+#include "event_bus.h"
 #include <LittleFS.h>
-#include <NeoPixelBus.h> 
 #include <WiFi.h>        
 
-// --- Global Object & Color Definitions ---
-// Definition of the LED strip object
-NeoPixelBus<NeoGrbFeature, NeoEsp32LcdX8Ws2812xMethod> strip(PixelCount, PixelPin);
-RgbColor red(255, 0, 0);
-RgbColor green(0, 255, 0);
-RgbColor black(0, 0, 0);
-RgbColor blue(0, 0, 255);
-RgbColor yellow(255, 165, 0); 
-
 // --- Function Implementations ---
 
-// --- LED Control ---
-
-/**
- * @brief Initializes the NeoPixel LED strip.
- * Turns the LED off initially by setting it to black.
- */
-void setupLed() {
-    strip.Begin();
-    strip.Show(); // Initialize strip to black (off)
-}
-
-/**
- * @brief Sets the color of the single NeoPixel LED.
- * @param color The RgbColor to set.
- */
-void setLedColor(RgbColor color) {
-    strip.SetPixelColor(0, color);
-    strip.Show();
-}
-
-/**
- * @brief Blinks the LED red 3 times to indicate an error, then sets a final color.
- * @param finalColor The color to set the LED to after blinking.
- */
-void blinkLedError(RgbColor finalColor) {
-    for (int i = 0; i < 3; i++) {
-        setLedColor(red);
-        delay(150);
-        setLedColor(black);
-        delay(150);
-    }
-    setLedColor(finalColor);
-}
-
-/**
- * @brief Blinks the LED with a specified color and number of times, then sets a final color.
- * Used for informational signals.
- * @param blinkColor The color to blink.
- * @param times The number of times to blink.
- * @param finalColor The color to set the LED to after blinking.
- */
-void blinkLedInfo(RgbColor blinkColor, int times, RgbColor finalColor) {
-     for (int i = 0; i < times; i++) {
-        setLedColor(blinkColor);
-        delay(200);
-        setLedColor(black);
-        delay(200);
-    }
-    setLedColor(finalColor);
-}
-
-
 // --- File System ---
 
 /**
  * @brief Initializes the LittleFS file system.
- * Blinks red on critical failure to mount the file system.
+ * Shows the fatal LED pattern on critical failure to mount the file system.
  * @return true if LittleFS was mounted successfully, false otherwise.
  */
 bool initLittleFS() {
     if (!LittleFS.begin()) {
         Serial.println("!!! CRITICAL ERROR: Failed to mount LittleFS!");
-        blinkLedError(red); 
+        ledPlay(LED_PATTERN_FATAL);
         return false;
     }
     Serial.println("LittleFS mounted.");
@@ -117,6 +59,13 @@ String loadFile(const char* path) {
 
 // --- Button ---
 
+// Button timing (milliseconds)
+const uint32_t BUTTON_DEBOUNCE_MS = 30;
+const uint32_t BUTTON_LONG_PRESS_MS = 3000;
+const uint32_t BUTTON_DOUBLE_PRESS_GAP_MS = 400;
+
+static TaskHandle_t buttonTaskHandle = NULL;
+
 /**
  * @brief Initializes the button pin (BUTTON_PIN from config.h) as input with an internal pull-up resistor.
  */
@@ -124,54 +73,69 @@ void setupButton() {
     pinMode(BUTTON_PIN, INPUT_PULLUP);
 }
 
-#include "nvs_handler.h"
-#include "wifi_manager.h"
-#include "web_interface.h" 
+/**
+ * @brief GPIO interrupt handler for both edges of the button pin.
+ * Only wakes the button task; all debouncing happens in task context.
+ */
+static void IRAM_ATTR buttonIsr() {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(buttonTaskHandle, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) {
+        portYIELD_FROM_ISR();
+    }
+}
 
 /**
- * @brief FreeRTOS task to handle button presses.
- * Detects a button press (connected between BUTTON_PIN and GND).
- * If pressed while the device is in MODE_CONFIGURED, it clears the NVS configuration
- * and switches the device to AP mode with the web server running for reconfiguration.
- * If pressed in MODE_UNCONFIGURED (AP mode), it performs a minor action (blinks yellow).
- * Includes debounce logic to prevent multiple triggers from a single press.
+ * @brief Returns a printable name of a button gesture.
+ * @param gesture The gesture to name.
+ * @return Constant string with the gesture name.
+ */
+const char* buttonGestureName(ButtonGesture gesture) {
+    switch (gesture) {
+        case GESTURE_SHORT_PRESS: return "short press";
+        case GESTURE_DOUBLE_PRESS: return "double press";
+        case GESTURE_LONG_PRESS: return "long press";
+        default: return "none";
+    }
+}
+
+/**
+ * @brief FreeRTOS task to handle button gestures.
+ * The button (connected between BUTTON_PIN and GND) raises a GPIO interrupt on
+ * every edge, which notifies this task. While idle the task blocks indefinitely;
+ * after an edge it waits with a timeout equal to the next debounce, long-press
+ * or double-press deadline of the gesture detector. Recognised gestures are
+ * posted to the supervisor as EVENT_BUTTON_GESTURE, which maps them to actions,
+ * and published on TOPIC_BUTTON for any other interested component.
  * @param pvParameters Standard FreeRTOS task parameters (unused).
  */
 void buttonTask(void *pvParameters) {
     Serial.println("Button Task started.");
-    bool buttonWasPressed = false; 
+    ButtonGestureDetector detector(BUTTON_DEBOUNCE_MS, BUTTON_LONG_PRESS_MS, BUTTON_DOUBLE_PRESS_GAP_MS);
+
+    buttonTaskHandle = xTaskGetCurrentTaskHandle();
+    attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonIsr, CHANGE);
 
     for (;;) {
-        if (digitalRead(BUTTON_PIN) == LOW) { // Button pressed (active low due to INPUT_PULLUP)
-            if (!buttonWasPressed) { // Check if it's a new press event
-                buttonWasPressed = true;
-                vTaskDelay(pdMS_TO_TICKS(50)); // Debounce delay
-                if (digitalRead(BUTTON_PIN) == LOW) { // Confirm press after debounce
-                    Serial.println("Button press detected");
-
-                    if (currentDeviceMode == MODE_CONFIGURED) {
-                        Serial.println("Button pressed in configured mode -> Forcing AP mode and clearing NVS");
-
-                        clearConfigurationInNVS(); 
-                        switchToAPMode();          
-                        setupWebServer();        
-
-                    } else { // Button pressed in AP mode (MODE_UNCONFIGURED)
-                        Serial.println("Button pressed in AP mode (unconfigured) - no major action taken");
-                        blinkLedInfo(yellow, 1, yellow); // Visual feedback
-                    }
-                } else {
-                     // False positive during debounce (button released quickly)
-                     buttonWasPressed = false;
-                }
-            }
-            // If button is still held down, do nothing further until released
-        } else { // Button released
-            if (buttonWasPressed) {
-                Serial.println("Button released");
-                buttonWasPressed = false; 
+        uint32_t waitMs = detector.msUntilDeadline(millis());
+        TickType_t waitTicks = (waitMs == GESTURE_NO_DEADLINE) ? portMAX_DELAY : pdMS_TO_TICKS(waitMs);
+
+        if (ulTaskNotifyTake(pdTRUE, waitTicks) > 0) {
+            detector.onEdge(millis()); // Edge (or bounce): restart the debounce window
+            continue;
+        }
+
+        // Active low due to INPUT_PULLUP
+        ButtonGesture gesture = detector.poll(digitalRead(BUTTON_PIN) == LOW, millis());
+        if (gesture != GESTURE_NONE) {
+            Serial.printf("Button gesture detected: %s\n", buttonGestureName(gesture));
+            postSupervisorEvent(EVENT_BUTTON_GESTURE, gesture);
+
+            BusMessage* message = eventBusAcquire(TOPIC_BUTTON);
+            if (message != NULL) {
+                message->data.button.gesture = gesture;
+                eventBusPublish(message);
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(20)); 
     }
 }
\ No newline at end of file
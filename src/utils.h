@@ -1,43 +1,17 @@
 /**
  * @file utils.h
- * @brief Declarations for utility functions including LED control, file system operations, and button handling.
+ * @brief Declarations for utility functions including file system operations and button handling.
  *
- * This header file provides function prototypes for initializing and controlling
- * the NeoPixel LED, initializing the LittleFS file system, loading files,
- * setting up the input button, and the FreeRTOS task for button press detection
- * and handling.
+ * This header file provides function prototypes for initializing the LittleFS
+ * file system, loading files,
+ * setting up the input button, and the interrupt-driven FreeRTOS task for button
+ * gesture detection.
  */
 #ifndef UTILS_H
 #define UTILS_H
 
 #include "config.h" 
-
-// --- LED Control ---
-
-/**
- * @brief Initializes the NeoPixel LED strip.
- */
-void setupLed();
-
-/**
- * @brief Sets the color of the single NeoPixel LED.
- * @param color The RgbColor to set.
- */
-void setLedColor(RgbColor color);
-
-/**
- * @brief Blinks the LED red 3 times to indicate an error, then sets a final color.
- * @param finalColor The color to set the LED to after blinking (defaults to black/off).
- */
-void blinkLedError(RgbColor finalColor = black);
-
-/**
- * @brief Blinks the LED with a specified color and number of times, then sets a final color.
- * @param blinkColor The color to blink.
- * @param times The number of times to blink (defaults to 1).
- * @param finalColor The color to set the LED to after blinking (defaults to black/off).
- */
-void blinkLedInfo(RgbColor blinkColor, int times = 1, RgbColor finalColor = black);
+#include "button_gesture.h"
 
 // --- File System ---
 
@@ -62,7 +36,15 @@ String loadFile(const char* path);
 void setupButton();
 
 /**
- * @brief FreeRTOS task function to handle button presses for mode switching or configuration clearing.
+ * @brief Returns a printable name of a button gesture.
+ * @param gesture The gesture to name.
+ * @return Constant string with the gesture name.
+ */
+const char* buttonGestureName(ButtonGesture gesture);
+
+/**
+ * @brief FreeRTOS task function woken by the button interrupt; recognises gestures
+ * (short, double, long press) and posts them to the supervisor.
  * @param pvParameters Standard FreeRTOS task parameters (unused).
  */
 void buttonTask(void *pvParameters); // Button handling task
@@ -4,39 +4,47 @@
  *
  * This file implements the web server setup, endpoint handlers for serving
  * HTML/CSS content, processing configuration form submissions (Wi-Fi credentials,
- * server details), and managing the web server lifecycle (start/stop).
- * It facilitates device configuration when in Access Point (AP) mode.
+ * server details). The handlers run on the shared HTTP server (see http_server.h)
+ * and answer only while the device is in Access Point (AP) mode.
  */
 #include "web_interface.h"
 #include "config.h"       
 #include "utils.h"        
 #include "wifi_manager.h" 
-#include "nvs_handler.h"  
-#include "data_sender.h"  
+#include "supervisor.h"   
+#include "http_server.h"
+#include "alloc_trace.h"
+#include "fanout.h"
 #include <WiFi.h>         
 #include <ESPmDNS.h>      
 
-// --- Global Objects ---
-WebServer server(80);
-
 // --- Web Server Endpoint Handlers ---
 
 /**
  * @brief Handles requests to the root path ("/").
  * Loads index.html, injects the current server address, scans for WiFi networks,
  * populates the network list, and sends the configuration page to the client.
+ * Outside AP mode the client is redirected to the live view.
  */
-void handleRoot() {
+esp_err_t handleRoot(httpd_req_t* request) {
+    ALLOC_TRACE_SCOPE("handleRoot");
+    if (getSupervisorState() != STATE_PROVISIONING) {
+        httpd_resp_set_status(request, "302 Found");
+        httpd_resp_set_hdr(request, "Location", "/live");
+        return httpd_resp_send(request, NULL, 0);
+    }
     Serial.println("Handling request for /");
     String html = loadFile("/index.html"); 
     if (html.length() == 0) {
-        server.send(500, "text/plain", "Server Error: Could not load index.html"); 
-        return;
+        return httpd_resp_send_err(request, HTTPD_500_INTERNAL_SERVER_ERROR, "Server Error: Could not load index.html");
     }
 
     // Insert the current server address as the default value in the form
     String valueAttribute = "value=\"" + serverAddress + "\"";
     html.replace("{{SERVER_ADDRESS_VALUE}}", valueAttribute);
+    String destinationsValue = fanoutGetDestinations();
+    destinationsValue.replace("\"", "&quot;");
+    html.replace("{{DESTINATIONS_VALUE}}", "value=\"" + destinationsValue + "\"");
 
     // Generate WiFi list dropdown
     String wifiList = "<select name=\"ssid\" id=\"ssid\" required>"; 
@@ -76,116 +84,93 @@ void handleRoot() {
     wifiList += "</select>";
     html.replace("{{WIFI_LIST}}", wifiList);
 
-    server.send(200, "text/html", html);
+    httpd_resp_set_type(request, "text/html");
+    esp_err_t result = httpd_resp_send(request, html.c_str(), html.length());
 
     if (WiFi.scanComplete() != WIFI_SCAN_RUNNING) {
         startWifiScan();
     }
+    return result;
 }
 
 /**
  * @brief Handles requests for the CSS file ("/style.css").
- * Loads style.css from LittleFS and sends it with the correct content type.
+ * Streams style.css from LittleFS with the correct content type (also used by the live view).
  */
-void handleCss() {
-    Serial.println("Handling request for /style.css");
-    String css = loadFile("/style.css");
-     if (css.length() == 0) {
-        server.send(404, "text/plain", "File style.css not found"); 
-        return;
-    }
-    server.send(200, "text/css", css);
+esp_err_t handleCss(httpd_req_t* request) {
+    return httpServerSendFile(request, "/style.css", "text/css");
 }
 
 /**
  * @brief Handles the POST request to "/connect" when the configuration form is submitted.
- * Reads SSID, password, username, and server address. Sends an intermediate HTML page
- * with a JavaScript alert (in Polish), then stops the web server and AP mode,
- * attempts to connect to the specified WiFi network, saves the configuration to NVS
- * on success, and handles connection failures by reverting to AP mode.
+ * Reads SSID, password, username, server address and the optional extra destinations. Sends an intermediate HTML page
+ * with a JavaScript alert (in Polish) and posts EVENT_CONFIG_SUBMITTED with the parsed
+ * values. The supervisor then applies them, stops AP mode, connects to the specified WiFi network, saves
+ * the configuration to NVS on success, and reverts to AP mode on failure.
+ * The handler returns at once; the connection attempt runs in the supervisor task.
  */
-void handleConnect() {
+esp_err_t handleConnect(httpd_req_t* request) {
+    ALLOC_TRACE_SCOPE("handleConnect");
     Serial.println("Handling POST request for /connect");
-    if (!server.hasArg("ssid") || !server.hasArg("pass") || !server.hasArg("username") || !server.hasArg("serveraddr")) {
-        server.send(400, "text/plain", "Missing required form data."); 
-        return;
+    if (getSupervisorState() != STATE_PROVISIONING) {
+        httpd_resp_set_status(request, "409 Conflict");
+        return httpd_resp_send(request, "Configuration is accepted in AP mode only.", HTTPD_RESP_USE_STRLEN);
+    }
+    String body;
+    if (!httpServerReadBody(request, body)) {
+        return ESP_FAIL;
+    }
+    // Parsed into a private copy: the configuration globals are read by other
+    // tasks and are written by the supervisor only.
+    PortalConfig* config = new PortalConfig();
+    if (!httpFormValue(body, "ssid", config->ssid) || !httpFormValue(body, "pass", config->pass) ||
+        !httpFormValue(body, "username", config->userName) || !httpFormValue(body, "serveraddr", config->serverAddress)) {
+        delete config;
+        return httpd_resp_send_err(request, HTTPD_400_BAD_REQUEST, "Missing required form data.");
+    }
+    if (!httpFormValue(body, "destinations", config->destinations)) { // Optional
+        config->destinations = "";
     }
-    wifiSSID = server.arg("ssid");
-    wifiPass = server.arg("pass");
-    userName = server.arg("username");
-    serverAddress = server.arg("serveraddr");
-
-    Serial.printf("Received data:\n SSID: %s\n Password: [HIDDEN]\n User: %s\n Server Address: %s\n",
-                  wifiSSID.c_str(), userName.c_str(), serverAddress.c_str());
 
     String initialResponseHtml = "<!DOCTYPE html><html lang=\"pl\"><head><meta charset=\"UTF-8\"><link rel=\"stylesheet\" href=\"/style.css\"><title>Laczenie...</title></head><body><div class=\"container\">";
     initialResponseHtml += "<h1>Próba połączenia...</h1>";
-    initialResponseHtml += "<p>Odebrano dane konfiguracyjne dla sieci: <strong>" + wifiSSID + "</strong>.</p>";
+    initialResponseHtml += "<p>Odebrano dane konfiguracyjne dla sieci: <strong>" + config->ssid + "</strong>.</p>";
     initialResponseHtml += "<p>Za chwilę punkt dostępowy (AP) zostanie wyłączony, a urządzenie spróbuje połączyć się z wybraną siecią.</p>";
     initialResponseHtml += "<p><strong>Twoje urządzenie zostanie rozłączone z siecią AP ESP32.</strong></p>";
     initialResponseHtml += "<p>Obserwuj diodę LED urządzenia, aby poznać status połączenia (Zielony=OK, Żółty=Spróbuj ponownie).</p>";
     initialResponseHtml += "</div>";
     initialResponseHtml += "<script>";
-    initialResponseHtml += "alert('Rozpoczynam próbę połączenia z siecią \"" + wifiSSID + "\".\\n\\nPunkt dostępowy ESP32 zostanie TERAZ wyłączony.\\n\\nTwoje urządzenie straci połączenie z tą siecią konfiguracyjną.\\n\\nKliknij OK, a następnie obserwuj diodę LED urządzenia (Zielony=OK, Żółty=Spróbuj ponownie) aby poznać wynik.');";
+    initialResponseHtml += "alert('Rozpoczynam próbę połączenia z siecią \"" + config->ssid + "\".\\n\\nPunkt dostępowy ESP32 zostanie TERAZ wyłączony.\\n\\nTwoje urządzenie straci połączenie z tą siecią konfiguracyjną.\\n\\nKliknij OK, a następnie obserwuj diodę LED urządzenia (Zielony=OK, Żółty=Spróbuj ponownie) aby poznać wynik.');";
     initialResponseHtml += "setTimeout(function(){ window.location.href = '/'; }, 2000);"; // Attempt to redirect client after 2s
     initialResponseHtml += "</script>";
     initialResponseHtml += "</body></html>";
 
-    server.send(200, "text/html", initialResponseHtml);
+    httpd_resp_set_type(request, "text/html");
+    esp_err_t result = httpd_resp_send(request, initialResponseHtml.c_str(), initialResponseHtml.length());
     Serial.println("Sent information page with JS alert() to the browser.");
-    Serial.println("Stopping HTTP server and MDNS...");
-    stopWebServerAndMDNS();
-    Serial.println("HTTP server and MDNS stopped.");
-
-    Serial.println("Disconnecting AP and attempting connection in STA mode...");
-    if (connectToWiFi()) { // connectToWiFi handles LED status and WiFi mode changes
-        saveConfigurationToNVS();
-        sendMacAddress();
-    } else {
-        // Connection failed
-        Serial.println("Failed to connect. Returning to AP mode.");
-        clearConfigurationInNVS(); 
-        switchToAPMode();
-        setupWebServer(); 
-    }
+    postConfigSubmitted(config);
+    return result;
 }
 
 // --- Web Server Management ---
 
 /**
- * @brief Configures and starts the web server in AP mode.
- * Sets up handlers for the root path ("/"), CSS file ("/style.css"),
- * and the connection form submission ("/connect"). Includes a 404 handler.
+ * @brief Registers the portal handlers for the root path ("/"), the CSS file
+ * ("/style.css") and the connection form submission ("/connect").
+ * Requests for other paths are answered with 404 by the server.
  */
 void setupWebServer() {
-    Serial.println("Configuring Web Server...");
-    server.on("/", HTTP_GET, handleRoot);
-    server.on("/style.css", HTTP_GET, handleCss);
-    server.on("/connect", HTTP_POST, handleConnect);
-    server.onNotFound([]() {
-        server.send(404, "text/plain", "404: Not Found"); 
-    });
-
-    server.begin();
-    Serial.println("HTTP server started.");
-}
-
-/**
- * @brief Handles incoming web server client requests.
- * This function should be called repeatedly in the main loop()
- * when the device is in AP mode (MODE_UNCONFIGURED).
- */
-void handleWebServerClient() {
-    server.handleClient();
+    httpServerOn("/", HTTP_GET, handleRoot);
+    httpServerOn("/style.css", HTTP_GET, handleCss);
+    httpServerOn("/connect", HTTP_POST, handleConnect);
 }
 
 /**
- * @brief Stops the web server and the mDNS service.
- * Called before attempting to switch from AP to STA mode.
+ * @brief Stops the mDNS service of the portal.
+ * Called before attempting to switch from AP to STA mode. The HTTP server keeps
+ * running for the local APIs; the portal handlers answer only in AP mode.
  */
-void stopWebServerAndMDNS() {
-    Serial.println("Stopping Web Server and MDNS...");
-    server.stop();
+void stopPortalMDNS() {
     MDNS.end(); 
-    Serial.println("Web Server and MDNS stopped.");
-}
\ No newline at end of file
+    Serial.println("Portal MDNS stopped.");
+}
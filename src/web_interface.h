@@ -2,9 +2,9 @@
  * @file web_interface.h
  * @brief Declarations for web server interface management functions.
  *
- * This header file provides function prototypes for setting up, handling client
- * requests, and stopping the web server used for device configuration when
- * in Access Point (AP) mode.
+ * This header file provides function prototypes for registering the configuration
+ * portal on the shared HTTP server (see http_server.h) and for stopping its mDNS
+ * service. The portal pages answer only in Access Point (AP) mode.
  */
 #ifndef WEB_INTERFACE_H
 #define WEB_INTERFACE_H
@@ -12,22 +12,16 @@
 #include "config.h" 
 
 /**
- * @brief Configures and starts the web server.
- * Defines HTTP endpoints for configuration via web interface.
+ * @brief Registers the portal handlers on the HTTP server.
+ * @note Called once from setup(); the supervisor starts the server.
  */
 void setupWebServer();
 
 /**
- * @brief Handles incoming client requests on the web server.
- * @note Should be called repeatedly in the main loop() when the server is active (AP mode).
- */
-void handleWebServerClient();
-
-/**
- * @brief Stops the web server and the mDNS service.
+ * @brief Stops the mDNS service of the portal.
  * Usually called before switching from AP mode to STA mode.
  */
-void stopWebServerAndMDNS();
+void stopPortalMDNS();
 
 
 #endif // WEB_INTERFACE_H
\ No newline at end of file
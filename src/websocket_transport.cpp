@@ -0,0 +1,557 @@
+/**
+ * @file websocket_transport.cpp
+ * @brief RFC 6455 WebSocket client over WiFiClient: handshake, framing,
+ * ping/pong liveness and reconnection with backoff.
+ *
+ * Frame layout:
+ *
+ *     | FIN RSV opcode | MASK len7 | len16/len64 | masking key (client only) | payload |
+ *
+ * The WebSocket task owns the connection: it connects, reads every frame and
+ * sends pings. Other tasks only write data frames. Reads and writes of whole
+ * frames are serialized by the connection mutex, so frames never interleave
+ * on the socket.
+ */
+#include "websocket_transport.h"
+
+#if WS_TRANSPORT_WEBSOCKET
+#include "dns_cache.h"
+#include "discovery.h"
+#include "supervisor.h"
+#include "uplink.h"
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <esp_system.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// --- Protocol Constants ---
+const uint8_t WS_OPCODE_CONTINUATION = 0x0;
+const uint8_t WS_OPCODE_TEXT = 0x1;
+const uint8_t WS_OPCODE_BINARY = 0x2;
+const uint8_t WS_OPCODE_CLOSE = 0x8;
+const uint8_t WS_OPCODE_PING = 0x9;
+const uint8_t WS_OPCODE_PONG = 0xA;
+const uint8_t WS_FIN = 0x80;
+const uint8_t WS_MASK = 0x80;
+const char* const WS_ACCEPT_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// --- Client Configuration ---
+const uint16_t WEBSOCKET_DEFAULT_PORT = 80;
+const size_t WEBSOCKET_MAX_MESSAGE = 4096;       // Longer control messages are dropped
+const uint32_t WEBSOCKET_HANDSHAKE_TIMEOUT_MS = 5000;
+const uint32_t WEBSOCKET_FRAME_TIMEOUT_MS = 2000; // Time to receive the rest of a frame once its header arrived
+const uint32_t WEBSOCKET_POLL_MS = 20;            // Receive poll period of the task
+const uint32_t WEBSOCKET_OFFLINE_POLL_MS = 1000;  // Poll period while the station is offline
+const uint32_t WEBSOCKET_CONNECT_POLL_MS = 20;    // Poll period while a send waits for the connection
+
+// --- Connection State ---
+static WiFiClient client;
+static SemaphoreHandle_t connectionMutex = NULL; // Serializes frames on the socket and closing it
+static std::atomic<bool> connected(false);
+static String connectedAddress;                  // Server address of the open connection
+
+// --- Message Reassembly (WebSocket task only) ---
+static String message;                           // Data frames of the current message
+static bool messageDropped = false;              // The current message exceeded WEBSOCKET_MAX_MESSAGE
+
+// --- Liveness (WebSocket task only) ---
+static uint32_t lastReceiveMs = 0;
+static uint32_t pingSentMs = 0;
+static bool pingOutstanding = false;
+
+static WebSocketStats stats = {};
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- Framing ---
+
+/**
+ * @brief Writes one masked frame; the caller holds the connection mutex.
+ * The payload is masked in small chunks, so it is never copied as a whole.
+ * @param opcode Frame opcode; the frame is always final.
+ * @param payload Payload bytes.
+ * @param length Payload length.
+ * @return true if the whole frame was written.
+ */
+static bool writeFrame(uint8_t opcode, const uint8_t* payload, size_t length) {
+    uint8_t header[14];
+    size_t headerLength = 0;
+    header[headerLength++] = WS_FIN | opcode;
+    if (length < 126) {
+        header[headerLength++] = WS_MASK | (uint8_t)length;
+    } else if (length <= 0xFFFF) {
+        header[headerLength++] = WS_MASK | 126;
+        header[headerLength++] = (uint8_t)(length >> 8);
+        header[headerLength++] = (uint8_t)length;
+    } else {
+        header[headerLength++] = WS_MASK | 127;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            header[headerLength++] = (uint8_t)((uint64_t)length >> shift);
+        }
+    }
+    uint32_t maskValue = esp_random();
+    uint8_t* mask = &header[headerLength];
+    memcpy(mask, &maskValue, 4);
+    headerLength += 4;
+    if (client.write(header, headerLength) != headerLength) {
+        return false;
+    }
+
+    uint8_t chunk[128];
+    for (size_t offset = 0; offset < length; offset += sizeof(chunk)) {
+        size_t chunkLength = length - offset < sizeof(chunk) ? length - offset : sizeof(chunk);
+        for (size_t i = 0; i < chunkLength; i++) {
+            chunk[i] = payload[offset + i] ^ mask[(offset + i) & 3];
+        }
+        if (client.write(chunk, chunkLength) != chunkLength) {
+            return false;
+        }
+    }
+
+    portENTER_CRITICAL(&statsLock);
+    stats.bytesSent += headerLength + length;
+    portEXIT_CRITICAL(&statsLock);
+    return true;
+}
+
+/**
+ * @brief Reads exactly length bytes, waiting at most until the deadline.
+ * @return true if all bytes were read.
+ */
+static bool readExactly(uint8_t* buffer, size_t length, uint32_t startMs) {
+    size_t received = 0;
+    while (received < length) {
+        int count = client.available() > 0 ? client.read(buffer + received, length - received) : 0;
+        if (count > 0) {
+            received += count;
+        } else if (!client.connected() || millis() - startMs >= WEBSOCKET_FRAME_TIMEOUT_MS) {
+            return false;
+        } else {
+            vTaskDelay(1);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Closes the connection; the caller holds the connection mutex.
+ * @param sendClose true to send a close frame first.
+ */
+static void closeConnection(bool sendClose) {
+    if (sendClose && client.connected()) {
+        const uint8_t normalClosure[2] = {0x03, 0xE8}; // 1000
+        writeFrame(WS_OPCODE_CLOSE, normalClosure, sizeof(normalClosure));
+    }
+    client.stop();
+    message = "";
+    messageDropped = false;
+    if (connected.exchange(false)) {
+        Serial.println("WebSocket: Disconnected.");
+    }
+}
+
+// --- Handshake ---
+
+/**
+ * @brief Computes the Sec-WebSocket-Accept value expected for a key.
+ * @param key The Sec-WebSocket-Key sent by the client.
+ * @return Base64 of SHA-1(key + GUID).
+ */
+static String expectedAccept(const String& key) {
+    String input = key + WS_ACCEPT_GUID;
+    uint8_t digest[20];
+    mbedtls_sha1_ret((const unsigned char*)input.c_str(), input.length(), digest);
+    unsigned char encoded[32];
+    size_t encodedLength = 0;
+    mbedtls_base64_encode(encoded, sizeof(encoded), &encodedLength, digest, sizeof(digest));
+    encoded[encodedLength] = '\0';
+    return String((const char*)encoded);
+}
+
+/**
+ * @brief Connects to the server and performs the opening handshake.
+ * @param address Server address (host or host:port).
+ * @return true if the server accepted the upgrade.
+ */
+static bool openConnection(const String& address) {
+    String host = address;
+    uint16_t port = WEBSOCKET_DEFAULT_PORT;
+    int colon = address.indexOf(':');
+    if (colon >= 0) {
+        host = address.substring(0, colon);
+        port = (uint16_t)address.substring(colon + 1).toInt();
+    }
+    String path = apiWebSocketPath;
+    path.replace("<mac_plytki>", WiFi.macAddress());
+
+    IPAddress ip;
+    if (!dnsCacheResolve(host, ip) || !client.connect(ip, port, (int32_t)WEBSOCKET_HANDSHAKE_TIMEOUT_MS)) {
+        Serial.printf("WebSocket: Cannot connect to %s.\n", address.c_str());
+        return false;
+    }
+    client.setNoDelay(true);
+
+    uint8_t nonce[16];
+    esp_fill_random(nonce, sizeof(nonce));
+    unsigned char keyBuffer[32];
+    size_t keyLength = 0;
+    mbedtls_base64_encode(keyBuffer, sizeof(keyBuffer), &keyLength, nonce, sizeof(nonce));
+    keyBuffer[keyLength] = '\0';
+    String key = (const char*)keyBuffer;
+
+    String request = "GET " + path + " HTTP/1.1\r\n";
+    request += "Host: " + address + "\r\n";
+    request += "Upgrade: websocket\r\n";
+    request += "Connection: Upgrade\r\n";
+    request += "Sec-WebSocket-Key: " + key + "\r\n";
+    request += "Sec-WebSocket-Version: 13\r\n\r\n";
+    client.print(request);
+
+    // Status line and headers, up to the empty line
+    bool switching = false;
+    bool accepted = false;
+    bool firstLine = true;
+    uint32_t start = millis();
+    for (;;) {
+        if (millis() - start >= WEBSOCKET_HANDSHAKE_TIMEOUT_MS || !client.connected()) {
+            break;
+        }
+        if (client.available() <= 0) {
+            vTaskDelay(pdMS_TO_TICKS(WEBSOCKET_POLL_MS));
+            continue;
+        }
+        String line = client.readStringUntil('\n');
+        line.trim();
+        if (firstLine) {
+            switching = line.startsWith("HTTP/1.1 101");
+            firstLine = false;
+            continue;
+        }
+        if (line.length() == 0) {
+            if (switching && accepted) {
+                return true;
+            }
+            break;
+        }
+        int separator = line.indexOf(':');
+        if (separator > 0) {
+            String name = line.substring(0, separator);
+            String value = line.substring(separator + 1);
+            value.trim();
+            if (name.equalsIgnoreCase("Sec-WebSocket-Accept") && value == expectedAccept(key)) {
+                accepted = true;
+            }
+        }
+    }
+    Serial.printf("WebSocket: Handshake with %s failed (%s).\n", address.c_str(),
+                  switching ? "bad accept key" : "no upgrade");
+    client.stop();
+    return false;
+}
+
+// --- Receiving ---
+
+/**
+ * @brief Reads one frame if its header is available; the caller holds the connection mutex.
+ * Control frames are answered here. A complete data message is moved to
+ * complete for the caller to handle after releasing the mutex.
+ * @param complete Receives a complete data message.
+ * @return false if the connection has to be closed.
+ */
+static bool receiveFrame(String& complete) {
+    if (client.available() < 2) {
+        return client.connected();
+    }
+    uint32_t start = millis();
+    uint8_t header[2];
+    if (!readExactly(header, 2, start)) {
+        return false;
+    }
+    bool fin = header[0] & WS_FIN;
+    uint8_t opcode = header[0] & 0x0F;
+    uint64_t length = header[1] & 0x7F;
+    if (header[1] & WS_MASK) {
+        Serial.println("WebSocket: Masked frame from server, closing.");
+        return false;
+    }
+    if (length == 126 || length == 127) {
+        uint8_t extended[8];
+        size_t extendedLength = length == 126 ? 2 : 8;
+        if (!readExactly(extended, extendedLength, start)) {
+            return false;
+        }
+        length = 0;
+        for (size_t i = 0; i < extendedLength; i++) {
+            length = (length << 8) | extended[i];
+        }
+    }
+    bool control = opcode & 0x08;
+    if (control && (length > 125 || !fin)) {
+        Serial.println("WebSocket: Invalid control frame, closing.");
+        return false;
+    }
+
+    bool keep = !control && !messageDropped && message.length() + length <= WEBSOCKET_MAX_MESSAGE;
+    uint8_t controlPayload[125];
+    uint8_t chunk[128];
+    for (uint64_t received = 0; received < length;) {
+        size_t chunkLength = length - received < sizeof(chunk) ? (size_t)(length - received) : sizeof(chunk);
+        uint8_t* target = control ? controlPayload + received : chunk;
+        if (!readExactly(target, chunkLength, start)) {
+            return false;
+        }
+        if (keep) {
+            for (size_t i = 0; i < chunkLength; i++) {
+                message += (char)chunk[i];
+            }
+        }
+        received += chunkLength;
+    }
+    lastReceiveMs = millis();
+    portENTER_CRITICAL(&statsLock);
+    stats.bytesReceived += 2 + (length >= 126 ? (length > 0xFFFF ? 8 : 2) : 0) + (uint32_t)length;
+    portEXIT_CRITICAL(&statsLock);
+
+    switch (opcode) {
+        case WS_OPCODE_PING:
+            return writeFrame(WS_OPCODE_PONG, controlPayload, (size_t)length);
+        case WS_OPCODE_PONG:
+            if (pingOutstanding) {
+                uint32_t rttMs = millis() - pingSentMs;
+                pingOutstanding = false;
+                portENTER_CRITICAL(&statsLock);
+                stats.pongs++;
+                stats.rttMsLast = rttMs;
+                if (rttMs > stats.rttMsMax) {
+                    stats.rttMsMax = rttMs;
+                }
+                portEXIT_CRITICAL(&statsLock);
+            }
+            return true;
+        case WS_OPCODE_CLOSE:
+            Serial.println("WebSocket: Server closed the connection.");
+            writeFrame(WS_OPCODE_CLOSE, controlPayload, length >= 2 ? 2 : 0); // Echo the status code
+            return false;
+        case WS_OPCODE_TEXT:
+        case WS_OPCODE_BINARY:
+        case WS_OPCODE_CONTINUATION:
+            if (!keep) {
+                messageDropped = true;
+            }
+            if (fin) {
+                if (messageDropped) {
+                    Serial.printf("WebSocket: Control message longer than %u bytes dropped.\n", (unsigned)WEBSOCKET_MAX_MESSAGE);
+                } else {
+                    complete = message;
+                    portENTER_CRITICAL(&statsLock);
+                    stats.framesReceived++;
+                    portEXIT_CRITICAL(&statsLock);
+                }
+                message = "";
+                messageDropped = false;
+            }
+            return true;
+        default:
+            Serial.printf("WebSocket: Unknown opcode 0x%X, closing.\n", opcode);
+            return false;
+    }
+}
+
+// --- Task ---
+
+/**
+ * @brief FreeRTOS task owning the connection.
+ * Connects while the station is online, applies pushed control messages,
+ * keeps the connection alive with pings and reconnects with backoff.
+ * @param pvParameters Unused.
+ */
+static void webSocketTask(void* pvParameters) {
+    uint32_t backoffMs = WEBSOCKET_BACKOFF_MIN_MS;
+    uint32_t retryAtMs = 0;
+    bool retryPending = false;
+
+    for (;;) {
+        String address = activeServerAddress();
+        bool online = getSupervisorState() == STATE_ONLINE && address.length() > 0;
+        if (!connected.load()) {
+            if (!online || (retryPending && (int32_t)(millis() - retryAtMs) < 0)) {
+                vTaskDelay(pdMS_TO_TICKS(online ? WEBSOCKET_POLL_MS * 5 : WEBSOCKET_OFFLINE_POLL_MS));
+                continue;
+            }
+            xSemaphoreTake(connectionMutex, portMAX_DELAY);
+            bool opened = openConnection(address);
+            if (opened) {
+                connectedAddress = address;
+                lastReceiveMs = millis();
+                pingOutstanding = false;
+                connected.store(true);
+            }
+            xSemaphoreGive(connectionMutex);
+
+            portENTER_CRITICAL(&statsLock);
+            if (opened) {
+                stats.connects++;
+            } else {
+                stats.connectFailures++;
+            }
+            portEXIT_CRITICAL(&statsLock);
+
+            if (opened) {
+                Serial.printf("WebSocket: Connected to %s.\n", connectedAddress.c_str());
+                backoffMs = WEBSOCKET_BACKOFF_MIN_MS;
+                retryPending = false;
+            } else {
+                // Retry after half the backoff plus a random part of the other half, so stations do not reconnect in step
+                uint32_t delayMs = backoffMs / 2 + esp_random() % (backoffMs / 2 + 1);
+                Serial.printf("WebSocket: Retrying in %lu ms.\n", (unsigned long)delayMs);
+                retryAtMs = millis() + delayMs;
+                retryPending = true;
+                backoffMs = backoffMs * 2 > WEBSOCKET_BACKOFF_MAX_MS ? WEBSOCKET_BACKOFF_MAX_MS : backoffMs * 2;
+            }
+            continue;
+        }
+
+        String complete;
+        bool drop = false;
+        bool pending = false;
+        xSemaphoreTake(connectionMutex, portMAX_DELAY);
+        if (!online || connectedAddress != address) {
+            closeConnection(true);
+        } else if (!receiveFrame(complete)) {
+            closeConnection(false);
+            drop = true;
+        } else if (pingOutstanding && millis() - pingSentMs >= WEBSOCKET_PONG_TIMEOUT_MS) {
+            Serial.println("WebSocket: No pong, dropping the connection.");
+            closeConnection(false);
+            drop = true;
+            portENTER_CRITICAL(&statsLock);
+            stats.livenessDrops++;
+            portEXIT_CRITICAL(&statsLock);
+        } else if (!pingOutstanding && millis() - lastReceiveMs >= WEBSOCKET_PING_INTERVAL_MS) {
+            uint32_t now = millis();
+            if (writeFrame(WS_OPCODE_PING, (const uint8_t*)&now, sizeof(now))) {
+                pingSentMs = now;
+                pingOutstanding = true;
+                portENTER_CRITICAL(&statsLock);
+                stats.pings++;
+                portEXIT_CRITICAL(&statsLock);
+            } else {
+                closeConnection(false);
+                drop = true;
+            }
+        }
+        pending = connected.load() && client.available() >= 2;
+        xSemaphoreGive(connectionMutex);
+
+        if (drop) {
+            // A lost connection is retried after the shortest backoff
+            retryAtMs = millis() + WEBSOCKET_BACKOFF_MIN_MS;
+            retryPending = true;
+        }
+        if (complete.length() > 0) {
+            DEBUG_PRINTF("WebSocket: Control message (%u bytes) received.\n", complete.length());
+            uplinkHandleDirectives(complete);
+        }
+        if (complete.length() == 0 && !pending) {
+            vTaskDelay(pdMS_TO_TICKS(WEBSOCKET_POLL_MS));
+        }
+    }
+}
+
+// --- Public API ---
+
+/**
+ * @brief Creates the connection lock and starts the WebSocket task.
+ * @return true on success.
+ */
+bool startWebSocketTransport() {
+    connectionMutex = xSemaphoreCreateMutex();
+    if (connectionMutex == NULL) {
+        return false;
+    }
+    return xTaskCreatePinnedToCore(
+        webSocketTask, "WebSocketTask", 6144, NULL, 2, NULL, APP_CPU_NUM) == pdPASS;
+}
+
+/**
+ * @brief Sends a payload upstream as one text frame.
+ * Waits up to timeoutMs for the connection if it is not open.
+ * @param channel Channel of the payload, e.g. "data".
+ * @param payload JSON payload.
+ * @param timeoutMs Maximum time to wait for the connection and for the socket.
+ * @return 200 when the frame was written, a negative WEBSOCKET_ERROR_* code otherwise.
+ */
+int webSocketSend(const char* channel, const String& payload, uint32_t timeoutMs) {
+    if (connectionMutex == NULL) {
+        return WEBSOCKET_ERROR_NOT_CONNECTED;
+    }
+    uint32_t start = millis();
+    while (!connected.load()) {
+        if (millis() - start >= timeoutMs) {
+            return WEBSOCKET_ERROR_NOT_CONNECTED;
+        }
+        vTaskDelay(pdMS_TO_TICKS(WEBSOCKET_CONNECT_POLL_MS));
+    }
+
+    String frame;
+    frame.reserve(payload.length() + strlen(channel) + 20);
+    frame = "{\"ch\":\"";
+    frame += channel;
+    frame += "\",\"body\":";
+    frame += payload;
+    frame += '}';
+
+    uint32_t waitedMs = millis() - start;
+    if (waitedMs >= timeoutMs || xSemaphoreTake(connectionMutex, pdMS_TO_TICKS(timeoutMs - waitedMs)) != pdTRUE) {
+        return WEBSOCKET_ERROR_BUSY;
+    }
+    int result = WEBSOCKET_ERROR_NOT_CONNECTED;
+    if (connected.load()) {
+        if (writeFrame(WS_OPCODE_TEXT, (const uint8_t*)frame.c_str(), frame.length())) {
+            result = 200;
+        } else {
+            closeConnection(false); // The task sees the closed connection and reconnects
+            result = WEBSOCKET_ERROR_WRITE;
+        }
+    }
+    xSemaphoreGive(connectionMutex);
+
+    if (result == 200) {
+        portENTER_CRITICAL(&statsLock);
+        stats.framesSent++;
+        portEXIT_CRITICAL(&statsLock);
+    }
+    return result;
+}
+
+/**
+ * @brief Returns a description of a WEBSOCKET_ERROR_* code.
+ * @param code The code.
+ * @return Printable description.
+ */
+String webSocketErrorToString(int code) {
+    switch (code) {
+        case WEBSOCKET_ERROR_NOT_CONNECTED: return "not connected to server";
+        case WEBSOCKET_ERROR_BUSY: return "connection busy";
+        case WEBSOCKET_ERROR_WRITE: return "write failed";
+        default: return String("WebSocket error ") + code;
+    }
+}
+
+/**
+ * @brief Returns a snapshot of the WebSocket counters.
+ * @return Copy of the current statistics.
+ */
+WebSocketStats webSocketGetStats() {
+    portENTER_CRITICAL(&statsLock);
+    WebSocketStats snapshot = stats;
+    portEXIT_CRITICAL(&statsLock);
+    snapshot.connected = connected.load();
+    return snapshot;
+}
+
+#endif // WS_TRANSPORT_WEBSOCKET
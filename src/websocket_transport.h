@@ -0,0 +1,74 @@
+/**
+ * @file websocket_transport.h
+ * @brief Declarations for the WebSocket uplink used by WebSocketTransport (WS_TRANSPORT_WEBSOCKET).
+ *
+ * The WebSocket task keeps one connection to ws://<serverAddress><apiWebSocketPath>
+ * open while the station is online. Uploads are sent upstream as text frames
+ * carrying {"ch":"<channel>","body":<payload>}; the payload must be JSON.
+ * Every text frame the server pushes downstream is a control message with the
+ * same content as an upload response (control block, backfill request, alert
+ * rules) and is applied as soon as it arrives.
+ *
+ * The task pings the server when nothing was received for
+ * WEBSOCKET_PING_INTERVAL_MS and drops the connection if the pong does not
+ * arrive within WEBSOCKET_PONG_TIMEOUT_MS. Failed connections are retried
+ * after a delay that doubles from WEBSOCKET_BACKOFF_MIN_MS up to
+ * WEBSOCKET_BACKOFF_MAX_MS, with random jitter.
+ */
+#ifndef WEBSOCKET_TRANSPORT_H
+#define WEBSOCKET_TRANSPORT_H
+
+#include "config.h"
+
+// --- Error Codes (negative, like HTTPClient errors) ---
+constexpr int WEBSOCKET_ERROR_NOT_CONNECTED = -1;
+constexpr int WEBSOCKET_ERROR_BUSY = -2;
+constexpr int WEBSOCKET_ERROR_WRITE = -3;
+
+/** @brief Counters of the WebSocket uplink. */
+struct WebSocketStats {
+  uint32_t framesSent;        ///< Data frames sent (uploads).
+  uint32_t framesReceived;    ///< Data frames received (control messages).
+  uint32_t bytesSent;         ///< Bytes written to the socket, including frame headers and control frames.
+  uint32_t bytesReceived;     ///< Bytes read from the socket after the handshake.
+  uint32_t pings;             ///< Pings sent.
+  uint32_t pongs;             ///< Pongs received for them.
+  uint32_t rttMsLast;         ///< Last ping round-trip time [ms].
+  uint32_t rttMsMax;          ///< Maximum ping round-trip time [ms].
+  uint32_t connects;          ///< Successful handshakes.
+  uint32_t connectFailures;   ///< Failed connection attempts.
+  uint32_t livenessDrops;     ///< Connections dropped because a pong was missing.
+  bool connected;             ///< A connection is currently open.
+};
+
+/**
+ * @brief Creates the connection lock and starts the WebSocket task.
+ * @note Must be called in setup() before any task sends.
+ * @return true on success.
+ */
+bool startWebSocketTransport();
+
+/**
+ * @brief Sends a payload upstream as one text frame.
+ * Waits up to timeoutMs for the connection if it is not open.
+ * @param channel Channel of the payload, e.g. "data".
+ * @param payload JSON payload.
+ * @param timeoutMs Maximum time to wait for the connection and for the socket.
+ * @return 200 when the frame was written, a negative WEBSOCKET_ERROR_* code otherwise.
+ */
+int webSocketSend(const char* channel, const String& payload, uint32_t timeoutMs);
+
+/**
+ * @brief Returns a description of a WEBSOCKET_ERROR_* code.
+ * @param code The code.
+ * @return Printable description.
+ */
+String webSocketErrorToString(int code);
+
+/**
+ * @brief Returns a snapshot of the WebSocket counters.
+ * @return Copy of the current statistics.
+ */
+WebSocketStats webSocketGetStats();
+
+#endif // WEBSOCKET_TRANSPORT_H
@@ -3,15 +3,17 @@
  * @brief Manages Wi-Fi connectivity, including AP mode, STA mode, and network scanning.
  *
  * This file implements functions for switching the ESP32 to Access Point (AP) mode
- * for configuration, initiating Wi-Fi network scans, connecting to a specified
- * Wi-Fi network in Station (STA) mode, and handling automatic reconnection
- * if the STA connection is lost.
+ * for configuration, initiating Wi-Fi network scans, starting non-blocking
+ * connection attempts in Station (STA) mode, and forwarding WiFi driver
+ * events to the supervisor state machine.
  */
 #include "wifi_manager.h"
 #include "config.h"        
 #include "utils.h"         
+#include "led_service.h"
 #include "nvs_handler.h"   
 #include "web_interface.h" 
+#include "supervisor.h"
 #include <WiFi.h>
 #include <ESPmDNS.h>
 
@@ -22,7 +24,7 @@
  * Disconnects any existing STA connection, starts a software AP with
  * credentials from config.h (AP_SSID, AP_PASS), starts mDNS responder,
  * sets LED to yellow, and triggers a background WiFi scan.
- * If AP fails to start, it blinks red and restarts the device.
+ * If AP fails to start, it shows the fatal LED pattern and restarts the device.
  */
 void switchToAPMode() {
     Serial.println("Switching to AP mode...");
@@ -45,15 +47,14 @@ void switchToAPMode() {
         } else {
             Serial.println("Error starting MDNS!");
         }
-        setLedColor(yellow); 
+        ledPlay(LED_PATTERN_PROVISIONING);
         startWifiScan();     
     } else {
         Serial.println("!!! CRITICAL ERROR: Failed to start AP mode!");
-        blinkLedError(red); 
+        ledPlay(LED_PATTERN_FATAL);
         delay(5000);
         ESP.restart();
     }
-    lastDataSendTime = millis(); 
     currentDeviceMode = MODE_UNCONFIGURED; 
 }
 
@@ -74,83 +75,45 @@ void startWifiScan(bool show_hidden /*= true*/) {
 // --- WiFi Connection (STA Mode) ---
 
 /**
- * @brief Attempts to connect to the WiFi network specified in the global
- * `wifiSSID` and `wifiPass` variables.
- * Sets the device to STA mode and tries connecting for up to 15 seconds.
- * Updates LED color based on connection status (blue while trying, green on success).
- * @return true if connection is successful within the timeout, false otherwise.
+ * @brief Starts a non-blocking connection attempt to the WiFi network specified
+ * in the global `wifiSSID` and `wifiPass` variables.
+ * Sets the device to STA mode and the LED to blinking blue. The result is reported
+ * asynchronously to the supervisor through the WiFi event handlers.
  */
-bool connectToWiFi() {
+void beginWiFiConnection() {
     Serial.print("Connecting to network: ");
     Serial.println(wifiSSID);
-    setLedColor(blue); 
+    ledPlay(LED_PATTERN_CONNECTING);
 
+    WiFi.disconnect(true);
+    delay(100);
     WiFi.mode(WIFI_STA);
     WiFi.begin(wifiSSID.c_str(), wifiPass.c_str());
-
-    unsigned long start = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - start < 15000) { // 15 second timeout
-        delay(250);
-        Serial.print(".");
-        setLedColor( (millis()/250) % 2 == 0 ? blue : black );
-    }
-    Serial.println();
-
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println(">>> SUCCESS: Connected to WiFi!");
-        setLedColor(green);
-        Serial.print("Device IP address: ");
-        Serial.println(WiFi.localIP());
-        lastDataSendTime = millis(); 
-        currentDeviceMode = MODE_CONFIGURED; 
-        return true;
-    } else {
-        Serial.println("!!! ERROR: Failed to connect to WiFi within the timeout.");
-        blinkLedError(black);
-        WiFi.disconnect(true); 
-        currentDeviceMode = MODE_UNCONFIGURED; 
-        return false;
-    }
 }
 
 /**
- * @brief Checks the WiFi connection status while in STA mode.
- * If disconnected, it attempts to reconnect using WiFi.reconnect() for up to 10 seconds.
- * If reconnection fails, it clears the potentially invalid NVS configuration,
- * switches the device back to AP mode, starts the web server, and returns false.
- * @return true if currently connected or successfully reconnected,
- * false if reconnection failed (and switched to AP mode) or if not currently in STA mode.
+ * @brief Starts a non-blocking reconnection attempt after the STA connection was lost.
+ * The result is reported asynchronously to the supervisor through the WiFi event handlers.
  */
-bool checkAndReconnectWiFi() {
-    if (currentDeviceMode == MODE_CONFIGURED && WiFi.status() != WL_CONNECTED) {
-        Serial.println("Lost WiFi connection in STA mode. Attempting to reconnect...");
-        setLedColor(blue); 
-
-        WiFi.reconnect();
+void beginWiFiReconnect() {
+    ledPlay(LED_PATTERN_CONNECTING);
+    WiFi.reconnect();
+}
 
-        unsigned long reconnStart = millis();
-        while(WiFi.status() != WL_CONNECTED && millis() - reconnStart < 10000) { 
-            delay(250);
-            Serial.print("*");
-            setLedColor( (millis()/250) % 2 == 0 ? blue : black );
-        }
-        Serial.println();
+// --- WiFi Driver Events ---
 
-        if (WiFi.status() != WL_CONNECTED) {
-            Serial.println("Reconnection failed. Reverting to AP mode.");
-            blinkLedError(black); 
-            clearConfigurationInNVS();
-            switchToAPMode();
-            setupWebServer();
-            return false; 
-        } else {
-            Serial.println("Reconnection successful.");
-            setLedColor(green); 
-            return true; 
-        }
-    } else if (currentDeviceMode == MODE_CONFIGURED && WiFi.status() == WL_CONNECTED) {
-        return true;
-    } else {
-        return false;
-    }
-}
\ No newline at end of file
+/**
+ * @brief Registers WiFi driver event callbacks that forward STA connection
+ * changes to the supervisor queue.
+ * The callbacks run in the WiFi event task and only post events; all mode
+ * changes are performed by the supervisor task.
+ */
+void registerWiFiEventHandlers() {
+    WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+        postSupervisorEvent(EVENT_WIFI_CONNECTED);
+    }, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+
+    WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+        postSupervisorEvent(EVENT_WIFI_DISCONNECTED);
+    }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+}
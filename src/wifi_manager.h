@@ -18,22 +18,23 @@ void switchToAPMode();
 void startWifiScan(bool show_hidden = true);
 
 /**
- * @brief Attempts to connect to the WiFi network using credentials from global variables (wifiSSID, wifiPass).
- * Sets the device to STA mode. Blocks execution for up to 15 seconds during the attempt.
- * Updates the LED based on connection status (blue trying, green success, error blink failure).
- * @return true if connection is successful within the timeout, false otherwise.
+ * @brief Starts a non-blocking connection attempt using credentials from global variables (wifiSSID, wifiPass).
+ * Sets the device to STA mode and the LED to blinking blue. The outcome is delivered to the
+ * supervisor as EVENT_WIFI_CONNECTED; the supervisor enforces the timeout.
  */
-bool connectToWiFi();
+void beginWiFiConnection();
 
 /**
- * @brief Checks the WiFi connection status while in STA mode (MODE_CONFIGURED).
- * If disconnected, attempts to reconnect using WiFi.reconnect() for up to 10 seconds.
- * Updates the LED color accordingly. If reconnection fails, it clears NVS,
- * switches back to AP mode, starts the web server, and returns false.
- * @return true if currently connected or successfully reconnected.
- * @return false if reconnection failed (and switched to AP mode) or if not currently in STA mode (MODE_CONFIGURED).
+ * @brief Starts a non-blocking reconnection attempt after the STA connection was lost.
+ * The outcome is delivered to the supervisor as EVENT_WIFI_CONNECTED.
  */
-bool checkAndReconnectWiFi();
+void beginWiFiReconnect();
+
+/**
+ * @brief Registers WiFi driver event callbacks forwarding STA connect/disconnect
+ * events to the supervisor queue.
+ */
+void registerWiFiEventHandlers();
 
 
 #endif // WIFI_MANAGER_H
\ No newline at end of file
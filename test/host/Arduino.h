@@ -0,0 +1,85 @@
+/**
+ * @file Arduino.h
+ * @brief Host stand-in for the parts of the Arduino-ESP32 core used by the modules under host test.
+ *
+ * Only what config.h and the tested modules need: String, Serial output,
+ * the cycle counter and the FreeRTOS critical sections. A critical section
+ * is a spinlock on an atomic flag, so that tests may run tasks as threads and
+ * benchmarks pay for an atomic exchange as on the ESP32.
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+#include <freertos/FreeRTOS.h>
+
+/** @brief Arduino String on top of std::string. */
+class String {
+public:
+  String(const char* text = "") : value(text != NULL ? text : "") {}
+  String(const std::string& text) : value(text) {}
+  const char* c_str() const { return value.c_str(); }
+  unsigned int length() const { return (unsigned int)value.size(); }
+  bool isEmpty() const { return value.empty(); }
+  String& operator+=(const String& other) { value += other.value; return *this; }
+  bool operator==(const String& other) const { return value == other.value; }
+  bool operator!=(const String& other) const { return value != other.value; }
+
+private:
+  std::string value;
+};
+
+/** @brief Serial port; output goes to stdout. */
+class HardwareSerial {
+public:
+  int printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    return written;
+  }
+  void print(const char* text) { fputs(text, stdout); }
+  void print(const String& text) { fputs(text.c_str(), stdout); }
+  void println(const char* text = "") { puts(text); }
+  void println(const String& text) { puts(text.c_str()); }
+};
+
+__attribute__((weak)) HardwareSerial Serial;
+
+/** @brief ESP object; a "cycle" of getCycleCount() is one nanosecond of the host's steady clock. */
+class EspClass {
+public:
+  uint32_t getCycleCount() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+};
+
+__attribute__((weak)) EspClass ESP;
+
+// --- FreeRTOS ---
+struct portMUX_TYPE {
+  std::atomic_flag flag;
+};
+#define portMUX_INITIALIZER_UNLOCKED {ATOMIC_FLAG_INIT}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {
+  while (mux->flag.test_and_set(std::memory_order_acquire)) {
+  }
+}
+
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+  mux->flag.clear(std::memory_order_release);
+}
+
+#endif // HOST_ARDUINO_H
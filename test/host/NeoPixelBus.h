@@ -0,0 +1,13 @@
+/**
+ * @file NeoPixelBus.h
+ * @brief Host stand-in for NeoPixelBus: only the types named by config.h.
+ */
+#ifndef HOST_NEOPIXELBUS_H
+#define HOST_NEOPIXELBUS_H
+
+struct NeoGrbFeature {};
+struct NeoEsp32LcdX8Ws2812xMethod {};
+
+template <typename Feature, typename Method> class NeoPixelBus {};
+
+#endif // HOST_NEOPIXELBUS_H
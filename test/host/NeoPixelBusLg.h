@@ -0,0 +1,5 @@
+/**
+ * @file NeoPixelBusLg.h
+ * @brief Host stand-in for NeoPixelBusLg (see NeoPixelBus.h).
+ */
+#include "NeoPixelBus.h"
@@ -0,0 +1,10 @@
+/**
+ * @file Preferences.h
+ * @brief Host stand-in for the NVS Preferences class: only the type named by config.h.
+ */
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+class Preferences {};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,71 @@
+/**
+ * @file queue.h
+ * @brief Host stand-in for FreeRTOS queues: a bounded ring of fixed-size items guarded by a mutex.
+ */
+#ifndef HOST_FREERTOS_QUEUE_H
+#define HOST_FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/** @brief A queue of length items of itemSize bytes. */
+struct HostQueue {
+  HostQueue(uint32_t length, uint32_t itemSize) : storage(length * itemSize), length(length), itemSize(itemSize) {}
+  std::vector<uint8_t> storage;
+  uint32_t length;
+  uint32_t itemSize;
+  uint32_t head = 0;
+  uint32_t count = 0;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+typedef HostQueue* QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(uint32_t length, uint32_t itemSize) {
+  return new HostQueue(length, itemSize);
+}
+
+inline void vQueueDelete(QueueHandle_t queue) {
+  delete queue;
+}
+
+/** @brief Waits until ready() holds or the ticks have passed. */
+template <typename Ready>
+static bool hostQueueWait(QueueHandle_t queue, std::unique_lock<std::mutex>& lock, TickType_t ticks, Ready ready) {
+  if (ticks == portMAX_DELAY) {
+    queue->changed.wait(lock, ready);
+    return true;
+  }
+  return queue->changed.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!hostQueueWait(queue, lock, ticks, [queue] { return queue->count < queue->length; })) {
+    return pdFALSE;
+  }
+  uint32_t tail = (queue->head + queue->count) % queue->length;
+  memcpy(&queue->storage[tail * queue->itemSize], item, queue->itemSize);
+  queue->count++;
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!hostQueueWait(queue, lock, ticks, [queue] { return queue->count > 0; })) {
+    return pdFALSE;
+  }
+  memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+#endif // HOST_FREERTOS_QUEUE_H
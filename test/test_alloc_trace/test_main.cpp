@@ -0,0 +1,194 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the heap allocation tracer.
+ *
+ * Built with WS_FEATURE_ALLOC_TRACE=1 and the --wrap linker flags (see the
+ * native-alloc-trace environment), so the allocations of this test go through
+ * the tracer.
+ *
+ *     pio test -e native-alloc-trace
+ */
+#include <unity.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc_trace.h"
+
+// --- Helpers ---
+
+static AllocSiteStats sites[ALLOC_TRACE_SITES];
+
+/**
+ * @brief Sums the counters of the sites of a scope.
+ * @param scope Name passed to ALLOC_TRACE_SCOPE().
+ * @param total Receives the sums.
+ * @return Number of sites of the scope.
+ */
+static uint8_t scopeCounters(const char* scope, AllocSiteStats& total) {
+    uint8_t count = allocTraceGetSites(sites, ALLOC_TRACE_SITES);
+    uint8_t found = 0;
+    memset(&total, 0, sizeof(total));
+    for (uint8_t i = 0; i < count; i++) {
+        if (sites[i].scope == NULL || strcmp(sites[i].scope, scope) != 0) {
+            continue;
+        }
+        total.allocations += sites[i].allocations;
+        total.bytes += sites[i].bytes;
+        total.transientFrees += sites[i].transientFrees;
+        total.longLivedFrees += sites[i].longLivedFrees;
+        total.liveBlocks += sites[i].liveBlocks;
+        total.liveBytes += sites[i].liveBytes;
+        found++;
+    }
+    return found;
+}
+
+static void* volatile blocks[256]; // Keeps the allocations observable
+
+// The loops are inside the helpers so that every block of a helper has the same call site
+static void __attribute__((noinline, noclone)) allocateSmall(uint16_t first, uint16_t count) {
+    for (uint16_t i = first; i < first + count; i++) {
+        blocks[i] = malloc(24);
+    }
+}
+
+static void __attribute__((noinline, noclone)) allocateLarge(uint16_t first, uint16_t count) {
+    for (uint16_t i = first; i < first + count; i++) {
+        blocks[i] = malloc(40);
+    }
+}
+
+static void freeBlocks(uint16_t first, uint16_t count, uint16_t step) {
+    for (uint16_t i = first; i < first + count; i += step) {
+        free(blocks[i]);
+        blocks[i] = NULL;
+    }
+}
+
+static void sleepMs(uint32_t ms) {
+    struct timespec duration = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&duration, NULL);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// --- Tests ---
+
+void test_allocations_are_attributed_to_scope_and_caller(void) {
+    {
+        ALLOC_TRACE_SCOPE("attribution");
+        allocateSmall(0, 3);
+        allocateLarge(3, 5);
+    }
+    {
+        ALLOC_TRACE_SCOPE("other");
+        allocateSmall(8, 1);
+    }
+
+    AllocSiteStats counters;
+    TEST_ASSERT_EQUAL_UINT8(2, scopeCounters("attribution", counters)); // Two call sites in one scope
+    TEST_ASSERT_EQUAL_UINT32(8, counters.allocations);
+    TEST_ASSERT_EQUAL_UINT32(3 * 24 + 5 * 40, counters.bytes);
+    TEST_ASSERT_EQUAL_UINT32(8, counters.liveBlocks);
+    TEST_ASSERT_EQUAL_UINT32(3 * 24 + 5 * 40, counters.liveBytes);
+    TEST_ASSERT_EQUAL_UINT8(1, scopeCounters("other", counters));
+    TEST_ASSERT_EQUAL_UINT32(1, counters.allocations);
+    freeBlocks(0, 9, 1);
+}
+
+void test_frees_are_classified_by_lifetime(void) {
+    {
+        ALLOC_TRACE_SCOPE("lifetime");
+        allocateSmall(0, 4);
+    }
+    freeBlocks(0, 2, 1);
+    sleepMs(ALLOC_TRACE_TRANSIENT_MS + 100);
+    freeBlocks(2, 1, 1);
+
+    AllocSiteStats counters;
+    TEST_ASSERT_EQUAL_UINT8(1, scopeCounters("lifetime", counters));
+    TEST_ASSERT_EQUAL_UINT32(2, counters.transientFrees);
+    TEST_ASSERT_EQUAL_UINT32(1, counters.longLivedFrees);
+    TEST_ASSERT_EQUAL_UINT32(1, counters.liveBlocks);
+    freeBlocks(3, 1, 1);
+}
+
+void test_live_table_erase_keeps_the_other_blocks(void) {
+    AllocTraceStats before = allocTraceGetStats();
+    {
+        ALLOC_TRACE_SCOPE("erase");
+        allocateSmall(0, 200);
+    }
+    freeBlocks(0, 200, 2); // Every erase shifts the probe chains behind it
+    AllocSiteStats counters;
+    scopeCounters("erase", counters);
+    TEST_ASSERT_EQUAL_UINT32(100, counters.liveBlocks);
+    TEST_ASSERT_EQUAL_UINT32(100, counters.transientFrees);
+    TEST_ASSERT_EQUAL_UINT16(before.liveBlocks + 100, allocTraceGetStats().liveBlocks);
+
+    freeBlocks(1, 199, 2); // Each remaining block must still be found
+    scopeCounters("erase", counters);
+    TEST_ASSERT_EQUAL_UINT32(0, counters.liveBlocks);
+    TEST_ASSERT_EQUAL_UINT32(0, counters.liveBytes);
+    TEST_ASSERT_EQUAL_UINT32(200, counters.transientFrees);
+    AllocTraceStats after = allocTraceGetStats();
+    TEST_ASSERT_EQUAL_UINT16(before.liveBlocks, after.liveBlocks);
+    TEST_ASSERT_EQUAL_UINT32(before.untracked, after.untracked);
+}
+
+void test_realloc_moves_the_block_to_the_new_site(void) {
+    void* block;
+    {
+        ALLOC_TRACE_SCOPE("before_realloc");
+        block = malloc(16);
+    }
+    {
+        ALLOC_TRACE_SCOPE("after_realloc");
+        block = realloc(block, 4096);
+    }
+    AllocSiteStats counters;
+    scopeCounters("before_realloc", counters);
+    TEST_ASSERT_EQUAL_UINT32(0, counters.liveBlocks);
+    TEST_ASSERT_EQUAL_UINT32(1, counters.transientFrees);
+    scopeCounters("after_realloc", counters);
+    TEST_ASSERT_EQUAL_UINT32(1, counters.liveBlocks);
+    TEST_ASSERT_EQUAL_UINT32(4096, counters.liveBytes);
+    free(block);
+}
+
+void test_failed_realloc_keeps_the_block(void) {
+    void* block;
+    {
+        ALLOC_TRACE_SCOPE("failed_realloc");
+        block = malloc(32);
+    }
+    AllocTraceStats before = allocTraceGetStats();
+
+    volatile size_t tooLarge = SIZE_MAX / 2;
+    TEST_ASSERT_NULL(realloc(block, tooLarge));
+    AllocSiteStats counters;
+    scopeCounters("failed_realloc", counters);
+    TEST_ASSERT_EQUAL_UINT32(1, counters.liveBlocks);
+    TEST_ASSERT_EQUAL_UINT32(0, counters.transientFrees);
+    TEST_ASSERT_EQUAL_UINT32(before.frees, allocTraceGetStats().frees);
+
+    free(block); // Still tracked, so not counted as untracked
+    scopeCounters("failed_realloc", counters);
+    TEST_ASSERT_EQUAL_UINT32(0, counters.liveBlocks);
+    TEST_ASSERT_EQUAL_UINT32(1, counters.transientFrees);
+    TEST_ASSERT_EQUAL_UINT32(before.untracked, allocTraceGetStats().untracked);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_allocations_are_attributed_to_scope_and_caller);
+    RUN_TEST(test_frees_are_classified_by_lifetime);
+    RUN_TEST(test_live_table_erase_keeps_the_other_blocks);
+    RUN_TEST(test_realloc_moves_the_block_to_the_new_site);
+    RUN_TEST(test_failed_realloc_keeps_the_block);
+    return UNITY_END();
+}
@@ -0,0 +1,178 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the button gesture detector.
+ *
+ * Synthetic button waveforms are replayed the way buttonTask() drives the
+ * detector: every raw edge calls onEdge(), and poll() is called whenever the
+ * wait for the next edge times out after msUntilDeadline().
+ *
+ *     pio test -e native -f test_button_gesture
+ */
+#include <unity.h>
+
+#include "button_gesture.h"
+
+// --- Waveform Replay ---
+
+static const uint32_t DEBOUNCE_MS = 30;
+static const uint32_t LONG_PRESS_MS = 3000;
+static const uint32_t DOUBLE_GAP_MS = 400;
+
+/** @brief A raw edge of the waveform: the pin level after the edge, at an offset from the start. */
+struct Edge {
+    uint32_t atMs;
+    bool pressed;
+};
+
+static const uint8_t MAX_GESTURES = 8;
+
+/** @brief Gestures reported while replaying a waveform. */
+struct Replay {
+    uint8_t count;
+    ButtonGesture gestures[MAX_GESTURES];
+    uint32_t atMs[MAX_GESTURES]; // Offset from the start
+};
+
+/**
+ * @brief Replays a waveform through a detector, as the button task does.
+ * @param edges Edges sorted by time.
+ * @param edgeCount Number of edges.
+ * @param startMs millis() value at offset 0.
+ * @param durationMs Offset at which the replay stops.
+ * @return The reported gestures.
+ */
+static Replay replay(const Edge* edges, uint8_t edgeCount, uint32_t startMs, uint32_t durationMs) {
+    ButtonGestureDetector detector(DEBOUNCE_MS, LONG_PRESS_MS, DOUBLE_GAP_MS);
+    Replay result = {};
+    bool level = false;
+    uint8_t next = 0;
+    uint32_t offset = 0;
+
+    while (offset < durationMs) {
+        uint32_t waitMs = detector.msUntilDeadline(startMs + offset);
+        uint32_t edgeAt = next < edgeCount ? edges[next].atMs : durationMs;
+        if (waitMs == GESTURE_NO_DEADLINE || offset + waitMs > edgeAt) {
+            // The edge arrives before the wait times out
+            offset = edgeAt;
+            if (next == edgeCount) {
+                break;
+            }
+            level = edges[next++].pressed;
+            detector.onEdge(startMs + offset);
+            continue;
+        }
+        offset += waitMs;
+        ButtonGesture gesture = detector.poll(level, startMs + offset);
+        if (gesture != GESTURE_NONE && result.count < MAX_GESTURES) {
+            result.gestures[result.count] = gesture;
+            result.atMs[result.count++] = offset;
+        }
+    }
+    return result;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// --- Tests ---
+
+void test_short_press_is_reported_after_the_double_press_gap(void) {
+    const Edge edges[] = {{100, true}, {250, false}};
+    Replay result = replay(edges, 2, 0, 2000);
+    TEST_ASSERT_EQUAL_UINT8(1, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_SHORT_PRESS, result.gestures[0]);
+    TEST_ASSERT_EQUAL_UINT32(250 + DEBOUNCE_MS + DOUBLE_GAP_MS, result.atMs[0]);
+}
+
+void test_double_press_is_reported_on_the_second_release(void) {
+    const Edge edges[] = {{100, true}, {200, false}, {400, true}, {500, false}};
+    Replay result = replay(edges, 4, 0, 2000);
+    TEST_ASSERT_EQUAL_UINT8(1, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_DOUBLE_PRESS, result.gestures[0]);
+    TEST_ASSERT_EQUAL_UINT32(500 + DEBOUNCE_MS, result.atMs[0]);
+}
+
+void test_presses_further_apart_than_the_gap_are_two_short_presses(void) {
+    const Edge edges[] = {{100, true}, {200, false}, {700, true}, {800, false}};
+    Replay result = replay(edges, 4, 0, 2000);
+    TEST_ASSERT_EQUAL_UINT8(2, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_SHORT_PRESS, result.gestures[0]);
+    TEST_ASSERT_EQUAL(GESTURE_SHORT_PRESS, result.gestures[1]);
+}
+
+void test_long_press_is_reported_while_held_and_once(void) {
+    const Edge edges[] = {{100, true}, {5000, false}};
+    Replay result = replay(edges, 2, 0, 8000);
+    TEST_ASSERT_EQUAL_UINT8(1, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_LONG_PRESS, result.gestures[0]);
+    TEST_ASSERT_EQUAL_UINT32(100 + DEBOUNCE_MS + LONG_PRESS_MS, result.atMs[0]);
+}
+
+void test_short_press_then_long_press_is_only_a_long_press(void) {
+    const Edge edges[] = {{100, true}, {200, false}, {400, true}, {4000, false}};
+    Replay result = replay(edges, 4, 0, 6000);
+    TEST_ASSERT_EQUAL_UINT8(1, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_LONG_PRESS, result.gestures[0]);
+}
+
+void test_bounce_trains_are_one_press(void) {
+    // Contact bounce of a few ms on both edges, each settling within the debounce time
+    const Edge edges[] = {{100, true}, {102, false}, {105, true}, {109, false}, {112, true},
+                          {300, false}, {303, true}, {306, false}, {311, true}, {315, false}};
+    Replay result = replay(edges, 10, 0, 2000);
+    TEST_ASSERT_EQUAL_UINT8(1, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_SHORT_PRESS, result.gestures[0]);
+    TEST_ASSERT_EQUAL_UINT32(315 + DEBOUNCE_MS + DOUBLE_GAP_MS, result.atMs[0]);
+}
+
+void test_glitch_shorter_than_the_debounce_time_is_ignored(void) {
+    const Edge edges[] = {{100, true}, {110, false}};
+    Replay result = replay(edges, 2, 0, 2000);
+    TEST_ASSERT_EQUAL_UINT8(0, result.count);
+}
+
+void test_gestures_across_millis_wrap(void) {
+    // millis() wraps between the edges of each gesture
+    const uint32_t startMs = 0xFFFFFFFFUL - 150;
+    const Edge shortEdges[] = {{100, true}, {250, false}};
+    Replay result = replay(shortEdges, 2, startMs, 2000);
+    TEST_ASSERT_EQUAL_UINT8(1, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_SHORT_PRESS, result.gestures[0]);
+    TEST_ASSERT_EQUAL_UINT32(250 + DEBOUNCE_MS + DOUBLE_GAP_MS, result.atMs[0]);
+
+    const Edge doubleEdges[] = {{100, true}, {200, false}, {400, true}, {500, false}};
+    result = replay(doubleEdges, 4, startMs, 2000);
+    TEST_ASSERT_EQUAL_UINT8(1, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_DOUBLE_PRESS, result.gestures[0]);
+
+    const Edge longEdges[] = {{100, true}, {5000, false}};
+    result = replay(longEdges, 2, startMs, 8000);
+    TEST_ASSERT_EQUAL_UINT8(1, result.count);
+    TEST_ASSERT_EQUAL(GESTURE_LONG_PRESS, result.gestures[0]);
+    TEST_ASSERT_EQUAL_UINT32(100 + DEBOUNCE_MS + LONG_PRESS_MS, result.atMs[0]);
+}
+
+void test_idle_detector_has_no_deadline(void) {
+    ButtonGestureDetector detector(DEBOUNCE_MS, LONG_PRESS_MS, DOUBLE_GAP_MS);
+    TEST_ASSERT_EQUAL_UINT32(GESTURE_NO_DEADLINE, detector.msUntilDeadline(0));
+    detector.onEdge(1000);
+    TEST_ASSERT_EQUAL_UINT32(DEBOUNCE_MS, detector.msUntilDeadline(1000));
+    TEST_ASSERT_EQUAL_UINT32(0, detector.msUntilDeadline(1000 + DEBOUNCE_MS + 5));
+    TEST_ASSERT_EQUAL(GESTURE_NONE, detector.poll(true, 1000 + DEBOUNCE_MS));
+    TEST_ASSERT_TRUE(detector.isPressed());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_short_press_is_reported_after_the_double_press_gap);
+    RUN_TEST(test_double_press_is_reported_on_the_second_release);
+    RUN_TEST(test_presses_further_apart_than_the_gap_are_two_short_presses);
+    RUN_TEST(test_long_press_is_reported_while_held_and_once);
+    RUN_TEST(test_short_press_then_long_press_is_only_a_long_press);
+    RUN_TEST(test_bounce_trains_are_one_press);
+    RUN_TEST(test_glitch_shorter_than_the_debounce_time_is_ignored);
+    RUN_TEST(test_gestures_across_millis_wrap);
+    RUN_TEST(test_idle_detector_has_no_deadline);
+    return UNITY_END();
+}
@@ -0,0 +1,117 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the per-field windowed downsampling stage.
+ *
+ * Samples are fed at a fixed period the way the uplink task does, and the
+ * closed windows are checked for their sample count and start stamp, also
+ * across the millis() wrap.
+ *
+ *     pio test -e native-downsampler
+ */
+#include <unity.h>
+
+#include "downsampler.h"
+
+// --- Helpers ---
+
+static const uint32_t SAMPLE_MS = 10000;
+static const uint32_t WINDOW_MS = 60000;
+
+static RuntimeConfig config;
+
+/** @brief A sample with every field set and a temperature of 20.0 °C. */
+static WeatherSample sampleAt(uint32_t timestampMs) {
+    WeatherSample sample = {};
+    sample.timestampMs = timestampMs;
+    sample.epochS = 0;
+    sample.temperature = 200;
+    sample.pressure = 10130;
+    sample.humidity = 50;
+    sample.sunshine = 40;
+    sample.windSpeed = 30;
+    sample.precipitation = 0;
+    sample.windGust = SAMPLE_MISSING;
+    return sample;
+}
+
+/** @brief Closed windows of the temperature field. */
+struct Windows {
+    uint8_t count;
+    uint32_t startMs[32];
+    int16_t temperature[32];
+};
+
+/**
+ * @brief Feeds samples every SAMPLE_MS and collects the closed temperature windows.
+ * @param startMs Time stamp of the first sample.
+ * @param samples Number of samples.
+ * @return The closed windows, oldest first.
+ */
+static Windows feed(uint32_t startMs, uint16_t samples) {
+    Windows windows = {};
+    WeatherSample records[SAMPLE_FIELD_COUNT];
+    for (uint16_t i = 0; i < samples; i++) {
+        uint8_t count = downsamplerAdd(sampleAt(startMs + i * SAMPLE_MS), config, records);
+        for (uint8_t r = 0; r < count && windows.count < 32; r++) {
+            windows.startMs[windows.count] = records[r].timestampMs;
+            windows.temperature[windows.count++] = records[r].temperature;
+        }
+    }
+    return windows;
+}
+
+void setUp(void) {
+    config = RuntimeConfig();
+    config.samplePeriodMs = SAMPLE_MS;
+    config.fieldMask = FIELD_TEMPERATURE; // Every field passes through (AGGREGATE_LAST, window 0)
+    // Passing a sample through drops the partial window of the previous test
+    WeatherSample records[SAMPLE_FIELD_COUNT];
+    downsamplerAdd(sampleAt(0), config, records);
+    config.downsampling[0].aggregation = AGGREGATE_COUNT;
+    config.downsampling[0].windowMs = WINDOW_MS;
+}
+
+void tearDown(void) {}
+
+// --- Tests ---
+
+void test_window_is_stamped_with_its_start(void) {
+    Windows windows = feed(120000, 13);
+    TEST_ASSERT_EQUAL_UINT8(2, windows.count);
+    TEST_ASSERT_EQUAL_UINT32(120000, windows.startMs[0]);
+    TEST_ASSERT_EQUAL_UINT32(180000, windows.startMs[1]);
+    TEST_ASSERT_EQUAL_INT16(6 * TEMPERATURE_SCALE, windows.temperature[0]);
+    TEST_ASSERT_EQUAL_INT16(6 * TEMPERATURE_SCALE, windows.temperature[1]);
+}
+
+void test_windows_stay_whole_across_the_millis_wrap(void) {
+    // The second window starts at 0xFFFF4740, the last multiple of 60000, and contains the wrap
+    uint32_t alignedMs = 0xFFFFFFFFUL - 0xFFFFFFFFUL % WINDOW_MS;
+    Windows windows = feed(alignedMs - WINDOW_MS, 6 * 4 + 1);
+    TEST_ASSERT_EQUAL_UINT8(4, windows.count);
+    for (uint8_t i = 0; i < windows.count; i++) {
+        TEST_ASSERT_EQUAL_UINT32(alignedMs - WINDOW_MS + i * WINDOW_MS, windows.startMs[i]);
+        TEST_ASSERT_EQUAL_INT16(6 * TEMPERATURE_SCALE, windows.temperature[i]);
+    }
+}
+
+void test_windows_without_samples_are_skipped(void) {
+    WeatherSample records[SAMPLE_FIELD_COUNT];
+    downsamplerAdd(sampleAt(60000), config, records);
+    downsamplerAdd(sampleAt(70000), config, records);
+    // Next sample 3 windows later: one record for the old window, the new one starts on the grid
+    TEST_ASSERT_EQUAL_UINT8(1, downsamplerAdd(sampleAt(250000), config, records));
+    TEST_ASSERT_EQUAL_UINT32(60000, records[0].timestampMs);
+    TEST_ASSERT_EQUAL_INT16(2 * TEMPERATURE_SCALE, records[0].temperature);
+    TEST_ASSERT_EQUAL_UINT8(1, downsamplerAdd(sampleAt(300000), config, records));
+    TEST_ASSERT_EQUAL_UINT32(240000, records[0].timestampMs);
+    TEST_ASSERT_EQUAL_INT16(1 * TEMPERATURE_SCALE, records[0].temperature);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_window_is_stamped_with_its_start);
+    RUN_TEST(test_windows_stay_whole_across_the_millis_wrap);
+    RUN_TEST(test_windows_without_samples_are_skipped);
+    return UNITY_END();
+}
@@ -0,0 +1,193 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests and benchmark for the event bus pool, reference counts and dispatch.
+ *
+ * Runs event_bus.cpp against the stand-ins in test/host: critical sections
+ * are a spinlock on an atomic flag, queues a mutex-guarded ring, and a
+ * "cycle" of the publish counters is one nanosecond. Subscribers are set up
+ * once in main(), since the bus has no unsubscribe; every test uses its own
+ * topic. The benchmark prints the cost per publish for each kind of
+ * subscriber; the figures are host figures, not ESP32 cycles.
+ *
+ *     pio test -e native-event-bus -v
+ */
+#include <unity.h>
+
+#include <chrono>
+#include <thread>
+
+#include "event_bus.h"
+
+// --- Fixtures ---
+
+static EventSubscriber* buttonQueues[2];    // TOPIC_BUTTON, with buttonCallback()
+static EventSubscriber* wifiQueue;          // TOPIC_WIFI_STATE, depth 1
+static EventSubscriber* sampleQueues[2];    // TOPIC_SAMPLE, drained by threads
+
+static uint32_t callbackCalls;
+static uint8_t callbackRefCount;
+
+static void buttonCallback(const BusMessage* message, void* context) {
+    callbackCalls++;
+    callbackRefCount = message->refCount;
+}
+
+static uint32_t alertCalls;
+
+static void alertCallback(const BusMessage* message, void* context) {
+    (*(uint32_t*)context)++;
+}
+
+/** @brief Publishes a message of a topic, retrying while the pool is empty. */
+static void publish(EventTopic topic) {
+    BusMessage* message;
+    while ((message = eventBusAcquire(topic)) == NULL) {
+        std::this_thread::yield();
+    }
+    eventBusPublish(message);
+}
+
+/** @brief Receives and releases every queued message of a subscriber. */
+static uint32_t drain(EventSubscriber* subscriber) {
+    uint32_t received = 0;
+    const BusMessage* message;
+    while ((message = eventBusReceive(subscriber, 0)) != NULL) {
+        eventBusRelease(message);
+        received++;
+    }
+    return received;
+}
+
+void setUp(void) {
+    initEventBus();
+    callbackCalls = 0;
+}
+
+void tearDown(void) {}
+
+// --- Pool and Reference Counts ---
+
+void test_pool_exhaustion_is_counted(void) {
+    BusMessage* held[16];
+    uint8_t count = 0;
+    while (count < 16 && (held[count] = eventBusAcquire(TOPIC_CONFIG_CHANGED)) != NULL) {
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT8(16, count); // EVENT_POOL_SIZE
+    TEST_ASSERT_NULL(eventBusAcquire(TOPIC_CONFIG_CHANGED));
+    TEST_ASSERT_EQUAL_UINT32(1, eventBusGetStats().poolExhausted);
+    TEST_ASSERT_EQUAL_UINT8(16, eventBusGetStats().poolInUse);
+
+    for (uint8_t i = 0; i < count; i++) {
+        eventBusPublish(held[i]); // No subscriber: straight back to the pool
+    }
+    TEST_ASSERT_EQUAL_UINT8(0, eventBusGetStats().poolInUse);
+    TEST_ASSERT_EQUAL_UINT32(16, eventBusGetStats().published);
+}
+
+void test_message_returns_to_the_pool_after_the_last_release(void) {
+    BusMessage* message = eventBusAcquire(TOPIC_BUTTON);
+    message->data.button.gesture = GESTURE_DOUBLE_PRESS;
+    eventBusPublish(message);
+    TEST_ASSERT_EQUAL_UINT32(1, callbackCalls);
+    TEST_ASSERT_EQUAL_UINT8(3, callbackRefCount); // Publisher and both queues hold it during the callback
+
+    const BusMessage* first = eventBusReceive(buttonQueues[0], 0);
+    const BusMessage* second = eventBusReceive(buttonQueues[1], 0);
+    TEST_ASSERT_TRUE(first == message && second == message); // Delivered by pointer
+    TEST_ASSERT_EQUAL(GESTURE_DOUBLE_PRESS, second->data.button.gesture);
+    eventBusRelease(first);
+    TEST_ASSERT_EQUAL_UINT8(1, eventBusGetStats().poolInUse);
+    eventBusRelease(second);
+    TEST_ASSERT_EQUAL_UINT8(0, eventBusGetStats().poolInUse);
+}
+
+void test_full_queue_drops_the_delivery_not_the_message(void) {
+    publish(TOPIC_WIFI_STATE);
+    publish(TOPIC_WIFI_STATE);
+    EventBusStats stats = eventBusGetStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.queueOverflows);
+    TEST_ASSERT_EQUAL_UINT8(1, stats.poolInUse); // Only the queued one is held
+    TEST_ASSERT_EQUAL_UINT32(1, drain(wifiQueue));
+    TEST_ASSERT_EQUAL_UINT8(0, eventBusGetStats().poolInUse);
+}
+
+void test_concurrent_publish_and_release_keep_the_pool_consistent(void) {
+    const uint32_t messages = 200000;
+    std::atomic<bool> done(false);
+    uint32_t received[2] = {0, 0};
+    std::thread subscribers[2];
+    for (uint8_t i = 0; i < 2; i++) {
+        subscribers[i] = std::thread([i, &done, &received] {
+            while (!done.load()) {
+                const BusMessage* message = eventBusReceive(sampleQueues[i], 1);
+                if (message != NULL) {
+                    eventBusRelease(message);
+                    received[i]++;
+                }
+            }
+            received[i] += drain(sampleQueues[i]);
+        });
+    }
+    for (uint32_t i = 0; i < messages; i++) {
+        publish(TOPIC_SAMPLE);
+    }
+    done.store(true);
+    subscribers[0].join();
+    subscribers[1].join();
+
+    EventBusStats stats = eventBusGetStats();
+    TEST_ASSERT_EQUAL_UINT32(messages, stats.published);
+    TEST_ASSERT_EQUAL_UINT32(2 * messages, received[0] + received[1] + stats.queueOverflows);
+    TEST_ASSERT_EQUAL_UINT8(0, stats.poolInUse);
+}
+
+// --- Benchmark ---
+
+/**
+ * @brief Times a publish loop and prints the average cost per message.
+ * @param label Name of the case.
+ * @param topic Topic to publish.
+ * @param receive Subscribers to receive and release each message from, NULL for none.
+ */
+static void benchmark(const char* label, EventTopic topic, EventSubscriber* const* receive) {
+    const uint32_t iterations = 1000000;
+    initEventBus();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        eventBusPublish(eventBusAcquire(topic));
+        for (uint8_t s = 0; receive != NULL && s < 2; s++) {
+            eventBusRelease(eventBusReceive(receive[s], 0));
+        }
+    }
+    double totalNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    EventBusStats stats = eventBusGetStats();
+    printf("  %-48s %6.0f ns per message\n", label, totalNs / iterations);
+    TEST_ASSERT_EQUAL_UINT32(iterations, stats.published);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.queueOverflows);
+    TEST_ASSERT_EQUAL_UINT8(0, stats.poolInUse);
+}
+
+void test_benchmark_publish_and_dispatch(void) {
+    benchmark("acquire + publish, no subscriber", TOPIC_UPLINK_RESULT, NULL);
+    benchmark("acquire + publish, 1 callback", TOPIC_ALERT, NULL);
+    benchmark("publish + 2 queues receive/release + callback", TOPIC_BUTTON, buttonQueues);
+}
+
+int main(int argc, char** argv) {
+    buttonQueues[0] = eventBusSubscribe(TOPIC_BIT(TOPIC_BUTTON), 4);
+    buttonQueues[1] = eventBusSubscribe(TOPIC_BIT(TOPIC_BUTTON), 4);
+    eventBusSubscribeCallback(TOPIC_BIT(TOPIC_BUTTON), buttonCallback, NULL);
+    eventBusSubscribeCallback(TOPIC_BIT(TOPIC_ALERT), alertCallback, &alertCalls);
+    wifiQueue = eventBusSubscribe(TOPIC_BIT(TOPIC_WIFI_STATE), 1);
+    sampleQueues[0] = eventBusSubscribe(TOPIC_BIT(TOPIC_SAMPLE), 8);
+    sampleQueues[1] = eventBusSubscribe(TOPIC_BIT(TOPIC_SAMPLE), 8);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_pool_exhaustion_is_counted);
+    RUN_TEST(test_message_returns_to_the_pool_after_the_last_release);
+    RUN_TEST(test_full_queue_drops_the_delivery_not_the_message);
+    RUN_TEST(test_concurrent_publish_and_release_keep_the_pool_consistent);
+    RUN_TEST(test_benchmark_publish_and_dispatch);
+    return UNITY_END();
+}
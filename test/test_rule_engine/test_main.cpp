@@ -0,0 +1,190 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the threshold rule compiler and its interpreter.
+ *
+ * Covers the compile-time limits of a rule set (RULE_MAX_RULES rules,
+ * RULE_MAX_CODE_BYTES of bytecode, RULE_STACK_DEPTH stack entries) and the
+ * evaluation of hold times and unavailable inputs.
+ *
+ *     pio test -e native -f test_rule_engine
+ */
+#include <unity.h>
+
+#include <math.h>
+#include <string>
+
+#include "rule_engine.h"
+
+// --- Helpers ---
+
+static RuleSet set;
+static float inputs[RULE_INPUT_COUNT];
+
+/** @brief Bytecode of one comparison: LOAD input, CONST float, compare. */
+static const uint16_t COMPARISON_BYTES = 8;
+
+/**
+ * @brief Builds a rule of comparisons joined with "and".
+ * @param count Number of comparisons.
+ * @return The rule source.
+ */
+static std::string chainOfComparisons(uint16_t count) {
+    std::string rule;
+    for (uint16_t i = 0; i < count; i++) {
+        rule += i == 0 ? "humidity > 0.1" : " and humidity > 0.1";
+    }
+    return rule;
+}
+
+static uint8_t firedRule;
+static float firedValue;
+
+static void recordFired(uint8_t rule, float value, void* context) {
+    firedRule = rule;
+    firedValue = value;
+    (*(uint8_t*)context)++;
+}
+
+void setUp(void) {
+    for (uint8_t i = 0; i < RULE_INPUT_COUNT; i++) {
+        inputs[i] = NAN;
+    }
+    firedRule = 0xFF;
+    firedValue = NAN;
+}
+
+void tearDown(void) {}
+
+// --- Limits ---
+
+void test_rule_count_limit(void) {
+    std::string source;
+    for (uint8_t i = 0; i < RULE_MAX_RULES; i++) {
+        source += "temperature > 1;";
+    }
+    const char* error = NULL;
+    uint8_t errorRule = 0xFF;
+    TEST_ASSERT_TRUE(ruleSetCompile(source.c_str(), set, &error, &errorRule));
+    TEST_ASSERT_EQUAL_UINT8(RULE_MAX_RULES, set.ruleCount);
+    TEST_ASSERT_NULL(error);
+
+    source += "pressure < 1000";
+    TEST_ASSERT_FALSE(ruleSetCompile(source.c_str(), set, &error, &errorRule));
+    TEST_ASSERT_EQUAL_STRING("too many rules", error);
+    TEST_ASSERT_EQUAL_UINT8(RULE_MAX_RULES, errorRule);
+}
+
+void test_empty_rules_do_not_count(void) {
+    TEST_ASSERT_TRUE(ruleSetCompile(";\n ;temperature > 1;;\n", set, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(1, set.ruleCount);
+}
+
+void test_code_size_limit(void) {
+    // n comparisons take n * 8 bytes, n - 1 AND opcodes and one END
+    const uint16_t fitting = RULE_MAX_CODE_BYTES / (COMPARISON_BYTES + 1);
+    std::string source = chainOfComparisons(fitting);
+    const char* error = NULL;
+    TEST_ASSERT_TRUE(ruleSetCompile(source.c_str(), set, &error, NULL));
+    TEST_ASSERT_EQUAL_UINT16(fitting * (COMPARISON_BYTES + 1), set.codeBytes);
+    TEST_ASSERT_LESS_OR_EQUAL(RULE_MAX_CODE_BYTES, set.codeBytes);
+
+    source = chainOfComparisons(fitting + 1);
+    TEST_ASSERT_FALSE(ruleSetCompile(source.c_str(), set, &error, NULL));
+    TEST_ASSERT_EQUAL_STRING("rule code too large", error);
+}
+
+void test_code_size_limit_spans_the_rules_of_a_set(void) {
+    // Each rule fits on its own, together they exceed the shared code array
+    const uint16_t perRule = RULE_MAX_CODE_BYTES / (COMPARISON_BYTES + 1) / 2 + 1;
+    std::string source = chainOfComparisons(perRule) + ";" + chainOfComparisons(perRule);
+    const char* error = NULL;
+    uint8_t errorRule = 0xFF;
+    TEST_ASSERT_TRUE(ruleSetCompile(chainOfComparisons(perRule).c_str(), set, NULL, NULL));
+    TEST_ASSERT_FALSE(ruleSetCompile(source.c_str(), set, &error, &errorRule));
+    TEST_ASSERT_EQUAL_STRING("rule code too large", error);
+    TEST_ASSERT_EQUAL_UINT8(1, errorRule);
+}
+
+void test_deepest_expression_stays_within_the_stack(void) {
+    // Without parentheses the deepest stack is reached by an "and" chain
+    // inside the second term of an "or": 1 + 1 + 2 entries
+    const char* source =
+        "temperature < 0 or humidity > 0.5 and wind_speed > 10 and pressure < 1000 and sunshine < 5";
+    const char* error = NULL;
+    TEST_ASSERT_TRUE(ruleSetCompile(source, set, &error, NULL));
+    TEST_ASSERT_NULL(error);
+
+    inputs[RULE_INPUT_TEMPERATURE] = 5;
+    inputs[RULE_INPUT_HUMIDITY] = 0.9f;
+    inputs[RULE_INPUT_WIND_SPEED] = 12;
+    inputs[RULE_INPUT_PRESSURE] = 990;
+    inputs[RULE_INPUT_SUNSHINE] = 1;
+    TEST_ASSERT_EQUAL_UINT8(1, ruleSetEvaluate(set, inputs, 0, NULL, NULL));
+
+    inputs[RULE_INPUT_SUNSHINE] = 50;
+    TEST_ASSERT_EQUAL_UINT8(0, ruleSetEvaluate(set, inputs, 0, NULL, NULL));
+}
+
+void test_syntax_errors_name_the_rule(void) {
+    const char* error = NULL;
+    uint8_t errorRule = 0xFF;
+    TEST_ASSERT_FALSE(ruleSetCompile("temperature > 1; dew_point > 3", set, &error, &errorRule));
+    TEST_ASSERT_EQUAL_STRING("unknown field", error);
+    TEST_ASSERT_EQUAL_UINT8(1, errorRule);
+
+    TEST_ASSERT_FALSE(ruleSetCompile("temperature >", set, &error, &errorRule));
+    TEST_ASSERT_EQUAL_STRING("number expected", error);
+    TEST_ASSERT_FALSE(ruleSetCompile("temperature 3", set, &error, &errorRule));
+    TEST_ASSERT_EQUAL_STRING("comparison expected", error);
+    TEST_ASSERT_FALSE(ruleSetCompile("temperature > 3 for -1 s", set, &error, &errorRule));
+    TEST_ASSERT_EQUAL_STRING("invalid hold time", error);
+}
+
+// --- Evaluation ---
+
+void test_rule_fires_once_after_the_hold_time(void) {
+    TEST_ASSERT_TRUE(ruleSetCompile("wind_gust > 15 for 30 s", set, NULL, NULL));
+    uint8_t fired = 0;
+    inputs[RULE_INPUT_WIND_GUST] = 20;
+    TEST_ASSERT_EQUAL_UINT8(0, ruleSetEvaluate(set, inputs, 1000, recordFired, &fired));
+    TEST_ASSERT_EQUAL_UINT8(0, ruleSetEvaluate(set, inputs, 30999, recordFired, &fired));
+    TEST_ASSERT_EQUAL_UINT8(1, ruleSetEvaluate(set, inputs, 31000, recordFired, &fired));
+    TEST_ASSERT_EQUAL_UINT8(0, firedRule);
+    TEST_ASSERT_EQUAL_FLOAT(20, firedValue);
+    TEST_ASSERT_EQUAL_UINT8(0, ruleSetEvaluate(set, inputs, 60000, recordFired, &fired));
+
+    // The condition must become false before the rule can fire again
+    inputs[RULE_INPUT_WIND_GUST] = 10;
+    ruleSetEvaluate(set, inputs, 61000, recordFired, &fired);
+    inputs[RULE_INPUT_WIND_GUST] = 20;
+    ruleSetEvaluate(set, inputs, 62000, recordFired, &fired);
+    TEST_ASSERT_EQUAL_UINT8(1, ruleSetEvaluate(set, inputs, 92000, recordFired, &fired));
+    TEST_ASSERT_EQUAL_UINT8(2, fired);
+}
+
+void test_hold_time_across_millis_wrap(void) {
+    TEST_ASSERT_TRUE(ruleSetCompile("temperature < 2 for 500 ms", set, NULL, NULL));
+    inputs[RULE_INPUT_TEMPERATURE] = 0;
+    TEST_ASSERT_EQUAL_UINT8(0, ruleSetEvaluate(set, inputs, 0xFFFFFF00UL, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(0, ruleSetEvaluate(set, inputs, 0x000000F3UL, NULL, NULL)); // 499 ms
+    TEST_ASSERT_EQUAL_UINT8(1, ruleSetEvaluate(set, inputs, 0x000000F4UL, NULL, NULL)); // 500 ms
+}
+
+void test_unavailable_inputs_are_false(void) {
+    TEST_ASSERT_TRUE(ruleSetCompile("temperature < 2; temperature != 2", set, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(0, ruleSetEvaluate(set, inputs, 0, NULL, NULL));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_rule_count_limit);
+    RUN_TEST(test_empty_rules_do_not_count);
+    RUN_TEST(test_code_size_limit);
+    RUN_TEST(test_code_size_limit_spans_the_rules_of_a_set);
+    RUN_TEST(test_deepest_expression_stays_within_the_stack);
+    RUN_TEST(test_syntax_errors_name_the_rule);
+    RUN_TEST(test_rule_fires_once_after_the_hold_time);
+    RUN_TEST(test_hold_time_across_millis_wrap);
+    RUN_TEST(test_unavailable_inputs_are_false);
+    return UNITY_END();
+}
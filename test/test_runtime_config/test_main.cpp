@@ -0,0 +1,211 @@
+/**
+ * @file test_main.cpp
+ * @brief Host tests for the server-controlled runtime configuration.
+ *
+ * Covers parsing of partial and out-of-range control blocks, the all-or-nothing
+ * validation, and switching the active configuration without a restart. The
+ * NVS store and the sensor task are replaced by fakes that record their calls.
+ *
+ *     pio test -e native-runtime-config
+ */
+#include <unity.h>
+
+#include "runtime_config.h"
+#include "data_sender.h"
+#include "nvs_handler.h"
+
+// --- Fakes ---
+
+static uint8_t saveCalls;
+static RuntimeConfig savedConfig;
+static uint8_t rescheduleCalls;
+
+bool loadRuntimeConfigFromNVS(RuntimeConfig& config) {
+    return false;
+}
+
+void saveRuntimeConfigToNVS(const RuntimeConfig& config) {
+    saveCalls++;
+    savedConfig = config;
+}
+
+void rescheduleSampling() {
+    rescheduleCalls++;
+}
+
+// --- Helpers ---
+
+/**
+ * @brief Parses a response on top of the active configuration and applies the result.
+ * @param response Server response containing a control block.
+ * @return Result of applyRuntimeConfig(), false if there is no control block.
+ */
+static bool applyResponse(const char* response) {
+    RuntimeConfig config = getRuntimeConfig();
+    return parseControlBlock(String(response), config) && applyRuntimeConfig(config, true);
+}
+
+/**
+ * @brief Parses a response on top of the defaults and returns the first violated limit.
+ * @param response Server response containing a control block.
+ * @return The reason reported by validateRuntimeConfig(), NULL if the result is valid.
+ */
+static const char* rejectionOf(const char* response) {
+    RuntimeConfig config = defaultRuntimeConfig();
+    const char* reason = NULL;
+    parseControlBlock(String(response), config);
+    validateRuntimeConfig(config, &reason);
+    return reason;
+}
+
+void setUp(void) {
+    applyRuntimeConfig(defaultRuntimeConfig(), false);
+    saveCalls = 0;
+    rescheduleCalls = 0;
+}
+
+void tearDown(void) {}
+
+// --- Parsing ---
+
+void test_response_without_control_block(void) {
+    RuntimeConfig config = defaultRuntimeConfig();
+    TEST_ASSERT_FALSE(parseControlBlock(String("{\"ack\": 12}"), config));
+    TEST_ASSERT_FALSE(parseControlBlock(String("{\"control\": 5"), config));
+    TEST_ASSERT_TRUE(config == defaultRuntimeConfig());
+}
+
+void test_partial_block_keeps_the_other_members(void) {
+    RuntimeConfig config = defaultRuntimeConfig();
+    TEST_ASSERT_TRUE(parseControlBlock(String("{\"ack\": 3, \"control\": {\"report_ms\": 60000}}"), config));
+    RuntimeConfig expected = defaultRuntimeConfig();
+    expected.reportPeriodMs = 60000;
+    TEST_ASSERT_TRUE(config == expected);
+
+    TEST_ASSERT_TRUE(parseControlBlock(String("{\"control\": {\"downsample\": \"wind_speed:max:10\"}}"), config));
+    expected.downsampling[4].aggregation = AGGREGATE_MAX;
+    expected.downsampling[4].windowMs = 10000;
+    TEST_ASSERT_TRUE(config == expected);
+}
+
+void test_members_after_the_block_are_ignored(void) {
+    RuntimeConfig config = defaultRuntimeConfig();
+    TEST_ASSERT_TRUE(parseControlBlock(String("{\"control\": {\"batch\": 4}, \"sample_ms\": 2000}"), config));
+    TEST_ASSERT_EQUAL_UINT8(4, config.batchSize);
+    TEST_ASSERT_EQUAL_UINT32(DATA_SEND_INTERVAL, config.samplePeriodMs);
+}
+
+void test_out_of_range_members_are_rejected(void) {
+    TEST_ASSERT_EQUAL_STRING("sample_ms out of range", rejectionOf("{\"control\": {\"sample_ms\": 10}}"));
+    TEST_ASSERT_EQUAL_STRING("sample_ms out of range", rejectionOf("{\"control\": {\"sample_ms\": 3600001}}"));
+    TEST_ASSERT_EQUAL_STRING("report_ms out of range", rejectionOf("{\"control\": {\"report_ms\": 86400001}}"));
+    TEST_ASSERT_EQUAL_STRING("wind_ms out of range", rejectionOf("{\"control\": {\"wind_ms\": 19}}"));
+    TEST_ASSERT_EQUAL_STRING("wind_ms out of range", rejectionOf("{\"control\": {\"wind_ms\": 70000}}"));
+    TEST_ASSERT_EQUAL_STRING("batch out of range", rejectionOf("{\"control\": {\"batch\": 0}}"));
+    TEST_ASSERT_EQUAL_STRING("batch out of range", rejectionOf("{\"control\": {\"batch\": 300}}"));
+    TEST_ASSERT_EQUAL_STRING("invalid fields mask", rejectionOf("{\"control\": {\"fields\": 0}}"));
+    TEST_ASSERT_EQUAL_STRING("invalid fields mask", rejectionOf("{\"control\": {\"fields\": 64}}"));
+    TEST_ASSERT_EQUAL_STRING("invalid aggregation", rejectionOf("{\"control\": {\"downsample\": \"wind_speed:median:10\"}}"));
+    TEST_ASSERT_EQUAL_STRING("invalid aggregation", rejectionOf("{\"control\": {\"downsample\": \"dew_point:max:10\"}}"));
+    TEST_ASSERT_EQUAL_STRING("downsample window out of range",
+                             rejectionOf("{\"control\": {\"downsample\": \"temperature:mean:86401\"}}"));
+    TEST_ASSERT_NULL(rejectionOf("{\"control\": {\"sample_ms\": 1000, \"report_ms\": 86400000, \"wind_ms\": 5000, "
+                                 "\"batch\": 12, \"fields\": 63, \"downsample\": \"temperature:mean:86400\"}}"));
+}
+
+void test_sum_and_count_that_can_saturate_are_rejected(void) {
+    // A window holds window / sample_ms + 1 samples; a record field holds at most INT16_MAX
+    TEST_ASSERT_NULL(rejectionOf("{\"control\": {\"sample_ms\": 1000, \"downsample\": \"humidity:count:326\"}}"));
+    TEST_ASSERT_EQUAL_STRING("downsample sum or count too large",
+                             rejectionOf("{\"control\": {\"sample_ms\": 1000, \"downsample\": \"humidity:count:327\"}}"));
+    TEST_ASSERT_NULL(rejectionOf("{\"control\": {\"sample_ms\": 1000, \"downsample\": \"pressure:sum:1\"}}"));
+    TEST_ASSERT_EQUAL_STRING("downsample sum or count too large",
+                             rejectionOf("{\"control\": {\"sample_ms\": 1000, \"downsample\": \"pressure:sum:2\"}}"));
+    TEST_ASSERT_NULL(rejectionOf("{\"control\": {\"sample_ms\": 1000, \"downsample\": \"precipitation:sum:300\"}}"));
+    TEST_ASSERT_NULL(rejectionOf("{\"control\": {\"downsample\": \"pressure:sum:0\"}}")); // Pass-through
+
+    // A shorter sample period puts more samples into the same window
+    TEST_ASSERT_NULL(rejectionOf("{\"control\": {\"sample_ms\": 60000, \"downsample\": \"temperature:sum:2220\"}}"));
+    TEST_ASSERT_EQUAL_STRING("downsample sum or count too large",
+                             rejectionOf("{\"control\": {\"sample_ms\": 30000, \"downsample\": \"temperature:sum:2220\"}}"));
+}
+
+// --- Hot Switch ---
+
+void test_valid_block_switches_without_restart(void) {
+    TEST_ASSERT_TRUE(applyResponse("{\"control\": {\"sample_ms\": 2000, \"batch\": 5, \"fields\": 7}}"));
+    RuntimeConfig active = getRuntimeConfig();
+    TEST_ASSERT_EQUAL_UINT32(2000, active.samplePeriodMs);
+    TEST_ASSERT_EQUAL_UINT8(5, active.batchSize);
+    TEST_ASSERT_EQUAL_UINT8(7, active.fieldMask);
+    TEST_ASSERT_EQUAL_UINT8(1, rescheduleCalls);
+    TEST_ASSERT_EQUAL_UINT8(1, saveCalls);
+    TEST_ASSERT_TRUE(savedConfig == active);
+}
+
+void test_invalid_block_leaves_the_active_configuration(void) {
+    TEST_ASSERT_FALSE(applyResponse("{\"control\": {\"sample_ms\": 2000, \"batch\": 40}}"));
+    TEST_ASSERT_TRUE(getRuntimeConfig() == defaultRuntimeConfig());
+    TEST_ASSERT_EQUAL_UINT8(0, rescheduleCalls);
+    TEST_ASSERT_EQUAL_UINT8(0, saveCalls);
+}
+
+void test_unchanged_configuration_is_not_reapplied(void) {
+    TEST_ASSERT_TRUE(applyResponse("{\"control\": {\"report_ms\": 30000}}"));
+    TEST_ASSERT_TRUE(applyResponse("{\"control\": {\"report_ms\": 30000}}"));
+    TEST_ASSERT_EQUAL_UINT8(1, rescheduleCalls);
+    TEST_ASSERT_EQUAL_UINT8(1, saveCalls);
+
+    // Padding with different content must not count as a change
+    RuntimeConfig copy;
+    memset(&copy, 0xA5, sizeof(copy));
+    RuntimeConfig active = getRuntimeConfig();
+    copy.samplePeriodMs = active.samplePeriodMs;
+    copy.reportPeriodMs = active.reportPeriodMs;
+    copy.windPeriodMs = active.windPeriodMs;
+    copy.batchSize = active.batchSize;
+    copy.fieldMask = active.fieldMask;
+    for (uint8_t i = 0; i < SAMPLE_FIELD_COUNT; i++) {
+        copy.downsampling[i].aggregation = active.downsampling[i].aggregation;
+        copy.downsampling[i].windowMs = active.downsampling[i].windowMs;
+    }
+    TEST_ASSERT_TRUE(applyRuntimeConfig(copy, true));
+    TEST_ASSERT_EQUAL_UINT8(1, rescheduleCalls);
+}
+
+void test_apply_without_persist_does_not_store(void) {
+    RuntimeConfig config = defaultRuntimeConfig();
+    config.windPeriodMs = 250;
+    TEST_ASSERT_TRUE(applyRuntimeConfig(config, false));
+    TEST_ASSERT_EQUAL_UINT16(250, getRuntimeConfig().windPeriodMs);
+    TEST_ASSERT_EQUAL_UINT8(1, rescheduleCalls);
+    TEST_ASSERT_EQUAL_UINT8(0, saveCalls);
+}
+
+// --- Field Mask ---
+
+void test_masked_fields_are_missing(void) {
+    WeatherSample sample = {};
+    sample.temperature = 215;
+    sample.windSpeed = 30;
+    sample.windGust = 55;
+    maskSampleFields(sample, FIELD_ALL & ~FIELD_WIND_SPEED);
+    TEST_ASSERT_EQUAL(215, sample.temperature);
+    TEST_ASSERT_EQUAL(SAMPLE_MISSING, sample.windSpeed);
+    TEST_ASSERT_EQUAL(SAMPLE_MISSING, sample.windGust);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_response_without_control_block);
+    RUN_TEST(test_partial_block_keeps_the_other_members);
+    RUN_TEST(test_members_after_the_block_are_ignored);
+    RUN_TEST(test_out_of_range_members_are_rejected);
+    RUN_TEST(test_sum_and_count_that_can_saturate_are_rejected);
+    RUN_TEST(test_valid_block_switches_without_restart);
+    RUN_TEST(test_invalid_block_leaves_the_active_configuration);
+    RUN_TEST(test_unchanged_configuration_is_not_reapplied);
+    RUN_TEST(test_apply_without_persist_does_not_store);
+    RUN_TEST(test_masked_fields_are_missing);
+    return UNITY_END();
+}
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Fault-injecting data server for testing the station's sequence numbers and acks.
+
+Serves the station's HTTP API (set the station's server address to this
+host and port) and answers reports on /<mac>/data with the cumulative ack
+watermark {"ack": N}. Faults are injected at random, per report:
+
+  --drop-request P   the report is lost: the connection is closed unread
+  --drop-response P  the report is stored but the ack is lost
+  --duplicate P      the report is delivered twice (a replay)
+  --reorder P        the answer carries an older ack, as if it was overtaken
+
+The server stores each sequence number once. When a report starts above the
+watermark, the records in between are no longer held by the station (it
+resends from its oldest unacknowledged record), so they are counted as lost.
+At the end it checks that no record was lost and exits with 1 otherwise.
+Sequence numbers are reserved in blocks, so a reboot of the station during
+the run also shows up as a gap.
+
+    python3 tools/ack_fault_server.py --port 5000 --drop-request 0.1 --drop-response 0.1 --duplicate 0.1 --reorder 0.1 --seconds 600
+
+Protobuf reports are answered with 415, so the station falls back to JSON.
+Only request/response transports are covered (HTTP; the same logic applies
+to HTTPS and CoAP).
+"""
+import argparse
+import http.server
+import json
+import random
+import sys
+import threading
+import time
+
+
+class Ledger:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.stored = set()
+        self.watermark = None
+        self.history = []          # Acks sent so far, for --reorder
+        self.gaps = []             # (first, last) ranges the station gave up
+        self.counts = dict(reports=0, records=0, duplicates=0, dropped_requests=0,
+                           dropped_responses=0, replays=0, stale_acks=0)
+
+    def deliver(self, seqs):
+        """Stores a report and returns the new watermark."""
+        with self.lock:
+            self.counts["reports"] += 1
+            for seq in seqs:
+                if seq in self.stored or (self.watermark is not None and seq <= self.watermark):
+                    self.counts["duplicates"] += 1
+                else:
+                    self.stored.add(seq)
+                    self.counts["records"] += 1
+            first = min(seqs)
+            if self.watermark is None:
+                self.watermark = first - 1
+            elif first - 1 > self.watermark:
+                missing = [seq for seq in range(self.watermark + 1, first) if seq not in self.stored]
+                if missing:
+                    self.gaps.append((missing[0], missing[-1]))
+                self.watermark = first - 1
+            while self.watermark + 1 in self.stored:
+                self.watermark += 1
+                self.stored.discard(self.watermark)
+            self.history.append(self.watermark)
+            return self.watermark
+
+    def stale_ack(self):
+        with self.lock:
+            self.counts["stale_acks"] += 1
+            return random.choice(self.history[-8:])
+
+    def summary(self):
+        with self.lock:
+            lost = sum(last - first + 1 for first, last in self.gaps)
+            return ("reports=%(reports)d records=%(records)d duplicates=%(duplicates)d "
+                    "dropped requests=%(dropped_requests)d dropped responses=%(dropped_responses)d "
+                    "replays=%(replays)d stale acks=%(stale_acks)d" % self.counts
+                    + " watermark=%s lost=%d %s" % (self.watermark, lost, self.gaps[:8] if self.gaps else ""))
+
+
+def sequence_numbers(body):
+    """Returns the "seq" members of a report (one object or an array of objects)."""
+    report = json.loads(body)
+    records = report if isinstance(report, list) else [report]
+    return [int(record["seq"]) for record in records if "seq" in record]
+
+
+def make_handler(ledger, faults):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def log_message(self, format, *args):
+            pass
+
+        def answer(self, status, body=b""):
+            self.send_response(status)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def do_GET(self):
+            self.answer(200)  # Registration
+
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            if not self.path.endswith("/data"):
+                self.answer(200)  # Alerts, backfill, diagnostics
+                return
+            if "protobuf" in self.headers.get("Content-Type", ""):
+                self.answer(415)
+                return
+            try:
+                seqs = sequence_numbers(body)
+            except (ValueError, KeyError, TypeError):
+                self.answer(400)
+                return
+            if not seqs:
+                self.answer(200, b"{}")
+                return
+            if random.random() < faults.drop_request:
+                ledger.counts["dropped_requests"] += 1
+                self.close_connection = True
+                return
+            ack = ledger.deliver(seqs)
+            if random.random() < faults.duplicate:
+                ledger.counts["replays"] += 1
+                ack = ledger.deliver(seqs)
+            if random.random() < faults.drop_response:
+                ledger.counts["dropped_responses"] += 1
+                self.close_connection = True
+                return
+            if random.random() < faults.reorder:
+                ack = ledger.stale_ack()
+            self.answer(200, json.dumps({"ack": ack}).encode())
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=5000)
+    parser.add_argument("--seconds", type=float, default=0, help="run time, 0 until interrupted")
+    parser.add_argument("--seed", type=int, default=None)
+    for fault in ("drop-request", "drop-response", "duplicate", "reorder"):
+        parser.add_argument("--" + fault, type=float, default=0.0, metavar="P")
+    args = parser.parse_args()
+    random.seed(args.seed)
+
+    ledger = Ledger()
+    server = http.server.ThreadingHTTPServer(("", args.port), make_handler(ledger, args))
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print("listening on port %d" % args.port)
+    started = time.monotonic()
+    try:
+        while not args.seconds or time.monotonic() - started < args.seconds:
+            time.sleep(min(30, args.seconds) if args.seconds else 30)
+            print(ledger.summary())
+    except KeyboardInterrupt:
+        pass
+    server.shutdown()
+    print(ledger.summary())
+    if ledger.gaps:
+        print("FAIL: records were lost (or the station rebooted during the run)")
+        sys.exit(1)
+    print("OK: every record was stored once")
+
+
+if __name__ == "__main__":
+    main()
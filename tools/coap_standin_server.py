@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+"""CoAP stand-in data server for the station's CoAP uplink (WS_TRANSPORT_COAP).
+
+Answers confirmable requests on UDP port 5683 the way a data server behind
+CoAP would: reports to /<mac>/data get a piggybacked 2.04 Changed carrying the
+cumulative ack {"ack": N}; other POSTs (alerts, backfill, diagnostics) get an
+empty 2.04, GETs (registration) a 2.05. Block1 transfers (RFC 7959) are
+reassembled and each non-final block is answered with 2.31 Continue.
+Retransmitted messages are recognised by message id and answered with the
+same reply again. Point the station at this host (the HTTP port of the server
+address is replaced by 5683):
+
+    python3 tools/coap_standin_server.py --port 5683 --loss 0.1 --seconds 600
+
+Options that exercise the client:
+
+  --loss P          an incoming message is dropped (the client retransmits)
+  --separate P      the request is answered with an empty ACK first and the
+                    response follows as a separate confirmable message
+  --block-size N    a smaller block size is proposed in 2.31 Continue
+
+A summary of messages, retransmissions, blocks and bytes is printed every
+30 s and at the end. tools/radio_on_sim.py uses this server to compare the
+radio-on time of CoAP and HTTP uploads.
+"""
+import argparse
+import json
+import random
+import socket
+import threading
+import time
+
+VERSION = 1
+CON, NON, ACK, RST = 0, 1, 2, 3
+GET, POST = 1, 2
+CHANGED = (2 << 5) | 4       # 2.04
+CONTENT = (2 << 5) | 5       # 2.05
+CONTINUE = (2 << 5) | 31     # 2.31
+BAD_REQUEST = (4 << 5) | 0   # 4.00
+INCOMPLETE = (4 << 5) | 8    # 4.08 Request Entity Incomplete
+URI_PATH, CONTENT_FORMAT, BLOCK1, SIZE1 = 11, 12, 27, 60
+FORMAT_JSON = 50
+
+
+# --- Message Codec (RFC 7252) ---
+
+def encode_option_nibble(value):
+    """Returns the 4-bit nibble and the extension bytes of an option delta or length."""
+    if value < 13:
+        return value, b""
+    if value < 269:
+        return 13, bytes([value - 13])
+    return 14, (value - 269).to_bytes(2, "big")
+
+
+def uint_bytes(value):
+    """Encodes an unsigned option value in the fewest bytes (0 is empty)."""
+    return value.to_bytes((value.bit_length() + 7) // 8, "big")
+
+
+def encode(kind, code, message_id, token=b"", options=(), payload=b""):
+    """Encodes a message. options is a list of (number, bytes), in any order."""
+    out = bytearray([(VERSION << 6) | (kind << 4) | len(token), code, message_id >> 8, message_id & 0xFF])
+    out += token
+    last = 0
+    for number, value in sorted(options, key=lambda option: option[0]):
+        delta, delta_ext = encode_option_nibble(number - last)
+        length, length_ext = encode_option_nibble(len(value))
+        out.append((delta << 4) | length)
+        out += delta_ext + length_ext + value
+        last = number
+    if payload:
+        out.append(0xFF)
+        out += payload
+    return bytes(out)
+
+
+def decode(data):
+    """Decodes a message into a dict, or returns None if it is malformed."""
+    if len(data) < 4 or data[0] >> 6 != VERSION:
+        return None
+    token_length = data[0] & 0x0F
+    if token_length > 8 or len(data) < 4 + token_length:
+        return None
+    message = dict(kind=(data[0] >> 4) & 0x03, code=data[1], mid=(data[2] << 8) | data[3],
+                   token=bytes(data[4:4 + token_length]), options=[], payload=b"")
+    position = 4 + token_length
+    number = 0
+    while position < len(data):
+        if data[position] == 0xFF:
+            message["payload"] = bytes(data[position + 1:])
+            break
+        fields = []
+        nibbles = (data[position] >> 4, data[position] & 0x0F)
+        position += 1
+        for nibble in nibbles:
+            if nibble == 15:
+                return None
+            if nibble == 13:
+                fields.append(data[position] + 13)
+                position += 1
+            elif nibble == 14:
+                fields.append(int.from_bytes(data[position:position + 2], "big") + 269)
+                position += 2
+            else:
+                fields.append(nibble)
+        number += fields[0]
+        message["options"].append((number, bytes(data[position:position + fields[1]])))
+        position += fields[1]
+    return message
+
+
+def option(message, number):
+    """Returns the first value of an option, or None."""
+    for candidate, value in message["options"]:
+        if candidate == number:
+            return value
+    return None
+
+
+def uri_path(message):
+    return "/" + "/".join(value.decode(errors="replace") for number, value in message["options"] if number == URI_PATH)
+
+
+# --- Server ---
+
+class Server:
+    def __init__(self, port, loss=0.0, separate=0.0, block_size=None, bind=""):
+        self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.socket.bind((bind, port))
+        self.port = self.socket.getsockname()[1]
+        self.loss = loss
+        self.separate = separate
+        self.block_size = block_size
+        self.lock = threading.Lock()
+        self.replies = {}          # (address, message id) -> reply bytes, for retransmissions
+        self.transfers = {}        # (address, token) -> reassembled Block1 payload
+        self.watermark = 0
+        self.next_mid = random.randrange(0x10000)
+        self.counts = dict(messages=0, retransmissions=0, dropped=0, blocks=0, requests=0,
+                           bytes_in=0, bytes_out=0, separate=0)
+
+    def send(self, data, address):
+        self.counts["bytes_out"] += len(data)
+        self.socket.sendto(data, address)
+
+    def serve_forever(self):
+        while True:
+            try:
+                data, address = self.socket.recvfrom(2048)
+            except OSError:
+                return
+            with self.lock:
+                self.handle(data, address)
+
+    def close(self):
+        self.socket.close()
+
+    def handle(self, data, address):
+        if random.random() < self.loss:
+            self.counts["dropped"] += 1
+            return
+        self.counts["messages"] += 1
+        self.counts["bytes_in"] += len(data)
+        message = decode(data)
+        if message is None or message["kind"] not in (CON, NON) or message["code"] == 0:
+            return  # ACKs of separate responses, pings and garbage
+        key = (address, message["mid"])
+        if key in self.replies:
+            self.counts["retransmissions"] += 1
+            for reply in self.replies[key]:
+                self.send(reply, address)
+            return
+        code, options, payload = self.respond(message, address)
+        if len(self.replies) > 256:
+            self.replies.clear()
+        if message["kind"] == CON and random.random() < self.separate:
+            self.counts["separate"] += 1
+            self.next_mid = (self.next_mid + 1) & 0xFFFF
+            replies = [encode(ACK, 0, message["mid"]),
+                       encode(CON, code, self.next_mid, message["token"], options, payload)]
+        else:
+            kind = ACK if message["kind"] == CON else NON
+            replies = [encode(kind, code, message["mid"], message["token"], options, payload)]
+        self.replies[key] = replies
+        for reply in replies:
+            self.send(reply, address)
+
+    def respond(self, message, address):
+        """Returns (code, options, payload) of the reply to a new request."""
+        block1 = option(message, BLOCK1)
+        body = message["payload"]
+        if block1 is not None:
+            self.counts["blocks"] += 1
+            value = int.from_bytes(block1, "big")
+            num, more, szx = value >> 4, (value >> 3) & 1, value & 0x07
+            key = (address, message["token"])
+            received = self.transfers.get(key, b"")
+            if len(received) != num * (16 << szx):
+                return INCOMPLETE, [], b""
+            received += body
+            if more:
+                self.transfers[key] = received
+                reply_szx = szx
+                if self.block_size:
+                    reply_szx = min(szx, max(0, self.block_size.bit_length() - 5))
+                return CONTINUE, [(BLOCK1, uint_bytes((num << 4) | 0x08 | reply_szx))], b""
+            self.transfers.pop(key, None)
+            body = received
+        self.counts["requests"] += 1
+        if message["code"] == GET:
+            return CONTENT, [], b""
+        if not uri_path(message).endswith("/data"):
+            return CHANGED, [], b""
+        try:
+            report = json.loads(body)
+            records = report if isinstance(report, list) else [report]
+            seqs = [int(record["seq"]) for record in records if "seq" in record]
+        except (ValueError, KeyError, TypeError):
+            return BAD_REQUEST, [], b""
+        if seqs:
+            self.watermark = max(self.watermark, max(seqs))
+        return CHANGED, [(CONTENT_FORMAT, uint_bytes(FORMAT_JSON))], json.dumps({"ack": self.watermark}).encode()
+
+    def summary(self):
+        with self.lock:
+            return ("messages=%(messages)d retransmissions=%(retransmissions)d dropped=%(dropped)d "
+                    "blocks=%(blocks)d requests=%(requests)d separate=%(separate)d "
+                    "bytes in/out=%(bytes_in)d/%(bytes_out)d" % self.counts + " ack=%d" % self.watermark)
+
+
+def start(port=0, **kwargs):
+    """Starts a server on a background thread and returns it (port 0 picks a free port)."""
+    server = Server(port, **kwargs)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--seconds", type=float, default=0, help="run time, 0 until interrupted")
+    parser.add_argument("--seed", type=int, default=None)
+    parser.add_argument("--loss", type=float, default=0.0, metavar="P")
+    parser.add_argument("--separate", type=float, default=0.0, metavar="P")
+    parser.add_argument("--block-size", type=int, default=None, metavar="N", help="16..1024, power of two")
+    args = parser.parse_args()
+    random.seed(args.seed)
+
+    server = start(args.port, loss=args.loss, separate=args.separate, block_size=args.block_size)
+    print("listening on UDP port %d" % server.port)
+    started = time.monotonic()
+    try:
+        while True:
+            remaining = args.seconds - (time.monotonic() - started) if args.seconds else 30
+            if remaining <= 0:
+                break
+            time.sleep(min(30, remaining))
+            if not args.seconds or time.monotonic() - started < args.seconds:
+                print(server.summary())
+    except KeyboardInterrupt:
+        pass
+    server.close()
+    print(server.summary())
+
+
+if __name__ == "__main__":
+    main()
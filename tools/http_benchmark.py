@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Concurrent request benchmark for the station's local HTTP server.
+
+Opens N keep-alive connections that each request PATH back to back for the
+given duration, optionally while K /api/live streams are held open, and
+prints the request rate, latency percentiles and errors.
+
+    python3 tools/http_benchmark.py 192.168.1.50 --connections 4 --seconds 20 --streams 2
+"""
+import argparse
+import http.client
+import socket
+import threading
+import time
+
+
+def worker(host, port, path, deadline, latencies, errors, lock):
+    connection = None
+    while time.monotonic() < deadline:
+        try:
+            if connection is None:
+                connection = http.client.HTTPConnection(host, port, timeout=5)
+            start = time.monotonic()
+            connection.request("GET", path)
+            response = connection.getresponse()
+            response.read()
+            elapsed = time.monotonic() - start
+            with lock:
+                if response.status == 200:
+                    latencies.append(elapsed)
+                else:
+                    errors.append(response.status)
+            if response.getheader("Connection", "").lower() == "close":
+                connection.close()
+                connection = None
+        except (OSError, http.client.HTTPException) as error:
+            with lock:
+                errors.append(type(error).__name__)
+            if connection is not None:
+                connection.close()
+            connection = None
+    if connection is not None:
+        connection.close()
+
+
+def open_stream(host, port):
+    stream = socket.create_connection((host, port), timeout=5)
+    stream.sendall(("GET /api/live HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n\r\n" % host).encode())
+    status = stream.recv(64).split(b"\r\n", 1)[0].decode(errors="replace")
+    print("stream: %s" % status)
+    return stream
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    return values[min(len(values) - 1, int(len(values) * fraction))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--path", default="/api/current")
+    parser.add_argument("--connections", type=int, default=4, help="concurrent keep-alive connections")
+    parser.add_argument("--seconds", type=float, default=10.0)
+    parser.add_argument("--streams", type=int, default=0, help="/api/live streams held open during the run")
+    args = parser.parse_args()
+
+    streams = [open_stream(args.host, args.port) for _ in range(args.streams)]
+    latencies, errors, lock = [], [], threading.Lock()
+    deadline = time.monotonic() + args.seconds
+    threads = [threading.Thread(target=worker, args=(args.host, args.port, args.path, deadline, latencies, errors, lock))
+               for _ in range(args.connections)]
+    started = time.monotonic()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    duration = time.monotonic() - started
+    for stream in streams:
+        stream.close()
+
+    latencies.sort()
+    print("%d connections, %d streams, %.1f s: %d requests, %.1f req/s, latency p50/p95/max = %.1f/%.1f/%.1f ms, errors = %d"
+          % (args.connections, args.streams, duration, len(latencies), len(latencies) / duration,
+             percentile(latencies, 0.50) * 1000, percentile(latencies, 0.95) * 1000,
+             (latencies[-1] if latencies else 0.0) * 1000, len(errors)))
+    if errors:
+        print("error kinds: %s" % sorted(set(str(error) for error in errors)))
+
+
+if __name__ == "__main__":
+    main()
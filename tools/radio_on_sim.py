@@ -0,0 +1,259 @@
+#!/usr/bin/env python3
+"""Host simulator comparing the radio-on time of HTTP and CoAP uploads.
+
+Sends station-shaped JSON reports of several batch sizes to local stand-ins,
+once the way HttpTransport does (a new TCP connection and an HTTPClient-style
+POST per report) and once the way CoapTransport does (confirmable requests,
+Block1 with 512-byte blocks and Size1, retransmission after 2-3 s with the
+timeout doubled). The CoAP side talks to tools/coap_standin_server.py, started
+in-process, so --loss exercises real retransmissions.
+
+    python3 tools/radio_on_sim.py --batches 1,5,12,30 --reports 20 --loss 0.05
+
+The bytes and datagrams of both sides are counted from the real exchanges;
+the TCP segments (handshake, ACKs, FIN) that the host stack hides are added
+per connection. The radio-on time is a MODEL, not a measurement: per report,
+every round trip costs --rtt-ms, every frame its airtime at --phy-mbps with
+802.11 and IP overhead, a lost CoAP message the retransmission timeout it
+waits for, and the radio stays on for --tail-ms after the last frame. The
+model ignores TCP loss recovery, so run it without --loss for a like-for-like
+comparison. Confirm the figures on hardware with the diagnostics mode
+counters of the esp32-s3-coap environment.
+"""
+import argparse
+import http.server
+import json
+import math
+import random
+import socket
+import threading
+import time
+
+import coap_standin_server as coap
+
+MAC = "a0b1c2d3e4f5"
+BLOCK_SIZE = 512                  # COAP_BLOCK_SIZE
+ACK_TIMEOUT_MS = 2000             # COAP_ACK_TIMEOUT_MS
+MAX_RETRANSMIT = 4                # COAP_MAX_RETRANSMIT
+MSS = 1460
+IP_TCP_HEADER = 40
+IP_UDP_HEADER = 28
+WIFI_OVERHEAD = 34                # 802.11 MAC header, LLC/SNAP and FCS
+TCP_CONTROL_SEGMENTS = 7          # SYN, SYN-ACK, ACK, FIN, ACK, FIN, ACK
+
+
+# --- Reports ---
+
+def record(seq, timestamp):
+    """Returns one record as PrintfJsonEncoder writes it."""
+    return ('{"seq":%d,"timestamp":%d,"temperature":%.1f,"pressure":%.1f,"humidity":%.2f,'
+            '"sunshine":%d,"wind_speed":%.2f,"precipitation":%d}'
+            % (seq, timestamp, random.uniform(-10, 30), random.uniform(980, 1040), random.uniform(0.2, 1),
+               random.randrange(0, 1200), random.uniform(0, 25), random.randrange(0, 40)))
+
+
+def report(first_seq, batch):
+    """Returns a report body: one record, or an array of batch records."""
+    timestamp = 1760000000 + first_seq * 10
+    records = [record(first_seq + i, timestamp + i * 10) for i in range(batch)]
+    return (records[0] if batch == 1 else "[" + ",".join(records) + "]").encode()
+
+
+# --- HTTP ---
+
+class AckHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    watermark = 0
+
+    def do_POST(self):
+        body = json.loads(self.rfile.read(int(self.headers["Content-Length"])))
+        records = body if isinstance(body, list) else [body]
+        AckHandler.watermark = max([AckHandler.watermark] + [r["seq"] for r in records])
+        reply = json.dumps({"ack": AckHandler.watermark}).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(reply)))
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.wfile.write(reply)
+
+    def log_message(self, *args):
+        pass
+
+
+def http_upload(port, body):
+    """Posts one report on a new connection, as HTTPClient does. Returns (sent, received) bytes."""
+    request = ("POST /%s/data HTTP/1.1\r\nHost: 127.0.0.1:%d\r\nUser-Agent: ESP32HTTPClient\r\n"
+               "Connection: close\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n"
+               "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n" % (MAC, port, len(body))).encode() + body
+    with socket.create_connection(("127.0.0.1", port)) as connection:
+        connection.sendall(request)
+        received = b""
+        while True:
+            chunk = connection.recv(4096)
+            if not chunk:
+                break
+            received += chunk
+    if not received.startswith(b"HTTP/1.1 200"):
+        raise RuntimeError("unexpected HTTP response %r" % received[:40])
+    return len(request), len(received)
+
+
+def http_cost(sent, received, args):
+    """Models one HTTP report. Returns (frames, bytes on air, radio-on ms)."""
+    data_segments = math.ceil(sent / MSS) + math.ceil(received / MSS)
+    frames = TCP_CONTROL_SEGMENTS + data_segments + 1       # One ACK of the response data
+    air_bytes = sent + received + frames * (IP_TCP_HEADER + WIFI_OVERHEAD)
+    round_trips = 3                                         # Handshake, request/response, close
+    return frames, air_bytes, round_trips * args.rtt_ms + airtime_ms(air_bytes, args) + args.tail_ms
+
+
+# --- CoAP ---
+
+class CoapClient:
+    """Sends requests the way CoapTransport does and counts what goes over the air."""
+
+    def __init__(self, port, time_scale):
+        self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.address = ("127.0.0.1", port)
+        self.time_scale = time_scale
+        self.mid = random.randrange(0x10000)
+        self.token = random.randrange(0x10000)
+
+    def exchange(self, message_id, datagram, stats):
+        """Sends a CON message until it is answered. Returns the response."""
+        timeout_ms = ACK_TIMEOUT_MS + random.randrange(ACK_TIMEOUT_MS // 2 + 1)
+        for transmission in range(MAX_RETRANSMIT + 1):
+            self.socket.sendto(datagram, self.address)
+            stats["datagrams"] += 1
+            stats["bytes"] += len(datagram)
+            if transmission:
+                stats["retransmissions"] += 1
+            deadline = time.monotonic() + timeout_ms / 1000 * self.time_scale
+            while True:
+                self.socket.settimeout(max(0.001, deadline - time.monotonic()))
+                try:
+                    data = self.socket.recv(2048)
+                except socket.timeout:
+                    break
+                stats["datagrams"] += 1
+                stats["bytes"] += len(data)
+                response = coap.decode(data)
+                if response is None:
+                    continue
+                if response["kind"] == coap.ACK and response["mid"] == message_id and response["code"] == 0:
+                    stats["round_trips"] += 1
+                    continue                                # Separate response follows
+                if response["kind"] == coap.CON:
+                    ack = coap.encode(coap.ACK, 0, response["mid"])
+                    self.socket.sendto(ack, self.address)
+                    stats["datagrams"] += 1
+                    stats["bytes"] += len(ack)
+                stats["round_trips"] += 1
+                return response
+            stats["waited_ms"] += timeout_ms
+            timeout_ms *= 2
+        raise RuntimeError("no CoAP response after %d transmissions" % (MAX_RETRANSMIT + 1))
+
+    def post(self, body, stats):
+        """Posts a report, block-wise if it is larger than BLOCK_SIZE. Returns the final response."""
+        self.token = (self.token + 1) & 0xFFFF
+        token = self.token.to_bytes(2, "big")
+        path = [(coap.URI_PATH, MAC.encode()), (coap.URI_PATH, b"data"),
+                (coap.CONTENT_FORMAT, coap.uint_bytes(coap.FORMAT_JSON))]
+        block_size = BLOCK_SIZE
+        offset = 0
+        while True:
+            options = list(path)
+            chunk = body
+            if len(body) > BLOCK_SIZE:
+                chunk = body[offset:offset + block_size]
+                more = offset + block_size < len(body)
+                szx = block_size.bit_length() - 5
+                options.append((coap.BLOCK1, coap.uint_bytes((offset // block_size) << 4 | more << 3 | szx)))
+                if offset == 0:
+                    options.append((coap.SIZE1, coap.uint_bytes(len(body))))
+            self.mid = (self.mid + 1) & 0xFFFF
+            response = self.exchange(self.mid, coap.encode(coap.CON, coap.POST, self.mid, token, options, chunk), stats)
+            if response["code"] != coap.CONTINUE:
+                return response
+            block1 = int.from_bytes(coap.option(response, coap.BLOCK1) or b"", "big")
+            offset += len(chunk)
+            block_size = min(block_size, 16 << (block1 & 0x07))
+
+
+def coap_cost(stats, args):
+    """Models the CoAP report of stats. Returns (frames, bytes on air, radio-on ms)."""
+    frames = stats["datagrams"]
+    air_bytes = stats["bytes"] + frames * (IP_UDP_HEADER + WIFI_OVERHEAD)
+    radio_ms = stats["round_trips"] * args.rtt_ms + airtime_ms(air_bytes, args) + stats["waited_ms"] + args.tail_ms
+    return frames, air_bytes, radio_ms
+
+
+def airtime_ms(air_bytes, args):
+    return air_bytes * 8 / (args.phy_mbps * 1000)
+
+
+# --- Comparison ---
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--batches", default="1,5,12,30", help="comma-separated records per report")
+    parser.add_argument("--reports", type=int, default=20, help="reports per batch size and protocol")
+    parser.add_argument("--rtt-ms", type=float, default=30.0, help="round trip to the server")
+    parser.add_argument("--phy-mbps", type=float, default=24.0, help="PHY rate of data frames")
+    parser.add_argument("--tail-ms", type=float, default=50.0, help="radio-on time after the last frame")
+    parser.add_argument("--loss", type=float, default=0.0, metavar="P", help="CoAP messages dropped by the stand-in")
+    parser.add_argument("--separate", type=float, default=0.0, metavar="P", help="CoAP separate responses")
+    parser.add_argument("--time-scale", type=float, default=0.01, help="scales real retransmission waits")
+    parser.add_argument("--seed", type=int, default=None)
+    args = parser.parse_args()
+    random.seed(args.seed)
+
+    http_server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), AckHandler)
+    threading.Thread(target=http_server.serve_forever, daemon=True).start()
+    coap_server = coap.start(0, loss=args.loss, separate=args.separate, bind="127.0.0.1")
+    client = CoapClient(coap_server.port, args.time_scale)
+
+    print("modeled radio-on time per report (rtt %.0f ms, %.0f Mbit/s, tail %.0f ms, CoAP loss %.0f%%)"
+          % (args.rtt_ms, args.phy_mbps, args.tail_ms, args.loss * 100))
+    print("%6s %7s | %6s %7s %9s | %6s %7s %6s %9s | %6s" % ("batch", "body", "HTTP", "bytes", "radio ms",
+                                                            "CoAP", "bytes", "retx", "radio ms", "saved"))
+    seq = 1
+    for batch in [int(value) for value in args.batches.split(",")]:
+        totals = dict(body=0, http_frames=0, http_bytes=0, http_ms=0.0,
+                      coap_frames=0, coap_bytes=0, coap_ms=0.0, retransmissions=0)
+        for _ in range(args.reports):
+            body = report(seq, batch)
+            totals["body"] += len(body)
+
+            frames, air_bytes, radio_ms = http_cost(*http_upload(http_server.server_address[1], body), args)
+            totals["http_frames"] += frames
+            totals["http_bytes"] += air_bytes
+            totals["http_ms"] += radio_ms
+
+            stats = dict(datagrams=0, bytes=0, retransmissions=0, round_trips=0, waited_ms=0)
+            response = client.post(body, stats)
+            if response["code"] != coap.CHANGED or json.loads(response["payload"])["ack"] < seq + batch - 1:
+                raise RuntimeError("report %d not acknowledged over CoAP" % seq)
+            frames, air_bytes, radio_ms = coap_cost(stats, args)
+            totals["coap_frames"] += frames
+            totals["coap_bytes"] += air_bytes
+            totals["coap_ms"] += radio_ms
+            totals["retransmissions"] += stats["retransmissions"]
+            seq += batch
+
+        n = args.reports
+        print("%6d %7d | %6.1f %7d %9.1f | %6.1f %7d %6d %9.1f | %5.0f%%"
+              % (batch, totals["body"] / n, totals["http_frames"] / n, totals["http_bytes"] / n,
+                 totals["http_ms"] / n, totals["coap_frames"] / n, totals["coap_bytes"] / n,
+                 totals["retransmissions"], totals["coap_ms"] / n,
+                 100 * (1 - totals["coap_ms"] / totals["http_ms"])))
+
+    http_server.shutdown()
+    coap_server.close()
+    print("stand-in: " + coap_server.summary())
+
+
+if __name__ == "__main__":
+    main()
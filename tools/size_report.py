@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Firmware size report for the PlatformIO environments.
+
+Builds each environment with `pio run -e ENV` and reads the RAM and flash
+usage that PlatformIO prints at the end of a build. Prints a table with the
+usage of every environment and its difference from the first one (the
+default build unless --envs says otherwise). --markdown prints the same
+table in Markdown for the README.
+
+    python3 tools/size_report.py
+    python3 tools/size_report.py --envs esp32-s3-devkitm-1 esp32-s3-minimal --markdown
+"""
+import argparse
+import re
+import subprocess
+import sys
+
+DEFAULT_ENVS = [
+    "esp32-s3-devkitm-1",
+    "esp32-s3-minimal",
+    "esp32-s3-mqtt",
+    "esp32-s3-coap",
+    "esp32-s3-websocket",
+    "esp32-s3-https",
+    "esp32-s3-protobuf",
+]
+
+# "RAM:   [==        ]  15.1% (used 49500 bytes from 327680 bytes)"
+USAGE = re.compile(r"^(RAM|Flash):.*\(used (\d+) bytes from (\d+) bytes\)", re.MULTILINE)
+
+
+def build(env, pio):
+    """Builds one environment; returns {"RAM": used, "Flash": used}, or None if the build failed."""
+    result = subprocess.run([pio, "run", "-e", env], stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                            universal_newlines=True)
+    usage = {name: int(used) for name, used, total in USAGE.findall(result.stdout)}
+    if result.returncode != 0 or "RAM" not in usage or "Flash" not in usage:
+        sys.stderr.write(result.stdout[-2000:])
+        sys.stderr.write("%s: build failed (exit code %d)\n" % (env, result.returncode))
+        return None
+    return usage
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--envs", nargs="+", default=DEFAULT_ENVS, help="environments, the first is the baseline")
+    parser.add_argument("--pio", default="pio", help="PlatformIO command")
+    parser.add_argument("--markdown", action="store_true", help="print a Markdown table")
+    args = parser.parse_args()
+
+    sizes = []
+    for env in args.envs:
+        print("building %s ..." % env, file=sys.stderr)
+        sizes.append((env, build(env, args.pio)))
+    baseline = sizes[0][1]
+
+    if args.markdown:
+        print("| Environment | RAM [B] | ΔRAM [B] | Flash [B] | ΔFlash [B] |")
+        print("| --- | ---: | ---: | ---: | ---: |")
+        row = "| `%s` | %s | %s | %s | %s |"
+    else:
+        print("%-24s %9s %9s %9s %9s" % ("environment", "RAM", "dRAM", "flash", "dflash"))
+        row = "%-24s %9s %9s %9s %9s"
+    for env, usage in sizes:
+        if usage is None:
+            print(row % (env, "failed", "", "", ""))
+            continue
+        delta = {name: ("%+d" % (usage[name] - baseline[name]) if baseline else "") for name in usage}
+        print(row % (env, usage["RAM"], delta["RAM"], usage["Flash"], delta["Flash"]))
+    return 0 if all(usage is not None for env, usage in sizes) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,383 @@
+#!/usr/bin/env python3
+"""Slow data server for measuring the latency of the station's alert lane and backfill.
+
+Serves the station's HTTP API (set the station's server address to this
+host and port) and delays the answers: reports on /<mac>/data by
+--data-delay-ms, alerts on /<mac>/alert by --alert-delay-ms, backfill batches
+on /<mac>/backfill by --backfill-delay-ms. Data reports are answered with the
+cumulative ack {"ack": N}. For every alert the server logs whether a routine
+report was in flight when the alert arrived and how long the alert waited
+for its answer. Run the station in diagnostics mode: it prints the
+detection-to-ack latency of the alert lane.
+
+    python3 tools/slow_server.py --port 5000 --data-delay-ms 3000 --alert-delay-ms 50 --seconds 600
+
+With --request-backfill S the answer to the first report asks the station
+for the samples of the last S seconds ({"backfill": {"from": F, "to": T}}).
+Backfill batches are checked for their range, and the summary adds the
+batches, samples, duplicates and the backfill throughput in bytes per second.
+
+    python3 tools/slow_server.py --data-delay-ms 200 --request-backfill 3600 --seconds 600
+
+Without a station, --simulate runs a host stand-in of the two lanes against
+the server and measures the detection-to-ack latency with and without a
+routine report in flight. The routine lane posts a report every
+--report-period-ms and waits while the alert lane is sending (as uplink.cpp
+does). The alert lane posts each detection with the firmware's timeouts: 2 s
+per attempt, 3 attempts and 250 ms between them. --lanes selects how the
+transport is shared:
+
+  separate   a new connection per request (HTTP): an alert never waits for
+             a report
+  shared     one connection and request lock (HTTPS, CoAP): an alert waits
+             until the report in flight is answered
+
+    python3 tools/slow_server.py --simulate 40 --lanes separate --data-delay-ms 3000
+    python3 tools/slow_server.py --simulate 40 --lanes shared --data-delay-ms 3000
+
+--backfill N adds a backfill lane to the stand-in that sends N stored samples
+(one per 10 s) like backfill.cpp: batches of 30, a token bucket of 4096 B/s
+with 8192 B burst, and no batch while a report or an alert is being sent. It
+prints the backfill throughput, the batch latency and the due-to-ack latency
+of routine reports with and without a backfill running.
+
+    python3 tools/slow_server.py --simulate 40 --data-delay-ms 200 --backfill 3000
+"""
+import argparse
+import http.client
+import http.server
+import json
+import random
+import statistics
+import threading
+import time
+
+ALERT_TIMEOUT_MS = 2000
+ALERT_MAX_ATTEMPTS = 3
+ALERT_RETRY_DELAY_MS = 250
+ALERT_YIELD_POLL_MS = 10
+TRANSPORT_TIMEOUT_MS = 5000
+BACKFILL_RATE_BYTES_PER_S = 4096
+BACKFILL_BURST_BYTES = 8192
+BACKFILL_BATCH_SAMPLES = 30
+BACKFILL_MAX_ATTEMPTS = 3
+BACKFILL_RETRY_DELAY_MS = 5000
+BACKFILL_LIVE_POLL_MS = 50
+BACKFILL_START_S = 10        # Reports before the backfill starts, as the baseline
+SAMPLE_PERIOD_S = 10
+MAC = "A0:B1:C2:D3:E4:F5"
+
+
+class Log:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.in_flight = 0         # Data reports being answered
+        self.watermark = 0
+        self.alerts = []           # (report in flight at arrival, service ms)
+        self.reports = 0
+        self.backfill_requested = False
+        self.backfill_batches = 0
+        self.backfill_rejected = 0  # Malformed batches or samples outside the range
+        self.backfill_stamps = set()
+        self.backfill_samples = 0
+        self.backfill_bytes = 0
+        self.backfill_first = None  # Arrival of the first and the last batch
+        self.backfill_last = None
+
+    def summary(self):
+        with self.lock:
+            busy = [ms for in_flight, ms in self.alerts if in_flight]
+            idle = [ms for in_flight, ms in self.alerts if not in_flight]
+            text = ("reports=%d alerts=%d (%d during a report, server time avg %.0f ms; %d idle, avg %.0f ms)"
+                    % (self.reports, len(self.alerts), len(busy), statistics.mean(busy) if busy else 0,
+                       len(idle), statistics.mean(idle) if idle else 0))
+            if self.backfill_batches:
+                seconds = self.backfill_last - self.backfill_first
+                text += ("; backfill batches=%d (%d rejected), samples=%d (%d duplicates), %d B, %.0f B/s"
+                         % (self.backfill_batches, self.backfill_rejected, self.backfill_samples,
+                            self.backfill_samples - len(self.backfill_stamps), self.backfill_bytes,
+                            self.backfill_bytes / seconds if seconds > 0 else 0))
+            return text
+
+
+def make_handler(log, args):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def log_message(self, format, *args):
+            pass
+
+        def answer(self, status, body=b""):
+            self.send_response(status)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def do_GET(self):
+            self.answer(200)  # Registration
+
+        def do_POST(self):
+            started = time.monotonic()
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            if self.path.endswith("/alert"):
+                with log.lock:
+                    in_flight = log.in_flight > 0
+                time.sleep(args.alert_delay_ms / 1000)
+                self.answer(200)
+                with log.lock:
+                    log.alerts.append((in_flight, (time.monotonic() - started) * 1000))
+                if args.verbose:
+                    print("alert %s (%s)" % (body.decode(errors="replace"),
+                                             "during a report" if in_flight else "idle"))
+                return
+            if self.path.endswith("/backfill"):
+                self.backfill(body)
+                return
+            if not self.path.endswith("/data"):
+                self.answer(200)  # Diagnostics
+                return
+            with log.lock:
+                log.in_flight += 1
+            try:
+                time.sleep(args.data_delay_ms / 1000)
+                try:
+                    report = json.loads(body)
+                    records = report if isinstance(report, list) else [report]
+                    seqs = [int(record["seq"]) for record in records if "seq" in record]
+                except (ValueError, KeyError, TypeError):
+                    seqs = []
+                with log.lock:
+                    log.reports += 1
+                    log.watermark = max([log.watermark] + seqs)
+                    response = {"ack": log.watermark}
+                    if args.request_backfill and not log.backfill_requested:
+                        log.backfill_requested = True
+                        now = int(time.time())
+                        response["backfill"] = {"from": now - args.request_backfill, "to": now}
+                self.answer(200, json.dumps(response).encode())
+            finally:
+                with log.lock:
+                    log.in_flight -= 1
+
+        def backfill(self, body):
+            """Checks a batch {"from": F, "to": T, "samples": [{"timestamp": E, ...}, ...]}."""
+            time.sleep(args.backfill_delay_ms / 1000)
+            try:
+                batch = json.loads(body)
+                stamps = [int(sample["timestamp"]) for sample in batch["samples"]]
+                valid = all(batch["from"] <= stamp <= batch["to"] for stamp in stamps)
+            except (ValueError, KeyError, TypeError):
+                stamps, valid = [], False
+            now = time.monotonic()
+            with log.lock:
+                log.backfill_batches += 1
+                if log.backfill_first is None:
+                    log.backfill_first = now
+                log.backfill_last = now
+                if not valid:
+                    log.backfill_rejected += 1
+                else:
+                    log.backfill_samples += len(stamps)
+                    log.backfill_stamps.update(stamps)
+                    log.backfill_bytes += len(body)
+            self.answer(200 if valid else 400)
+
+    return Handler
+
+
+# --- Host Stand-in of the Station's Lanes ---
+
+class Station:
+    def __init__(self, port, shared):
+        self.port = port
+        self.shared = shared
+        self.request_lock = threading.Lock()   # The single connection of HTTPS and CoAP
+        self.lane_busy = threading.Event()
+        self.report_in_flight = threading.Event()
+        self.backfill_active = threading.Event()
+        self.stop = threading.Event()
+        self.seq = 0
+        self.reports = []      # (backfill running when due, due-to-answer ms)
+        self.batches = []      # Post-to-answer ms of the backfill batches
+        self.backfill_bytes = 0
+        self.backfill_samples = 0
+        self.backfill_seconds = 0
+
+    def post(self, path, body, timeout_ms):
+        """Posts like Transport::post(); returns the status, or None on a timeout or busy transport."""
+        if self.shared and not self.request_lock.acquire(timeout=timeout_ms / 1000):
+            return None  # HTTPS_ERROR_BUSY
+        try:
+            connection = http.client.HTTPConnection("127.0.0.1", self.port, timeout=timeout_ms / 1000)
+            connection.request("POST", path, body, {"Content-Type": "application/json"})
+            status = connection.getresponse().status
+            connection.close()
+            return status
+        except OSError:
+            return None
+        finally:
+            if self.shared:
+                self.request_lock.release()
+
+    def routine_lane(self, period_ms):
+        next_report = time.monotonic()
+        while not self.stop.is_set():
+            time.sleep(max(0, next_report - time.monotonic()))
+            next_report += period_ms / 1000
+            while self.lane_busy.is_set():  # Alerts preempt routine reports
+                time.sleep(ALERT_YIELD_POLL_MS / 1000)
+            due = time.monotonic()
+            during_backfill = self.backfill_active.is_set()
+            self.seq += 1
+            body = json.dumps({"seq": self.seq, "temperature": 21.4, "pressure": 1013.2})
+            self.report_in_flight.set()
+            status = self.post("/%s/data" % MAC, body, TRANSPORT_TIMEOUT_MS)
+            self.report_in_flight.clear()
+            if status is not None and 200 <= status < 300:
+                self.reports.append((during_backfill, (time.monotonic() - due) * 1000))
+
+    def backfill_lane(self, samples):
+        """Sends samples stored samples like backfill.cpp: token bucket, batches, live uploads first."""
+        self.backfill_active.set()
+        started = time.monotonic()
+        tokens, refilled = float(BACKFILL_BURST_BYTES), started
+        to_s = int(time.time())
+        from_s = to_s - samples * SAMPLE_PERIOD_S
+        for first in range(0, samples, BACKFILL_BATCH_SAMPLES):
+            count = min(BACKFILL_BATCH_SAMPLES, samples - first)
+            batch = [{"timestamp": from_s + (first + i) * SAMPLE_PERIOD_S, "temperature": 21.4, "pressure": 1013.2,
+                      "humidity": 45.5, "sunshine": 40, "wind_speed": 3.6, "precipitation": 0}
+                     for i in range(count)]
+            body = json.dumps({"from": from_s, "to": to_s, "samples": batch}, separators=(",", ":"))
+            for attempt in range(1, BACKFILL_MAX_ATTEMPTS + 1):
+                needed = min(len(body), BACKFILL_BURST_BYTES)
+                while True:  # takeTokens()
+                    now = time.monotonic()
+                    tokens = min(BACKFILL_BURST_BYTES, tokens + (now - refilled) * BACKFILL_RATE_BYTES_PER_S)
+                    refilled = now
+                    if tokens >= needed:
+                        tokens -= len(body)
+                        break
+                    time.sleep((needed - tokens) / BACKFILL_RATE_BYTES_PER_S + 0.001)
+                while self.report_in_flight.is_set() or self.lane_busy.is_set():  # waitForLiveIdle()
+                    time.sleep(BACKFILL_LIVE_POLL_MS / 1000)
+                posted = time.monotonic()
+                status = self.post("/%s/backfill" % MAC, body, TRANSPORT_TIMEOUT_MS)
+                if status is not None and 200 <= status < 300:
+                    self.batches.append((time.monotonic() - posted) * 1000)
+                    self.backfill_bytes += len(body)
+                    self.backfill_samples += count
+                    break
+                time.sleep(BACKFILL_RETRY_DELAY_MS / 1000)
+        self.backfill_seconds = time.monotonic() - started
+        self.backfill_active.clear()
+
+    def alert(self):
+        """Sends one alert like sendAlert(); returns (acknowledged, report in flight at detection, latency ms)."""
+        detected = time.monotonic()
+        in_flight = self.report_in_flight.is_set()
+        self.lane_busy.set()
+        try:
+            body = json.dumps({"type": "gust", "value": 18.5, "timestamp": int(time.time())})
+            for attempt in range(1, ALERT_MAX_ATTEMPTS + 1):
+                status = self.post("/%s/alert" % MAC, body, ALERT_TIMEOUT_MS)
+                if status is not None and 200 <= status < 300:
+                    return True, in_flight, (time.monotonic() - detected) * 1000
+                if attempt < ALERT_MAX_ATTEMPTS:
+                    time.sleep(ALERT_RETRY_DELAY_MS / 1000)
+            return False, in_flight, (time.monotonic() - detected) * 1000
+        finally:
+            self.lane_busy.clear()
+
+
+def describe(latencies):
+    if not latencies:
+        return "      -"
+    latencies = sorted(latencies)
+    return "%4d  %7.0f %7.0f %7.0f" % (len(latencies), statistics.mean(latencies),
+                                       latencies[len(latencies) // 2], latencies[-1])
+
+
+def simulate(port, args):
+    """Measures the detection-to-ack latency of args.simulate alerts."""
+    station = Station(port, args.lanes == "shared")
+    results = []
+    if args.data_delay_ms > 0:
+        routine = threading.Thread(target=station.routine_lane, args=(args.report_period_ms,), daemon=True)
+        routine.start()
+    backfill = None
+    if args.backfill:
+        backfill = threading.Timer(BACKFILL_START_S, station.backfill_lane, args=(args.backfill,))
+        backfill.start()
+    for _ in range(args.simulate):
+        time.sleep(random.uniform(0.5, 4.0))  # Detections at random points of the report cycle
+        results.append(station.alert())
+    if backfill is not None:
+        backfill.join()
+    station.stop.set()
+
+    busy = [ms for ok, in_flight, ms in results if ok and in_flight]
+    idle = [ms for ok, in_flight, ms in results if ok and not in_flight]
+    failed = sum(1 for ok, in_flight, ms in results if not ok)
+    print("lanes=%s report every %d ms, data delay %d ms, alert delay %d ms"
+          % (args.lanes, args.report_period_ms, args.data_delay_ms, args.alert_delay_ms))
+    print("%-28s %4s  %7s %7s %7s" % ("detection-to-ack [ms]", "n", "mean", "median", "max"))
+    print("%-28s %s" % ("report in flight", describe(busy)))
+    print("%-28s %s" % ("no report in flight", describe(idle)))
+    print("dropped alerts: %d" % failed)
+    if args.backfill:
+        print("backfill: %d of %d samples in %d batches, %d B in %.1f s = %.0f B/s, %.1f samples/s"
+              % (station.backfill_samples, args.backfill, len(station.batches), station.backfill_bytes,
+                 station.backfill_seconds, station.backfill_bytes / station.backfill_seconds,
+                 station.backfill_samples / station.backfill_seconds))
+        print("%-28s %s" % ("backfill batch post-to-ack", describe(station.batches)))
+        print("%-28s %s" % ("report due-to-ack, backfill", describe([ms for active, ms in station.reports if active])))
+        print("%-28s %s" % ("report due-to-ack, idle", describe([ms for active, ms in station.reports if not active])))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=5000, help="0 picks a free port")
+    parser.add_argument("--seconds", type=float, default=0, help="run time, 0 until interrupted")
+    parser.add_argument("--seed", type=int, default=None)
+    parser.add_argument("--data-delay-ms", type=int, default=3000)
+    parser.add_argument("--alert-delay-ms", type=int, default=50)
+    parser.add_argument("--backfill-delay-ms", type=int, default=50)
+    parser.add_argument("--request-backfill", type=int, default=0, metavar="S",
+                        help="ask for the last S seconds in the answer to the first report")
+    parser.add_argument("--report-period-ms", type=int, default=5000, help="routine report period of --simulate")
+    parser.add_argument("--backfill", type=int, default=0, metavar="N", help="backfill N samples in --simulate")
+    parser.add_argument("--simulate", type=int, default=0, metavar="N", help="measure N alerts of a host stand-in")
+    parser.add_argument("--lanes", choices=("separate", "shared"), default="separate")
+    parser.add_argument("--verbose", action="store_true", help="print every alert")
+    args = parser.parse_args()
+    random.seed(args.seed)
+
+    log = Log()
+    server = http.server.ThreadingHTTPServer(("", 0 if args.simulate else args.port), make_handler(log, args))
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    if args.simulate:
+        simulate(server.server_address[1], args)
+        server.shutdown()
+        print("server: " + log.summary())
+        return
+
+    print("listening on port %d" % server.server_address[1])
+    started = time.monotonic()
+    try:
+        while True:
+            remaining = args.seconds - (time.monotonic() - started) if args.seconds else 30
+            if remaining <= 0:
+                break
+            time.sleep(min(30, remaining))
+            if not args.seconds or time.monotonic() - started < args.seconds:
+                print(log.summary())
+    except KeyboardInterrupt:
+        pass
+    server.shutdown()
+    print(log.summary())
+
+
+if __name__ == "__main__":
+    main()
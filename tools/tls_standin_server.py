@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""TLS stand-in data server for the station's HTTPS uplink (WS_TRANSPORT_HTTPS).
+
+Serves the station's HTTP API over TLS 1.2 with session tickets and session
+ids enabled, answers reports on /<mac>/data with the cumulative ack
+{"ack": N} and closes the connection after every --close-after responses,
+so the station has to reconnect and can resume its session. For every
+handshake the server logs whether the session was resumed and how long the
+handshake took on the server side. Without --cert/--key a self-signed
+certificate for --hostname is created with the openssl command; put the
+printed PEM in HTTPS_CA_CERT and set the station's server address to
+<pc-ip>:<port>.
+
+    python3 tools/tls_standin_server.py --port 8443 --close-after 1 --seconds 600
+
+Without a station, --simulate runs N connections of a host client against
+the server: the first handshake is full, the following ones offer the saved
+session, like https_transport.cpp. It prints the duration of full and
+resumed handshakes as the client sees them (TCP connect not included).
+These are host figures; the station's diagnostics print its own.
+
+    python3 tools/tls_standin_server.py --simulate 200
+"""
+import argparse
+import http.server
+import json
+import os
+import socket
+import ssl
+import statistics
+import subprocess
+import tempfile
+import threading
+import time
+
+MAC = "A0:B1:C2:D3:E4:F5"
+
+
+class Log:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.handshakes = {True: [], False: []}  # resumed -> server-side durations [ms]
+        self.failures = 0
+        self.requests = 0
+        self.watermark = 0
+
+    def summary(self):
+        with self.lock:
+            full, resumed = self.handshakes[False], self.handshakes[True]
+            return ("requests=%d handshakes full=%d (avg %.2f ms) resumed=%d (avg %.2f ms) failed=%d"
+                    % (self.requests, len(full), statistics.mean(full) if full else 0,
+                       len(resumed), statistics.mean(resumed) if resumed else 0, self.failures))
+
+
+def make_certificate(directory, hostname):
+    """Creates a self-signed certificate and key; returns their paths."""
+    cert = os.path.join(directory, "cert.pem")
+    key = os.path.join(directory, "key.pem")
+    subprocess.run(["openssl", "req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1",
+                    "-nodes", "-days", "30", "-subj", "/CN=" + hostname, "-addext", "subjectAltName=DNS:" + hostname,
+                    "-keyout", key, "-out", cert], check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def make_handler(log, args):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def log_message(self, format, *args):
+            pass
+
+        def answer(self, status, body=b""):
+            self.answered = getattr(self, "answered", 0) + 1
+            close = self.answered >= args.close_after
+            self.send_response(status)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            if close:
+                self.send_header("Connection", "close")
+                self.close_connection = True
+            self.end_headers()
+            self.wfile.write(body)
+            with log.lock:
+                log.requests += 1
+
+        def do_GET(self):
+            self.answer(200)  # Registration
+
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            if not self.path.endswith("/data"):
+                self.answer(200)  # Alerts, backfill, diagnostics
+                return
+            try:
+                report = json.loads(body)
+                records = report if isinstance(report, list) else [report]
+                seqs = [int(record["seq"]) for record in records if "seq" in record]
+            except (ValueError, KeyError, TypeError):
+                seqs = []
+            with log.lock:
+                log.watermark = max([log.watermark] + seqs)
+                ack = log.watermark
+            self.answer(200, json.dumps({"ack": ack}).encode())
+
+    return Handler
+
+
+class TlsServer(http.server.ThreadingHTTPServer):
+    """Performs the handshake in the connection's thread and logs its duration."""
+
+    def __init__(self, address, handler, make_context, resumption, log):
+        super().__init__(address, handler)
+        self.make_context = make_context
+        self.context = make_context()
+        self.resumption = resumption
+        self.log = log
+
+    def finish_request(self, request, client_address):
+        # A context caches sessions and holds the ticket key; a new one per connection refuses resumption
+        context = self.context if self.resumption else self.make_context()
+        started = time.perf_counter()
+        try:
+            connection = context.wrap_socket(request, server_side=True)
+        except (ssl.SSLError, OSError):
+            with self.log.lock:
+                self.log.failures += 1
+            return
+        with self.log.lock:
+            self.log.handshakes[connection.session_reused].append((time.perf_counter() - started) * 1000)
+        super().finish_request(connection, client_address)
+
+
+# --- Host Client ---
+
+def simulate(port, cert, args):
+    """Opens args.simulate connections, resuming the session of the previous one."""
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    context.maximum_version = ssl.TLSVersion.TLSv1_2  # As the station's mbedTLS
+    context.load_verify_locations(cert)
+    session = None
+    times = {True: [], False: []}
+    for seq in range(1, args.simulate + 1):
+        raw = socket.create_connection(("127.0.0.1", port))
+        started = time.perf_counter()
+        connection = context.wrap_socket(raw, server_hostname=args.hostname, session=session)
+        elapsed = (time.perf_counter() - started) * 1000
+        times[connection.session_reused].append(elapsed)
+        body = json.dumps({"seq": seq, "temperature": 21.4}).encode()
+        connection.sendall(b"POST /%s/data HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+                           b"Content-Length: %d\r\n\r\n%s" % (MAC.encode(), args.hostname.encode(), len(body), body))
+        while connection.recv(4096):  # Until the server closes
+            pass
+        session = connection.session  # Complete once the ticket has arrived
+        connection.close()
+
+    print("%-22s %5s %8s %8s %8s" % ("handshake [ms]", "n", "mean", "median", "max"))
+    for resumed in (False, True):
+        values = sorted(times[resumed])
+        if values:
+            print("%-22s %5d %8.2f %8.2f %8.2f" % ("resumed" if resumed else "full", len(values),
+                                                statistics.mean(values), values[len(values) // 2], values[-1]))
+        else:
+            print("%-22s %5d" % ("resumed" if resumed else "full", 0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=8443, help="0 picks a free port")
+    parser.add_argument("--seconds", type=float, default=0, help="run time, 0 until interrupted")
+    parser.add_argument("--cert", help="PEM certificate (default: a new self-signed one)")
+    parser.add_argument("--key", help="PEM private key of --cert")
+    parser.add_argument("--hostname", default="weather.local", help="name in the self-signed certificate")
+    parser.add_argument("--close-after", type=int, default=1, help="responses per connection")
+    parser.add_argument("--no-resumption", action="store_true", help="refuse session tickets and ids")
+    parser.add_argument("--simulate", type=int, default=0, metavar="N", help="measure N connections of a host client")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        cert, key = (args.cert, args.key) if args.cert else make_certificate(directory, args.hostname)
+        def make_context():
+            context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+            context.maximum_version = ssl.TLSVersion.TLSv1_2
+            context.load_cert_chain(cert, key)
+            return context
+
+        log = Log()
+        server = TlsServer(("", 0 if args.simulate else args.port), make_handler(log, args), make_context,
+                           not args.no_resumption, log)
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        if args.simulate:
+            simulate(server.server_address[1], cert, args)
+            server.shutdown()
+            print("server: " + log.summary())
+            return
+
+        if not args.cert:
+            with open(cert) as pem:
+                print("HTTPS_CA_CERT:\n" + pem.read())
+        print("listening on port %d" % server.server_address[1])
+        started = time.monotonic()
+        try:
+            while True:
+                remaining = args.seconds - (time.monotonic() - started) if args.seconds else 30
+                if remaining <= 0:
+                    break
+                time.sleep(min(30, remaining))
+                if not args.seconds or time.monotonic() - started < args.seconds:
+                    print(log.summary())
+        except KeyboardInterrupt:
+            pass
+        server.shutdown()
+        print(log.summary())
+
+
+if __name__ == "__main__":
+    main()